@@ -1,1434 +1,4911 @@
-#include <iostream>         // cout, cerr
-#include <cstdlib>          // EXIT_FAILURE
-#include <GL/glew.h>        // GLEW library
-#include <GLFW/glfw3.h>     // GLFW library
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"      // Image loading Utility functions
-
-// GLM Math Header inclusions
-#include <glm/glm.hpp>
-#include <glm/gtx/transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-
-#include "camera.h" // Camera class
-
-using namespace std; // Standard namespace
-
-static int perspective_state = 1; // Ortho view = 0, Perspective = 1
-/*Shader program Macro*/
-#ifndef GLSL
-#define GLSL(Version, Source) "#version " #Version " core \n" #Source
-#endif
-
-// Unnamed namespace
-namespace
-{
-    const char* const WINDOW_TITLE = "Final Project"; // Macro for window title
-
-    // Variables for window width and height
-    const int WINDOW_WIDTH = 800;
-    const int WINDOW_HEIGHT = 600;
-
-    // Stores the GL data relative to a given mesh
-    struct GLMesh
-    {
-        GLuint tablevao;         // Handle for the table vertex array object
-        GLuint bowlvao;// Handle for the bowl vertex array object
-        GLuint plantarvao;      //Handle for the plantar vertex array object
-        GLuint dirtvao;      //Handle for the dirt vertex array object
-        GLuint grindervao;      //Handle for the grinder vertex array object
-        GLuint tablevbo;     // Handles for the table vertex buffer objects
-        GLuint bowlvbo;     // Handles for the bowl vertex buffer objects
-        GLuint plantarvbo;  // Handles for the plantar vertex buffer objects
-        GLuint dirtvbo;  // Handles for the dirt vertex buffer objects
-        GLuint grindervbo;  // Handles for the grinder vertex buffer objects
-        GLuint nTableVerticies;    // Number of verts of the table mesh
-        GLuint nBowlVerticies;    // Number of verts of the bowl mesh
-        GLuint nPlantarVerticies;   // Number of verts for the plantar mesh
-        GLuint nDirtVerticies;     // Number of verts for the dirt mesh
-        GLuint nGrinderVerticies;  // Number of verts for the grinder mesh
-    };
-
-    // Main GLFW window
-    GLFWwindow* gWindow = nullptr;
-    // Triangle mesh data
-    GLMesh gMesh;
-    // Texture id
-    GLuint gTextureTableId;
-    GLuint gTextureBowlId;
-    GLuint gTexturePlantarId;
-    GLuint gTextureDirtId;
-    GLuint gTextureGrinderId;
-    glm::vec2 gUVScale(1.0f, 1.0f);
-    // Shader program
-    GLuint gTableProgramId;
-    GLuint gBowlProgramId;
-    GLuint gPlantarProgramId;
-    GLuint gDirtProgramId;
-    GLuint gGrinderProgramId;
-
-    // camera
-    Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
-    float gLastX = WINDOW_WIDTH / 2.0f;
-    float gLastY = WINDOW_HEIGHT / 2.0f;
-    bool gFirstMouse = true;
-
-    // timing
-    float gDeltaTime = 0.0f; // time between current frame and last frame
-    float gLastFrame = 0.0f;
-
-    // Subject position and scale
-    glm::vec3 gTablePosition(0.0f, 0.0f, 0.0f);
-    glm::vec3 gTableScale(1.0f);
-
-    glm::vec3 gBowlPosition(-0.7f, 0.0f, 0.0f);
-    glm::vec3 gBowlScale(1.0f);
-
-    glm::vec3 gPlantarPosition(1.0, 0.0f, 0.0f);
-    glm::vec3 gPlantarScale(1.0f);
-
-    glm::vec3 gDirtPosition(1.0, 0.0f, 0.0f);
-    glm::vec3 gDirtScale(1.0f);
-
-    glm::vec3 gGrinderPosition(-0.7f, 0.0f, 0.0f);
-    glm::vec3 gGrinderScale(1.0f);
-
-
-    // Cube and light color
-
-    glm::vec3 gObjectColor(1.0f, 0.2f, 0.0f);
-    glm::vec3 gKeyLightColor(1.0f, 1.0f, 1.0f);
-    glm::vec3 gSpotLightColor(0.0f, 0.0f, 1.0f);
-
-
-    // Light position and scale
-    glm::vec3 gKeyLightPosition(-1.5f, 3.5f, 0.0f);
-    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-    glm::vec3 gSpotLightPosition = gCamera.Position;
-}
-
-/* User-defined Function prototypes to:
- * initialize the program, set the window size,
- * redraw graphics on the window when resized,
- * and render graphics on the screen
- */
-bool UInitialize(int, char* [], GLFWwindow** window);
-void UResizeWindow(GLFWwindow* window, int width, int height);
-void UProcessInput(GLFWwindow* window);
-void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
-void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UCreateTableMesh(GLMesh& mesh);
-void UCreateBowlMesh(GLMesh& mesh);
-void UCreateDirtMesh(GLMesh& mesh);
-void UCreatePlantarMesh(GLMesh& mesh);
-void UCreateGrinderMesh(GLMesh& mesh);
-void UDestroyMesh(GLMesh& mesh);
-bool UCreateTexture(const char* filename, GLuint& textureId);
-glm::vec3 CalculateSurfaceNormal(glm::vec3 vecOne, glm::vec3 vecTwo, glm::vec3 vecThree);
-void UDestroyTexture(GLuint textureId);
-void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
-
-
-/* Vertex Shader Source Code*/
-const GLchar* vertexShaderSource = GLSL(440,
-    layout(location = 0) in vec3 position;
-layout(location = 1) in vec3 normal; // VAP position 1 for normals
-layout(location = 2) in vec2 textureCoordinate;
-
-out vec3 vertexNormal; // For outgoing normals to fragment shader
-out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
-out vec2 vertexTextureCoordinate;
-
-
-//Global variables for the transform matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-    gl_Position = projection * view * model * vec4(position, 1.0f); // transforms vertices to clip coordinates
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
-    vertexTextureCoordinate = textureCoordinate;
-}
-);
-
-
-/* Fragment Shader Source Code*/
-const GLchar* fragmentShaderSource = GLSL(440,
-    in vec3 vertexNormal; // For incoming normals
-in vec3 vertexFragmentPos; // For incoming fragment position
-in vec2 vertexTextureCoordinate;
-out vec4 fragmentColor; // For outgoing cube color to the GPU
-
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-uniform vec3 keyLightColor;
-uniform vec3 keyLightPos;
-uniform vec3 spotLightPos;
-uniform vec3 spotLightColor;
-uniform vec3 viewPosition;
-uniform vec3 spotLightDirection;
-uniform sampler2D uTexture; // Useful when working with multiple textures
-uniform vec2 uvScale;
-
-void main()
-{
-    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
-
-    //Calculate Ambient lighting*/
-    float ambientStrength = 0.1f; // Set ambient or global lighting strength
-    vec3 ambient = ambientStrength * keyLightColor; // Generate ambient light color
-
-    // calculate lighting for keylight
-    //Calculate Diffuse lighting*/
-    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(keyLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 diffuse = impact * keyLightColor; // Generate diffuse light color
-
-    //Calculate Specular lighting*/
-    float specularIntensity = 1.0f; // Set specular light strength
-    float highlightSize = 16.0f; // Set specular highlight size
-    vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    //Calculate specular component
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-    vec3 specular = specularIntensity * specularComponent * keyLightColor;
-
-    // calclate lighting for spotlight
-    
-    float cutOff = cos(radians(8.5f));
-    float outerCutOff = cos(radians(12.5f));
-    ////Calculate Ambient lighting*/
-
-   
-
-    ////Calculate Diffuse lighting*/
-
-    lightDirection = normalize(spotLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    impact = max(dot(norm, lightDirection), 1.0);// Calculate diffuse impact by generating dot product of normal and light
-    //diffuse = diffuse + impact *
-        //spotLightColor; // Generate diffuse light color
-
-    //Calculate Specular lighting*/
-    specularIntensity = 1.0f; // Set specular light strength
-    highlightSize = 16.0f; // Set specular highlight size
-    viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    reflectDir = reflect(-lightDirection, norm);// Calculate reflection vector
-    //Calculate specular component
-    specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
-   
-
-    // spotlight code
-    float theta = dot(lightDirection, normalize(-spotLightDirection));
-    float epsilon = (cutOff - outerCutOff);
-    float intensity = clamp((theta - outerCutOff) / epsilon, 0.0, 1.0);
-    ambient = ambient + ambientStrength * spotLightColor * intensity;
-    specular = specular + specularIntensity * specularComponent * spotLightColor * intensity;
-    diffuse = diffuse + impact * spotLightColor * intensity; // Generate diffuse light color
-    //
-
-    // Texture holds the color to be used for all three components
-    vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
-
-    // Calculate phong result
-    vec3 phong = (ambient + diffuse + specular) * textureColor.xyz;
-
-    fragmentColor = vec4(phong, 1.0f); // Send lighting results to GPU
-}
-);
-
-
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
-}
-
-
-int main(int argc, char* argv[])
-{
-    if (!UInitialize(argc, argv, &gWindow))
-        return EXIT_FAILURE;
-
-    // Create the mesh
-    UCreateTableMesh(gMesh); // Calls the function to create the table mesh
-    UCreateBowlMesh(gMesh); // calls the function to create the bowl mesh
-    UCreatePlantarMesh(gMesh);  //calls the function to create the plantar mesh
-    UCreateDirtMesh(gMesh);  //calls the function to create the dirt mesh
-    UCreateGrinderMesh(gMesh);  //calls the function to create the dirt mesh
-
-    // Create the shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gTableProgramId))
-        return EXIT_FAILURE;
-
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gBowlProgramId))
-        return EXIT_FAILURE;
-
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gPlantarProgramId))
-        return EXIT_FAILURE;
-
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gDirtProgramId))
-        return EXIT_FAILURE;
-
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gGrinderProgramId))
-        return EXIT_FAILURE;
-
-    // Load texture
-    const char* texFilename = "../resources/textures/old_wood.jpg";
-    if (!UCreateTexture(texFilename, gTextureTableId))
-        return EXIT_FAILURE;
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gTableProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gTableProgramId, "uTexture"), 0);
-
-    // Load texture
-    texFilename = "../resources/textures/stone_rock.jpg";
-    if (!UCreateTexture(texFilename, gTextureBowlId))
-        return EXIT_FAILURE;
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gBowlProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gBowlProgramId, "uTexture"), 0);
-
-    // Load texture
-    texFilename = "../resources/textures/granite.jpg";
-    if (!UCreateTexture(texFilename, gTextureGrinderId))
-        return EXIT_FAILURE;
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gGrinderProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gGrinderProgramId, "uTexture"), 0);
-
-    // Load texture
-    texFilename = "../resources/textures/pot2.jpg";
-    if (!UCreateTexture(texFilename, gTexturePlantarId))
-        return EXIT_FAILURE;
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gPlantarProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gPlantarProgramId, "uTexture"), 0);
-
-    // Load texture
-    texFilename = "../resources/textures/plantar_dirt.jpg";
-    if (!UCreateTexture(texFilename, gTextureDirtId))
-        return EXIT_FAILURE;
-    // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gDirtProgramId);
-    // We set the texture as texture unit 0
-    glUniform1i(glGetUniformLocation(gDirtProgramId, "uTexture"), 0);
-
-    // Sets the background color of the window to black (it will be implicitely used by glClear)
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(gWindow))
-    {
-        // per-frame timing
-        // --------------------
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
-
-        // input
-        // -----
-        UProcessInput(gWindow);
-
-        // Render this frame
-        URender();
-
-        glfwPollEvents();
-    }
-
-    // Release mesh data
-    UDestroyMesh(gMesh);
-
-    // Release texture
-    UDestroyTexture(gTextureTableId);
-    UDestroyTexture(gTextureBowlId);
-    UDestroyTexture(gTexturePlantarId);
-    UDestroyTexture(gTextureDirtId);
-    UDestroyTexture(gTextureGrinderId);
-
-    // Release shader program
-    UDestroyShaderProgram(gTableProgramId);
-    UDestroyShaderProgram(gBowlProgramId);
-    UDestroyShaderProgram(gPlantarProgramId);
-    UDestroyShaderProgram(gDirtProgramId);
-    UDestroyShaderProgram(gGrinderProgramId);
-
-    exit(EXIT_SUCCESS); // Terminates the program successfully
-}
-
-
-// Initialize GLFW, GLEW, and create a window
-bool UInitialize(int argc, char* argv[], GLFWwindow** window)
-{
-    // GLFW: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-    // GLFW: window creation
-    // ---------------------
-    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
-    if (*window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return false;
-    }
-    glfwMakeContextCurrent(*window);
-    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
-    glfwSetCursorPosCallback(*window, UMousePositionCallback);
-    glfwSetScrollCallback(*window, UMouseScrollCallback);
-    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
-
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-    // GLEW: initialize
-    // ----------------
-    // Note: if using GLEW version 1.13 or earlier
-    glewExperimental = GL_TRUE;
-    GLenum GlewInitResult = glewInit();
-
-    if (GLEW_OK != GlewInitResult)
-    {
-        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
-        return false;
-    }
-
-    // Displays GPU OpenGL version
-    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
-
-    return true;
-}
-
-
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-void UProcessInput(GLFWwindow* window)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
-
-    // monitor key press to move camera
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, gDeltaTime);  // added enum to camera class
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime);  // added enum to camera class
-
-    gSpotLightPosition = gCamera.Position;
-
-}
-
-// handles single key press so that perspective/ortho can be changed only once on p press
-void USingleKeyPressCallBack(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-    if (key == GLFW_KEY_P && action == GLFW_PRESS)
-    {
-        // change the state to the opposite of current state
-        perspective_state = abs(perspective_state - 1);
-    }
-}
-
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
-void UResizeWindow(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
-
-// glfw: whenever the mouse moves, this callback is called
-// -------------------------------------------------------
-void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
-{
-    if (gFirstMouse)
-    {
-        gLastX = xpos;
-        gLastY = ypos;
-        gFirstMouse = false;
-    }
-
-    float xoffset = xpos - gLastX;
-    float yoffset = gLastY - ypos; // reversed since y-coordinates go from bottom to top
-
-    gLastX = xpos;
-    gLastY = ypos;
-
-    gCamera.ProcessMouseMovement(xoffset, yoffset);
-}
-
-
-// glfw: whenever the mouse scroll wheel scrolls, this callback is called
-// ----------------------------------------------------------------------
-void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
-{
-    gCamera.ProcessMouseScroll(yoffset);
-}
-
-// glfw: handle mouse button events
-// --------------------------------
-void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
-{
-    switch (button)
-    {
-    case GLFW_MOUSE_BUTTON_LEFT:
-    {
-        if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
-        else
-            cout << "Left mouse button released" << endl;
-    }
-    break;
-
-    case GLFW_MOUSE_BUTTON_MIDDLE:
-    {
-        if (action == GLFW_PRESS)
-            cout << "Middle mouse button pressed" << endl;
-        else
-            cout << "Middle mouse button released" << endl;
-    }
-    break;
-
-    case GLFW_MOUSE_BUTTON_RIGHT:
-    {
-        if (action == GLFW_PRESS)
-            cout << "Right mouse button pressed" << endl;
-        else
-            cout << "Right mouse button released" << endl;
-    }
-    break;
-
-    default:
-        cout << "Unhandled mouse button event" << endl;
-        break;
-    }
-}
-
-
-// Functioned called to render a frame
-void URender()
-{
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
-
-    // Clear the frame and z buffers
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glm::mat4 model;
-
-    // camera/view transformation
-    glm::mat4 view = gCamera.GetViewMatrix();
-
-    if (perspective_state) {
-
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-    }
-    else {
-        projection = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, .1f, 100.0f);
-    }
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.tablevao);
-    // Set the shader to be used
-    glUseProgram(gTableProgramId);
-
-    model = glm::translate(gTablePosition) * glm::scale(gTableScale);
-
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gTableProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gTableProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gTableProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gTableProgramId, "objectColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gTableProgramId, "keyLightColor");
-    GLint keyLightPositionLoc = glGetUniformLocation(gTableProgramId, "keyLightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gTableProgramId, "viewPosition");
-    GLint spotLightColorLoc = glGetUniformLocation(gTableProgramId, "spotLightColor");
-    GLint spotLightPositionLoc = glGetUniformLocation(gTableProgramId, "spotLightPos");
-    GLint spotLightDirectionLoc = glGetUniformLocation(gTableProgramId, "spotLightDirection");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(spotLightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-    glUniform3f(spotLightPositionLoc,gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-    glUniform3f(spotLightDirectionLoc, gCamera.Front.x, gCamera.Front.y, gCamera.Front.z);
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    GLint UVScaleLoc = glGetUniformLocation(gTableProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureTableId);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nTableVerticies);
-
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.bowlvao);
-
-    // Set the shader to be used
-    glUseProgram(gBowlProgramId);
-
-    model = glm::translate(gBowlPosition) * glm::scale(gBowlScale);
-
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gBowlProgramId, "model");
-    viewLoc = glGetUniformLocation(gBowlProgramId, "view");
-    projLoc = glGetUniformLocation(gBowlProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the light color, light position, and camera position
-
-    keyLightColorLoc = glGetUniformLocation(gBowlProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gBowlProgramId, "keyLightPos");
-    viewPositionLoc = glGetUniformLocation(gBowlProgramId, "viewPosition");
-    spotLightColorLoc = glGetUniformLocation(gBowlProgramId, "spotLightColor");
-    spotLightPositionLoc = glGetUniformLocation(gBowlProgramId, "spotLightPos");
-    spotLightDirectionLoc = glGetUniformLocation(gBowlProgramId, "spotLightDirection");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(spotLightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-    glUniform3f(spotLightPositionLoc, gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-    glUniform3f(spotLightDirectionLoc, gCamera.Front.x, gCamera.Front.y, gCamera.Front.z);
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    UVScaleLoc = glGetUniformLocation(gBowlProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureBowlId);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nBowlVerticies);
-
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.grindervao);
-
-    // Set the shader to be used
-    glUseProgram(gGrinderProgramId);
-
-    model = glm::translate(gGrinderPosition) * glm::scale(gGrinderScale);
-
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gGrinderProgramId, "model");
-    viewLoc = glGetUniformLocation(gGrinderProgramId, "view");
-    projLoc = glGetUniformLocation(gGrinderProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the light color, light position, and camera position
-
-    keyLightColorLoc = glGetUniformLocation(gGrinderProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gGrinderProgramId, "keyLightPos");
-    viewPositionLoc = glGetUniformLocation(gGrinderProgramId, "viewPosition");
-    spotLightColorLoc = glGetUniformLocation(gGrinderProgramId, "spotLightColor");
-    spotLightPositionLoc = glGetUniformLocation(gGrinderProgramId, "spotLightPos");
-    spotLightDirectionLoc = glGetUniformLocation(gGrinderProgramId, "spotLightDirection");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(spotLightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-    glUniform3f(spotLightPositionLoc, gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-    glUniform3f(spotLightDirectionLoc, gCamera.Front.x, gCamera.Front.y, gCamera.Front.z);
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    UVScaleLoc = glGetUniformLocation(gGrinderProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureGrinderId);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nGrinderVerticies);
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.plantarvao);
-
-    // Set the shader to be used
-    glUseProgram(gPlantarProgramId);
-
-    model = glm::translate(gPlantarPosition) * glm::scale(gPlantarScale);
-
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gPlantarProgramId, "model");
-    viewLoc = glGetUniformLocation(gPlantarProgramId, "view");
-    projLoc = glGetUniformLocation(gPlantarProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the light color, light position, and camera position
-
-    keyLightColorLoc = glGetUniformLocation(gPlantarProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gPlantarProgramId, "keyLightPos");
-    spotLightColorLoc = glGetUniformLocation(gPlantarProgramId, "spotLightColor");
-    spotLightPositionLoc = glGetUniformLocation(gPlantarProgramId, "spotLightPos");
-    spotLightDirectionLoc = glGetUniformLocation(gPlantarProgramId, "spotLightDirection");
-    viewPositionLoc = glGetUniformLocation(gPlantarProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(spotLightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-    glUniform3f(spotLightPositionLoc, gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-    glUniform3f(spotLightDirectionLoc, gCamera.Front.x, gCamera.Front.y, gCamera.Front.z);
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    UVScaleLoc = glGetUniformLocation(gPlantarProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTexturePlantarId);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nPlantarVerticies);
-
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.dirtvao);
-
-    // Set the shader to be used
-    glUseProgram(gDirtProgramId);
-
-    model = glm::translate(gDirtPosition) * glm::scale(gDirtScale);
-
-    // Retrieves and passes transform matrices to the Shader program
-    modelLoc = glGetUniformLocation(gDirtProgramId, "model");
-    viewLoc = glGetUniformLocation(gDirtProgramId, "view");
-    projLoc = glGetUniformLocation(gDirtProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    keyLightColorLoc = glGetUniformLocation(gDirtProgramId, "keyLightColor");
-    keyLightPositionLoc = glGetUniformLocation(gDirtProgramId, "keyLightPos");
-    spotLightColorLoc = glGetUniformLocation(gDirtProgramId, "spotLightColor");
-    spotLightPositionLoc = glGetUniformLocation(gDirtProgramId, "spotLightPos");
-    spotLightDirectionLoc = glGetUniformLocation(gDirtProgramId, "spotLightDirection");
-    viewPositionLoc = glGetUniformLocation(gDirtProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    glUniform3f(spotLightColorLoc, gSpotLightColor.r, gSpotLightColor.g, gSpotLightColor.b);
-    glUniform3f(spotLightPositionLoc, gSpotLightPosition.x, gSpotLightPosition.y, gSpotLightPosition.z);
-    glUniform3f(spotLightDirectionLoc, gCamera.Front.x, gCamera.Front.y, gCamera.Front.z);
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-
-    UVScaleLoc = glGetUniformLocation(gDirtProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-
-
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureDirtId);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nDirtVerticies);
-
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
-
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
-}
-
-// creates the vertices from one circle to another with texture points
-void getUnitCircleVertices(vector<GLfloat>& verts, GLint sectorCount, GLfloat firstYCoord, GLfloat secondYCoord, GLfloat firstRadius, GLfloat secondRadius)
-{
-    const float PI = 3.1415926f;
-    float sectorStep = 2 * PI / sectorCount;
-    float sectorAngle;  // radian
-    float x, z;  // variables for position of verticies
-    float topV = sqrt(pow(firstYCoord - secondYCoord, 2) + pow((firstRadius - secondRadius),2));
-    float bottomV = 0.0;
-    glm::vec3 normal;
-    glm::vec3 firstVec(0.0f);
-    glm::vec3 secondVec(0.0f);
-    glm::vec3 thirdVec(0.0f);
-
-    for (int i = 0; i < sectorCount; ++i)
-    {
-        // calculate the vertex for ith point in first cirlce
-        sectorAngle = i * (sectorStep);
-        x = firstRadius * cos(sectorAngle);
-        z = (firstRadius * sin(sectorAngle));
-        // push the x y and z coordinates into verts
-        verts.push_back(x); // x
-        firstVec.x = x;
-        verts.push_back(firstYCoord); // y
-        firstVec.y = firstYCoord;
-        verts.push_back(z); // z
-        firstVec.z = z;
-        // push 3 numbers into verts as holder for the normal
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-
-        // push texture map coordinates into vert
-        verts.push_back(sectorAngle/ (2*PI));
-        verts.push_back(topV);
-
-        // repeat same steps for ith point in second circle
-        x = secondRadius * cos(sectorAngle);
-        z = (secondRadius * sin(sectorAngle));
-        verts.push_back(x); // x
-        secondVec.x = x;
-        verts.push_back(secondYCoord);                // y
-        secondVec.y = secondYCoord;
-        verts.push_back(z); // z
-        secondVec.z = z;
-        verts.push_back(0.0);
-        verts.push_back(0.0);
-        verts.push_back(0.0);
-
-        verts.push_back(sectorAngle / (2 * PI));
-        verts.push_back(bottomV);
-
-        // repeat same steps for i + 1 point in second circle
-        sectorAngle = (i + 1.0) * (sectorStep);
-
-        x = secondRadius * cos(sectorAngle);
-        z = (secondRadius * sin(sectorAngle));
-        verts.push_back(x); // x
-        thirdVec.x = x;
-        verts.push_back(secondYCoord);                // y
-        thirdVec.y = secondYCoord;
-        verts.push_back(z); // z
-        thirdVec.z = z;
-        // we now have all three points of the triangle and can calculate the normal vector
-        normal = CalculateSurfaceNormal(firstVec, secondVec, thirdVec);
-        //push the normal vector x, y, and z into verts
-        verts.push_back(normal.x * -1);
-        verts.push_back(normal.y);
-        verts.push_back(normal.z * -1);
-
-        verts.push_back(sectorAngle / (2 * PI));
-        verts.push_back(bottomV);
-
-        // replace all normal vector place holders with actual values
-        verts.at(verts.size() - 21) = normal.x * -1;
-        verts.at(verts.size() - 20) = normal.y;
-        verts.at(verts.size() - 19) = normal.z * -1;
-
-        verts.at(verts.size() - 13) = normal.x * -1;
-        verts.at(verts.size() - 12) = normal.y;
-        verts.at(verts.size() - 11) = normal.z * -1;
-
-        // repeat all steps for second triangle to make up first section of final shape
-        verts.push_back(x); // x
-        firstVec.x = x;
-        verts.push_back(secondYCoord);                // y
-        firstVec.y = secondYCoord;
-        verts.push_back(z); // z
-        firstVec.z = z;
-
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-
-        verts.push_back(sectorAngle / (2 * PI));
-        verts.push_back(bottomV);
-
-        x = firstRadius * cos(sectorAngle);
-        z = (firstRadius * sin(sectorAngle));
-        verts.push_back(x); // x
-        secondVec.x = x;
-        verts.push_back(firstYCoord);                // y
-        secondVec.y = firstYCoord;
-        verts.push_back(z); // z
-        secondVec.z = z;
-
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-        verts.push_back(1.0);
-
-        verts.push_back(sectorAngle / (2 * PI));
-        verts.push_back(topV);
-
-        sectorAngle = i * (sectorStep);
-        x = firstRadius * cos(sectorAngle);
-        z = (firstRadius * sin(sectorAngle));
-        verts.push_back(x); // x
-        thirdVec.x = x;
-        verts.push_back(firstYCoord);                // y
-        thirdVec.y = firstYCoord;
-        verts.push_back(z); // z
-        thirdVec.z = z;
-        normal = CalculateSurfaceNormal(firstVec, secondVec, thirdVec);
-        verts.push_back(normal.x * -1);
-        verts.push_back(normal.y);
-        verts.push_back(normal.z * -1);
-
-        verts.push_back(sectorAngle / (2 * PI));
-        verts.push_back(topV);
-
-
-        verts.at(verts.size() - 21) = normal.x * -1;
-        verts.at(verts.size() - 20) = normal.y;
-        verts.at(verts.size() - 19) = normal.z * -1;
-
-        verts.at(verts.size() - 13) = normal.x * -1;
-        verts.at(verts.size() - 12) = normal.y;
-        verts.at(verts.size() - 11) = normal.z * -1;
-    }
-}
-
-// generate vertices for +X face only by intersecting 2 circular planes
-// (longitudinal and latitudinal) at the given longitude/latitude angles
-void buildUnitPositiveX(vector<GLfloat> verts, int subdivision)
-{
-    const float DEG2RAD = acos(-1) / 180.0f;
-
-    std::vector<float> vertices;
-    float n1[3];        // normal of longitudinal plane rotating along Y-axis
-    float n2[3];        // normal of latitudinal plane rotating along Z-axis
-    float v[3];         // direction vector intersecting 2 planes, n1 x n2
-    float a1;           // longitudinal angle along Y-axis
-    float a2;           // latitudinal angle along Z-axis
-    //gsl::
-
-    // compute the number of vertices per row, 2^n + 1
-    int pointsPerRow = (int)pow(2, subdivision) + 1;
-
-    // rotate latitudinal plane from 45 to -45 degrees along Z-axis (top-to-bottom)
-    for (unsigned int i = 0; i < pointsPerRow; ++i)
-    {
-        // normal for latitudinal plane
-        // if latitude angle is 0, then normal vector of latitude plane is n2=(0,1,0)
-        // therefore, it is rotating (0,1,0) vector by latitude angle a2
-        a2 = DEG2RAD * (45.0f - 90.0f * i / (pointsPerRow - 1));
-        n2[0] = -sin(a2);
-        n2[1] = cos(a2);
-        n2[2] = 0;
-
-        // rotate longitudinal plane from -45 to 45 along Y-axis (left-to-right)
-        for (unsigned int j = 0; j < pointsPerRow; ++j)
-        {
-            // normal for longitudinal plane
-            // if longitude angle is 0, then normal vector of longitude is n1=(0,0,-1)
-            // therefore, it is rotating (0,0,-1) vector by longitude angle a1
-            a1 = DEG2RAD * (-45.0f + 90.0f * j / (pointsPerRow - 1));
-            n1[0] = -sin(a1);
-            n1[1] = 0;
-            n1[2] = -cos(a1);
-
-            // find direction vector of intersected line, n1 x n2
-            v[0] = n1[1] * n2[2] - n1[2] * n2[1];
-            v[1] = n1[2] * n2[0] - n1[0] * n2[2];
-            v[2] = n1[0] * n2[1] - n1[1] * n2[0];
-
-            // normalize direction vector
-            float scale = 1 / sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
-            v[0] *= scale;
-            v[1] *= scale;
-            v[2] *= scale;
-
-            // add a vertex into array
-            verts.push_back(v[0]);
-            verts.push_back(v[1]);
-            verts.push_back(v[2]);
-        }
-    }
-
-}
-
-
-
-// Implements the UCreateMesh function to create the bowl
-void UCreateBowlMesh(GLMesh& mesh)
-{
-    GLint numberOfVerts = 60;
-    // Specifies Normalized Device Coordinates (x,y,z) and image (u,v) for triangle vertices
-    vector<GLfloat> verts;
-
-
-    // create verticies for bowl  
-    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.2, 0.5, 0.4);
-    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.4, 0.4, 0.0);
-    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.49, 0.5, 0.4);
-    getUnitCircleVertices(verts, numberOfVerts, -0.49, -0.49, 0.4, 0.0);
-
-    cout << verts.size();
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nBowlVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-    cout << mesh.nBowlVerticies;
-
-    glGenVertexArrays(1, &mesh.bowlvao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.bowlvao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.bowlvbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.bowlvbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), &verts.front(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates is 6 (x, y, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNormal);// The number of floats before each
-
-    // Creates the Vertex Attribute Pointer
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-
-}
-
-// Implements the UCreateMesh function to create the grinder
-void UCreateGrinderMesh(GLMesh& mesh)
-{
-    GLint numberOfVerts = 60;
-    // Specifies Normalized Device Coordinates (x,y,z) and image (u,v) for triangle vertices
-    vector<GLfloat> verts;
-
-
-    // create verticies for Grinder  
-    //sides of grinder
-   getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.4, 0.05, 0.06);
-   // top of grinder
-   getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.2, 0.05, 0);
-    // bottom of grinder
-   getUnitCircleVertices(verts, numberOfVerts, -0.4, -0.4, 0.06, 0);
-    
-   
-
-    cout << verts.size();
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nGrinderVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-    cout << mesh.nGrinderVerticies;
-
-    glGenVertexArrays(1, &mesh.grindervao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.grindervao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.grindervbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.grindervbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), &verts.front(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates is 6 (x, y, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNormal);// The number of floats before each
-
-    // Creates the Vertex Attribute Pointer
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-
-}
-
-
-// Implements the UCreateMesh function
-void UCreateTableMesh(GLMesh& mesh)
-{
-    // Vertex data
-    vector<GLfloat> verts = {
-        // The two triangles will be drawn using indices
-        // Left triangle indices: 0, 1, 2
-        // Right triangle indices: 3, 2, 4
-
-        -2.0f, -0.5f, -2.0f,  0.0f, 1.0f, 0.0f, 0.0f, 0.0f, // bottom left
-        2.0f, -0.5f, -2.0f,    0.0f, 1.0f, 0.0f,  1.0f, 0.0f, // bottom right
-        -2.0f, -0.5f, 2.0f,    0.0f, 1.0f, 0.0f,  0.0f, 1.0f, // top left
-
-
-        2.0f, -0.5f, -2.0f,     0.0f, 1.0f, 0.0f, 1.0f, 0.0f, // bottom right
-        -2.0f, -0.5f, 2.0f,     0.0f, 1.0f, 0.0f, 0.0f, 1.0f, // top left
-        2.0f, -0.5f, 2.0f,        0.0f, 1.0f, 0.0f, 1.0f, 1.0f, // top right
-
-         -2.0f, -0.51f, -2.0f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // bottom left
-        2.0f, -0.51f, -2.0f,    0.0f, -1.0f, 0.0f,  1.0f, 0.0f, // bottom right
-        -2.0f, -0.51f, 2.0f,    0.0f, -1.0f, 0.0f,  0.0f, 1.0f, // top left
-
-
-        2.0f, -0.51f, -2.0f,     0.0f, -1.0f, 0.0f, 1.0f, 0.0f, // bottom right
-        -2.0f, -0.51f, 2.0f,     0.0f, -1.0f, 0.0f, 0.0f, 1.0f, // top left
-        2.0f, -0.51f, 2.0f,        0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // top right
-    };
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nTableVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-    glGenVertexArrays(1, &mesh.tablevao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.tablevao);
-
-    // Create VBO
-    glGenBuffers(1, &mesh.tablevbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.tablevbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), &verts.front(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-   // Strides between vertex coordinates is 6 (x, y, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNormal);// The number of floats before each
-
-    // Creates the Vertex Attribute Pointer
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-}
-
-void UCreatePlantarMesh(GLMesh& mesh) {
-    vector<GLfloat> verts = {
-        //plantar back face
-          -0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-         0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-         0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-         0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-        -0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-        -0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-        // plantar front face
-        -0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-         0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-         0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-         0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-        -0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-        -0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-        // left face
-        -0.25f,  0.0f,  0.25f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        -0.25f,  0.0f, -0.25f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.15f, -0.5f, -0.15f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.15f, -0.5f, -0.15f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.15f, -0.5f,  0.15f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-        -0.25f,  0.0f,  0.25f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        // right face
-         0.25f,  0.0f,  0.25f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         0.25f,  0.0f, -0.25f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.15f, -0.5f, -0.15f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.15f, -0.5f, -0.15f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.15f, -0.5f,  0.15f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-         0.25f,  0.0f,  0.25f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         // bottom face
-        -0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-         0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-         0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-         0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-        -0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-        -0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-        //top face
-        -0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nPlantarVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-
-    glGenVertexArrays(1, &mesh.plantarvao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.plantarvao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.plantarvbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.plantarvbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), &verts.front(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates is 6 (x, y, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNormal);// The number of floats before each
-
-    // Creates the Vertex Attribute Pointer
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-}
-
-void UCreateDirtMesh(GLMesh& mesh) {
-    vector<GLfloat> verts = {
-        //Dirt
-          
-        //top face
-        -0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
-    };
-
-    const GLuint floatsPerVertex = 3;
-    const GLuint floatsPerNormal = 3;
-    const GLuint floatsPerUV = 2;
-
-    mesh.nDirtVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
-
-
-    glGenVertexArrays(1, &mesh.dirtvao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.dirtvao);
-
-    // Create 2 buffers: first one for the vertex data; second one for the indices
-    glGenBuffers(1, &mesh.dirtvbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.dirtvbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), &verts.front(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-    // Strides between vertex coordinates is 6 (x, y, r, g, b, a). A tightly packed stride is 0.
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerUV + floatsPerNormal);// The number of floats before each
-
-    // Creates the Vertex Attribute Pointer
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-    glEnableVertexAttribArray(2);
-
-}
-
-// returns the normal of a triangle given the three vectors of the triangle
-glm::vec3 CalculateSurfaceNormal(glm::vec3 vOne, glm::vec3 vTwo, glm::vec3 vThree) {
-    glm::vec3 normal(0.0f, 0.0f, 0.0f);
-
-    normal.x = normal.x + (vOne.y - vTwo.y) * (vOne.z + vTwo.z);
-    normal.y = normal.y + (vOne.z - vTwo.z) * (vOne.x + vTwo.x);
-    normal.z = normal.z + (vOne.x - vTwo.x) * (vOne.y + vTwo.y);
-
-    normal.x = normal.x + (vTwo.y - vThree.y) * (vTwo.z + vThree.z);
-    normal.y = normal.y + (vTwo.z - vThree.z) * (vTwo.x + vThree.x);
-    normal.z = normal.z + (vTwo.x - vThree.x) * (vTwo.y + vThree.y);
-
-    normal.x = normal.x + (vThree.y - vOne.y) * (vThree.z + vOne.z);
-    normal.y = normal.y + (vThree.z - vOne.z) * (vThree.x + vOne.x);
-    normal.z = normal.z + (vThree.x - vOne.x) * (vThree.y + vOne.y);
-
-    return normal;
-
-}
-
-
-void UDestroyMesh(GLMesh& mesh)
-{
-    glDeleteVertexArrays(1, &mesh.tablevao);
-    glDeleteBuffers(1, &mesh.tablevbo);
-    glDeleteVertexArrays(1, &mesh.bowlvao);
-    glDeleteBuffers(1, &mesh.bowlvbo);
-    glDeleteVertexArrays(1, &mesh.plantarvao);
-    glDeleteBuffers(1, &mesh.plantarvbo);
-    glDeleteVertexArrays(1, &mesh.dirtvao);
-    glDeleteBuffers(1, &mesh.dirtvbo);
-    glDeleteVertexArrays(1, &mesh.grindervao);
-    glDeleteBuffers(1, &mesh.grindervbo);
-}
-
-
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
-{
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
-
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-        return true;
-    }
-
-    // Error loading the image
-    return false;
-}
-
-
-void UDestroyTexture(GLuint textureId)
-{
-    glGenTextures(1, &textureId);
-}
-
-
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
-{
-    // Compilation and linkage error reporting
-    int success = 0;
-    char infoLog[512];
-
-    // Create a Shader program object.
-    programId = glCreateProgram();
-
-    // Create the vertex and fragment shader objects
-    GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Retrive the shader source
-    glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-    glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
-
-    // Compile the vertex shader, and print compilation errors (if any)
-    glCompileShader(vertexShaderId); // compile the vertex shader
-    // check for shader compile errors
-    glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-
-        return false;
-    }
-
-    glCompileShader(fragmentShaderId); // compile the fragment shader
-    // check for shader compile errors
-    glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-
-        return false;
-    }
-
-    // Attached compiled shaders to the shader program
-    glAttachShader(programId, vertexShaderId);
-    glAttachShader(programId, fragmentShaderId);
-
-    glLinkProgram(programId);   // links the shader program
-    // check for linking errors
-    glGetProgramiv(programId, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-
-        return false;
-    }
-
-    glUseProgram(programId);    // Uses the shader program
-
-    return true;
-}
-
-
-void UDestroyShaderProgram(GLuint programId)
-{
-    glDeleteProgram(programId);
-}
+#include <iostream>         // cout, cerr
+#include <cstdlib>          // EXIT_FAILURE
+#include <vector>           // vector
+#include <algorithm>        // sort
+#include <map>              // map
+#include <sstream>          // ostringstream
+#include <fstream>          // ifstream, ofstream
+#include <cstdio>           // snprintf
+#include <cstring>          // memcpy
+#include <chrono>           // steady_clock
+#include <thread>           // hardware_concurrency, the --threaded render thread
+#include <mutex>            // mutex
+#include <atomic>           // atomic
+#include <GL/glew.h>        // GLEW library
+#include <GLFW/glfw3.h>     // GLFW library
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"      // Image loading Utility functions
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "camera.h" // Camera class
+#include "programcache.h" // On-disk program binary cache
+#include "glstate.h" // Redundant state call filter
+#include "renderstats.h" // Per-frame draw, switch and uniform counters
+#include "trace.h" // Chrome trace JSON of the frame phases (ENABLE_TRACING builds)
+#include "framearena.h" // Per-frame linear allocator and the heap allocation counter
+#include "softrasterizer.h" // CPU rendering backend (--software)
+#include "raytracer.h" // CPU reference images (--raytrace)
+#include "lightmapbaker.h" // Offline lightmaps of the static objects (--bake-lightmaps)
+#include "snapshotbuffer.h" // Simulation to render thread hand-off (--threaded)
+#include "framepacer.h" // Swap interval, frame rate cap and frames in flight (--pacing)
+#include "resolutionscaler.h" // GPU time driven render scale (--dynamic-resolution)
+
+using namespace std; // Standard namespace
+
+#ifdef TRACK_ALLOCATIONS
+// Debug allocation hook: every heap allocation made through new is counted (see --check-allocations)
+void* operator new(size_t size)
+{
+    AllocationCounter::Count();
+    if (void* memory = malloc(size ? size : 1))
+        return memory;
+    throw bad_alloc();
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+#endif
+
+static int perspective_state = 1; // Ortho view = 0, Perspective = 1
+/*Shader program Macro*/
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+/*Shared shader code Macro, injected after the #version line of a GLSL() shader*/
+#ifndef GLSL_CHUNK
+#define GLSL_CHUNK(Source) #Source " \n"
+#endif
+
+// Unnamed namespace
+namespace
+{
+    const char* const WINDOW_TITLE = "Final Project"; // Macro for window title
+
+    // Variables for window width and height
+    const int WINDOW_WIDTH = 800;
+    const int WINDOW_HEIGHT = 600;
+
+    // Near and far clip planes, shared by the projection and the light cluster slices
+    const float Z_NEAR = 0.1f;
+    const float Z_FAR = 100.0f;
+
+    // Clustered lighting: screen tiles in x and y, exponential depth slices in z
+    const GLuint CLUSTER_X = 16;
+    const GLuint CLUSTER_Y = 9;
+    const GLuint CLUSTER_Z = 24;
+    const GLuint MAX_LIGHTS_PER_CLUSTER = 128;
+    const GLuint MAX_LIGHTS = 1024;  // key light and spotlight included
+
+    // Per-frame transient data (the light list) comes from a linear allocator reset at the start of each frame
+    const size_t FRAME_ARENA_SIZE = 256 * 1024;
+
+    // --check-allocations: frames to run before measuring (shader variants must be finished too), then frames measured
+    const int ALLOCATION_WARMUP_FRAMES = 120;
+    const int ALLOCATION_CHECK_FRAMES = 600;
+
+    // Shader permutations: features are compiled in or out with #defines and the programs are cached by a variant key
+    const GLuint SHADER_HAS_TEXTURE = 1u << 0;    // samples uTexture, otherwise uses objectColor
+    const GLuint SHADER_HAS_SPOTLIGHT = 1u << 1;  // evaluates spot cones
+    const GLuint SHADER_HAS_SHADOWS = 1u << 2;    // samples the shadow maps
+    const GLuint SHADER_CLUSTERED = 1u << 3;      // walks the cluster light lists instead of the first NUM_LIGHTS lights
+    const GLuint SHADER_PCF_SHIFT = 4;            // 2 bits, PCF kernel radius
+    const GLuint SHADER_PASS_SHIFT = 6;           // 2 bits, ShaderPass
+    const GLuint SHADER_LIGHTMAP = 1u << 8;       // the key light comes from a baked lightmap, only its highlight is live
+    const GLuint SHADER_MULTIVIEW = 1u << 9;      // multiViewVertexShaderSource, one instance per view (forward pass only)
+    const GLuint SHADER_NUM_LIGHTS_SHIFT = 10;    // light count compiled into variants that are not clustered
+    const GLuint MAX_UNCLUSTERED_LIGHTS = 8;      // with more lights the cluster lists are cheaper
+
+    // Explicit uniform locations of the scene shaders, SPIR-V modules carry no names to look up
+    const GLint UNIFORM_MODEL = 0;
+    const GLint UNIFORM_VIEW = 1;                // deferred lighting only, the scene passes read CameraBlock
+    const GLint UNIFORM_CLUSTER_GRID = 4;
+    const GLint UNIFORM_MAX_LIGHTS_PER_CLUSTER = 5;
+    const GLint UNIFORM_SCREEN_SIZE = 6;
+    const GLint UNIFORM_Z_NEAR = 7;
+    const GLint UNIFORM_Z_FAR = 8;
+    const GLint UNIFORM_SHADOW_MATRICES = 9;     // mat4[2], also takes location 10
+    const GLint UNIFORM_OBJECT_COLOR = 11;
+    const GLint UNIFORM_UV_SCALE = 12;
+    const GLint UNIFORM_INVERSE_VIEW_PROJECTION = 13;
+    const GLint UNIFORM_FIRST_VIEW = 14;         // multi-view only, the view of instance 0
+    const GLint UNIFORM_LIGHT_VIEW_PROJECTION = 15;  // shadow casters only, the light's camera
+
+    // Specialization constant ids of the SPIR-V lighting shaders, the GLSL path #defines the same names
+    const char* const SPEC_CONSTANT_NAMES[] = { "HAS_TEXTURE", "HAS_SPOTLIGHT", "HAS_SHADOWS", "CLUSTERED", "PCF_RADIUS", "NUM_LIGHTS", "LIGHTMAP" };
+    const GLuint SPEC_CONSTANT_COUNT = 7;
+
+    // Textures of the scene objects, loaded by the GL path and by the software renderer
+    const char* const TABLE_TEXTURE_FILE = "../resources/textures/old_wood.jpg";
+    const char* const BOWL_TEXTURE_FILE = "../resources/textures/stone_rock.jpg";
+    const char* const GRINDER_TEXTURE_FILE = "../resources/textures/granite.jpg";
+    const char* const PLANTAR_TEXTURE_FILE = "../resources/textures/pot2.jpg";
+    const char* const DIRT_TEXTURE_FILE = "../resources/textures/plantar_dirt.jpg";
+
+    // Software renderer: frames timed per thread count, and how far its image may be from the GL frame
+    // (--software-compare): channel differences above the tolerance count as mismatched pixels
+    const int SOFTWARE_TIMED_FRAMES = 10;
+    const int SOFTWARE_COMPARE_WARMUP_FRAMES = 120;
+    const int SOFTWARE_COMPARE_TOLERANCE = 16;
+    const double SOFTWARE_COMPARE_MAX_MISMATCH = 0.02;
+    // Ray tracer (--raytrace): frames timed per thread count
+    const int RAYTRACE_TIMED_FRAMES = 3;
+
+    // Lightmaps of the key light for the objects that never move, by their index in UBuildDrawList order
+    // (table, plantar, dirt). --bake-lightmaps writes them, startup loads whichever are there.
+    const char* const LIGHTMAP_DIRECTORY = "lightmaps";
+    const int LIGHTMAP_OBJECT_COUNT = 3;
+    const int LIGHTMAP_OBJECTS[LIGHTMAP_OBJECT_COUNT] = { 0, 3, 4 };
+    const char* const LIGHTMAP_NAMES[LIGHTMAP_OBJECT_COUNT] = { "table", "plantar", "dirt" };
+    const int LIGHTMAP_SIZE = 512;
+    const unsigned int LIGHTMAP_BOUNCE_SAMPLES = 128;
+    const float LIGHTMAP_BOUNCE_DISTANCE = 10.0f;   // the whole table fits in it
+    const GLuint LIGHTMAP_TEXTURE_UNIT = 5;         // after the shadow maps
+
+    // On-demand rendering redraws this often while shader variants build in the background, to swap them in
+    const double SHADER_BUILD_POLL_SECONDS = 0.01;
+
+    // Frame rate of --pacing cap when --fps-cap does not give one
+    const double DEFAULT_FRAME_CAP = 60.0;
+
+    // GPU time per frame dynamic resolution aims for when R turns it on without --dynamic-resolution
+    const double DEFAULT_GPU_BUDGET_MS = 14.0;
+
+    // --threaded: fixed step of the simulation thread, and the backlog it drops after a stall instead of catching up
+    const double SIMULATION_TICK_SECONDS = 1.0 / 120.0;
+    const double SIMULATION_MAX_LAG_SECONDS = 0.25;
+
+    // The scene passes read the camera from a persistently mapped uniform buffer, a slot per frame in flight,
+    // so it can be written as late as right before the first draw
+    const GLuint CAMERA_BLOCK_BINDING = 0;
+    const int CAMERA_BLOCK_FRAMES = 3;
+
+    // Multi-view (--multiview): most views in a frame (the CameraBlock arrays), the stereo eye distance, and how
+    // far from the table the preview cameras of the quad split stand
+    const int MAX_VIEWS = 4;
+    const float STEREO_EYE_SEPARATION = 0.065f;
+    const float PREVIEW_CAMERA_DISTANCE = 5.0f;
+
+    // Input-to-GPU latency: timestamp queries in flight, and the frames --measure-latency runs per latch mode
+    const int LATENCY_QUERY_FRAMES = 4;
+    const int LATENCY_WARMUP_FRAMES = 60;
+    const int LATENCY_MEASURE_FRAMES = 300;
+
+    // Shadow map sizes for the key light and the camera spotlight
+    const GLsizei KEY_SHADOW_MAP_SIZE = 2048;
+    const GLsizei SPOT_SHADOW_MAP_SIZE = 1024;
+
+    // Stores the GL data relative to a given mesh
+    struct GLMesh
+    {
+        GLuint tablevao;         // Handle for the table vertex array object
+        GLuint bowlvao;// Handle for the bowl vertex array object
+        GLuint plantarvao;      //Handle for the plantar vertex array object
+        GLuint dirtvao;      //Handle for the dirt vertex array object
+        GLuint grindervao;      //Handle for the grinder vertex array object
+        GLuint tablevbo;     // Handles for the table vertex buffer objects
+        GLuint bowlvbo;     // Handles for the bowl vertex buffer objects
+        GLuint plantarvbo;  // Handles for the plantar vertex buffer objects
+        GLuint dirtvbo;  // Handles for the dirt vertex buffer objects
+        GLuint grindervbo;  // Handles for the grinder vertex buffer objects
+        GLuint nTableVerticies;    // Number of verts of the table mesh
+        GLuint nBowlVerticies;    // Number of verts of the bowl mesh
+        GLuint nPlantarVerticies;   // Number of verts for the plantar mesh
+        GLuint nDirtVerticies;     // Number of verts for the dirt mesh
+        GLuint nGrinderVerticies;  // Number of verts for the grinder mesh
+        GLuint tabledepthvao;     // Handles for the position-only vertex array objects used by the depth pre-pass
+        GLuint bowldepthvao;
+        GLuint plantardepthvao;
+        GLuint dirtdepthvao;
+        GLuint grinderdepthvao;
+        GLuint tabledepthvbo;     // Handles for the position-only vertex buffer objects
+        GLuint bowldepthvbo;
+        GLuint plantardepthvbo;
+        GLuint dirtdepthvbo;
+        GLuint grinderdepthvbo;
+        glm::vec3 tableCenter;    // Object space centers of each mesh, used to sort draws by view depth
+        glm::vec3 bowlCenter;
+        glm::vec3 plantarCenter;
+        glm::vec3 dirtCenter;
+        glm::vec3 grinderCenter;
+    };
+
+    // Everything needed to issue one opaque draw of an object in the scene
+    struct GLDrawItem
+    {
+        GLuint vao;          // Vertex array object with positions, normals and uvs
+        GLuint depthvao;     // Vertex array object with positions only
+        GLuint nVerticies;   // Number of verts to draw
+        GLuint features;     // Material shader features (SHADER_HAS_TEXTURE)
+        GLuint textureId;    // Texture bound to unit 0 while shading
+        glm::vec3 position;  // World position of the object
+        glm::vec3 scale;     // Scale of the object
+        glm::vec3 center;    // Object space center of the mesh
+        float viewDepth;     // Distance in front of the camera, refreshed every frame for sorting
+        bool dynamic;        // Moves or deforms, so it is drawn into the shadow maps every frame instead of being cached
+        GLuint lightmapId;   // Baked key light (SHADER_LIGHTMAP), 0 when the object has none
+    };
+
+    // Shadow map of one light. Static casters are cached in staticMap and only re-rendered when
+    // the light or the static geometry changes, dynamic casters are composited on a copy each frame.
+    struct GLShadowMap
+    {
+        GLsizei size;
+        GLuint staticMap;             // depth of the static casters
+        GLuint staticFbo;
+        GLuint finalMap;              // static depth plus this frame's dynamic casters
+        GLuint finalFbo;
+        glm::mat4 view;               // light view and projection for this frame
+        glm::mat4 projection;
+        glm::mat4 cachedViewProjection; // light matrix the static map was rendered with
+        bool cacheValid;
+        bool hasDynamic;              // finalMap holds this frame's result instead of staticMap
+    };
+
+    // One light as laid out in the light SSBO (std430, four vec4s)
+    struct GLLight
+    {
+        glm::vec4 positionRange;    // xyz world position, w range (0 = unbounded)
+        glm::vec4 colorType;        // rgb color, w type (0 = point, 1 = spot)
+        glm::vec4 directionCutOff;  // xyz spot direction, w cosine of the inner cone
+        glm::vec4 outerCutOff;      // x cosine of the outer cone, y shadow map index (-1 = none)
+    };
+
+    // Precompiled SPIR-V modules of the lighting shaders, written by compile_spirv.cmd
+    enum SpirvModule
+    {
+        SPIRV_SCENE_VERT,               // vertexShaderSource
+        SPIRV_FORWARD_FRAG,             // fragmentShaderSource
+        SPIRV_GBUFFER_FRAG,             // gBufferFragmentShaderSource
+        SPIRV_FULLSCREEN_VERT,          // fullscreenVertexShaderSource
+        SPIRV_DEFERRED_LIGHTING_FRAG,   // deferredLightingFragmentShaderSource
+        SPIRV_MODULE_COUNT
+    };
+
+    // Which program a shader variant is built for
+    enum ShaderPass
+    {
+        PASS_FORWARD = 0,           // vertexShaderSource + fragmentShaderSource
+        PASS_GBUFFER = 1,           // vertexShaderSource + gBufferFragmentShaderSource
+        PASS_DEFERRED_LIGHTING = 2  // fullscreenVertexShaderSource + deferredLightingFragmentShaderSource
+    };
+
+    // Where in the frame the camera is sampled for drawing
+    enum LatchMode
+    {
+        LATCH_FRAME_START,      // once, at the top of the frame
+        LATCH_BEFORE_DRAW,      // again right before the first camera-dependent draw
+        LATCH_BEFORE_SWAP,      // also before the swap, the finished frame is rotated to the newest view
+        LATCH_MODE_COUNT
+    };
+    const char* const LATCH_MODE_NAMES[LATCH_MODE_COUNT] = { "frame start", "before draw", "before swap" };
+
+    // The cameras a frame is drawn from
+    enum MultiViewMode
+    {
+        MULTIVIEW_OFF,          // the camera alone
+        MULTIVIEW_STEREO,       // left and right eye side by side
+        MULTIVIEW_QUAD,         // the camera and top, front and side previews in a 2x2 split
+        MULTIVIEW_MODE_COUNT
+    };
+    const char* const MULTIVIEW_MODE_NAMES[MULTIVIEW_MODE_COUNT] = { "off", "stereo", "quad" };
+
+    // std140 layout of CameraBlock (cameraBlockSource), UCameraBlockSource sizes its arrays from MAX_VIEWS
+    struct GLCameraBlock
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 viewPosition;   // xyz
+        glm::mat4 viewProjections[MAX_VIEWS];   // the views of a multi-view frame
+        glm::vec4 viewPositions[MAX_VIEWS];     // xyz, [0] is viewPosition in a single view frame
+    };
+
+    // One view of the frame: its camera and the part of the render size it is drawn into
+    struct GLView
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec3 position;
+        glm::vec4 viewport;     // x, y, width, height in pixels
+    };
+
+    // A program whose compile and link were submitted without waiting for the driver
+    struct GLProgramBuild
+    {
+        GLuint programId;
+        GLuint vertexShaderId;      // 0 once finished, or when the program came from the binary cache
+        GLuint fragmentShaderId;
+        string cacheKey;
+        double submitTime;
+        bool cached;                // the binary cache's program was submitted, it is accepted once the driver is done
+    };
+
+    enum ProgramBuildStatus
+    {
+        BUILD_PENDING,
+        BUILD_READY,
+        BUILD_FAILED,
+        BUILD_REJECTED              // the driver refused the cached binary, submit the build again to compile it
+    };
+
+    // What the simulation thread hands to the render thread after a tick (--threaded). The camera of the
+    // previous tick comes along so the render thread can draw any moment in between.
+    struct SceneSnapshot
+    {
+        Camera previousCamera;
+        Camera camera;
+        double time;                  // simulation time of camera, previousCamera is one tick earlier
+        glm::ivec2 framebufferSize;   // resizes are applied by the render thread, which owns the context
+    };
+
+    // Animation parameters of one of the extra dynamic lights orbiting the table
+    struct DynamicLight
+    {
+        float orbitRadius;
+        float height;
+        float phase;
+        float speed;
+        float range;
+        bool spot;
+        glm::vec3 color;
+    };
+
+    // CPU copy of one scene object for the software renderer
+    struct SoftwareObject
+    {
+        vector<GLfloat> vertices;    // interleaved like the GL vertex streams
+        SoftwareTexture texture;
+        glm::vec3 position;
+        glm::vec3 scale;
+    };
+
+    // Main GLFW window
+    GLFWwindow* gWindow = nullptr;
+    // Binding and capability changes of the frame loop go through here so repeated ones are dropped
+    GLStateCache& gState = GLStateCache::Current();
+    // Draw calls, triangles and uniform uploads of the frame loop, logged once a second and per frame to a CSV file
+    RenderStats& gStats = RenderStats::Current();
+    string gStatsLogPath = "render_stats.csv";  // --stats <file>
+    string gTracePath;                          // --trace <file>, written at exit by ENABLE_TRACING builds
+    FrameArena gFrameArena(FRAME_ARENA_SIZE);
+    bool gCheckAllocations = false;             // --check-allocations, fails the run if a steady-state frame allocates
+    bool gBenchmarkMeshDraw = false;            // --bench-mesh-draw, runs the Mesh::Draw micro-benchmark instead of the scene
+    string gSoftwareImagePath;                  // --software <file>, renders on the CPU without a GL context and writes a PPM
+    bool gBenchmarkPhong = false;               // --bench-phong, checks and times the CPU Phong kernels
+    bool gSoftwareCompare = false;              // --software-compare, checks the software image against the GL frame
+    bool gSoftwareComparePassed = false;
+    vector<unsigned char> gSoftwareComparePixels;   // the GL frame of the comparison, read from the back buffer before the swap
+    string gRayTraceImagePath;                  // --raytrace <file>, renders a ray-traced reference image without a GL context
+    bool gBakeLightmaps = false;                // --bake-lightmaps, bakes the static objects' lightmaps without a GL context
+    bool gThreadedLoop = false;                 // --threaded, fixed-step simulation on the main thread, drawing on a render thread
+    bool gMeasureLatency = false;               // --measure-latency, times every latch mode and exits
+    vector<SoftwareObject> gSoftwareObjects;
+    int gAllocationWarmupFrames = 0;
+    int gAllocationCheckedFrames = 0;
+    int gAllocatingFrames = 0;
+    // ARB_pipeline_statistics_query: vertex shader invocations, clipping input primitives and fragment shader
+    // invocations per frame, a ring of query sets so results are read a few frames late instead of stalling
+    const int PIPELINE_QUERY_FRAMES = 3;
+    GLuint gPipelineQueries[PIPELINE_QUERY_FRAMES][3];
+    bool gPipelineStatistics = false;
+
+    // Late latch (--latch, J cycles): when the camera is sampled, the mapped camera block ring, and the off-screen
+    // frame the before-swap mode reprojects
+    LatchMode gLatchMode = LATCH_BEFORE_DRAW;
+    bool gLatchingInput = false;                // events handled mid-frame, keys and resizes wait for the next frame
+    glm::ivec2 gDeferredResize(-1, -1);         // framebuffer size reported while latching, x < 0 when none
+    GLuint gCameraBuffer = 0;
+    unsigned char* gCameraBlocks = nullptr;     // persistent, coherent mapping of gCameraBuffer
+    GLsizeiptr gCameraBlockStride = 0;          // sizeof(GLCameraBlock) rounded up to the uniform buffer offset alignment
+    GLsync gCameraBlockFences[CAMERA_BLOCK_FRAMES] = {};
+    int gCameraBlockFrame = 0;
+    GLuint gSceneTargetFbo = 0;                 // created on first use, dropped on resize
+    GLuint gSceneTargetColor = 0;
+    GLuint gSceneTargetDepth = 0;
+    GLuint gPresentProgramId = 0;
+    double gLatchTime = 0.0;                    // when the camera this frame is drawn with was sampled
+
+    // Input-to-GPU latency: a timestamp after each frame's last command, read back LATENCY_QUERY_FRAMES frames later.
+    // Measured from the top of the frame and from the latch, the difference is what late latching gains.
+    GLuint gLatencyQueries[LATENCY_QUERY_FRAMES];
+    double gLatencyFrameStart[LATENCY_QUERY_FRAMES];
+    double gLatencyLatched[LATENCY_QUERY_FRAMES];
+    long long gLatencyFrame = 0;
+    double gGpuClockOffset = 0.0;               // CPU clock minus GPU clock, seconds
+    double gLatencyFrameStartMs = 0.0;          // sums since the last report
+    double gLatencyLatchedMs = 0.0;
+    int gLatencyFrames = 0;
+    int gLatencyMeasuredFrames = 0;             // --measure-latency progress in the current mode
+    double gLatencyResults[LATCH_MODE_COUNT][2];
+    // Triangle mesh data
+    GLMesh gMesh;
+    // Texture id
+    GLuint gTextureTableId;
+    GLuint gTextureBowlId;
+    GLuint gTexturePlantarId;
+    GLuint gTextureDirtId;
+    GLuint gTextureGrinderId;
+    glm::vec2 gUVScale(1.0f, 1.0f);
+    // Shader program
+    GLuint gDepthProgramId;
+    GLuint gShadowCasterProgramId;
+    GLuint gClusterProgramId;
+
+    // Light data and the cluster grid the compute pass bins the lights into
+    GLLight* gLights = nullptr;  // this frame's lights, in the frame arena
+    GLuint gLightCount = 0;
+    vector<DynamicLight> gDynamicLights;
+    GLuint gLightSsbo;
+    GLuint gClusterCountSsbo;
+    GLuint gClusterIndexSsbo;
+    int gDynamicLightCount = 0;  // cycled with the L key
+    glm::ivec2 gFramebufferSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    // Shader variants by variant key: finished programs, builds still running in the driver, and the
+    // cheap programs drawn per pass (ShaderPass) until a variant is ready
+    map<GLuint, GLuint> gShaderVariants;
+    map<GLuint, GLProgramBuild> gPendingShaderVariants;
+    GLuint gFallbackProgramIds[3];
+    GLuint gFallbackMultiViewProgramId;     // PASS_FORWARD with SHADER_MULTIVIEW
+    bool gParallelShaderCompile = false;    // GL_KHR_parallel_shader_compile, completion can be polled
+    map<GLuint, GLuint> gActiveUniformMasks; // program -> bit per active explicit uniform location
+
+    // SPIR-V path (ARB_gl_spirv / GL 4.6): variants are specialized from precompiled modules instead of compiled from GLSL
+    const char* SPIRV_DIRECTORY = "shaders";
+    vector<char> gSpirvModules[SPIRV_MODULE_COUNT];
+    bool gSpirvShaders = false;
+    bool gSpirvAllowed = true;              // --glsl forces the GLSL path
+    string gExportShaderDirectory;          // --export-shaders <dir>, used by compile_spirv.cmd
+    double gShaderVariantBlockingMs = 0.0;  // main thread time spent submitting and polling variant builds
+
+    // Shadows for the key light [0] and the camera spotlight [1]
+    GLShadowMap gShadowMaps[2];
+    bool gShadowsEnabled = true;            // H toggles shadows
+    bool gShadowCacheEnabled = true;        // K toggles against a naive per-frame shadow pass
+    bool gStaticShadowCastersDirty = true;  // set whenever a static object moves
+    int gPcfRadius = 1;                     // F cycles 0 (single tap), 1 (3x3) and 2 (5x5)
+    GLuint gShadowTimerQueries[2];          // GPU time of the shadow pass, double buffered to avoid stalls
+    int gShadowTimerFrame = 0;
+    float gShadowPassMs = 0.0f;
+    int gStaticShadowRenders = 0;           // number of static map refreshes since the last title update
+
+    // Deferred render path (--deferred at startup): geometry into a compact G-buffer, then one lighting pass
+    bool gDeferredShading = false;
+    GLuint gGBufferFbo = 0;
+    GLuint gGBufferAlbedo = 0;   // RGBA8 texture color
+    GLuint gGBufferNormal = 0;   // RG16 octahedral packed world normal
+    GLuint gGBufferDepth = 0;    // 32 bit float depth, positions are reconstructed from it
+    GLuint gFullscreenVao;       // Empty VAO, the fullscreen triangle is generated from gl_VertexID
+
+    // Opaque draws, sorted front-to-back every frame
+    vector<GLDrawItem> gDrawItems;
+
+    // Baked lighting of the static objects: a texture and a lightmap coordinate stream per LIGHTMAP_OBJECTS entry
+    GLuint gLightmapTextures[LIGHTMAP_OBJECT_COUNT];
+    GLuint gLightmapUvBuffers[LIGHTMAP_OBJECT_COUNT];
+    bool gLightmapsEnabled = true;          // B switches the static objects back to live key lighting
+
+    // Depth pre-pass toggle (Z key) and the frame timing shown in the window title to compare modes
+    bool gDepthPrepass = false;
+    int gTitleFrameCount = 0;
+    float gTitleLastTime = 0.0f;
+
+    // camera
+    Camera gCamera(glm::vec3(0.0f, 0.0f, 3.0f));
+    float gLastX = WINDOW_WIDTH / 2.0f;
+    float gLastY = WINDOW_HEIGHT / 2.0f;
+    bool gFirstMouse = true;
+
+    // Input moves this camera: gCamera itself, or with --threaded the simulation's camera, which the render
+    // thread interpolates into gCamera
+    Camera* gInputCamera = &gCamera;
+
+    // timing
+    float gDeltaTime = 0.0f; // time between current frame and last frame
+    float gLastFrame = 0.0f;
+    double gSceneTime = 0.0;  // animation time of the frame being drawn
+    double gStartupStart = 0.0;
+    bool gFirstFrame = true;
+    unsigned long long gAllocationMark = 0;  // allocation count at the end of the last frame
+
+    // --threaded: the simulation (main) thread's state, and what it shares with the render thread
+    Camera gSimulationCamera;
+    glm::ivec2 gSimulationFramebufferSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    SnapshotBuffer<SceneSnapshot> gSnapshots;
+    std::mutex gSimulationMutex;    // guards the two hand-offs below
+    vector<int> gPendingKeys;       // settings keys pressed since the render thread last looked
+    vector<int> gAppliedKeys;       // swapped with gPendingKeys, keeps its capacity so the frame does not allocate
+    char gPendingTitle[512] = "";   // window title the render thread formatted, glfwSetWindowTitle is main thread only
+
+    // On-demand rendering (--on-demand, N key): the loop sleeps until input, a resize or an animation marks the scene dirty
+    bool gOnDemandRendering = false;
+    std::atomic<bool> gSceneDirty(true);    // set by the input callbacks on the main thread and by resizes on the render thread
+
+    // Frame pacing (--pacing, --fps-cap, --frames-in-flight, V cycles the mode)
+    FramePacer gPacer;
+    bool gSwapTearSupported = false;    // EXT_swap_control_tear, adaptive vsync
+
+    // Dynamic resolution (--dynamic-resolution <ms>, --sharpen <amount>, R toggles): the scene is drawn into the lower
+    // left gRenderSize pixels of the scene target and the G-buffer, then upscaled to the window
+    ResolutionScaler gResolution;
+    bool gDynamicResolution = false;
+    float gSharpness = 0.0f;                    // 0 is a plain bilinear upscale
+    glm::ivec2 gRenderSize(WINDOW_WIDTH, WINDOW_HEIGHT);    // the size the scene is drawn at this frame
+
+    // Multi-view (--multiview, M cycles): each draw is instanced once per view and the vertex shader sends the
+    // instance to its view's viewport. Without a viewport index extension, or with --multiview-passes, the scene
+    // is drawn once per view instead.
+    MultiViewMode gMultiView = MULTIVIEW_OFF;
+    const char* gViewportIndexExtension = nullptr;  // writes gl_ViewportIndex from the vertex shader
+    bool gMultiViewPasses = false;
+    GLView gViews[MAX_VIEWS];                       // this frame's views
+    int gViewCount = 1;
+
+    // Subject position and scale
+    glm::vec3 gTablePosition(0.0f, 0.0f, 0.0f);
+    glm::vec3 gTableScale(1.0f);
+
+    glm::vec3 gBowlPosition(-0.7f, 0.0f, 0.0f);
+    glm::vec3 gBowlScale(1.0f);
+
+    glm::vec3 gPlantarPosition(1.0, 0.0f, 0.0f);
+    glm::vec3 gPlantarScale(1.0f);
+
+    glm::vec3 gDirtPosition(1.0, 0.0f, 0.0f);
+    glm::vec3 gDirtScale(1.0f);
+
+    glm::vec3 gGrinderPosition(-0.7f, 0.0f, 0.0f);
+    glm::vec3 gGrinderScale(1.0f);
+
+
+    // Cube and light color
+
+    glm::vec3 gObjectColor(1.0f, 0.2f, 0.0f);
+    glm::vec3 gKeyLightColor(1.0f, 1.0f, 1.0f);
+    glm::vec3 gSpotLightColor(0.0f, 0.0f, 1.0f);
+
+
+    // Light position and scale
+    glm::vec3 gKeyLightPosition(-1.5f, 3.5f, 0.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, Z_NEAR, Z_FAR);
+    glm::vec3 gSpotLightPosition = gCamera.Position;
+}
+
+/* User-defined Function prototypes to:
+ * initialize the program, set the window size,
+ * redraw graphics on the window when resized,
+ * and render graphics on the screen
+ */
+bool UInitialize(int, char* [], GLFWwindow** window);
+void UParseCommandLine(int argc, char* argv[]);
+void UResizeWindow(GLFWwindow* window, int width, int height);
+void UProcessInput(GLFWwindow* window);
+void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
+void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void UWindowRefreshCallback(GLFWwindow* window);
+bool USceneAnimating();
+void UWaitForChanges();
+void UDrawFrame(double frameStart);
+void UApplyKey(int key);
+void URunThreadedLoop();
+void URenderThread();
+void USimulationResize(GLFWwindow* window, int width, int height);
+double UInterpolateSnapshot(double now);
+void UCreateCameraBlocks();
+void UDestroyCameraBlocks();
+void UWriteCameraBlock(const glm::mat4& view, const glm::vec3& viewPosition);
+void UComputeViews(const glm::mat4& view);
+void UEndCameraBlock();
+void UApplyPacing();
+double ULatchCamera();
+GLuint USceneTarget();
+void UDestroySceneTarget();
+void UPresentFrame(const glm::mat4& renderedView, const glm::mat4& latestView);
+void UApplyDynamicResolution();
+void UCreateLatencyQueries();
+void UDestroyLatencyQueries();
+void UCalibrateGpuClock();
+void UEndLatencyFrame(double frameStart);
+bool UMeasureLatency();
+void UCreateTableMesh(GLMesh& mesh);
+void UCreateBowlMesh(GLMesh& mesh);
+void UCreateDirtMesh(GLMesh& mesh);
+void UCreatePlantarMesh(GLMesh& mesh);
+void UCreateGrinderMesh(GLMesh& mesh);
+void UCreateVertexStream(const vector<GLfloat>& verts, GLuint& vao, GLuint& vbo);
+glm::vec3 UCreateDepthOnlyStream(const vector<GLfloat>& verts, GLuint& vao, GLuint& vbo);
+void UBuildTableVertices(vector<GLfloat>& verts);
+void UBuildBowlVertices(vector<GLfloat>& verts);
+void UBuildDirtVertices(vector<GLfloat>& verts);
+void UBuildPlantarVertices(vector<GLfloat>& verts);
+void UBuildGrinderVertices(vector<GLfloat>& verts);
+void UBuildDrawList();
+void USortDrawItems(const glm::mat4& view);
+void UUpdateWindowTitle();
+void UCreateStatsQueries();
+void UDestroyStatsQueries();
+void UBeginPipelineStatistics();
+void UEndPipelineStatistics();
+bool UCheckAllocations(unsigned int frameAllocations);
+int UBenchmarkMeshDraw(); // meshbenchmark.cpp
+int UBenchmarkPhongKernels(); // phongbenchmark.cpp
+bool UCreateSoftwareScene();
+bool ULoadSoftwareTexture(const char* filename, SoftwareTexture& texture);
+void USoftwareDraws(vector<SoftwareRasterizer::Draw>& draws);
+void USoftwareLights(vector<SoftwareRasterizer::Light>& lights);
+void URenderSoftwareFrame(SoftwareRasterizer& rasterizer, SoftwareRasterizer::ShadowMap* shadowMaps);
+int URunSoftwareRenderer(const string& path);
+int URunRayTracer(const string& path);
+int UBakeLightmaps();
+void ULoadLightmaps();
+void UDestroyLightmaps();
+void UCaptureSoftwareCompareFrame();
+bool UCompareSoftwareFrame();
+bool UWritePpm(const string& path, int width, int height, const unsigned char* pixels);
+void UCreateLightBuffers();
+void UDestroyLightBuffers();
+void UUpdateLights(float time);
+void UCullLightsIntoClusters(const glm::mat4& view);
+void UCreateShadowMaps();
+void UDestroyShadowMaps();
+void UUpdateShadowMatrices();
+void URenderShadowMaps();
+void URenderShadowCasters(GLuint fbo, const GLShadowMap& shadow, bool dynamicCasters);
+bool UCreateComputeProgram(const char* compShaderSource, GLuint& programId);
+string UInjectAfterVersion(const char* shaderSource, const char* injectedSource);
+string UCameraBlockSource();
+string UMultiViewVertexSource();
+GLuint UFrameShaderFeatures();
+GLuint UGetShaderVariant(GLuint variantKey);
+void USubmitShaderVariant(GLuint variantKey);
+void UPrewarmShaderVariants();
+bool UCreateFallbackPrograms();
+void UDestroyShaderVariants();
+void UBeginShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLProgramBuild& build);
+void UBeginSpirvProgram(SpirvModule vertexModule, SpirvModule fragmentModule, GLuint variantKey, GLProgramBuild& build);
+GLint ULightingUniform(GLuint programId, GLint location);
+const char* USpirvModuleInfo(SpirvModule module, const char*& source, GLuint& constants, bool& lighting);
+GLuint USpecializeSpirvShader(SpirvModule module, GLenum stage, const GLuint* constantValues);
+bool UExportShaders(const string& directory);
+void ULoadSpirvModules();
+ProgramBuildStatus UPollShaderProgram(GLProgramBuild& build, bool wait);
+bool UCreateGBuffer(int width, int height);
+void UDestroyGBuffer();
+void USingleKeyPressCallBack(GLFWwindow* window, int key, int scancode, int action, int mods);
+void UDestroyMesh(GLMesh& mesh);
+bool UCreateTexture(const char* filename, GLuint& textureId);
+glm::vec3 CalculateSurfaceNormal(glm::vec3 vecOne, glm::vec3 vecTwo, glm::vec3 vecThree);
+void UDestroyTexture(GLuint textureId);
+void URender();
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+void UDestroyShaderProgram(GLuint programId);
+
+
+/* Camera Block Shader Code, injected after the #version line of every shader that reads the camera. UCameraBlockSource
+   defines MAX_VIEWS from the C++ constant in front of it*/
+const GLchar* cameraBlockSource = GLSL_CHUNK(
+// Camera of the frame (GLCameraBlock), written as late as possible from the newest input
+layout(std140, binding = 0) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition; // xyz
+    mat4 viewProjections[MAX_VIEWS]; // the views of a multi-view frame
+    vec4 viewPositions[MAX_VIEWS]; // xyz, [0] is viewPosition in a single view frame
+} camera;
+);
+
+
+/* Vertex Shader Source Code, the feature #defines and cameraBlockSource are injected after the #version line*/
+const GLchar* vertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal; // VAP position 1 for normals
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in vec2 lightmapCoordinate; // second stream, only on objects with a baked lightmap
+
+invariant gl_Position; // must match the depth pre-pass exactly for the GL_EQUAL depth test
+
+layout(location = 0) out vec3 vertexNormal; // For outgoing normals to fragment shader
+layout(location = 1) out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+layout(location = 2) out vec2 vertexTextureCoordinate;
+layout(location = 3) out float vertexViewDepth; // For selecting the light cluster in the fragment shader
+layout(location = 4) out vec2 vertexLightmapCoordinate;
+layout(location = 5) flat out uint vertexViewIndex; // always view 0, multiViewVertexShaderSource picks one per instance
+
+
+//Global variables for the transform matrices, explicit locations (UNIFORM_*) so the SPIR-V build needs no name lookups
+layout(location = 0) uniform mat4 model;
+
+void main()
+{
+    gl_Position = camera.projection * camera.view * model * vec4(position, 1.0f); // transforms vertices to clip coordinates
+    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vertexTextureCoordinate = textureCoordinate;
+    vertexLightmapCoordinate = lightmapCoordinate;
+    vertexViewDepth = CLUSTERED == 1 ? -(camera.view * model * vec4(position, 1.0f)).z : 0.0f; // distance in front of the camera
+    vertexViewIndex = 0u;
+}
+);
+
+
+/* Multi-view Vertex Shader Source Code, vertexShaderSource for several views in one draw: instance i draws view
+   firstView + i into viewport firstView + i. SELECT_VIEWPORT and cameraBlockSource are injected after the #version line,
+   SELECT_VIEWPORT writes gl_ViewportIndex through the driver's viewport index extension, or is empty when the views are
+   separate passes*/
+const GLchar* multiViewVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 textureCoordinate;
+layout(location = 3) in vec2 lightmapCoordinate;
+
+layout(location = 0) out vec3 vertexNormal;
+layout(location = 1) out vec3 vertexFragmentPos;
+layout(location = 2) out vec2 vertexTextureCoordinate;
+layout(location = 3) out float vertexViewDepth; // 0, a multi-view frame is not clustered
+layout(location = 4) out vec2 vertexLightmapCoordinate;
+layout(location = 5) flat out uint vertexViewIndex; // selects the eye position in the fragment shader
+
+layout(location = 0) uniform mat4 model;
+layout(location = 14) uniform uint firstView;
+
+void main()
+{
+    uint view = firstView + uint(gl_InstanceID);
+    vec4 worldPosition = model * vec4(position, 1.0f);
+    gl_Position = camera.viewProjections[view] * worldPosition;
+    SELECT_VIEWPORT(view);
+
+    vertexFragmentPos = vec3(worldPosition);
+    vertexNormal = mat3(transpose(inverse(model))) * normal;
+    vertexTextureCoordinate = textureCoordinate;
+    vertexLightmapCoordinate = lightmapCoordinate;
+    vertexViewDepth = 0.0f;
+    vertexViewIndex = view;
+}
+);
+
+
+/* Clustered Lighting Shader Code, shared by the forward and deferred lighting fragment shaders, injected after cameraBlockSource*/
+const GLchar* clusteredLightingSource = GLSL_CHUNK(
+// Lights and the per cluster light lists written by clusterComputeShaderSource
+struct Light
+{
+    vec4 positionRange; // xyz position, w range (0 = unbounded)
+    vec4 colorType; // rgb color, w type (0 = point, 1 = spot)
+    vec4 directionCutOff; // xyz spot direction, w cosine of the inner cone
+    vec4 outerCutOff; // x cosine of the outer cone, y shadow map index (-1 = none)
+};
+layout(std430, binding = 0) readonly buffer LightBuffer { Light lights[]; };
+layout(std430, binding = 1) readonly buffer ClusterCountBuffer { uint clusterLightCounts[]; };
+layout(std430, binding = 2) readonly buffer ClusterIndexBuffer { uint clusterLightIndices[]; };
+
+// Uniform / Global variables for camera/view position and the cluster grid
+layout(location = 4) uniform uvec3 clusterGrid;
+layout(location = 5) uniform uint maxLightsPerCluster;
+layout(location = 6) uniform vec2 screenSize;
+layout(location = 7) uniform float zNear;
+layout(location = 8) uniform float zFar;
+
+// Shadow maps of the key light (0) and the camera spotlight (1), on texture units 3 and 4
+layout(binding = 3) uniform sampler2DShadow keyShadowMap;
+layout(binding = 4) uniform sampler2DShadow spotShadowMap;
+layout(location = 9) uniform mat4 shadowMatrices[2];
+
+// The view the fragment is seen from, its eye is camera.viewPositions[viewIndex]. Set by the forward fragment
+// shader in a multi-view frame, view 0 everywhere else.
+uint viewIndex = 0u;
+
+// LIGHTMAP == 1: the key light (light 0) baked for this fragment, rgb its ambient, diffuse and first bounce,
+// a its shadow factor. Set by the fragment shader before clusteredPhong.
+vec4 bakedKeyLight = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+// Fraction of the light reaching a surface point that is not blocked by a shadow caster
+float shadowFactor(int shadowIndex, vec3 fragmentPos, vec3 norm)
+{
+    if (shadowIndex < 0)
+        return 1.0f;
+
+    // offset along the normal against shadow acne
+    vec4 lightClip = shadowMatrices[shadowIndex] * vec4(fragmentPos + norm * 0.01f, 1.0f);
+    vec3 coord = lightClip.xyz / lightClip.w * 0.5f + 0.5f;
+    if (lightClip.w <= 0.0f || coord.z > 1.0f)
+        return 1.0f;
+
+    // samplers cannot be indexed with a per-light value, so select them with a branch
+    // PCF_RADIUS 0 = single hardware filtered tap, N = (2N+1)^2 taps
+    vec2 texelSize = 1.0f / vec2(shadowIndex == 0 ? textureSize(keyShadowMap, 0) : textureSize(spotShadowMap, 0));
+    float lit = 0.0f;
+    for (int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
+    {
+        for (int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
+        {
+            vec3 tap = vec3(coord.xy + vec2(x, y) * texelSize, coord.z - 0.0005f);
+            lit += shadowIndex == 0 ? texture(keyShadowMap, tap) : texture(spotShadowMap, tap);
+        }
+    }
+    float taps = float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
+    return lit / taps;
+}
+
+// Sum of the ambient, diffuse and specular light reaching a surface point, from the lights of its cluster
+// (CLUSTERED == 1) or from the first NUM_LIGHTS lights. The feature macros are always defined to 0 or 1,
+// so the disabled branches fold away at compile time. With LIGHTMAP the key light only adds its specular
+// highlight, shadowed by the baked shadow factor, the rest of it is in bakedKeyLight.
+vec3 clusteredPhong(vec3 fragmentPos, vec3 norm, float viewDepth)
+{
+    /*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
+    float ambientStrength = 0.1f; // Set ambient or global lighting strength
+    float specularIntensity = 1.0f; // Set specular light strength
+    float highlightSize = 16.0f; // Set specular highlight size
+
+    vec3 viewDir = normalize(camera.viewPositions[viewIndex].xyz - fragmentPos); // Calculate view direction
+
+    uint lightCount = uint(NUM_LIGHTS);
+    uint lightBase = 0u;
+    if (CLUSTERED == 1)
+    {
+        // Find the cluster this fragment falls in: screen tile in x/y, exponential depth slice in z
+        float slice = floor(log(viewDepth / zNear) / log(zFar / zNear) * float(clusterGrid.z));
+        uvec2 tile = uvec2(clamp(gl_FragCoord.xy / screenSize * vec2(clusterGrid.xy), vec2(0.0), vec2(clusterGrid.xy) - 1.0));
+        uint clusterIndex = tile.x + clusterGrid.x * (tile.y + clusterGrid.y * uint(clamp(slice, 0.0, float(clusterGrid.z) - 1.0)));
+
+        // Only the lights binned into this cluster are evaluated
+        lightCount = clusterLightCounts[clusterIndex];
+        lightBase = clusterIndex * maxLightsPerCluster;
+    }
+
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+
+    for (uint i = 0u; i < lightCount; ++i)
+    {
+        uint lightIndex = CLUSTERED == 1 ? clusterLightIndices[lightBase + i] : i;
+        Light light = lights[lightIndex];
+        bool baked = LIGHTMAP == 1 && lightIndex == 0u;
+
+        vec3 lightDirection = normalize(light.positionRange.xyz - fragmentPos); // Calculate direction between light source and fragments/pixels
+        float impact = max(dot(norm, lightDirection), 0.0); // Calculate diffuse impact by generating dot product of normal and light
+        float intensity = 1.0f;
+
+        if (HAS_SPOTLIGHT == 1 && light.colorType.w > 0.5f)
+        {
+            // spotlight cone, the diffuse term is not scaled by the surface angle
+            float theta = dot(lightDirection, normalize(-light.directionCutOff.xyz));
+            float epsilon = (light.directionCutOff.w - light.outerCutOff.x);
+            intensity = clamp((theta - light.outerCutOff.x) / epsilon, 0.0, 1.0);
+            impact = 1.0f;
+        }
+
+        float range = light.positionRange.w;
+        if (range > 0.0f)
+        {
+            // smooth window so bounded lights reach exactly zero at their range
+            float distance = length(light.positionRange.xyz - fragmentPos);
+            float window = clamp(1.0f - pow(distance / range, 4.0f), 0.0, 1.0);
+            intensity *= window * window / (distance * distance + 1.0f);
+        }
+
+        //Calculate specular component
+        vec3 reflectDir = reflect(-lightDirection, norm); // Calculate reflection vector
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize);
+
+        // ambient is not shadowed
+        vec3 lightColor = light.colorType.rgb * intensity;
+        float shadow = baked ? bakedKeyLight.a : (HAS_SHADOWS == 1 ? shadowFactor(int(light.outerCutOff.y), fragmentPos, norm) : 1.0f);
+        if (!baked)
+        {
+            ambient += ambientStrength * lightColor;
+            diffuse += impact * lightColor * shadow;
+        }
+        specular += specularIntensity * specularComponent * lightColor * shadow;
+    }
+
+    return ambient + diffuse + specular + (LIGHTMAP == 1 ? bakedKeyLight.rgb : vec3(0.0f));
+}
+);
+
+
+/* Fragment Shader Source Code, the feature #defines, cameraBlockSource and clusteredLightingSource are injected after the #version line*/
+const GLchar* fragmentShaderSource = GLSL(440,
+    layout(location = 0) in vec3 vertexNormal; // For incoming normals
+layout(location = 1) in vec3 vertexFragmentPos; // For incoming fragment position
+layout(location = 2) in vec2 vertexTextureCoordinate;
+layout(location = 3) in float vertexViewDepth; // For incoming distance in front of the camera
+layout(location = 4) in vec2 vertexLightmapCoordinate;
+layout(location = 5) flat in uint vertexViewIndex;
+layout(location = 0) out vec4 fragmentColor; // For outgoing cube color to the GPU
+
+// Uniform / Global variables for object color and texture
+layout(location = 11) uniform vec3 objectColor;
+layout(binding = 0) uniform sampler2D uTexture; // Useful when working with multiple textures
+layout(location = 12) uniform vec2 uvScale;
+layout(binding = 5) uniform sampler2D lightmap; // LIGHTMAP_TEXTURE_UNIT
+
+void main()
+{
+    vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
+
+    // Texture holds the color to be used for all three components, untextured materials use objectColor
+    vec3 baseColor = HAS_TEXTURE == 1 ? texture(uTexture, vertexTextureCoordinate * uvScale).xyz : objectColor;
+
+    if (LIGHTMAP == 1)
+        bakedKeyLight = texture(lightmap, vertexLightmapCoordinate);
+    viewIndex = vertexViewIndex;
+
+    // Calculate phong result
+    vec3 phong = clusteredPhong(vertexFragmentPos, norm, vertexViewDepth) * baseColor;
+
+    fragmentColor = vec4(phong, 1.0f); // Send lighting results to GPU
+}
+);
+
+
+/* G-buffer Fragment Shader Source Code, the feature #defines are injected after the #version line*/
+const GLchar* gBufferFragmentShaderSource = GLSL(440,
+    layout(location = 0) in vec3 vertexNormal; // For incoming normals
+layout(location = 1) in vec3 vertexFragmentPos; // For incoming fragment position
+layout(location = 2) in vec2 vertexTextureCoordinate;
+layout(location = 3) in float vertexViewDepth;
+
+layout(location = 0) out vec4 gAlbedo; // texture color
+layout(location = 1) out vec2 gNormal; // octahedral packed normal
+
+layout(location = 11) uniform vec3 objectColor;
+layout(binding = 0) uniform sampler2D uTexture;
+layout(location = 12) uniform vec2 uvScale;
+
+// Maps a unit normal onto the octahedron and unfolds it into [0, 1]^2
+vec2 encodeOctahedral(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return (n.z >= 0.0 ? n.xy : folded) * 0.5 + 0.5;
+}
+
+void main()
+{
+    gAlbedo = vec4(HAS_TEXTURE == 1 ? texture(uTexture, vertexTextureCoordinate * uvScale).rgb : objectColor, 1.0f);
+    gNormal = encodeOctahedral(normalize(vertexNormal));
+}
+);
+
+
+/* Deferred Lighting Vertex Shader Source Code*/
+const GLchar* fullscreenVertexShaderSource = GLSL(440,
+void main()
+{
+    // one triangle covering the screen, generated from the vertex index
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
+);
+
+
+/* Deferred Lighting Fragment Shader Source Code, the feature #defines, cameraBlockSource and clusteredLightingSource are injected after the #version line*/
+const GLchar* deferredLightingFragmentShaderSource = GLSL(440,
+    layout(location = 0) out vec4 fragmentColor;
+
+layout(binding = 0) uniform sampler2D gAlbedo;
+layout(binding = 1) uniform sampler2D gNormal;
+layout(binding = 2) uniform sampler2D gDepth;
+layout(location = 13) uniform mat4 inverseViewProjection;
+layout(location = 1) uniform mat4 view;
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    encoded = encoded * 2.0 - 1.0;
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth >= 1.0f)
+        discard; // nothing was drawn here, keep the clear color
+
+    // Rebuild the world position from the depth buffer
+    vec2 ndc = (vec2(pixel) + 0.5f) / screenSize * 2.0f - 1.0f;
+    vec4 worldPosition = inverseViewProjection * vec4(ndc, depth * 2.0f - 1.0f, 1.0f);
+    vec3 fragmentPos = worldPosition.xyz / worldPosition.w;
+    float viewDepth = -(view * vec4(fragmentPos, 1.0f)).z;
+
+    vec3 norm = decodeOctahedral(texelFetch(gNormal, pixel, 0).rg);
+    vec3 albedo = texelFetch(gAlbedo, pixel, 0).rgb;
+
+    fragmentColor = vec4(clusteredPhong(fragmentPos, norm, viewDepth) * albedo, 1.0f);
+}
+);
+
+
+/* Light Cluster Compute Shader Source Code*/
+const GLchar* clusterComputeShaderSource = GLSL(440,
+    layout(local_size_x = 64) in;
+
+struct Light
+{
+    vec4 positionRange;
+    vec4 colorType;
+    vec4 directionCutOff;
+    vec4 outerCutOff;
+};
+layout(std430, binding = 0) readonly buffer LightBuffer { Light lights[]; };
+layout(std430, binding = 1) writeonly buffer ClusterCountBuffer { uint clusterLightCounts[]; };
+layout(std430, binding = 2) writeonly buffer ClusterIndexBuffer { uint clusterLightIndices[]; };
+
+uniform mat4 view;
+uniform mat4 inverseProjection;
+uniform uvec3 clusterGrid;
+uniform uint maxLightsPerCluster;
+uniform uint lightCount;
+uniform float zNear;
+uniform float zFar;
+
+// Lights are transformed to view space once per batch and shared by the whole work group
+shared vec4 batchLights[64];
+
+// View space point on the line through an NDC corner, at the given view depth
+vec3 clusterCorner(vec2 ndc, float viewZ)
+{
+    vec4 nearPoint = inverseProjection * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = inverseProjection * vec4(ndc, 1.0, 1.0);
+    nearPoint /= nearPoint.w;
+    farPoint /= farPoint.w;
+    return mix(nearPoint.xyz, farPoint.xyz, (viewZ - nearPoint.z) / (farPoint.z - nearPoint.z));
+}
+
+void main()
+{
+    uint clusterIndex = gl_GlobalInvocationID.x;
+    bool active = clusterIndex < clusterGrid.x * clusterGrid.y * clusterGrid.z;
+
+    // View space bounds of this cluster
+    uint x = clusterIndex % clusterGrid.x;
+    uint y = (clusterIndex / clusterGrid.x) % clusterGrid.y;
+    uint z = clusterIndex / (clusterGrid.x * clusterGrid.y);
+    float sliceNear = -zNear * pow(zFar / zNear, float(z) / float(clusterGrid.z));
+    float sliceFar = -zNear * pow(zFar / zNear, float(z + 1u) / float(clusterGrid.z));
+    vec2 ndcMin = vec2(x, y) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+    vec2 ndcMax = vec2(x + 1u, y + 1u) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+    vec3 a = clusterCorner(ndcMin, sliceNear);
+    vec3 b = clusterCorner(ndcMax, sliceNear);
+    vec3 c = clusterCorner(ndcMin, sliceFar);
+    vec3 d = clusterCorner(ndcMax, sliceFar);
+    vec3 aabbMin = min(min(a, b), min(c, d));
+    vec3 aabbMax = max(max(a, b), max(c, d));
+
+    uint count = 0u;
+    uint base = clusterIndex * maxLightsPerCluster;
+
+    for (uint batch = 0u; batch < lightCount; batch += 64u)
+    {
+        // each invocation moves one light of the batch into view space
+        uint loadIndex = batch + gl_LocalInvocationIndex;
+        if (loadIndex < lightCount)
+            batchLights[gl_LocalInvocationIndex] = vec4(vec3(view * vec4(lights[loadIndex].positionRange.xyz, 1.0)), lights[loadIndex].positionRange.w);
+        barrier();
+
+        uint batchSize = min(64u, lightCount - batch);
+        for (uint i = 0u; active && i < batchSize && count < maxLightsPerCluster; ++i)
+        {
+            // sphere against cluster box, unbounded lights touch every cluster
+            vec4 light = batchLights[i];
+            vec3 delta = clamp(light.xyz, aabbMin, aabbMax) - light.xyz;
+            if (light.w <= 0.0 || dot(delta, delta) <= light.w * light.w)
+            {
+                clusterLightIndices[base + count] = batch + i;
+                ++count;
+            }
+        }
+        barrier();
+    }
+
+    if (active)
+        clusterLightCounts[clusterIndex] = count;
+}
+);
+
+
+/* Depth pre-pass Vertex Shader Source Code, cameraBlockSource is injected after the #version line*/
+const GLchar* depthVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+invariant gl_Position; // must match the shading pass exactly for the GL_EQUAL depth test
+
+layout(location = 0) uniform mat4 model;
+
+void main()
+{
+    gl_Position = camera.projection * camera.view * model * vec4(position, 1.0f); // same transform as vertexShaderSource
+}
+);
+
+
+/* Shadow Caster Vertex Shader Source Code, the position-only streams seen from a light*/
+const GLchar* shadowCasterVertexShaderSource = GLSL(440,
+    layout(location = 0) in vec3 position;
+
+layout(location = 0) uniform mat4 model;
+layout(location = 15) uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * model * vec4(position, 1.0f);
+}
+);
+
+
+/* Depth pre-pass and Shadow Caster Fragment Shader Source Code*/
+const GLchar* depthFragmentShaderSource = GLSL(440,
+void main()
+{
+    // depth only, color writes are masked off during the pre-pass and shadow maps have no color
+}
+);
+
+
+/* Present Fragment Shader Source Code, drawn with fullscreenVertexShaderSource to put the off-screen frame in the window:
+   rotated to the newest view for the before-swap latch, upscaled (and sharpened) for dynamic resolution*/
+const GLchar* presentFragmentShaderSource = GLSL(440,
+    layout(location = 0) out vec4 fragmentColor;
+
+layout(binding = 0) uniform sampler2D sceneColor;
+layout(location = 0) uniform mat4 reprojection; // newest clip space to the clip space the frame was drawn in
+layout(location = 1) uniform vec2 screenSize;
+layout(location = 2) uniform vec2 renderSize; // the drawn part of sceneColor, in texels from the lower left
+layout(location = 3) uniform float sharpness; // 0 = bilinear
+
+void main()
+{
+    // rotation only, so any depth gives the same direction; the far plane is used
+    vec2 ndc = gl_FragCoord.xy / screenSize * 2.0f - 1.0f;
+    vec4 source = reprojection * vec4(ndc, 1.0f, 1.0f);
+    vec2 uv = source.xy / source.w * 0.5f + 0.5f;
+    bool inside = source.w > 0.0f && all(greaterThanEqual(uv, vec2(0.0f))) && all(lessThanEqual(uv, vec2(1.0f)));
+    if (!inside)
+    {
+        fragmentColor = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    // bilinear, kept half a texel inside the drawn part so nothing outside it bleeds in
+    vec2 texel = 1.0f / vec2(textureSize(sceneColor, 0));
+    vec2 lowest = 0.5f * texel;
+    vec2 highest = (renderSize - 0.5f) * texel;
+    vec2 center = clamp(uv * renderSize * texel, lowest, highest);
+    vec3 color = texture(sceneColor, center).rgb;
+
+    if (sharpness > 0.0f)
+    {
+        // contrast adaptive sharpening: a cross of neighbours one source texel away, sharpened less where the
+        // local contrast is already high so edges do not ring
+        vec3 north = texture(sceneColor, clamp(center + vec2(0.0f, texel.y), lowest, highest)).rgb;
+        vec3 south = texture(sceneColor, clamp(center - vec2(0.0f, texel.y), lowest, highest)).rgb;
+        vec3 east = texture(sceneColor, clamp(center + vec2(texel.x, 0.0f), lowest, highest)).rgb;
+        vec3 west = texture(sceneColor, clamp(center - vec2(texel.x, 0.0f), lowest, highest)).rgb;
+        vec3 minimum = min(color, min(min(north, south), min(east, west)));
+        vec3 maximum = max(color, max(max(north, south), max(east, west)));
+        vec3 contrast = sqrt(clamp(min(minimum, 1.0f - maximum) / max(maximum, vec3(1e-4f)), 0.0f, 1.0f));
+        vec3 weight = -0.125f * sharpness * contrast;
+        color = clamp((color + weight * (north + south + east + west)) / (1.0f + 4.0f * weight), 0.0f, 1.0f);
+    }
+    fragmentColor = vec4(color, 1.0f);
+}
+);
+
+
+/* Fallback Fragment Shader Source Code, drawn with vertexShaderSource (or multiViewVertexShaderSource) while the object's variant is still compiling.
+   cameraBlockSource is injected after the #version line*/
+const GLchar* fallbackFragmentShaderSource = GLSL(440,
+    layout(location = 0) in vec3 vertexNormal;
+layout(location = 1) in vec3 vertexFragmentPos;
+layout(location = 2) in vec2 vertexTextureCoordinate;
+layout(location = 5) flat in uint vertexViewIndex;
+layout(location = 0) out vec4 fragmentColor;
+
+layout(binding = 0) uniform sampler2D uTexture;
+layout(location = 12) uniform vec2 uvScale;
+
+void main()
+{
+    // unshadowed headlight, just enough shading to read the shapes
+    float facing = max(dot(normalize(vertexNormal), normalize(camera.viewPositions[vertexViewIndex].xyz - vertexFragmentPos)), 0.0f);
+    fragmentColor = vec4(texture(uTexture, vertexTextureCoordinate * uvScale).rgb * (0.3f + 0.7f * facing), 1.0f);
+}
+);
+
+
+/* Fallback Deferred Lighting Fragment Shader Source Code, shows the unlit albedo while the lighting variant is still compiling*/
+const GLchar* fallbackDeferredFragmentShaderSource = GLSL(440,
+    layout(location = 0) out vec4 fragmentColor;
+
+layout(binding = 0) uniform sampler2D gAlbedo;
+layout(binding = 2) uniform sampler2D gDepth;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (texelFetch(gDepth, pixel, 0).r >= 1.0f)
+        discard;
+    fragmentColor = vec4(texelFetch(gAlbedo, pixel, 0).rgb * 0.6f, 1.0f);
+}
+);
+
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
+void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+    for (int j = 0; j < height / 2; ++j)
+    {
+        int index1 = j * width * channels;
+        int index2 = (height - 1 - j) * width * channels;
+
+        for (int i = width * channels; i > 0; --i)
+        {
+            unsigned char tmp = image[index1];
+            image[index1] = image[index2];
+            image[index2] = tmp;
+            ++index1;
+            ++index2;
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    TRACE_THREAD_NAME("main");
+    UParseCommandLine(argc, argv);
+
+    // Build step mode: write the GLSL the SPIR-V modules are compiled from, no window needed
+    if (!gExportShaderDirectory.empty())
+        return UExportShaders(gExportShaderDirectory) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (gCheckAllocations && !AllocationCounter::Enabled())
+    {
+        cout << "ERROR: --check-allocations needs a build with TRACK_ALLOCATIONS defined" << endl;
+        return EXIT_FAILURE;
+    }
+
+    // CPU rendering mode: no window and no GL context, for machines without a GPU
+    if (!gSoftwareImagePath.empty())
+        return URunSoftwareRenderer(gSoftwareImagePath);
+    if (!gRayTraceImagePath.empty())
+        return URunRayTracer(gRayTraceImagePath);
+    if (gBakeLightmaps)
+        return UBakeLightmaps();
+    if (gBenchmarkPhong)
+        return UBenchmarkPhongKernels();
+
+    if (!UInitialize(argc, argv, &gWindow))
+        return EXIT_FAILURE;
+
+    // Micro-benchmark mode: only needs the context
+    if (gBenchmarkMeshDraw)
+    {
+        const int result = UBenchmarkMeshDraw();
+        glfwTerminate();
+        return result;
+    }
+
+    // Use the precompiled SPIR-V lighting shaders when the driver and the build provide them
+    ULoadSpirvModules();
+
+    // Startup is timed up to the first presented frame, which is where the shader variants get built
+    gStartupStart = glfwGetTime();
+
+    // Create the mesh
+    UCreateTableMesh(gMesh); // Calls the function to create the table mesh
+    UCreateBowlMesh(gMesh); // calls the function to create the bowl mesh
+    UCreatePlantarMesh(gMesh);  //calls the function to create the plantar mesh
+    UCreateDirtMesh(gMesh);  //calls the function to create the dirt mesh
+    UCreateGrinderMesh(gMesh);  //calls the function to create the dirt mesh
+
+    // Create the shader programs, the lighting programs are shader variants built in the background
+    if (!UCreateShaderProgram(UInjectAfterVersion(depthVertexShaderSource, UCameraBlockSource().c_str()).c_str(), depthFragmentShaderSource, gDepthProgramId))
+        return EXIT_FAILURE;
+
+    if (!UCreateShaderProgram(shadowCasterVertexShaderSource, depthFragmentShaderSource, gShadowCasterProgramId))
+        return EXIT_FAILURE;
+
+    if (!UCreateFallbackPrograms())
+        return EXIT_FAILURE;
+
+    if (!UCreateComputeProgram(clusterComputeShaderSource, gClusterProgramId))
+        return EXIT_FAILURE;
+
+    // Create the light and cluster storage buffers
+    UCreateLightBuffers();
+
+    // Create the camera block ring the scene passes read the latched camera from, and the latency timestamps
+    UCreateCameraBlocks();
+    UCreateLatencyQueries();
+
+    // Create the shadow maps and their timer queries
+    UCreateShadowMaps();
+
+    // Per-frame statistics: pipeline statistics queries when the driver has them, and the per-run CSV dump
+    UCreateStatsQueries();
+    if (!gStats.OpenLog(gStatsLogPath))
+        cout << "WARNING: cannot write the frame statistics to " << gStatsLogPath << endl;
+
+    // Create the deferred path's G-buffer
+    if (gDeferredShading && !UCreateGBuffer(gFramebufferSize.x, gFramebufferSize.y))
+        return EXIT_FAILURE;
+
+    // Fullscreen passes: deferred lighting and presenting the off-screen frame
+    glCreateVertexArrays(1, &gFullscreenVao);
+    if (!UCreateShaderProgram(fullscreenVertexShaderSource, presentFragmentShaderSource, gPresentProgramId))
+        return EXIT_FAILURE;
+
+    // GPU frame timing of dynamic resolution
+    gResolution.Create();
+
+    // Load texture
+    if (!UCreateTexture(TABLE_TEXTURE_FILE, gTextureTableId))
+        return EXIT_FAILURE;
+
+    // Load texture
+    if (!UCreateTexture(BOWL_TEXTURE_FILE, gTextureBowlId))
+        return EXIT_FAILURE;
+
+    // Load texture
+    if (!UCreateTexture(GRINDER_TEXTURE_FILE, gTextureGrinderId))
+        return EXIT_FAILURE;
+
+    // Load texture
+    if (!UCreateTexture(PLANTAR_TEXTURE_FILE, gTexturePlantarId))
+        return EXIT_FAILURE;
+
+    // Load texture
+    if (!UCreateTexture(DIRT_TEXTURE_FILE, gTextureDirtId))
+        return EXIT_FAILURE;
+
+    // Sets the background color of the window to black (it will be implicitely used by glClear)
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+    // Gather the opaque draws now that meshes, programs and textures exist
+    UBuildDrawList();
+
+    // Baked key light of the static objects, when --bake-lightmaps has been run
+    ULoadLightmaps();
+
+    // Submit every variant the scene is expected to need, the driver compiles them while the first frames draw
+    UPrewarmShaderVariants();
+
+    // The software renderer's copy of the scene, compared with the GL frames once they settle
+    if (gSoftwareCompare && !UCreateSoftwareScene())
+        return EXIT_FAILURE;
+
+    // Setup bound objects directly, start the frame loop from unknown state
+    gState.Invalidate();
+
+    // Allocations are attributed to the frame that closes after them, so event handling is included
+    gAllocationMark = AllocationCounter::Total();
+
+    // render loop
+    // -----------
+    if (gThreadedLoop)
+        URunThreadedLoop();
+    else
+    {
+        while (!glfwWindowShouldClose(gWindow))
+        {
+            TRACE_SCOPE("frame");
+
+            // frames in flight and the frame rate cap, before the input is sampled so the wait adds no latency
+            gPacer.BeginFrame();
+
+            // per-frame timing
+            // --------------------
+            const double frameStart = glfwGetTime();
+            float currentFrame = frameStart;
+            gDeltaTime = currentFrame - gLastFrame;
+            gLastFrame = currentFrame;
+            gSceneTime = frameStart;
+
+            // input
+            // -----
+            gSceneDirty = false;    // this frame shows every change so far
+            UProcessInput(gWindow);
+
+            // Render this frame
+            UDrawFrame(frameStart);
+
+            UWaitForChanges();
+        }
+    }
+
+    // Release mesh data
+    UDestroyMesh(gMesh);
+
+    // Release texture
+    UDestroyTexture(gTextureTableId);
+    UDestroyTexture(gTextureBowlId);
+    UDestroyTexture(gTexturePlantarId);
+    UDestroyTexture(gTextureDirtId);
+    UDestroyTexture(gTextureGrinderId);
+    UDestroyLightmaps();
+
+    // Report and release the shader variants
+    cout << "INFO: " << gShaderVariants.size() << " shader variants built (" << gPendingShaderVariants.size() << " unfinished), main thread blocked "
+        << gShaderVariantBlockingMs << " ms on them" << endl;
+    UDestroyShaderVariants();
+
+    // Release shader program
+    UDestroyShaderProgram(gDepthProgramId);
+    UDestroyShaderProgram(gShadowCasterProgramId);
+    UDestroyShaderProgram(gClusterProgramId);
+    UDestroyShaderProgram(gPresentProgramId);
+
+    // Release light buffers
+    UDestroyLightBuffers();
+
+    // Release the camera blocks, the pacing fences, the timer queries and the off-screen frame
+    UDestroyCameraBlocks();
+    gPacer.Destroy();
+    gResolution.Destroy();
+    UDestroyLatencyQueries();
+    UDestroySceneTarget();
+
+    // Release shadow maps
+    UDestroyShadowMaps();
+
+    // Release the statistics queries
+    UDestroyStatsQueries();
+
+    // Write the trace of the last frames
+#ifdef ENABLE_TRACING
+    if (!gTracePath.empty())
+    {
+        if (Tracer::Write(gTracePath))
+            cout << "INFO: Trace written to " << gTracePath << " (" << GpuTracer::Current().Dropped() << " GPU slices dropped)" << endl;
+        else
+            cout << "WARNING: cannot write the trace to " << gTracePath << endl;
+    }
+#else
+    if (!gTracePath.empty())
+        cout << "WARNING: --trace needs a build with ENABLE_TRACING defined (the Debug configurations)" << endl;
+#endif
+
+    // Release the deferred path
+    if (gDeferredShading)
+        UDestroyGBuffer();
+    glDeleteVertexArrays(1, &gFullscreenVao);
+
+    if (gCheckAllocations)
+    {
+        const bool passed = gAllocationCheckedFrames == ALLOCATION_CHECK_FRAMES && gAllocatingFrames == 0;
+        cout << "ALLOCATION CHECK " << (passed ? "PASSED" : "FAILED") << ": " << gAllocatingFrames << " of " << gAllocationCheckedFrames
+            << " steady-state frames allocated (after " << gAllocationWarmupFrames << " warm-up frames), frame arena high water "
+            << gFrameArena.HighWater() << " of " << gFrameArena.Capacity() << " bytes, " << gFrameArena.Overflows() << " overflows" << endl;
+        exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (gSoftwareCompare)
+        exit(gSoftwareComparePassed ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    exit(EXIT_SUCCESS); // Terminates the program successfully
+}
+
+
+// Reads the startup options
+void UParseCommandLine(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--deferred")
+            gDeferredShading = true;
+        else if (arg == "--forward")
+            gDeferredShading = false;
+        else if (arg == "--no-program-cache")
+            ProgramCache::Enabled() = false;
+        else if (arg == "--glsl")
+            gSpirvAllowed = false;
+        else if (arg == "--export-shaders" && i + 1 < argc)
+            gExportShaderDirectory = argv[++i];
+        else if (arg == "--stats" && i + 1 < argc)
+            gStatsLogPath = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc)
+            gTracePath = argv[++i];
+        else if (arg == "--check-allocations")
+            gCheckAllocations = true;
+        else if (arg == "--bench-mesh-draw")
+            gBenchmarkMeshDraw = true;
+        else if (arg == "--software" && i + 1 < argc)
+            gSoftwareImagePath = argv[++i];
+        else if (arg == "--software-compare")
+            gSoftwareCompare = true;
+        else if (arg == "--bench-phong")
+            gBenchmarkPhong = true;
+        else if (arg == "--raytrace" && i + 1 < argc)
+            gRayTraceImagePath = argv[++i];
+        else if (arg == "--bake-lightmaps")
+            gBakeLightmaps = true;
+        else if (arg == "--on-demand")
+            gOnDemandRendering = true;
+        else if (arg == "--threaded")
+            gThreadedLoop = true;
+        else if (arg == "--latch" && i + 1 < argc)
+        {
+            const string mode = argv[++i];
+            if (mode == "frame-start")
+                gLatchMode = LATCH_FRAME_START;
+            else if (mode == "draw")
+                gLatchMode = LATCH_BEFORE_DRAW;
+            else if (mode == "swap")
+                gLatchMode = LATCH_BEFORE_SWAP;
+            else
+                cout << "Unknown latch mode " << mode << " (frame-start, draw, swap)" << endl;
+        }
+        else if (arg == "--pacing" && i + 1 < argc)
+        {
+            const string mode = argv[++i];
+            if (mode == "vsync")
+                gPacer.SetMode(FramePacer::VSYNC);
+            else if (mode == "adaptive")
+                gPacer.SetMode(FramePacer::ADAPTIVE_VSYNC);
+            else if (mode == "uncapped")
+                gPacer.SetMode(FramePacer::UNCAPPED);
+            else if (mode == "cap")
+                gPacer.SetMode(FramePacer::CAPPED);
+            else
+                cout << "Unknown pacing mode " << mode << " (vsync, adaptive, uncapped, cap)" << endl;
+        }
+        else if (arg == "--fps-cap" && i + 1 < argc)
+        {
+            gPacer.SetCap(atof(argv[++i]));
+            gPacer.SetMode(FramePacer::CAPPED);
+        }
+        else if (arg == "--frames-in-flight" && i + 1 < argc)
+            gPacer.SetFramesInFlight(atoi(argv[++i]));
+        else if (arg == "--dynamic-resolution" && i + 1 < argc)
+        {
+            gDynamicResolution = true;
+            gResolution.SetBudget(atof(argv[++i]));
+        }
+        else if (arg == "--sharpen" && i + 1 < argc)
+            gSharpness = glm::clamp(float(atof(argv[++i])), 0.0f, 1.0f);
+        else if (arg == "--multiview" && i + 1 < argc)
+        {
+            const string mode = argv[++i];
+            int m = 0;
+            while (m < MULTIVIEW_MODE_COUNT && mode != MULTIVIEW_MODE_NAMES[m])
+                ++m;
+            if (m < MULTIVIEW_MODE_COUNT)
+                gMultiView = MultiViewMode(m);
+            else
+                cout << "Unknown multi-view mode " << mode << " (off, stereo, quad)" << endl;
+        }
+        else if (arg == "--multiview-passes")
+            gMultiViewPasses = true;
+        else if (arg == "--measure-latency")
+        {
+            gMeasureLatency = true;
+            gLatchMode = LATCH_FRAME_START;     // then every other mode in turn
+        }
+        else
+            cout << "Unknown option " << arg << " (options: --forward, --deferred, --no-program-cache, --glsl, --export-shaders <dir>, --stats <file>, --trace <file>, --check-allocations, --bench-mesh-draw, --software <file>, --software-compare, --bench-phong, --raytrace <file>, --bake-lightmaps, --on-demand, --threaded, --latch <frame-start|draw|swap>, --measure-latency, --pacing <vsync|adaptive|uncapped|cap>, --fps-cap <fps>, --frames-in-flight <1-3>, --dynamic-resolution <gpu ms>, --sharpen <0-1>, --multiview <off|stereo|quad>, --multiview-passes)" << endl;
+    }
+
+    cout << "INFO: Render path: " << (gDeferredShading ? "deferred" : "forward") << endl;
+    cout << "INFO: Program binary cache: " << (ProgramCache::Enabled() ? ProgramCache::Directory() : string("disabled")) << endl;
+    cout << "INFO: Rendering: " << (gThreadedLoop ? "simulation and render threads" : gOnDemandRendering ? "on demand" : "continuous") << endl;
+    if (gResolution.Budget() <= 0.0)
+        gResolution.SetBudget(DEFAULT_GPU_BUDGET_MS);
+    UApplyDynamicResolution();
+    cout << "INFO: Camera latch: " << (gMeasureLatency ? "measuring every mode" : LATCH_MODE_NAMES[gLatchMode]) << endl;
+}
+
+
+// Initialize GLFW, GLEW, and create a window
+bool UInitialize(int argc, char* argv[], GLFWwindow** window)
+{
+    // GLFW: initialize and configure
+    // ------------------------------
+    glfwInit();
+    // 4.5: resources are created with direct state access and immutable storage, without it the window fails
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+    // GLFW: window creation
+    // ---------------------
+    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+    if (*window == NULL)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(*window);
+    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+    glfwSetCursorPosCallback(*window, UMousePositionCallback);
+    glfwSetScrollCallback(*window, UMouseScrollCallback);
+    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+    glfwSetKeyCallback(*window, USingleKeyPressCallBack);
+    glfwSetWindowRefreshCallback(*window, UWindowRefreshCallback);
+
+    // tell GLFW to capture our mouse
+    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+    // GLEW: initialize
+    // ----------------
+    // Note: if using GLEW version 1.13 or earlier
+    glewExperimental = GL_TRUE;
+    GLenum GlewInitResult = glewInit();
+
+    if (GLEW_OK != GlewInitResult)
+    {
+        std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
+        return false;
+    }
+
+    // The framebuffer can be larger than the window on high DPI displays
+    glfwGetFramebufferSize(*window, &gFramebufferSize.x, &gFramebufferSize.y);
+
+    // Displays GPU OpenGL version
+    cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
+
+    // Let the driver compile on as many threads as it likes, builds are then polled instead of waited on
+    if (GLEW_KHR_parallel_shader_compile)
+    {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        gParallelShaderCompile = true;
+    }
+    cout << "INFO: Parallel shader compile: " << (gParallelShaderCompile ? "yes" : "no (variant builds block)") << endl;
+
+    // Multi-view draws every view in one pass when the vertex shader can pick the viewport
+    if (GLEW_ARB_shader_viewport_layer_array)
+        gViewportIndexExtension = "GL_ARB_shader_viewport_layer_array";
+    else if (GLEW_AMD_vertex_shader_viewport_index)
+        gViewportIndexExtension = "GL_AMD_vertex_shader_viewport_index";
+    cout << "INFO: Multi-view: " << MULTIVIEW_MODE_NAMES[gMultiView] << ", " << (gViewportIndexExtension && !gMultiViewPasses ? "one pass with " : "one pass per view")
+        << (gViewportIndexExtension && !gMultiViewPasses ? gViewportIndexExtension : "") << endl;
+
+    // Pacing is set explicitly, the driver default swap interval differs between vendors and control panels
+    gSwapTearSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    if (gPacer.Cap() <= 0.0)
+        gPacer.SetCap(DEFAULT_FRAME_CAP);
+    UApplyPacing();
+
+    return true;
+}
+
+
+// Starts dynamic resolution at full scale, or leaves it
+void UApplyDynamicResolution()
+{
+    gResolution.Reset();
+    cout << "INFO: Dynamic resolution: ";
+    if (gDynamicResolution)
+        cout << gResolution.Budget() << " ms GPU budget, " << (gSharpness > 0.0f ? "sharpened" : "bilinear") << " upscale" << endl;
+    else
+        cout << "off" << endl;
+}
+
+
+// Sets the swap interval of the pacing mode, for the context current on this thread
+void UApplyPacing()
+{
+    const FramePacer::Mode mode = gPacer.GetMode();
+    glfwSwapInterval(FramePacer::SwapInterval(mode, gSwapTearSupported));
+    cout << "INFO: Frame pacing: " << FramePacer::ModeName(mode);
+    if (mode == FramePacer::ADAPTIVE_VSYNC && !gSwapTearSupported)
+        cout << " (no swap_control_tear, vsync)";
+    if (mode == FramePacer::CAPPED)
+        cout << " at " << gPacer.Cap() << " fps";
+    cout << ", " << gPacer.FramesInFlight() << " frames in flight" << endl;
+}
+
+
+// Draws and presents one frame of the scene as gCamera sees it at gSceneTime, then does the per-frame
+// bookkeeping: statistics, the title, and the checks that end the run
+void UDrawFrame(double frameStart)
+{
+    // last frame's transient data is dead now
+    gFrameArena.Reset();
+
+    // keys and resizes held back by the render thread or a mid-frame latch
+    {
+        std::lock_guard<std::mutex> lock(gSimulationMutex);
+        gAppliedKeys.swap(gPendingKeys);
+    }
+    for (int key : gAppliedKeys)
+        UApplyKey(key);
+    gAppliedKeys.clear();
+    if (gDeferredResize.x >= 0)
+    {
+        UResizeWindow(gWindow, gDeferredResize.x, gDeferredResize.y);
+        gDeferredResize = glm::ivec2(-1, -1);
+    }
+
+    URender();
+    UUpdateWindowTitle();
+    gState.EndFrame();
+    const unsigned int frameAllocations = (unsigned int)(AllocationCounter::Total() - gAllocationMark);
+    gAllocationMark = AllocationCounter::Total();
+    gStats.Memory(frameAllocations, gFrameArena.Used());
+    gStats.EndFrame(gState.LastFrame(), float((glfwGetTime() - frameStart) * 1000.0));
+
+    if (gCheckAllocations && UCheckAllocations(frameAllocations))
+        glfwSetWindowShouldClose(gWindow, true);
+
+    if (gSoftwareCompare && UCompareSoftwareFrame())
+        glfwSetWindowShouldClose(gWindow, true);
+
+    if (gMeasureLatency && UMeasureLatency())
+        glfwSetWindowShouldClose(gWindow, true);
+
+    if (gFirstFrame)
+    {
+        // Cold start = programs compiled from source, warm start = programs restored from the binary cache
+        const ProgramCache::Stats& cacheStats = ProgramCache::GetStats();
+        cout << "INFO: Startup took " << (glfwGetTime() - gStartupStart) * 1000.0 << " ms ("
+            << (cacheStats.hits > 0 && cacheStats.misses == 0 ? "warm" : "cold") << "): "
+            << cacheStats.hits << " programs from the binary cache, " << cacheStats.misses << " compiled from source ("
+            << cacheStats.rejected << " cached binaries rejected), " << cacheStats.stored << " binaries stored" << endl;
+        gFirstFrame = false;
+    }
+}
+
+
+// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+void UProcessInput(GLFWwindow* window)
+{
+    TRACE_SCOPE("UProcessInput");
+
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
+
+    // monitor key press to move camera
+    const glm::vec3 previousPosition = gInputCamera->Position;
+    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(FORWARD, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(BACKWARD, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(LEFT, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(RIGHT, gDeltaTime);
+    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(UP, gDeltaTime);  // added enum to camera class
+    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        gInputCamera->ProcessKeyboard(DOWN, gDeltaTime);  // added enum to camera class
+
+    // a held movement key keeps the on-demand loop drawing
+    if (gInputCamera->Position != previousPosition)
+        gSceneDirty = true;
+}
+
+// handles single key press so that perspective/ortho can be changed only once on p press
+void USingleKeyPressCallBack(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    // any key can change what is drawn
+    gSceneDirty = true;
+    if (action != GLFW_PRESS)
+        return;
+
+    // the settings belong to the render thread, which applies the keys at its next frame; keys handled by a
+    // mid-frame latch wait for the next frame too
+    if (gThreadedLoop || gLatchingInput)
+    {
+        std::lock_guard<std::mutex> lock(gSimulationMutex);
+        gPendingKeys.push_back(key);
+        return;
+    }
+    UApplyKey(key);
+}
+
+
+// Switches the render settings bound to a key
+void UApplyKey(int key)
+{
+    if (key == GLFW_KEY_P)
+    {
+        // change the state to the opposite of current state
+        perspective_state = abs(perspective_state - 1);
+    }
+
+    // Z toggles the depth pre-pass so both modes can be compared at runtime
+    if (key == GLFW_KEY_Z)
+    {
+        gDepthPrepass = !gDepthPrepass;
+        cout << "Depth pre-pass " << (gDepthPrepass ? "enabled" : "disabled") << endl;
+    }
+
+    // L cycles the number of extra dynamic lights
+    if (key == GLFW_KEY_L)
+    {
+        const int lightSteps[] = { 0, 100, 300, (int)MAX_LIGHTS - 2 };
+        const int stepCount = sizeof(lightSteps) / sizeof(lightSteps[0]);
+        int step = 0;
+        while (step < stepCount && lightSteps[step] != gDynamicLightCount)
+            ++step;
+        gDynamicLightCount = lightSteps[(step + 1) % stepCount];
+        cout << "Dynamic lights: " << gDynamicLightCount << endl;
+    }
+
+    // K compares cached static shadow maps against re-rendering every caster each frame
+    if (key == GLFW_KEY_K)
+    {
+        gShadowCacheEnabled = !gShadowCacheEnabled;
+        cout << "Shadow cache " << (gShadowCacheEnabled ? "enabled" : "disabled (naive per-frame shadow pass)") << endl;
+    }
+
+    // F cycles the PCF kernel
+    if (key == GLFW_KEY_F)
+    {
+        gPcfRadius = (gPcfRadius + 1) % 3;
+        cout << "PCF kernel: " << (2 * gPcfRadius + 1) << "x" << (2 * gPcfRadius + 1) << endl;
+    }
+
+    // H toggles shadows, which switches every lighting program to a variant without shadow sampling
+    if (key == GLFW_KEY_H)
+    {
+        gShadowsEnabled = !gShadowsEnabled;
+        cout << "Shadows " << (gShadowsEnabled ? "enabled" : "disabled") << endl;
+    }
+
+    // B compares the baked key light of the static objects with lighting them live
+    if (key == GLFW_KEY_B)
+    {
+        gLightmapsEnabled = !gLightmapsEnabled;
+        cout << "Lightmaps " << (gLightmapsEnabled ? "enabled" : "disabled") << endl;
+    }
+
+    // N switches between drawing every frame and drawing only when something changed
+    if (key == GLFW_KEY_N)
+    {
+        gOnDemandRendering = !gOnDemandRendering;
+        cout << "On-demand rendering " << (gOnDemandRendering ? "enabled" : "disabled") << endl;
+    }
+
+    // J cycles when the camera is sampled: frame start, before the first draw, and again before the swap
+    if (key == GLFW_KEY_J)
+    {
+        gLatchMode = LatchMode((gLatchMode + 1) % LATCH_MODE_COUNT);
+        cout << "Camera latch: " << LATCH_MODE_NAMES[gLatchMode] << endl;
+    }
+
+    // V cycles the frame pacing: vsync, adaptive vsync, uncapped, capped
+    if (key == GLFW_KEY_V)
+    {
+        gPacer.SetMode(FramePacer::Mode((gPacer.GetMode() + 1) % FramePacer::MODE_COUNT));
+        UApplyPacing();
+    }
+
+    // R switches dynamic resolution on and off
+    if (key == GLFW_KEY_R)
+    {
+        gDynamicResolution = !gDynamicResolution;
+        UApplyDynamicResolution();
+    }
+
+    // M cycles the views: the camera, stereo, the camera with three previews
+    if (key == GLFW_KEY_M)
+    {
+        gMultiView = MultiViewMode((gMultiView + 1) % MULTIVIEW_MODE_COUNT);
+        cout << "Multi-view: " << MULTIVIEW_MODE_NAMES[gMultiView] << endl;
+    }
+
+    // O switches the camera spotlight on and off
+    if (key == GLFW_KEY_O)
+    {
+        gSpotLightColor = gSpotLightColor == glm::vec3(0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f);
+        cout << "Camera spotlight " << (gSpotLightColor != glm::vec3(0.0f) ? "on" : "off") << endl;
+    }
+}
+
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+void UResizeWindow(GLFWwindow* window, int width, int height)
+{
+    // a resize during a mid-frame latch would change targets the frame is drawing into
+    if (gLatchingInput)
+    {
+        gDeferredResize = glm::ivec2(width, height);
+        gSceneDirty = true;
+        return;
+    }
+
+    gState.Viewport(0, 0, width, height);
+    gFramebufferSize = glm::ivec2(width, height);
+    gSceneDirty = true;
+
+    // The G-buffer always matches the framebuffer (skipped while minimized)
+    if (gDeferredShading && width > 0 && height > 0)
+    {
+        UDestroyGBuffer();
+        UCreateGBuffer(width, height);
+
+        // the G-buffer setup binds its framebuffer and textures directly
+        gState.Invalidate();
+    }
+
+    // recreated at the new size when next drawn into
+    UDestroySceneTarget();
+}
+
+
+// glfw: whenever the mouse moves, this callback is called
+// -------------------------------------------------------
+void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
+{
+    if (gFirstMouse)
+    {
+        gLastX = xpos;
+        gLastY = ypos;
+        gFirstMouse = false;
+    }
+
+    float xoffset = xpos - gLastX;
+    float yoffset = gLastY - ypos; // reversed since y-coordinates go from bottom to top
+
+    gLastX = xpos;
+    gLastY = ypos;
+
+    gInputCamera->ProcessMouseMovement(xoffset, yoffset);
+    gSceneDirty = true;
+}
+
+
+// glfw: whenever the mouse scroll wheel scrolls, this callback is called
+// ----------------------------------------------------------------------
+void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    gInputCamera->ProcessMouseScroll(yoffset);
+    gSceneDirty = true;
+}
+
+// glfw: handle mouse button events
+// --------------------------------
+void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+{
+    switch (button)
+    {
+    case GLFW_MOUSE_BUTTON_LEFT:
+    {
+        if (action == GLFW_PRESS)
+            cout << "Left mouse button pressed" << endl;
+        else
+            cout << "Left mouse button released" << endl;
+    }
+    break;
+
+    case GLFW_MOUSE_BUTTON_MIDDLE:
+    {
+        if (action == GLFW_PRESS)
+            cout << "Middle mouse button pressed" << endl;
+        else
+            cout << "Middle mouse button released" << endl;
+    }
+    break;
+
+    case GLFW_MOUSE_BUTTON_RIGHT:
+    {
+        if (action == GLFW_PRESS)
+            cout << "Right mouse button pressed" << endl;
+        else
+            cout << "Right mouse button released" << endl;
+    }
+    break;
+
+    default:
+        cout << "Unhandled mouse button event" << endl;
+        break;
+    }
+}
+
+
+// glfw: the window contents were lost (uncovered, restored), on-demand rendering has to draw them again
+void UWindowRefreshCallback(GLFWwindow* window)
+{
+    gSceneDirty = true;
+}
+
+
+// True while the picture changes without any input: orbiting dynamic lights, moving objects, and the
+// frame-counting checks and measurements that need a steady stream of frames
+bool USceneAnimating()
+{
+    if (gDynamicLightCount > 0 || gCheckAllocations || gSoftwareCompare || gMeasureLatency)
+        return true;
+
+    for (const GLDrawItem& item : gDrawItems)
+    {
+        if (item.dynamic)
+            return true;
+    }
+    return false;
+}
+
+
+// Handles the window events of the frame. Continuous rendering only polls them; on-demand rendering sleeps
+// in glfwWaitEvents until an event marks the scene dirty, so a still scene costs no CPU or GPU time.
+// Time spent asleep is left out of the camera's frame delta and the frame time in the title.
+void UWaitForChanges()
+{
+    TRACE_SCOPE("UWaitForChanges");
+
+    glfwPollEvents();
+    if (!gOnDemandRendering || gSceneDirty || USceneAnimating())
+        return;
+
+    const double idleStart = glfwGetTime();
+    while (!gSceneDirty && !glfwWindowShouldClose(gWindow))
+    {
+        // pending variants are only picked up by drawing, so wake up now and then until they are ready
+        if (gPendingShaderVariants.empty())
+            glfwWaitEvents();
+        else
+        {
+            glfwWaitEventsTimeout(SHADER_BUILD_POLL_SECONDS);
+            gSceneDirty = true;
+        }
+    }
+
+    const float idleSeconds = float(glfwGetTime() - idleStart);
+    gLastFrame += idleSeconds;
+    gTitleLastTime += idleSeconds;
+    gPacer.Idle();
+}
+
+
+// --threaded: the main thread handles the window events and advances the camera by fixed SIMULATION_TICK_SECONDS
+// steps, publishing a snapshot after each; the render thread owns the GL context and draws the newest snapshot,
+// interpolated to one tick in the past so it always lies between two known poses. A slow frame no longer
+// delays input, and input handling no longer delays the frame. Returns when the window closes.
+void URunThreadedLoop()
+{
+    gSimulationCamera = gCamera;
+    gInputCamera = &gSimulationCamera;
+    gSimulationFramebufferSize = gFramebufferSize;
+    glfwSetFramebufferSizeCallback(gWindow, USimulationResize);
+    gDeltaTime = float(SIMULATION_TICK_SECONDS);    // UProcessInput moves the camera by one tick
+
+    double simulationTime = glfwGetTime();
+    gSnapshots.Write() = { gSimulationCamera, gSimulationCamera, simulationTime, gSimulationFramebufferSize };
+    gSnapshots.Publish();
+
+    // the render thread owns the context from here on
+    glfwMakeContextCurrent(nullptr);
+    std::thread renderThread(URenderThread);
+
+    unsigned long long ticks = 0;
+    while (!glfwWindowShouldClose(gWindow))
+    {
+        // sleeps until the next tick is due, or handles input as soon as it arrives
+        glfwWaitEventsTimeout((std::max)(simulationTime + SIMULATION_TICK_SECONDS - glfwGetTime(), 0.0));
+
+        {
+            std::lock_guard<std::mutex> lock(gSimulationMutex);
+            if (gPendingTitle[0] != '\0')
+            {
+                glfwSetWindowTitle(gWindow, gPendingTitle);
+                gPendingTitle[0] = '\0';
+            }
+        }
+
+        // after a stall (window dragged, breakpoint) drop the backlog instead of fast-forwarding through it
+        const double now = glfwGetTime();
+        if (now - simulationTime > SIMULATION_MAX_LAG_SECONDS)
+            simulationTime = now - SIMULATION_TICK_SECONDS;
+        if (now < simulationTime + SIMULATION_TICK_SECONDS)
+            continue;
+
+        TRACE_SCOPE("simulation ticks");
+        Camera previousCamera = gSimulationCamera;
+        while (simulationTime + SIMULATION_TICK_SECONDS <= now)
+        {
+            previousCamera = gSimulationCamera;
+            UProcessInput(gWindow);
+            simulationTime += SIMULATION_TICK_SECONDS;
+            ++ticks;
+        }
+
+        SceneSnapshot& snapshot = gSnapshots.Write();
+        snapshot.previousCamera = previousCamera;
+        snapshot.camera = gSimulationCamera;
+        snapshot.time = simulationTime;
+        snapshot.framebufferSize = gSimulationFramebufferSize;
+        gSnapshots.Publish();
+    }
+
+    renderThread.join();
+    glfwMakeContextCurrent(gWindow);
+    cout << "INFO: Simulation: " << ticks << " ticks of " << SIMULATION_TICK_SECONDS * 1000.0 << " ms" << endl;
+}
+
+
+// --threaded: draws the newest snapshot until the window closes. Settings keys (in UDrawFrame) and resizes are
+// applied here, between frames, since they touch GL objects or state the frame reads.
+void URenderThread()
+{
+    TRACE_THREAD_NAME("render");
+    glfwMakeContextCurrent(gWindow);
+
+    while (!glfwWindowShouldClose(gWindow))
+    {
+        TRACE_SCOPE("frame");
+        gPacer.BeginFrame();
+        const double frameStart = glfwGetTime();
+
+        gSnapshots.Acquire();
+        const SceneSnapshot& snapshot = gSnapshots.Read();
+        if (snapshot.framebufferSize != gFramebufferSize)
+            UResizeWindow(gWindow, snapshot.framebufferSize.x, snapshot.framebufferSize.y);
+        gSceneTime = UInterpolateSnapshot(frameStart);
+
+        UDrawFrame(frameStart);
+    }
+
+    glfwMakeContextCurrent(nullptr);
+}
+
+
+// --threaded: the framebuffer size callback, the render thread resizes the GL objects when the snapshot shows it
+void USimulationResize(GLFWwindow* window, int width, int height)
+{
+    gSimulationFramebufferSize = glm::ivec2(width, height);
+    gSceneDirty = true;
+}
+
+
+// --threaded: sets gCamera to the acquired snapshot's pose one tick behind now, and returns that simulation time
+double UInterpolateSnapshot(double now)
+{
+    // t = 0 draws previousCamera, t = 1 draws camera
+    const SceneSnapshot& snapshot = gSnapshots.Read();
+    const double drawTime = now - SIMULATION_TICK_SECONDS;
+    const double previousTime = snapshot.time - SIMULATION_TICK_SECONDS;
+    const float t = glm::clamp(float((drawTime - previousTime) / SIMULATION_TICK_SECONDS), 0.0f, 1.0f);
+    gCamera.Interpolate(snapshot.previousCamera, snapshot.camera, t);
+    return previousTime + t * SIMULATION_TICK_SECONDS;
+}
+
+
+// Samples the newest camera in the middle of a frame and returns when. The single-threaded loop handles the
+// window events that arrived since the frame started, so the mouse look is current; the render thread takes
+// the newest snapshot instead. The animation time stays that of the frame start.
+double ULatchCamera()
+{
+    TRACE_SCOPE("ULatchCamera");
+
+    if (gThreadedLoop)
+    {
+        gSnapshots.Acquire();
+        UInterpolateSnapshot(glfwGetTime());
+    }
+    else
+    {
+        gLatchingInput = true;
+        glfwPollEvents();
+        gLatchingInput = false;
+    }
+    return glfwGetTime();
+}
+
+
+// Creates the ring of camera blocks, persistently mapped so a block is written with a memcpy and no GL call
+void UCreateCameraBlocks()
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    gCameraBlockStride = (sizeof(GLCameraBlock) + alignment - 1) / alignment * alignment;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &gCameraBuffer);
+    glNamedBufferStorage(gCameraBuffer, gCameraBlockStride * CAMERA_BLOCK_FRAMES, nullptr, flags);
+    gCameraBlocks = (unsigned char*)glMapNamedBufferRange(gCameraBuffer, 0, gCameraBlockStride * CAMERA_BLOCK_FRAMES, flags);
+}
+
+
+void UDestroyCameraBlocks()
+{
+    for (GLsync& fence : gCameraBlockFences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    glUnmapNamedBuffer(gCameraBuffer);
+    glDeleteBuffers(1, &gCameraBuffer);
+    gCameraBlocks = nullptr;
+}
+
+
+// Writes this frame's camera into its slot of the ring and binds it to CAMERA_BLOCK_BINDING. The slot was last
+// read CAMERA_BLOCK_FRAMES frames ago, its fence has almost always signalled by now; a slow GPU is waited for
+// as long as it takes, since the slot must not change under a draw still reading it.
+void UWriteCameraBlock(const glm::mat4& view, const glm::vec3& viewPosition)
+{
+    const int slot = gCameraBlockFrame % CAMERA_BLOCK_FRAMES;
+    if (gCameraBlockFences[slot])
+    {
+        TRACE_SCOPE("camera block fence");
+        while (glClientWaitSync(gCameraBlockFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            cout << "WARNING: Camera block " << slot << " still in use after 1 s, waiting again" << endl;
+        glDeleteSync(gCameraBlockFences[slot]);
+        gCameraBlockFences[slot] = 0;
+    }
+
+    GLCameraBlock block = { view, projection, glm::vec4(viewPosition, 1.0f) };
+    for (int i = 0; i < gViewCount; ++i)
+    {
+        block.viewProjections[i] = gViews[i].projection * gViews[i].view;
+        block.viewPositions[i] = glm::vec4(gViews[i].position, 1.0f);
+    }
+    memcpy(gCameraBlocks + slot * gCameraBlockStride, &block, sizeof(block));
+    gState.BindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, gCameraBuffer, slot * gCameraBlockStride, sizeof(GLCameraBlock));
+}
+
+
+// Fills gViews from the latched camera for the multi-view mode: the camera alone, two eyes side by side, or the
+// camera and three previews of the table in a 2x2 split. Every view keeps the window's aspect in its part of it.
+void UComputeViews(const glm::mat4& view)
+{
+    const float width = float(gRenderSize.x);
+    const float height = float(gRenderSize.y);
+    gViewCount = gMultiView == MULTIVIEW_STEREO ? 2 : gMultiView == MULTIVIEW_QUAD ? 4 : 1;
+    if (gViewCount == 1)
+    {
+        gViews[0] = { view, projection, gCamera.Position, glm::vec4(0.0f, 0.0f, width, height) };
+        return;
+    }
+
+    const float viewWidth = width / 2.0f;
+    const float viewHeight = gMultiView == MULTIVIEW_QUAD ? height / 2.0f : height;
+    const GLfloat windowAspect = gFramebufferSize.y > 0 ? (GLfloat)gFramebufferSize.x / (GLfloat)gFramebufferSize.y : (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+    const GLfloat aspect = gMultiView == MULTIVIEW_QUAD ? windowAspect : windowAspect / 2.0f;
+    const glm::mat4 viewProjection = perspective_state ? glm::perspective(glm::radians(gCamera.Zoom), aspect, Z_NEAR, Z_FAR) : projection;
+
+    if (gMultiView == MULTIVIEW_STEREO)
+    {
+        // parallel eyes half the separation left and right of the camera
+        for (int eye = 0; eye < 2; ++eye)
+        {
+            const float offset = (eye == 0 ? -0.5f : 0.5f) * STEREO_EYE_SEPARATION;
+            gViews[eye] = { glm::translate(glm::vec3(-offset, 0.0f, 0.0f)) * view, viewProjection, gCamera.Position + gCamera.Right * offset,
+                glm::vec4(eye * viewWidth, 0.0f, viewWidth, viewHeight) };
+        }
+        return;
+    }
+
+    // the camera top left, then the table from above, the front and the side
+    gViews[0] = { view, viewProjection, gCamera.Position, glm::vec4(0.0f, viewHeight, viewWidth, viewHeight) };
+    const glm::vec3 eyes[3] = { glm::vec3(0.0f, PREVIEW_CAMERA_DISTANCE, 0.0f), glm::vec3(0.0f, 1.0f, PREVIEW_CAMERA_DISTANCE), glm::vec3(PREVIEW_CAMERA_DISTANCE, 1.0f, 0.0f) };
+    const glm::vec3 ups[3] = { glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+    const glm::vec4 viewports[3] = { glm::vec4(viewWidth, viewHeight, viewWidth, viewHeight), glm::vec4(0.0f, 0.0f, viewWidth, viewHeight), glm::vec4(viewWidth, 0.0f, viewWidth, viewHeight) };
+    for (int i = 0; i < 3; ++i)
+        gViews[i + 1] = { glm::lookAt(eyes[i], gTablePosition, ups[i]), viewProjection, eyes[i], viewports[i] };
+}
+
+
+// Fences the slot the frame read, after the swap so the fence follows every command of the frame
+void UEndCameraBlock()
+{
+    gCameraBlockFences[gCameraBlockFrame % CAMERA_BLOCK_FRAMES] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++gCameraBlockFrame;
+}
+
+
+// Off-screen color and depth the before-swap latch and dynamic resolution draw the frame into, created at the
+// framebuffer size on first use; dynamic resolution uses the lower left part of it
+GLuint USceneTarget()
+{
+    if (gSceneTargetFbo)
+        return gSceneTargetFbo;
+
+    const GLsizei width = (std::max)(gFramebufferSize.x, 1);
+    const GLsizei height = (std::max)(gFramebufferSize.y, 1);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &gSceneTargetColor);
+    glTextureStorage2D(gSceneTargetColor, 1, GL_RGBA8, width, height);
+    glTextureParameteri(gSceneTargetColor, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(gSceneTargetColor, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(gSceneTargetColor, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(gSceneTargetColor, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &gSceneTargetDepth);
+    glTextureStorage2D(gSceneTargetDepth, 1, GL_DEPTH_COMPONENT32F, width, height);
+
+    glCreateFramebuffers(1, &gSceneTargetFbo);
+    glNamedFramebufferTexture(gSceneTargetFbo, GL_COLOR_ATTACHMENT0, gSceneTargetColor, 0);
+    glNamedFramebufferTexture(gSceneTargetFbo, GL_DEPTH_ATTACHMENT, gSceneTargetDepth, 0);
+
+    if (glCheckNamedFramebufferStatus(gSceneTargetFbo, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cout << "ERROR::SCENE_TARGET::INCOMPLETE_FRAMEBUFFER" << endl;
+    return gSceneTargetFbo;
+}
+
+
+void UDestroySceneTarget()
+{
+    if (!gSceneTargetFbo)
+        return;
+    glDeleteFramebuffers(1, &gSceneTargetFbo);
+    glDeleteTextures(1, &gSceneTargetColor);
+    glDeleteTextures(1, &gSceneTargetDepth);
+    gSceneTargetFbo = gSceneTargetColor = gSceneTargetDepth = 0;
+}
+
+
+// Draws the finished off-screen frame into the window, upscaled from gRenderSize. With the before-swap latch
+// it is also rotated from the view it was drawn with to the newest one. Rotation only: the camera's movement
+// since the draw is not corrected, and what the drawn frame did not cover stays black at the edges.
+void UPresentFrame(const glm::mat4& renderedView, const glm::mat4& latestView)
+{
+    TRACE_GPU_BEGIN("present");
+
+    glm::mat4 reprojection(1.0f);
+    if (perspective_state)
+    {
+        const glm::mat4 rotation = glm::mat4(glm::mat3(renderedView) * glm::transpose(glm::mat3(latestView)));
+        reprojection = projection * rotation * glm::inverse(projection);
+    }
+
+    gState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    gState.Viewport(0, 0, gFramebufferSize.x, gFramebufferSize.y);
+    gState.Disable(GL_DEPTH_TEST);
+    gState.UseProgram(gPresentProgramId);
+    glUniformMatrix4fv(gStats.Uniform(0), 1, GL_FALSE, glm::value_ptr(reprojection));
+    glUniform2f(gStats.Uniform(1), float(gFramebufferSize.x), float(gFramebufferSize.y));
+    glUniform2f(gStats.Uniform(2), float(gRenderSize.x), float(gRenderSize.y));
+    glUniform1f(gStats.Uniform(3), gRenderSize == gFramebufferSize ? 0.0f : gSharpness);
+    gState.BindTextureUnit(0, GL_TEXTURE_2D, gSceneTargetColor);
+    gState.BindVertexArray(gFullscreenVao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    gStats.Draw(GL_TRIANGLES, 3);
+    gState.Enable(GL_DEPTH_TEST);
+    TRACE_GPU_END();
+}
+
+
+// Functioned called to render a frame
+void URender()
+{
+    TRACE_SCOPE("URender");
+    const double frameStart = glfwGetTime();
+    gLatchTime = frameStart;
+
+    // Everything up to the swap is measured by the pipeline statistics queries
+    UBeginPipelineStatistics();
+    TRACE_GPU_BEGIN("frame");
+
+    // GPU time of the scene, and this frame's render scale from the frames the GPU has finished
+    gResolution.BeginFrame(gDynamicResolution);
+    gRenderSize = gDynamicResolution ? glm::ivec2(gResolution.Scaled(gFramebufferSize.x), gResolution.Scaled(gFramebufferSize.y)) : gFramebufferSize;
+
+    // Enable z-depth
+    gState.Enable(GL_DEPTH_TEST);
+
+    // Several views are drawn forward, the G-buffer lighting and the depth pre-pass see one camera
+    const bool multiView = gMultiView != MULTIVIEW_OFF;
+    const bool deferred = gDeferredShading && !multiView;
+
+    // The before-swap latch and dynamic resolution draw the frame off screen and present it at the end
+    const bool offscreen = gLatchMode == LATCH_BEFORE_SWAP || gDynamicResolution;
+    const GLuint frameFbo = offscreen ? USceneTarget() : 0;
+    gState.BindFramebuffer(GL_FRAMEBUFFER, frameFbo);
+    gState.Viewport(0, 0, gRenderSize.x, gRenderSize.y);
+
+    // Clear the frame and z buffers
+    gState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glm::mat4 model;
+
+    // camera/view transformation
+    glm::mat4 view = gCamera.GetViewMatrix();
+    gSpotLightPosition = gCamera.Position;
+
+    if (perspective_state) {
+
+        // the window's aspect, the render scale keeps it
+        const GLfloat aspect = gFramebufferSize.y > 0 ? (GLfloat)gFramebufferSize.x / (GLfloat)gFramebufferSize.y : (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+        projection = glm::perspective(glm::radians(gCamera.Zoom), aspect, Z_NEAR, Z_FAR);
+    }
+    else {
+        projection = glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, Z_NEAR, Z_FAR);
+    }
+
+    // Sort the opaque draws front-to-back so early-z rejects hidden fragments
+    USortDrawItems(view);
+
+    // Upload this frame's lights
+    UUpdateLights(gSceneTime);
+    glNamedBufferSubData(gLightSsbo, 0, gLightCount * sizeof(GLLight), gLights);
+    const GLuint frameFeatures = UFrameShaderFeatures();
+
+    // Refresh the shadow maps, the static casters only when their cache is stale
+    if (gShadowsEnabled)
+        URenderShadowMaps();
+
+    // Late latch: sample the newest input right before the first draw that depends on the camera. The lights,
+    // the camera spotlight and its shadow map keep the pose from the top of the frame.
+    if (gLatchMode != LATCH_FRAME_START)
+    {
+        gLatchTime = ULatchCamera();
+        view = gCamera.GetViewMatrix();
+    }
+    UComputeViews(view);
+    UWriteCameraBlock(view, gCamera.Position);
+
+    // Bin the lights into the cluster grid, in the latched view, when there are enough of them to need it
+    if (frameFeatures & SHADER_CLUSTERED)
+        UCullLightsIntoClusters(view);
+
+    TRACE_GPU_BEGIN("scene");
+    if (deferred)
+    {
+        // Geometry goes into the G-buffer, the lighting pass below writes the frame
+        gState.BindFramebuffer(GL_FRAMEBUFFER, gGBufferFbo);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    else
+        gState.BindFramebuffer(GL_FRAMEBUFFER, frameFbo);
+
+    if (gDepthPrepass && !multiView)
+    {
+        // Depth pre-pass: lay down the nearest depth with the position-only streams and no color writes
+        gState.ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        gState.DepthMask(GL_TRUE);
+        gState.DepthFunc(GL_LESS);
+
+        // the camera comes from CameraBlock like in the shading pass, so both compute gl_Position from the same data
+        gState.UseProgram(gDepthProgramId);
+
+        for (const GLDrawItem& item : gDrawItems)
+        {
+            model = glm::translate(item.position) * glm::scale(item.scale);
+            glUniformMatrix4fv(gStats.Uniform(UNIFORM_MODEL), 1, GL_FALSE, glm::value_ptr(model));
+
+            gState.BindVertexArray(item.depthvao);
+            glDrawArrays(GL_TRIANGLES, 0, item.nVerticies);
+            gStats.Draw(GL_TRIANGLES, item.nVerticies);
+        }
+
+        // Shading pass: only the fragment that won the pre-pass is shaded
+        gState.ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        gState.DepthMask(GL_FALSE);
+        gState.DepthFunc(GL_EQUAL);
+    }
+
+    // Multi-view: one pass instanced once per view, each instance sent to its view's viewport by the vertex
+    // shader, so the state changes and draw calls do not grow with the views. Without a viewport index
+    // extension (or with --multiview-passes) the scene is drawn once per view into its viewport.
+    const bool singlePass = !multiView || (gViewportIndexExtension && !gMultiViewPasses);
+    const int scenePasses = singlePass ? 1 : gViewCount;
+    const GLsizei instances = multiView && singlePass ? gViewCount : 1;
+    if (multiView && singlePass)
+    {
+        GLfloat viewports[MAX_VIEWS][4];
+        for (int i = 0; i < gViewCount; ++i)
+            memcpy(viewports[i], glm::value_ptr(gViews[i].viewport), sizeof(viewports[i]));
+        gState.ViewportArray(gViewCount, viewports[0]);
+    }
+
+    // Shadow matrices, the filter radius is compiled into the variant
+    const glm::mat4 shadowMatrices[2] = { gShadowMaps[0].projection * gShadowMaps[0].view, gShadowMaps[1].projection * gShadowMaps[1].view };
+
+    for (int scenePass = 0; scenePass < scenePasses; ++scenePass)
+    {
+        if (!singlePass)
+        {
+            const glm::vec4& viewport = gViews[scenePass].viewport;
+            gState.Viewport(GLint(viewport.x), GLint(viewport.y), GLsizei(viewport.z), GLsizei(viewport.w));
+        }
+
+        // The uniforms that hold for the whole pass are uploaded when the program changes, only model per draw
+        GLuint passProgramId = 0;
+        for (const GLDrawItem& item : gDrawItems)
+        {
+            // Pick the cheapest variant for this material, the deferred path only writes the G-buffer here and lights later
+            const GLuint programId = deferred
+                ? UGetShaderVariant((PASS_GBUFFER << SHADER_PASS_SHIFT) | (item.features & SHADER_HAS_TEXTURE))
+                : UGetShaderVariant((PASS_FORWARD << SHADER_PASS_SHIFT) | frameFeatures | (item.features & (gLightmapsEnabled ? ~0u : ~SHADER_LIGHTMAP)) | (multiView ? SHADER_MULTIVIEW : 0u));
+
+            // Activate the VBOs contained within the mesh's VAO
+            gState.BindVertexArray(item.vao);
+
+            // Set the shader to be used
+            gState.UseProgram(programId);
+
+            if (programId != passProgramId)
+            {
+                passProgramId = programId;
+
+                // Pass cluster data to the Shader program's corresponding uniforms, the lights themselves live in the SSBO
+                glUniform3ui(gStats.Uniform(ULightingUniform(programId, UNIFORM_CLUSTER_GRID)), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+                glUniform1ui(gStats.Uniform(ULightingUniform(programId, UNIFORM_MAX_LIGHTS_PER_CLUSTER)), MAX_LIGHTS_PER_CLUSTER);
+                glUniform2f(gStats.Uniform(ULightingUniform(programId, UNIFORM_SCREEN_SIZE)), (GLfloat)gRenderSize.x, (GLfloat)gRenderSize.y);
+                glUniform1f(gStats.Uniform(ULightingUniform(programId, UNIFORM_Z_NEAR)), Z_NEAR);
+                glUniform1f(gStats.Uniform(ULightingUniform(programId, UNIFORM_Z_FAR)), Z_FAR);
+
+                glUniformMatrix4fv(gStats.Uniform(ULightingUniform(programId, UNIFORM_SHADOW_MATRICES)), 2, GL_FALSE, glm::value_ptr(shadowMatrices[0]));
+                glUniform3f(gStats.Uniform(ULightingUniform(programId, UNIFORM_OBJECT_COLOR)), gObjectColor.r, gObjectColor.g, gObjectColor.b);
+                glUniform2fv(gStats.Uniform(ULightingUniform(programId, UNIFORM_UV_SCALE)), 1, glm::value_ptr(gUVScale));
+
+                // The first view of this pass's instances
+                if (multiView)
+                    glUniform1ui(gStats.Uniform(ULightingUniform(programId, UNIFORM_FIRST_VIEW)), GLuint(scenePass));
+            }
+
+            // Passes the model matrix to the Shader program, the camera comes from CameraBlock
+            model = glm::translate(item.position) * glm::scale(item.scale);
+            glUniformMatrix4fv(gStats.Uniform(ULightingUniform(programId, UNIFORM_MODEL)), 1, GL_FALSE, glm::value_ptr(model));
+
+            // bind textures on corresponding texture units
+            gState.BindTextureUnit(0, GL_TEXTURE_2D, item.textureId);
+            if (item.lightmapId != 0)
+                gState.BindTextureUnit(LIGHTMAP_TEXTURE_UNIT, GL_TEXTURE_2D, item.lightmapId);
+
+            // Draws the triangles, once per view of this pass
+            glDrawArraysInstanced(GL_TRIANGLES, 0, item.nVerticies, instances);
+            gStats.Draw(GL_TRIANGLES, item.nVerticies, instances);
+        }
+    }
+    if (multiView)
+        gState.Viewport(0, 0, gRenderSize.x, gRenderSize.y);
+
+    // Restore the default depth state so the next glClear can write depth
+    gState.DepthMask(GL_TRUE);
+    gState.DepthFunc(GL_LESS);
+    TRACE_GPU_END();
+
+    if (deferred)
+    {
+        // Lighting pass: one fullscreen triangle evaluates every light once per pixel
+        TRACE_SCOPE("deferred lighting");
+        TRACE_GPU_BEGIN("deferred lighting");
+        gState.BindFramebuffer(GL_FRAMEBUFFER, frameFbo);
+        gState.Disable(GL_DEPTH_TEST);
+
+        const glm::mat4 inverseViewProjection = glm::inverse(projection * view);
+        const GLuint deferredLightingProgramId = UGetShaderVariant((PASS_DEFERRED_LIGHTING << SHADER_PASS_SHIFT) | frameFeatures);
+
+        gState.UseProgram(deferredLightingProgramId);
+        glUniformMatrix4fv(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_VIEW)), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_INVERSE_VIEW_PROJECTION)), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
+        glUniform3ui(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_CLUSTER_GRID)), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+        glUniform1ui(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_MAX_LIGHTS_PER_CLUSTER)), MAX_LIGHTS_PER_CLUSTER);
+        glUniform2f(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_SCREEN_SIZE)), (GLfloat)gRenderSize.x, (GLfloat)gRenderSize.y);
+        glUniform1f(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_Z_NEAR)), Z_NEAR);
+        glUniform1f(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_Z_FAR)), Z_FAR);
+
+        const glm::mat4 shadowMatrices[2] = { gShadowMaps[0].projection * gShadowMaps[0].view, gShadowMaps[1].projection * gShadowMaps[1].view };
+        glUniformMatrix4fv(gStats.Uniform(ULightingUniform(deferredLightingProgramId, UNIFORM_SHADOW_MATRICES)), 2, GL_FALSE, glm::value_ptr(shadowMatrices[0]));
+
+        gState.BindTextureUnit(0, GL_TEXTURE_2D, gGBufferAlbedo);
+        gState.BindTextureUnit(1, GL_TEXTURE_2D, gGBufferNormal);
+        gState.BindTextureUnit(2, GL_TEXTURE_2D, gGBufferDepth);
+
+        gState.BindVertexArray(gFullscreenVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        gStats.Draw(GL_TRIANGLES, 3);
+
+        gState.Enable(GL_DEPTH_TEST);
+        TRACE_GPU_END();
+    }
+
+    gResolution.EndFrame();
+
+    // Before-swap latch: the newest input once more, the finished frame is rotated to it. A multi-view frame has
+    // no single view to rotate and is presented as drawn.
+    if (offscreen)
+    {
+        glm::mat4 latestView = view;
+        if (gLatchMode == LATCH_BEFORE_SWAP && !multiView)
+        {
+            gLatchTime = ULatchCamera();
+            latestView = gCamera.GetViewMatrix();
+        }
+        UPresentFrame(view, latestView);
+    }
+
+    TRACE_GPU_END();
+    UEndPipelineStatistics();
+    UEndLatencyFrame(frameStart);
+
+    if (gSoftwareCompare)
+        UCaptureSoftwareCompareFrame();
+
+    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    {
+        TRACE_SCOPE("glfwSwapBuffers");
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    }
+    UEndCameraBlock();
+    gPacer.EndFrame();
+
+    // Move the GPU slices the GPU has finished onto the trace
+    TRACE_GPU_FRAME();
+}
+
+// Fills the opaque draw list from the meshes, programs and textures created in main
+void UBuildDrawList()
+{
+    gDrawItems.clear();
+    gDrawItems.push_back({ gMesh.tablevao, gMesh.tabledepthvao, gMesh.nTableVerticies, SHADER_HAS_TEXTURE, gTextureTableId, gTablePosition, gTableScale, gMesh.tableCenter, 0.0f, false, 0 });
+    gDrawItems.push_back({ gMesh.bowlvao, gMesh.bowldepthvao, gMesh.nBowlVerticies, SHADER_HAS_TEXTURE, gTextureBowlId, gBowlPosition, gBowlScale, gMesh.bowlCenter, 0.0f, false, 0 });
+    gDrawItems.push_back({ gMesh.grindervao, gMesh.grinderdepthvao, gMesh.nGrinderVerticies, SHADER_HAS_TEXTURE, gTextureGrinderId, gGrinderPosition, gGrinderScale, gMesh.grinderCenter, 0.0f, false, 0 });
+    gDrawItems.push_back({ gMesh.plantarvao, gMesh.plantardepthvao, gMesh.nPlantarVerticies, SHADER_HAS_TEXTURE, gTexturePlantarId, gPlantarPosition, gPlantarScale, gMesh.plantarCenter, 0.0f, false, 0 });
+    gDrawItems.push_back({ gMesh.dirtvao, gMesh.dirtdepthvao, gMesh.nDirtVerticies, SHADER_HAS_TEXTURE, gTextureDirtId, gDirtPosition, gDirtScale, gMesh.dirtCenter, 0.0f, false, 0 });
+}
+
+
+// Orders the opaque draws front-to-back by the view depth of each object's center
+void USortDrawItems(const glm::mat4& view)
+{
+    for (GLDrawItem& item : gDrawItems)
+    {
+        glm::vec3 worldCenter = item.position + item.center * item.scale;
+        item.viewDepth = -(view * glm::vec4(worldCenter, 1.0f)).z; // camera looks down -z in view space
+    }
+
+    // Insertion sort: stable, so objects at the same depth (the dirt inside the plantar) keep their submission
+    // order, allocation free unlike std::stable_sort, and close to linear since the order barely changes between frames
+    for (size_t i = 1; i < gDrawItems.size(); ++i)
+    {
+        GLDrawItem item = gDrawItems[i];
+        size_t j = i;
+        for (; j > 0 && item.viewDepth < gDrawItems[j - 1].viewDepth; --j)
+            gDrawItems[j] = gDrawItems[j - 1];
+        gDrawItems[j] = item;
+    }
+}
+
+
+// Shows the render mode and the average frame time once a second so modes can be compared
+void UUpdateWindowTitle()
+{
+    ++gTitleFrameCount;
+    float now = glfwGetTime();
+    if (now - gTitleLastTime < 1.0f)
+        return;
+
+    float msPerFrame = 1000.0f * (now - gTitleLastTime) / gTitleFrameCount;
+
+    // formatted into a fixed buffer, the frame loop does not allocate
+    char title[512];
+    snprintf(title, sizeof(title), "%s - %s - %d%% resolution - %d views - %s - %s - %u lights - %f ms - shadows %s %f ms (%d static refreshes) - state calls %u (%u redundant dropped) - %u draws %llu triangles",
+        WINDOW_TITLE, FramePacer::ModeName(gPacer.GetMode()), int(gRenderSize.x * 100 / (std::max)(gFramebufferSize.x, 1)), gViewCount, gDeferredShading && gMultiView == MULTIVIEW_OFF ? "deferred" : "forward", gDepthPrepass ? "depth pre-pass" : "single pass", gLightCount, msPerFrame,
+        gShadowCacheEnabled ? "cached" : "naive", gShadowPassMs, gStaticShadowRenders, gState.LastFrame().issued, gState.LastFrame().filtered,
+        gStats.LastFrame().draws, gStats.LastFrame().triangles);
+    if (gThreadedLoop)
+    {
+        // drawn on the render thread, set by the simulation thread
+        std::lock_guard<std::mutex> lock(gSimulationMutex);
+        snprintf(gPendingTitle, sizeof(gPendingTitle), "%s", title);
+    }
+    else
+        glfwSetWindowTitle(gWindow, title);
+
+    // Rolling log: averages over the last RenderStats::HISTORY frames
+    const RenderStats::Frame average = gStats.Average();
+    cout << "STATS: frame " << gStats.FrameIndex() << ": " << average.cpuMs << " ms cpu, " << average.draws << " draws, " << average.triangles << " triangles, switches "
+        << average.programSwitches << " program / " << average.vertexArraySwitches << " vao / " << average.textureSwitches << " texture, "
+        << average.uniformUploads << " uniform uploads";
+    if (average.pipelineFrame >= 0)
+        cout << ", " << average.vertexInvocations << " vs invocations, " << average.clippingPrimitives << " clipping primitives, " << average.fragmentInvocations << " fs invocations";
+    const FramePacer::Report pacing = gPacer.GetReport();
+    if (pacing.frames > 0)
+        cout << ", frame time " << pacing.meanMs << " ms +/- " << pacing.deviationMs << " (p99 " << pacing.p99Ms << ", worst " << pacing.worstMs
+            << ", paced wait " << pacing.waitMs << " ms)";
+    if (gDynamicResolution)
+        cout << ", render scale " << gResolution.Scale() << " (GPU " << gResolution.GpuMs() << " ms of " << gResolution.Budget() << ")";
+    if (gLatencyFrames > 0)
+        cout << ", input to GPU " << gLatencyLatchedMs / gLatencyFrames << " ms from the latch (" << LATCH_MODE_NAMES[gLatchMode] << "), "
+            << gLatencyFrameStartMs / gLatencyFrames << " ms from the frame start";
+    cout << endl;
+    gLatencyFrameStartMs = gLatencyLatchedMs = 0.0;
+    gLatencyFrames = 0;
+    UCalibrateGpuClock();
+
+    gStaticShadowRenders = 0;
+    gTitleFrameCount = 0;
+    gTitleLastTime = now;
+}
+
+
+
+// Creates the ring of pipeline statistics queries when the driver supports ARB_pipeline_statistics_query
+void UCreateStatsQueries()
+{
+    gPipelineStatistics = GLEW_ARB_pipeline_statistics_query != 0;
+    if (gPipelineStatistics)
+    {
+        for (int frame = 0; frame < PIPELINE_QUERY_FRAMES; ++frame)
+            glGenQueries(3, gPipelineQueries[frame]);
+    }
+    cout << "INFO: Pipeline statistics queries: " << (gPipelineStatistics ? "enabled" : "not supported") << endl;
+}
+
+
+void UDestroyStatsQueries()
+{
+    if (!gPipelineStatistics)
+        return;
+    for (int frame = 0; frame < PIPELINE_QUERY_FRAMES; ++frame)
+        glDeleteQueries(3, gPipelineQueries[frame]);
+}
+
+
+// Collects the oldest query set in the ring if the GPU finished it, then starts this frame's set in its place
+void UBeginPipelineStatistics()
+{
+    if (!gPipelineStatistics)
+        return;
+
+    const long long frame = gStats.FrameIndex();
+    GLuint* queries = gPipelineQueries[frame % PIPELINE_QUERY_FRAMES];
+    GLint available = 0;
+    if (frame >= PIPELINE_QUERY_FRAMES)
+        glGetQueryObjectiv(queries[2], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 results[3] = { 0, 0, 0 };
+        for (int i = 0; i < 3; ++i)
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &results[i]);
+        gStats.PipelineStatistics(frame - PIPELINE_QUERY_FRAMES, results[0], results[1], results[2]);
+    }
+
+    glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, queries[0]);
+    glBeginQuery(GL_CLIPPING_INPUT_PRIMITIVES_ARB, queries[1]);
+    glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[2]);
+}
+
+
+void UEndPipelineStatistics()
+{
+    if (!gPipelineStatistics)
+        return;
+
+    glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+    glEndQuery(GL_CLIPPING_INPUT_PRIMITIVES_ARB);
+    glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+}
+
+
+// Creates the ring of input-to-GPU latency timestamp queries
+void UCreateLatencyQueries()
+{
+    glGenQueries(LATENCY_QUERY_FRAMES, gLatencyQueries);
+    UCalibrateGpuClock();
+}
+
+
+void UDestroyLatencyQueries()
+{
+    glDeleteQueries(LATENCY_QUERY_FRAMES, gLatencyQueries);
+}
+
+
+// GL_TIMESTAMP is the GPU clock now, without waiting for the queued commands; the offset converts GPU
+// timestamps to glfwGetTime seconds. Redone once a second since the two clocks drift apart.
+void UCalibrateGpuClock()
+{
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    gGpuClockOffset = glfwGetTime() - gpuTime * 1e-9;
+}
+
+
+// Collects the latency of the frame LATENCY_QUERY_FRAMES frames back if the GPU finished it, then puts a
+// timestamp after this frame's last command: the time from the input sample to the GPU finishing the frame
+// that shows it. Measured from the top of the frame and from the latch.
+void UEndLatencyFrame(double frameStart)
+{
+    const int slot = int(gLatencyFrame % LATENCY_QUERY_FRAMES);
+    GLint available = 0;
+    if (gLatencyFrame >= LATENCY_QUERY_FRAMES)
+        glGetQueryObjectiv(gLatencyQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(gLatencyQueries[slot], GL_QUERY_RESULT, &gpuTime);
+        const double finished = gpuTime * 1e-9 + gGpuClockOffset;
+        const double frameStartMs = (finished - gLatencyFrameStart[slot]) * 1000.0;
+        const double latchedMs = (finished - gLatencyLatched[slot]) * 1000.0;
+        gLatencyFrameStartMs += frameStartMs;
+        gLatencyLatchedMs += latchedMs;
+        ++gLatencyFrames;
+
+        // --measure-latency counts after the variants are built, the warm-up covers the frames of the previous mode
+        if (gMeasureLatency && gPendingShaderVariants.empty() && gLatencyMeasuredFrames++ >= LATENCY_WARMUP_FRAMES)
+        {
+            gLatencyResults[gLatchMode][0] += frameStartMs;
+            gLatencyResults[gLatchMode][1] += latchedMs;
+        }
+    }
+
+    glQueryCounter(gLatencyQueries[slot], GL_TIMESTAMP);
+    gLatencyFrameStart[slot] = frameStart;
+    gLatencyLatched[slot] = gLatchTime;
+    ++gLatencyFrame;
+}
+
+
+// --measure-latency: runs LATENCY_MEASURE_FRAMES frames in every latch mode and reports the average latency
+// of each; returns true once the report is printed
+bool UMeasureLatency()
+{
+    if (gLatencyMeasuredFrames < LATENCY_WARMUP_FRAMES + LATENCY_MEASURE_FRAMES)
+        return false;
+
+    gLatencyMeasuredFrames = 0;
+    gLatchMode = LatchMode(gLatchMode + 1);
+    if (gLatchMode < LATCH_MODE_COUNT)
+        return false;
+
+    cout << "LATENCY: input to GPU completion, average of " << LATENCY_MEASURE_FRAMES << " frames per mode:" << endl;
+    for (int mode = 0; mode < LATCH_MODE_COUNT; ++mode)
+    {
+        const double frameStartMs = gLatencyResults[mode][0] / LATENCY_MEASURE_FRAMES;
+        const double latchedMs = gLatencyResults[mode][1] / LATENCY_MEASURE_FRAMES;
+        cout << "  " << LATCH_MODE_NAMES[mode] << ": " << latchedMs << " ms from the latch, " << frameStartMs
+            << " ms from the frame start (" << frameStartMs - latchedMs << " ms gained)" << endl;
+    }
+    gLatchMode = LATCH_BEFORE_DRAW;
+    return true;
+}
+
+
+// --check-allocations: warms up until every shader variant is built, then requires ALLOCATION_CHECK_FRAMES frames
+// without a heap allocation; returns true once the check is complete
+bool UCheckAllocations(unsigned int frameAllocations)
+{
+    if (gAllocationWarmupFrames < ALLOCATION_WARMUP_FRAMES || !gPendingShaderVariants.empty())
+    {
+        ++gAllocationWarmupFrames;
+        return false;
+    }
+
+    if (frameAllocations > 0)
+    {
+        ++gAllocatingFrames;
+        cout << "ALLOCATION: frame " << gStats.FrameIndex() - 1 << " made " << frameAllocations << " heap allocations" << endl;
+    }
+    return ++gAllocationCheckedFrames == ALLOCATION_CHECK_FRAMES;
+}
+
+
+// Loads an image into a software texture, flipped like UCreateTexture flips the GL ones
+bool ULoadSoftwareTexture(const char* filename, SoftwareTexture& texture)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
+    if (!image)
+    {
+        cout << "ERROR: could not load " << filename << endl;
+        return false;
+    }
+    if (channels != 3 && channels != 4)
+    {
+        cout << "Not implemented to handle image with " << channels << " channels" << endl;
+        stbi_image_free(image);
+        return false;
+    }
+
+    flipImageVertically(image, width, height, channels);
+    texture.width = width;
+    texture.height = height;
+    texture.channels = channels;
+    texture.texels.assign(image, image + size_t(width) * height * channels);
+    stbi_image_free(image);
+    return true;
+}
+
+
+// Builds the CPU copy of the scene in the order of UBuildDrawList: table, bowl, grinder, plantar, dirt
+bool UCreateSoftwareScene()
+{
+    const char* textureFiles[] = { TABLE_TEXTURE_FILE, BOWL_TEXTURE_FILE, GRINDER_TEXTURE_FILE, PLANTAR_TEXTURE_FILE, DIRT_TEXTURE_FILE };
+    void (*builders[])(vector<GLfloat>&) = { UBuildTableVertices, UBuildBowlVertices, UBuildGrinderVertices, UBuildPlantarVertices, UBuildDirtVertices };
+    const glm::vec3 positions[] = { gTablePosition, gBowlPosition, gGrinderPosition, gPlantarPosition, gDirtPosition };
+    const glm::vec3 scales[] = { gTableScale, gBowlScale, gGrinderScale, gPlantarScale, gDirtScale };
+
+    gSoftwareObjects.resize(5);
+    for (int i = 0; i < 5; ++i)
+    {
+        SoftwareObject& object = gSoftwareObjects[i];
+        builders[i](object.vertices);
+        object.position = positions[i];
+        object.scale = scales[i];
+        if (!ULoadSoftwareTexture(textureFiles[i], object.texture))
+            return false;
+    }
+    return true;
+}
+
+
+// The CPU scene objects as draws for the software rasterizer and the ray tracer
+void USoftwareDraws(vector<SoftwareRasterizer::Draw>& draws)
+{
+    draws.resize(gSoftwareObjects.size());
+    for (size_t i = 0; i < gSoftwareObjects.size(); ++i)
+    {
+        const SoftwareObject& object = gSoftwareObjects[i];
+        draws[i].vertices = object.vertices.data();
+        draws[i].vertexCount = (unsigned int)(object.vertices.size() / 8);
+        draws[i].model = glm::translate(object.position) * glm::scale(object.scale);
+        draws[i].texture = &object.texture;
+        draws[i].color = gObjectColor;
+    }
+}
+
+
+// gLights, the light SSBO contents, in the CPU renderers' layout
+void USoftwareLights(vector<SoftwareRasterizer::Light>& lights)
+{
+    lights.resize(gLightCount);
+    for (GLuint i = 0; i < gLightCount; ++i)
+    {
+        const GLLight& light = gLights[i];
+        lights[i].position = glm::vec3(light.positionRange);
+        lights[i].range = light.positionRange.w;
+        lights[i].color = glm::vec3(light.colorType);
+        lights[i].spot = light.colorType.w > 0.5f;
+        lights[i].direction = glm::vec3(light.directionCutOff);
+        lights[i].innerCutOff = light.directionCutOff.w;
+        lights[i].outerCutOff = light.outerCutOff.x;
+        lights[i].shadowMap = int(light.outerCutOff.y);
+    }
+}
+
+
+// Renders the current scene state (gCamera, gLights, gShadowMaps matrices, shading toggles) on the CPU
+void URenderSoftwareFrame(SoftwareRasterizer& rasterizer, SoftwareRasterizer::ShadowMap* shadowMaps)
+{
+    TRACE_SCOPE("URenderSoftwareFrame");
+
+    vector<SoftwareRasterizer::Draw> draws;
+    USoftwareDraws(draws);
+    vector<SoftwareRasterizer::Light> lights;
+    USoftwareLights(lights);
+
+    // same sizes and polygon offset as URenderShadowMaps
+    if (gShadowsEnabled)
+    {
+        const int sizes[] = { KEY_SHADOW_MAP_SIZE, SPOT_SHADOW_MAP_SIZE };
+        for (int i = 0; i < 2; ++i)
+        {
+            shadowMaps[i].viewProjection = gShadowMaps[i].projection * gShadowMaps[i].view;
+            shadowMaps[i].size = sizes[i];
+            rasterizer.RenderShadowMap(draws.data(), (unsigned int)draws.size(), shadowMaps[i], 2.0f, 4.0f);
+        }
+    }
+
+    SoftwareRasterizer::Frame frame;
+    frame.draws = draws.data();
+    frame.drawCount = (unsigned int)draws.size();
+    frame.view = gCamera.GetViewMatrix();
+    frame.projection = projection;
+    frame.viewPosition = gCamera.Position;
+    frame.lights = lights.data();
+    frame.lightCount = (unsigned int)lights.size();
+    frame.shadowMaps = gShadowsEnabled ? shadowMaps : nullptr;
+    frame.pcfRadius = gPcfRadius;
+    frame.uvScale = gUVScale;
+    rasterizer.Render(frame);
+}
+
+
+// Writes a binary PPM, pixels are RGB8 with the rows bottom to top
+bool UWritePpm(const string& path, int width, int height, const unsigned char* pixels)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        cout << "ERROR: could not write " << path << endl;
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    for (int y = height - 1; y >= 0; --y)
+        file.write(reinterpret_cast<const char*>(pixels) + size_t(y) * width * 3, size_t(width) * 3);
+    return bool(file);
+}
+
+
+// --software: renders the starting view on the CPU without a window or a GL context, times it with 1, 2, 4 ...
+// threads up to the hardware thread count and writes the image rendered with all of them.
+// Returns a process exit code.
+int URunSoftwareRenderer(const string& path)
+{
+    if (!UCreateSoftwareScene())
+        return EXIT_FAILURE;
+
+    UUpdateLights(0.0f);
+    UUpdateShadowMatrices();
+    SoftwareRasterizer::ShadowMap shadowMaps[2];
+
+    const unsigned int maxThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    cout << "Software renderer, " << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << ", " << gSoftwareObjects.size() << " objects, "
+        << gLightCount << " lights, shadows " << (gShadowsEnabled ? "on" : "off") << ", " << PhongKernelName(PhongBestKernel())
+        << " lighting:" << endl;
+
+    double singleThreadMs = 0.0;
+    bool written = false;
+    for (unsigned int threads : threadCounts)
+    {
+        WorkerPool pool(threads);
+        SoftwareRasterizer rasterizer(pool);
+        rasterizer.Resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+        // the first frames grow the tile bins and depth buffers, they are not timed
+        URenderSoftwareFrame(rasterizer, shadowMaps);
+        URenderSoftwareFrame(rasterizer, shadowMaps);
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < SOFTWARE_TIMED_FRAMES; ++i)
+            URenderSoftwareFrame(rasterizer, shadowMaps);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / SOFTWARE_TIMED_FRAMES;
+        if (threads == 1)
+            singleThreadMs = ms;
+
+        cout << "  " << threads << " threads: " << ms << " ms/frame, " << rasterizer.Triangles() << " triangles, speedup "
+            << singleThreadMs / ms << "x, efficiency " << 100.0 * singleThreadMs / (ms * threads) << "%" << endl;
+
+        if (threads == maxThreads)
+            written = UWritePpm(path, rasterizer.Width(), rasterizer.Height(), rasterizer.Pixels());
+    }
+
+    if (!written)
+        return EXIT_FAILURE;
+    cout << "Wrote " << path << endl;
+    return EXIT_SUCCESS;
+}
+
+
+// --raytrace: ray traces the starting view with shadow rays for the key light and the spotlight, the ground
+// truth the rasterized frames are checked against. Times the BVH build and the frames with 1, 2, 4 ...
+// threads, writes the image and reports how far the software rasterizer's frame of the same view is from it.
+// Returns a process exit code.
+int URunRayTracer(const string& path)
+{
+    if (!UCreateSoftwareScene())
+        return EXIT_FAILURE;
+
+    UUpdateLights(0.0f);
+    UUpdateShadowMatrices();
+    vector<SoftwareRasterizer::Draw> draws;
+    USoftwareDraws(draws);
+    vector<SoftwareRasterizer::Light> lights;
+    USoftwareLights(lights);
+
+    RayTracer::Frame frame;
+    frame.view = gCamera.GetViewMatrix();
+    frame.projection = projection;
+    frame.viewPosition = gCamera.Position;
+    frame.lights = lights.data();
+    frame.lightCount = (unsigned int)lights.size();
+    frame.shadows = gShadowsEnabled;
+    frame.uvScale = gUVScale;
+
+    const unsigned int maxThreads = (std::max)(std::thread::hardware_concurrency(), 1u);
+    vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    cout << "Ray tracer, " << WINDOW_WIDTH << "x" << WINDOW_HEIGHT << ", " << draws.size() << " objects, " << gLightCount
+        << " lights, shadows " << (gShadowsEnabled ? "on" : "off") << ", " << PhongKernelName(PhongBestKernel()) << " lighting:" << endl;
+
+    double singleThreadMs = 0.0;
+    vector<unsigned char> image;
+    for (unsigned int threads : threadCounts)
+    {
+        WorkerPool pool(threads);
+        RayTracer tracer(pool);
+        tracer.Resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+        const std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        tracer.Build(draws.data(), (unsigned int)draws.size());
+        const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+        tracer.Render(frame);   // warm-up
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RAYTRACE_TIMED_FRAMES; ++i)
+            tracer.Render(frame);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / RAYTRACE_TIMED_FRAMES;
+        const double ms = seconds * 1000.0;
+        if (threads == 1)
+            singleThreadMs = ms;
+
+        const double raysPerSecond = double(tracer.Rays()) / seconds;
+        cout << "  " << threads << " threads: BVH " << tracer.TriangleCount() << " triangles, " << tracer.NodeCount() << " nodes (depth " << tracer.Depth() << ") in "
+            << buildMs << " ms; " << ms << " ms/frame, " << tracer.Rays() << " rays, " << raysPerSecond / 1e6 << " M rays/s, "
+            << raysPerSecond / threads / 1e6 << " M rays/s/core, speedup " << singleThreadMs / ms << "x" << endl;
+
+        if (threads == maxThreads)
+            image.assign(tracer.Pixels(), tracer.Pixels() + size_t(WINDOW_WIDTH) * WINDOW_HEIGHT * 3);
+    }
+
+    if (!UWritePpm(path, WINDOW_WIDTH, WINDOW_HEIGHT, image.data()))
+        return EXIT_FAILURE;
+    cout << "Wrote " << path << endl;
+
+    // the rasterized frame of the same view against the reference: shadow map resolution, bias and PCF show up here
+    WorkerPool pool;
+    SoftwareRasterizer rasterizer(pool);
+    SoftwareRasterizer::ShadowMap shadowMaps[2];
+    rasterizer.Resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    URenderSoftwareFrame(rasterizer, shadowMaps);
+
+    const unsigned char* rasterPixels = rasterizer.Pixels();
+    size_t mismatched = 0;
+    double errorSum = 0.0;
+    for (size_t pixel = 0; pixel < size_t(WINDOW_WIDTH) * WINDOW_HEIGHT; ++pixel)
+    {
+        int pixelError = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            const int error = std::abs(int(image[pixel * 3 + c]) - int(rasterPixels[pixel * 3 + c]));
+            errorSum += error;
+            pixelError = (std::max)(pixelError, error);
+        }
+        if (pixelError > SOFTWARE_COMPARE_TOLERANCE)
+            ++mismatched;
+    }
+    cout << "Software rasterizer against the reference: mean channel error " << errorSum / (double(WINDOW_WIDTH) * WINDOW_HEIGHT * 3)
+        << ", " << 100.0 * mismatched / (double(WINDOW_WIDTH) * WINDOW_HEIGHT) << "% of pixels off by more than "
+        << SOFTWARE_COMPARE_TOLERANCE << endl;
+    return EXIT_SUCCESS;
+}
+
+
+// --bake-lightmaps: unwraps the static objects and bakes the key light into their lightmaps on all threads,
+// every object of the scene shadowing and bouncing light. Writes LIGHTMAP_DIRECTORY/<name>.lightmap and a
+// PPM preview of each. Returns a process exit code.
+int UBakeLightmaps()
+{
+    if (!UCreateSoftwareScene())
+        return EXIT_FAILURE;
+
+    UUpdateLights(0.0f);
+    vector<SoftwareRasterizer::Draw> draws;
+    USoftwareDraws(draws);
+    vector<SoftwareRasterizer::Light> lights;
+    USoftwareLights(lights);
+    const SoftwareRasterizer::Light& keyLight = lights[0];  // UUpdateLights puts the key light first
+
+    WorkerPool pool;
+    RayTracer tracer(pool);
+    tracer.Build(draws.data(), (unsigned int)draws.size());
+    LightmapBaker baker(pool, tracer, draws.data());
+    const LightmapBaker::Settings settings = { LIGHTMAP_BOUNCE_SAMPLES, LIGHTMAP_BOUNCE_DISTANCE, gUVScale };
+
+    cout << "Baking lightmaps, " << LIGHTMAP_SIZE << "x" << LIGHTMAP_SIZE << ", " << LIGHTMAP_BOUNCE_SAMPLES << " bounce rays per texel, "
+        << pool.Threads() << " threads:" << endl;
+    for (int i = 0; i < LIGHTMAP_OBJECT_COUNT; ++i)
+    {
+        LightmapBaker::Lightmap lightmap;
+        if (!LightmapBaker::Unwrap(draws[LIGHTMAP_OBJECTS[i]], LIGHTMAP_SIZE, lightmap))
+        {
+            cout << "ERROR: the " << LIGHTMAP_NAMES[i] << " charts do not fit in " << LIGHTMAP_SIZE << "x" << LIGHTMAP_SIZE << endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        baker.Bake(LIGHTMAP_OBJECTS[i], keyLight, settings, lightmap);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (!LightmapBaker::Save(LIGHTMAP_DIRECTORY, string(LIGHTMAP_NAMES[i]) + ".lightmap", lightmap))
+        {
+            cout << "ERROR: could not write the " << LIGHTMAP_NAMES[i] << " lightmap to " << LIGHTMAP_DIRECTORY << endl;
+            return EXIT_FAILURE;
+        }
+
+        // preview of the irradiance, clamped at 1
+        size_t usedTexels = 0;
+        vector<unsigned char> preview(lightmap.texels.size() * 3);
+        for (size_t texel = 0; texel < lightmap.texels.size(); ++texel)
+        {
+            for (int c = 0; c < 3; ++c)
+                preview[texel * 3 + c] = (unsigned char)((std::min)(lightmap.texels[texel][c], 1.0f) * 255.0f + 0.5f);
+            if (lightmap.texelTriangles[texel] >= 0)
+                ++usedTexels;
+        }
+        UWritePpm(string(LIGHTMAP_DIRECTORY) + "/" + LIGHTMAP_NAMES[i] + ".ppm", lightmap.size, lightmap.size, preview.data());
+
+        cout << "  " << LIGHTMAP_NAMES[i] << ": " << draws[LIGHTMAP_OBJECTS[i]].vertexCount / 3 << " triangles, "
+            << 100.0 * usedTexels / lightmap.texels.size() << "% of the texels used, baked in " << ms << " ms" << endl;
+    }
+    cout << "Wrote the lightmaps to " << LIGHTMAP_DIRECTORY << endl;
+    return EXIT_SUCCESS;
+}
+
+
+// Attaches the lightmaps --bake-lightmaps wrote to the static draws: an RGBA16F texture, and the lightmap
+// coordinates as a second buffer binding of the object's VAO feeding attribute 3. Objects without a usable
+// lightmap keep the live key light. --software-compare loads none: the software rasterizer lights every
+// object live, and a baked frame would be compared with a live one.
+void ULoadLightmaps()
+{
+    if (gSoftwareCompare)
+    {
+        cout << "INFO: Lightmaps: off (--software-compare lights every object live)" << endl;
+        return;
+    }
+
+    int loaded = 0;
+    for (int i = 0; i < LIGHTMAP_OBJECT_COUNT; ++i)
+    {
+        gLightmapTextures[i] = 0;
+        gLightmapUvBuffers[i] = 0;
+
+        GLDrawItem& item = gDrawItems[LIGHTMAP_OBJECTS[i]];
+        const string path = string(LIGHTMAP_DIRECTORY) + "/" + LIGHTMAP_NAMES[i] + ".lightmap";
+        LightmapBaker::Lightmap lightmap;
+        if (!LightmapBaker::Load(path, lightmap))
+            continue;
+        if (lightmap.uvs.size() != item.nVerticies)
+        {
+            cout << "WARNING: " << path << " was baked for other geometry, run --bake-lightmaps again" << endl;
+            continue;
+        }
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &gLightmapTextures[i]);
+        glTextureStorage2D(gLightmapTextures[i], 1, GL_RGBA16F, lightmap.size, lightmap.size);
+        glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_MIN_FILTER, GL_LINEAR);  // no mipmaps, they would blend the charts
+        glTextureParameteri(gLightmapTextures[i], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureSubImage2D(gLightmapTextures[i], 0, 0, 0, lightmap.size, lightmap.size, GL_RGBA, GL_FLOAT, lightmap.texels.data());
+
+        glCreateBuffers(1, &gLightmapUvBuffers[i]);
+        glNamedBufferStorage(gLightmapUvBuffers[i], lightmap.uvs.size() * sizeof(glm::vec2), lightmap.uvs.data(), 0);
+        glVertexArrayVertexBuffer(item.vao, 1, gLightmapUvBuffers[i], 0, sizeof(glm::vec2));
+        glEnableVertexArrayAttrib(item.vao, 3);
+        glVertexArrayAttribFormat(item.vao, 3, 2, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(item.vao, 3, 1);
+
+        item.lightmapId = gLightmapTextures[i];
+        item.features |= SHADER_LIGHTMAP;
+        ++loaded;
+    }
+
+    if (loaded > 0)
+        cout << "INFO: Lightmaps: " << loaded << " of " << LIGHTMAP_OBJECT_COUNT << " static objects from " << LIGHTMAP_DIRECTORY << endl;
+    else
+        cout << "INFO: Lightmaps: none (run --bake-lightmaps)" << endl;
+}
+
+
+void UDestroyLightmaps()
+{
+    glDeleteTextures(LIGHTMAP_OBJECT_COUNT, gLightmapTextures);
+    glDeleteBuffers(LIGHTMAP_OBJECT_COUNT, gLightmapUvBuffers);
+}
+
+
+// --software-compare: once the shader variants are built and the frames have settled, reads the finished frame
+// back from the default framebuffer. Called before the swap: after it the back buffer is undefined, and the front
+// buffer of a composited window need not hold the frame (or anything) at all.
+void UCaptureSoftwareCompareFrame()
+{
+    static int warmupFrames = 0;
+    if (!gSoftwareComparePixels.empty())
+        return;
+    if (warmupFrames < SOFTWARE_COMPARE_WARMUP_FRAMES || !gPendingShaderVariants.empty())
+    {
+        ++warmupFrames;
+        return;
+    }
+
+    gSoftwareComparePixels.resize(size_t(gFramebufferSize.x) * gFramebufferSize.y * 3);
+    gState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    glReadBuffer(GL_BACK);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, gFramebufferSize.x, gFramebufferSize.y, GL_RGB, GL_UNSIGNED_BYTE, gSoftwareComparePixels.data());
+}
+
+
+// --software-compare: renders the view of the captured frame on the CPU. Passes when few enough pixels differ
+// by more than SOFTWARE_COMPARE_TOLERANCE in a channel; edges and shadow borders differ a little between the two.
+// Returns true once the comparison is done.
+bool UCompareSoftwareFrame()
+{
+    if (gSoftwareComparePixels.empty())
+        return false;
+
+    const int width = gFramebufferSize.x;
+    const int height = gFramebufferSize.y;
+    const vector<unsigned char>& glPixels = gSoftwareComparePixels;
+
+    WorkerPool pool;
+    SoftwareRasterizer rasterizer(pool);
+    SoftwareRasterizer::ShadowMap shadowMaps[2];
+    rasterizer.Resize(width, height);
+    URenderSoftwareFrame(rasterizer, shadowMaps);
+
+    const unsigned char* softwarePixels = rasterizer.Pixels();
+    size_t mismatched = 0;
+    double errorSum = 0.0;
+    int maxError = 0;
+    for (size_t pixel = 0; pixel < size_t(width) * height; ++pixel)
+    {
+        int pixelError = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            const int error = std::abs(int(glPixels[pixel * 3 + c]) - int(softwarePixels[pixel * 3 + c]));
+            errorSum += error;
+            pixelError = (std::max)(pixelError, error);
+        }
+        maxError = (std::max)(maxError, pixelError);
+        if (pixelError > SOFTWARE_COMPARE_TOLERANCE)
+            ++mismatched;
+    }
+
+    const double mismatchFraction = double(mismatched) / (double(width) * height);
+    gSoftwareComparePassed = mismatchFraction < SOFTWARE_COMPARE_MAX_MISMATCH;
+    cout << "SOFTWARE COMPARE " << (gSoftwareComparePassed ? "PASSED" : "FAILED") << ": " << width << "x" << height
+        << ", mean channel error " << errorSum / (double(width) * height * 3) << ", max " << maxError << ", "
+        << 100.0 * mismatchFraction << "% of pixels off by more than " << SOFTWARE_COMPARE_TOLERANCE
+        << " (limit " << 100.0 * SOFTWARE_COMPARE_MAX_MISMATCH << "%)" << endl;
+    return true;
+}
+
+
+// Creates the G-buffer: albedo, octahedral normal and depth, all sampled by the lighting pass
+bool UCreateGBuffer(int width, int height)
+{
+    glCreateFramebuffers(1, &gGBufferFbo);
+
+    const GLenum formats[] = { GL_RGBA8, GL_RG16, GL_DEPTH_COMPONENT32F };
+    GLuint* textures[] = { &gGBufferAlbedo, &gGBufferNormal, &gGBufferDepth };
+    const GLenum attachments[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_DEPTH_ATTACHMENT };
+
+    for (int i = 0; i < 3; ++i)
+    {
+        glCreateTextures(GL_TEXTURE_2D, 1, textures[i]);
+        glTextureStorage2D(*textures[i], 1, formats[i], width, height);
+
+        // read with texelFetch, no filtering
+        glTextureParameteri(*textures[i], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(*textures[i], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glNamedFramebufferTexture(gGBufferFbo, attachments[i], *textures[i], 0);
+    }
+
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glNamedFramebufferDrawBuffers(gGBufferFbo, 2, drawBuffers);
+
+    bool complete = glCheckNamedFramebufferStatus(gGBufferFbo, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (!complete)
+    {
+        cout << "ERROR::GBUFFER::INCOMPLETE_FRAMEBUFFER" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+void UDestroyGBuffer()
+{
+    glDeleteFramebuffers(1, &gGBufferFbo);
+    glDeleteTextures(1, &gGBufferAlbedo);
+    glDeleteTextures(1, &gGBufferNormal);
+    glDeleteTextures(1, &gGBufferDepth);
+}
+
+
+// Creates the static and final depth maps of the key light and camera spotlight shadows
+void UCreateShadowMaps()
+{
+    const GLsizei sizes[2] = { KEY_SHADOW_MAP_SIZE, SPOT_SHADOW_MAP_SIZE };
+    const float borderDepth[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // outside the map is lit
+
+    for (int i = 0; i < 2; ++i)
+    {
+        GLShadowMap& shadow = gShadowMaps[i];
+        shadow.size = sizes[i];
+        shadow.view = glm::mat4(1.0f);
+        shadow.projection = glm::mat4(1.0f);
+        shadow.cachedViewProjection = glm::mat4(1.0f);
+        shadow.cacheValid = false;
+        shadow.hasDynamic = false;
+
+        GLuint* maps[2] = { &shadow.staticMap, &shadow.finalMap };
+        GLuint* fbos[2] = { &shadow.staticFbo, &shadow.finalFbo };
+        for (int m = 0; m < 2; ++m)
+        {
+            glCreateTextures(GL_TEXTURE_2D, 1, maps[m]);
+            glTextureStorage2D(*maps[m], 1, GL_DEPTH_COMPONENT32F, shadow.size, shadow.size);
+
+            // hardware depth comparison with bilinear filtering gives a 2x2 PCF per tap
+            glTextureParameteri(*maps[m], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(*maps[m], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(*maps[m], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTextureParameteri(*maps[m], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTextureParameterfv(*maps[m], GL_TEXTURE_BORDER_COLOR, borderDepth);
+            glTextureParameteri(*maps[m], GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTextureParameteri(*maps[m], GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+            glCreateFramebuffers(1, fbos[m]);
+            glNamedFramebufferTexture(*fbos[m], GL_DEPTH_ATTACHMENT, *maps[m], 0);
+            glNamedFramebufferDrawBuffer(*fbos[m], GL_NONE);
+            glNamedFramebufferReadBuffer(*fbos[m], GL_NONE);
+        }
+    }
+
+    glGenQueries(2, gShadowTimerQueries);
+}
+
+
+void UDestroyShadowMaps()
+{
+    for (GLShadowMap& shadow : gShadowMaps)
+    {
+        glDeleteFramebuffers(1, &shadow.staticFbo);
+        glDeleteFramebuffers(1, &shadow.finalFbo);
+        glDeleteTextures(1, &shadow.staticMap);
+        glDeleteTextures(1, &shadow.finalMap);
+    }
+    glDeleteQueries(2, gShadowTimerQueries);
+}
+
+
+// Draws the static or the dynamic shadow casters into a shadow map framebuffer with the depth-only program
+void URenderShadowCasters(GLuint fbo, const GLShadowMap& shadow, bool dynamicCasters)
+{
+    gState.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    gState.UseProgram(gShadowCasterProgramId);
+    const glm::mat4 lightViewProjection = shadow.projection * shadow.view;
+    glUniformMatrix4fv(gStats.Uniform(UNIFORM_LIGHT_VIEW_PROJECTION), 1, GL_FALSE, glm::value_ptr(lightViewProjection));
+
+    for (const GLDrawItem& item : gDrawItems)
+    {
+        if (item.dynamic != dynamicCasters)
+            continue;
+
+        glm::mat4 model = glm::translate(item.position) * glm::scale(item.scale);
+        glUniformMatrix4fv(gStats.Uniform(UNIFORM_MODEL), 1, GL_FALSE, glm::value_ptr(model));
+
+        gState.BindVertexArray(item.depthvao);
+        glDrawArrays(GL_TRIANGLES, 0, item.nVerticies);
+        gStats.Draw(GL_TRIANGLES, item.nVerticies);
+    }
+}
+
+
+// Points the shadow maps at this frame's lights, shared with the software renderer
+void UUpdateShadowMatrices()
+{
+    // Key light looks at the middle of the table, the spotlight follows the camera
+    gShadowMaps[0].view = glm::lookAt(gKeyLightPosition, glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    gShadowMaps[0].projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.5f, 10.0f);
+    gShadowMaps[1].view = glm::lookAt(gSpotLightPosition, gSpotLightPosition + gCamera.Front, gCamera.Up);
+    gShadowMaps[1].projection = glm::perspective(glm::radians(30.0f), 1.0f, Z_NEAR, 20.0f);
+}
+
+
+// Updates both shadow maps. With the cache enabled the static casters are only re-rendered when the light
+// matrix or the static geometry changed; dynamic casters are drawn every frame on a copy of the static map.
+void URenderShadowMaps()
+{
+    TRACE_SCOPE("URenderShadowMaps");
+    TRACE_GPU_BEGIN("shadow maps");
+
+    // Collect last frame's GPU time without waiting for the GPU
+    GLuint previousQuery = gShadowTimerQueries[(gShadowTimerFrame + 1) % 2];
+    GLint available = 0;
+    if (gShadowTimerFrame > 0)
+        glGetQueryObjectiv(previousQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(previousQuery, GL_QUERY_RESULT, &elapsed);
+        gShadowPassMs = elapsed / 1000000.0f;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, gShadowTimerQueries[gShadowTimerFrame % 2]);
+
+    UUpdateShadowMatrices();
+
+    bool anyDynamic = false;
+    for (const GLDrawItem& item : gDrawItems)
+        anyDynamic = anyDynamic || item.dynamic;
+
+    gState.Enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    gState.DepthMask(GL_TRUE);
+    gState.DepthFunc(GL_LESS);
+
+    for (GLShadowMap& shadow : gShadowMaps)
+    {
+        gState.Viewport(0, 0, shadow.size, shadow.size);
+
+        glm::mat4 viewProjection = shadow.projection * shadow.view;
+        bool stale = !shadow.cacheValid || gStaticShadowCastersDirty || viewProjection != shadow.cachedViewProjection;
+        if (!gShadowCacheEnabled || stale)
+        {
+            gState.BindFramebuffer(GL_FRAMEBUFFER, shadow.staticFbo);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            URenderShadowCasters(shadow.staticFbo, shadow, false);
+
+            shadow.cachedViewProjection = viewProjection;
+            shadow.cacheValid = true;
+            ++gStaticShadowRenders;
+        }
+
+        // Composite the dynamic casters over a copy of the cached static depth
+        shadow.hasDynamic = anyDynamic;
+        if (anyDynamic)
+        {
+            glCopyImageSubData(shadow.staticMap, GL_TEXTURE_2D, 0, 0, 0, 0, shadow.finalMap, GL_TEXTURE_2D, 0, 0, 0, 0, shadow.size, shadow.size, 1);
+            URenderShadowCasters(shadow.finalFbo, shadow, true);
+        }
+    }
+    gStaticShadowCastersDirty = false;
+
+    gState.Disable(GL_POLYGON_OFFSET_FILL);
+    gState.BindFramebuffer(GL_FRAMEBUFFER, 0);
+    gState.Viewport(0, 0, gRenderSize.x, gRenderSize.y);
+
+    glEndQuery(GL_TIME_ELAPSED);
+    ++gShadowTimerFrame;
+    TRACE_GPU_END();
+
+    // Bind the result maps on units 3 and 4 for the lighting shaders
+    gState.BindTextureUnit(3, GL_TEXTURE_2D, gShadowMaps[0].hasDynamic ? gShadowMaps[0].finalMap : gShadowMaps[0].staticMap);
+    gState.BindTextureUnit(4, GL_TEXTURE_2D, gShadowMaps[1].hasDynamic ? gShadowMaps[1].finalMap : gShadowMaps[1].staticMap);
+}
+
+
+// Creates the light SSBO, the cluster grid buffers and the parameters of the extra dynamic lights
+void UCreateLightBuffers()
+{
+    const GLuint clusterCount = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+    // The light list is rewritten from the CPU every frame, the cluster buffers only by the culling shader
+    glCreateBuffers(1, &gLightSsbo);
+    glNamedBufferStorage(gLightSsbo, MAX_LIGHTS * sizeof(GLLight), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+    glCreateBuffers(1, &gClusterCountSsbo);
+    glNamedBufferStorage(gClusterCountSsbo, clusterCount * sizeof(GLuint), NULL, 0);
+
+    glCreateBuffers(1, &gClusterIndexSsbo);
+    glNamedBufferStorage(gClusterIndexSsbo, clusterCount * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), NULL, 0);
+
+    // Binding points match the layout qualifiers in the shaders
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gLightSsbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gClusterCountSsbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gClusterIndexSsbo);
+
+    // Repeatable pseudo random orbits over the table top, every fourth light is a spot pointing down
+    unsigned int seed = 330;
+    auto random01 = [&seed]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+
+    gDynamicLights.clear();
+    for (GLuint i = 0; i < MAX_LIGHTS - 2; ++i)
+    {
+        DynamicLight light;
+        light.orbitRadius = 0.2f + 1.7f * random01();
+        light.height = -0.45f + 0.6f * random01();
+        light.phase = 6.2831853f * random01();
+        light.speed = 0.2f + 0.6f * random01();
+        light.range = 0.3f + 0.4f * random01();
+        light.spot = (i % 4) == 3;
+        light.color = glm::vec3(random01(), random01(), random01());
+        gDynamicLights.push_back(light);
+    }
+}
+
+
+void UDestroyLightBuffers()
+{
+    glDeleteBuffers(1, &gLightSsbo);
+    glDeleteBuffers(1, &gClusterCountSsbo);
+    glDeleteBuffers(1, &gClusterIndexSsbo);
+}
+
+
+// Rebuilds the light list for this frame (key light, camera spotlight, dynamic lights), no GL calls
+void UUpdateLights(float time)
+{
+    const glm::vec4 noCone(0.0f);
+    const glm::vec4 noShadow(0.0f, -1.0f, 0.0f, 0.0f);
+
+    gLights = gFrameArena.Allocate<GLLight>(2 + gDynamicLightCount);
+    gLightCount = 0;
+
+    // key light, unbounded point light using shadow map 0
+    gLights[gLightCount++] = { glm::vec4(gKeyLightPosition, 0.0f), glm::vec4(gKeyLightColor, 0.0f), noCone, glm::vec4(0.0f, 0.0f, 0.0f, 0.0f) };
+
+    // camera spotlight, unbounded, using shadow map 1 (left out while switched off)
+    if (gSpotLightColor != glm::vec3(0.0f))
+        gLights[gLightCount++] = { glm::vec4(gSpotLightPosition, 0.0f), glm::vec4(gSpotLightColor, 1.0f),
+            glm::vec4(gCamera.Front, cos(glm::radians(8.5f))), glm::vec4(cos(glm::radians(12.5f)), 1.0f, 0.0f, 0.0f) };
+
+    for (int i = 0; i < gDynamicLightCount; ++i)
+    {
+        const DynamicLight& light = gDynamicLights[i];
+        float angle = light.phase + light.speed * time;
+        glm::vec3 position(light.orbitRadius * cos(angle), light.height, light.orbitRadius * sin(angle));
+
+        if (light.spot)
+            gLights[gLightCount++] = { glm::vec4(position, light.range), glm::vec4(light.color, 1.0f),
+                glm::vec4(0.0f, -1.0f, 0.0f, cos(glm::radians(20.0f))), glm::vec4(cos(glm::radians(30.0f)), -1.0f, 0.0f, 0.0f) };
+        else
+            gLights[gLightCount++] = { glm::vec4(position, light.range), glm::vec4(light.color, 0.0f), noCone, noShadow };
+    }
+}
+
+
+// Runs the compute pass that writes the list of lights touching each cluster
+void UCullLightsIntoClusters(const glm::mat4& view)
+{
+    TRACE_SCOPE("UCullLightsIntoClusters");
+    TRACE_GPU_BEGIN("light culling");
+
+    const GLuint clusterCount = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    const glm::mat4 inverseProjection = glm::inverse(projection);
+
+    gState.UseProgram(gClusterProgramId);
+    glUniformMatrix4fv(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "view")), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "inverseProjection")), 1, GL_FALSE, glm::value_ptr(inverseProjection));
+    glUniform3ui(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "clusterGrid")), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    glUniform1ui(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "maxLightsPerCluster")), MAX_LIGHTS_PER_CLUSTER);
+    glUniform1ui(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "lightCount")), gLightCount);
+    glUniform1f(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "zNear")), Z_NEAR);
+    glUniform1f(gStats.Uniform(glGetUniformLocation(gClusterProgramId, "zFar")), Z_FAR);
+
+    // One invocation per cluster
+    glDispatchCompute((clusterCount + 63) / 64, 1, 1);
+
+    // The fragment shaders read the cluster lists written above
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    TRACE_GPU_END();
+}
+
+
+// creates the vertices from one circle to another with texture points
+void getUnitCircleVertices(vector<GLfloat>& verts, GLint sectorCount, GLfloat firstYCoord, GLfloat secondYCoord, GLfloat firstRadius, GLfloat secondRadius)
+{
+    const float PI = 3.1415926f;
+    float sectorStep = 2 * PI / sectorCount;
+    float sectorAngle;  // radian
+    float x, z;  // variables for position of verticies
+    float topV = sqrt(pow(firstYCoord - secondYCoord, 2) + pow((firstRadius - secondRadius),2));
+    float bottomV = 0.0;
+    glm::vec3 normal;
+    glm::vec3 firstVec(0.0f);
+    glm::vec3 secondVec(0.0f);
+    glm::vec3 thirdVec(0.0f);
+
+    for (int i = 0; i < sectorCount; ++i)
+    {
+        // calculate the vertex for ith point in first cirlce
+        sectorAngle = i * (sectorStep);
+        x = firstRadius * cos(sectorAngle);
+        z = (firstRadius * sin(sectorAngle));
+        // push the x y and z coordinates into verts
+        verts.push_back(x); // x
+        firstVec.x = x;
+        verts.push_back(firstYCoord); // y
+        firstVec.y = firstYCoord;
+        verts.push_back(z); // z
+        firstVec.z = z;
+        // push 3 numbers into verts as holder for the normal
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+
+        // push texture map coordinates into vert
+        verts.push_back(sectorAngle/ (2*PI));
+        verts.push_back(topV);
+
+        // repeat same steps for ith point in second circle
+        x = secondRadius * cos(sectorAngle);
+        z = (secondRadius * sin(sectorAngle));
+        verts.push_back(x); // x
+        secondVec.x = x;
+        verts.push_back(secondYCoord);                // y
+        secondVec.y = secondYCoord;
+        verts.push_back(z); // z
+        secondVec.z = z;
+        verts.push_back(0.0);
+        verts.push_back(0.0);
+        verts.push_back(0.0);
+
+        verts.push_back(sectorAngle / (2 * PI));
+        verts.push_back(bottomV);
+
+        // repeat same steps for i + 1 point in second circle
+        sectorAngle = (i + 1.0) * (sectorStep);
+
+        x = secondRadius * cos(sectorAngle);
+        z = (secondRadius * sin(sectorAngle));
+        verts.push_back(x); // x
+        thirdVec.x = x;
+        verts.push_back(secondYCoord);                // y
+        thirdVec.y = secondYCoord;
+        verts.push_back(z); // z
+        thirdVec.z = z;
+        // we now have all three points of the triangle and can calculate the normal vector
+        normal = CalculateSurfaceNormal(firstVec, secondVec, thirdVec);
+        //push the normal vector x, y, and z into verts
+        verts.push_back(normal.x * -1);
+        verts.push_back(normal.y);
+        verts.push_back(normal.z * -1);
+
+        verts.push_back(sectorAngle / (2 * PI));
+        verts.push_back(bottomV);
+
+        // replace all normal vector place holders with actual values
+        verts.at(verts.size() - 21) = normal.x * -1;
+        verts.at(verts.size() - 20) = normal.y;
+        verts.at(verts.size() - 19) = normal.z * -1;
+
+        verts.at(verts.size() - 13) = normal.x * -1;
+        verts.at(verts.size() - 12) = normal.y;
+        verts.at(verts.size() - 11) = normal.z * -1;
+
+        // repeat all steps for second triangle to make up first section of final shape
+        verts.push_back(x); // x
+        firstVec.x = x;
+        verts.push_back(secondYCoord);                // y
+        firstVec.y = secondYCoord;
+        verts.push_back(z); // z
+        firstVec.z = z;
+
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+
+        verts.push_back(sectorAngle / (2 * PI));
+        verts.push_back(bottomV);
+
+        x = firstRadius * cos(sectorAngle);
+        z = (firstRadius * sin(sectorAngle));
+        verts.push_back(x); // x
+        secondVec.x = x;
+        verts.push_back(firstYCoord);                // y
+        secondVec.y = firstYCoord;
+        verts.push_back(z); // z
+        secondVec.z = z;
+
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+        verts.push_back(1.0);
+
+        verts.push_back(sectorAngle / (2 * PI));
+        verts.push_back(topV);
+
+        sectorAngle = i * (sectorStep);
+        x = firstRadius * cos(sectorAngle);
+        z = (firstRadius * sin(sectorAngle));
+        verts.push_back(x); // x
+        thirdVec.x = x;
+        verts.push_back(firstYCoord);                // y
+        thirdVec.y = firstYCoord;
+        verts.push_back(z); // z
+        thirdVec.z = z;
+        normal = CalculateSurfaceNormal(firstVec, secondVec, thirdVec);
+        verts.push_back(normal.x * -1);
+        verts.push_back(normal.y);
+        verts.push_back(normal.z * -1);
+
+        verts.push_back(sectorAngle / (2 * PI));
+        verts.push_back(topV);
+
+
+        verts.at(verts.size() - 21) = normal.x * -1;
+        verts.at(verts.size() - 20) = normal.y;
+        verts.at(verts.size() - 19) = normal.z * -1;
+
+        verts.at(verts.size() - 13) = normal.x * -1;
+        verts.at(verts.size() - 12) = normal.y;
+        verts.at(verts.size() - 11) = normal.z * -1;
+    }
+}
+
+// generate vertices for +X face only by intersecting 2 circular planes
+// (longitudinal and latitudinal) at the given longitude/latitude angles
+void buildUnitPositiveX(vector<GLfloat> verts, int subdivision)
+{
+    const float DEG2RAD = acos(-1) / 180.0f;
+
+    std::vector<float> vertices;
+    float n1[3];        // normal of longitudinal plane rotating along Y-axis
+    float n2[3];        // normal of latitudinal plane rotating along Z-axis
+    float v[3];         // direction vector intersecting 2 planes, n1 x n2
+    float a1;           // longitudinal angle along Y-axis
+    float a2;           // latitudinal angle along Z-axis
+    //gsl::
+
+    // compute the number of vertices per row, 2^n + 1
+    int pointsPerRow = (int)pow(2, subdivision) + 1;
+
+    // rotate latitudinal plane from 45 to -45 degrees along Z-axis (top-to-bottom)
+    for (unsigned int i = 0; i < pointsPerRow; ++i)
+    {
+        // normal for latitudinal plane
+        // if latitude angle is 0, then normal vector of latitude plane is n2=(0,1,0)
+        // therefore, it is rotating (0,1,0) vector by latitude angle a2
+        a2 = DEG2RAD * (45.0f - 90.0f * i / (pointsPerRow - 1));
+        n2[0] = -sin(a2);
+        n2[1] = cos(a2);
+        n2[2] = 0;
+
+        // rotate longitudinal plane from -45 to 45 along Y-axis (left-to-right)
+        for (unsigned int j = 0; j < pointsPerRow; ++j)
+        {
+            // normal for longitudinal plane
+            // if longitude angle is 0, then normal vector of longitude is n1=(0,0,-1)
+            // therefore, it is rotating (0,0,-1) vector by longitude angle a1
+            a1 = DEG2RAD * (-45.0f + 90.0f * j / (pointsPerRow - 1));
+            n1[0] = -sin(a1);
+            n1[1] = 0;
+            n1[2] = -cos(a1);
+
+            // find direction vector of intersected line, n1 x n2
+            v[0] = n1[1] * n2[2] - n1[2] * n2[1];
+            v[1] = n1[2] * n2[0] - n1[0] * n2[2];
+            v[2] = n1[0] * n2[1] - n1[1] * n2[0];
+
+            // normalize direction vector
+            float scale = 1 / sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            v[0] *= scale;
+            v[1] *= scale;
+            v[2] *= scale;
+
+            // add a vertex into array
+            verts.push_back(v[0]);
+            verts.push_back(v[1]);
+            verts.push_back(v[2]);
+        }
+    }
+
+}
+
+
+
+// Uploads an interleaved position (3), normal (3), uv (2) mesh into immutable storage and describes it
+// to a new VAO, all through direct state access so no buffer or vertex array binding changes. Storage of
+// size 0 is an error, an empty mesh gets one unused byte.
+void UCreateVertexStream(const vector<GLfloat>& verts, GLuint& vao, GLuint& vbo)
+{
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+    const GLsizei stride = sizeof(GLfloat) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+    glCreateBuffers(1, &vbo);
+    glNamedBufferStorage(vbo, (std::max)(verts.size() * sizeof(GLfloat), size_t(1)), verts.empty() ? nullptr : verts.data(), 0);
+
+    // one buffer binding, the attributes are offsets into it
+    glCreateVertexArrays(1, &vao);
+    glVertexArrayVertexBuffer(vao, 0, vbo, 0, stride);
+
+    const GLint sizes[] = { floatsPerVertex, floatsPerNormal, floatsPerUV };
+    GLuint offset = 0;
+    for (GLuint attribute = 0; attribute < 3; ++attribute)
+    {
+        glEnableVertexArrayAttrib(vao, attribute);
+        glVertexArrayAttribFormat(vao, attribute, sizes[attribute], GL_FLOAT, GL_FALSE, offset);
+        glVertexArrayAttribBinding(vao, attribute, 0);
+        offset += sizes[attribute] * sizeof(GLfloat);
+    }
+}
+
+
+// Builds a tightly packed position-only copy of an interleaved mesh for the depth pre-pass
+// and returns the center of its bounds, the origin for an empty mesh
+glm::vec3 UCreateDepthOnlyStream(const vector<GLfloat>& verts, GLuint& vao, GLuint& vbo)
+{
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+    const GLuint floatsPerInterleaved = floatsPerVertex + floatsPerNormal + floatsPerUV;
+
+    vector<GLfloat> positions;
+    positions.reserve(verts.size() / floatsPerInterleaved * floatsPerVertex);
+
+    glm::vec3 boundsMin = verts.size() >= floatsPerVertex ? glm::vec3(verts[0], verts[1], verts[2]) : glm::vec3(0.0f);
+    glm::vec3 boundsMax = boundsMin;
+    for (size_t i = 0; i + floatsPerVertex <= verts.size(); i += floatsPerInterleaved)
+    {
+        glm::vec3 p(verts[i], verts[i + 1], verts[i + 2]);
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+
+        positions.push_back(p.x);
+        positions.push_back(p.y);
+        positions.push_back(p.z);
+    }
+
+    glCreateBuffers(1, &vbo);
+    glNamedBufferStorage(vbo, (std::max)(positions.size() * sizeof(GLfloat), size_t(1)), positions.empty() ? nullptr : positions.data(), 0);
+
+    // Only the position attribute, tightly packed
+    glCreateVertexArrays(1, &vao);
+    glVertexArrayVertexBuffer(vao, 0, vbo, 0, floatsPerVertex * sizeof(GLfloat));
+    glEnableVertexArrayAttrib(vao, 0);
+    glVertexArrayAttribFormat(vao, 0, floatsPerVertex, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(vao, 0, 0);
+
+    return (boundsMin + boundsMax) * 0.5f;
+}
+
+
+// Fills verts with the interleaved bowl vertices (position, normal, uv), no GL calls
+void UBuildBowlVertices(vector<GLfloat>& verts)
+{
+    GLint numberOfVerts = 60;
+
+    // create verticies for bowl  
+    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.2, 0.5, 0.4);
+    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.4, 0.4, 0.0);
+    getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.49, 0.5, 0.4);
+    getUnitCircleVertices(verts, numberOfVerts, -0.49, -0.49, 0.4, 0.0);
+}
+
+
+// Implements the UCreateMesh function to create the bowl
+void UCreateBowlMesh(GLMesh& mesh)
+{
+    // Specifies Normalized Device Coordinates (x,y,z) and image (u,v) for triangle vertices
+    vector<GLfloat> verts;
+    UBuildBowlVertices(verts);
+
+    cout << verts.size();
+
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+
+    mesh.nBowlVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+    cout << mesh.nBowlVerticies;
+
+    UCreateVertexStream(verts, mesh.bowlvao, mesh.bowlvbo);
+
+    // Position-only copy for the depth pre-pass
+    mesh.bowlCenter = UCreateDepthOnlyStream(verts, mesh.bowldepthvao, mesh.bowldepthvbo);
+
+
+}
+
+// Fills verts with the interleaved grinder vertices (position, normal, uv), no GL calls
+void UBuildGrinderVertices(vector<GLfloat>& verts)
+{
+    GLint numberOfVerts = 60;
+
+    // create verticies for Grinder  
+    //sides of grinder
+   getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.4, 0.05, 0.06);
+   // top of grinder
+   getUnitCircleVertices(verts, numberOfVerts, -0.2, -0.2, 0.05, 0);
+    // bottom of grinder
+   getUnitCircleVertices(verts, numberOfVerts, -0.4, -0.4, 0.06, 0);
+}
+
+
+// Implements the UCreateMesh function to create the grinder
+void UCreateGrinderMesh(GLMesh& mesh)
+{
+    // Specifies Normalized Device Coordinates (x,y,z) and image (u,v) for triangle vertices
+    vector<GLfloat> verts;
+    UBuildGrinderVertices(verts);
+
+    cout << verts.size();
+
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+
+    mesh.nGrinderVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+    cout << mesh.nGrinderVerticies;
+
+    UCreateVertexStream(verts, mesh.grindervao, mesh.grindervbo);
+
+    // Position-only copy for the depth pre-pass
+    mesh.grinderCenter = UCreateDepthOnlyStream(verts, mesh.grinderdepthvao, mesh.grinderdepthvbo);
+
+
+}
+
+
+// Fills verts with the interleaved table vertices (position, normal, uv), no GL calls
+void UBuildTableVertices(vector<GLfloat>& verts)
+{
+    // Vertex data
+    verts = {
+        // The two triangles will be drawn using indices
+        // Left triangle indices: 0, 1, 2
+        // Right triangle indices: 3, 2, 4
+
+        -2.0f, -0.5f, -2.0f,  0.0f, 1.0f, 0.0f, 0.0f, 0.0f, // bottom left
+        2.0f, -0.5f, -2.0f,    0.0f, 1.0f, 0.0f,  1.0f, 0.0f, // bottom right
+        -2.0f, -0.5f, 2.0f,    0.0f, 1.0f, 0.0f,  0.0f, 1.0f, // top left
+
+
+        2.0f, -0.5f, -2.0f,     0.0f, 1.0f, 0.0f, 1.0f, 0.0f, // bottom right
+        -2.0f, -0.5f, 2.0f,     0.0f, 1.0f, 0.0f, 0.0f, 1.0f, // top left
+        2.0f, -0.5f, 2.0f,        0.0f, 1.0f, 0.0f, 1.0f, 1.0f, // top right
+
+         -2.0f, -0.51f, -2.0f,  0.0f, -1.0f, 0.0f, 0.0f, 0.0f, // bottom left
+        2.0f, -0.51f, -2.0f,    0.0f, -1.0f, 0.0f,  1.0f, 0.0f, // bottom right
+        -2.0f, -0.51f, 2.0f,    0.0f, -1.0f, 0.0f,  0.0f, 1.0f, // top left
+
+
+        2.0f, -0.51f, -2.0f,     0.0f, -1.0f, 0.0f, 1.0f, 0.0f, // bottom right
+        -2.0f, -0.51f, 2.0f,     0.0f, -1.0f, 0.0f, 0.0f, 1.0f, // top left
+        2.0f, -0.51f, 2.0f,        0.0f, -1.0f, 0.0f, 1.0f, 1.0f, // top right
+    };
+}
+
+// Implements the UCreateMesh function
+void UCreateTableMesh(GLMesh& mesh)
+{
+    vector<GLfloat> verts;
+    UBuildTableVertices(verts);
+
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+
+    mesh.nTableVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+    UCreateVertexStream(verts, mesh.tablevao, mesh.tablevbo);
+
+    // Position-only copy for the depth pre-pass
+    mesh.tableCenter = UCreateDepthOnlyStream(verts, mesh.tabledepthvao, mesh.tabledepthvbo);
+}
+
+// Fills verts with the interleaved plantar vertices (position, normal, uv), no GL calls
+void UBuildPlantarVertices(vector<GLfloat>& verts) {
+    verts = {
+        //plantar back face
+          -0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
+         0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
+         0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
+         0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
+        -0.25f,  0.0f, -0.25f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
+        -0.15f, -0.5f, -0.15f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
+        // plantar front face
+        -0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
+         0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
+         0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
+         0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
+        -0.25f,  0.0f,  0.25f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
+        -0.15f, -0.5f,  0.15f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
+        // left face
+        -0.25f,  0.0f,  0.25f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+        -0.25f,  0.0f, -0.25f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+        -0.15f, -0.5f, -0.15f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+        -0.15f, -0.5f, -0.15f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+        -0.15f, -0.5f,  0.15f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
+        -0.25f,  0.0f,  0.25f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+        // right face
+         0.25f,  0.0f,  0.25f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+         0.25f,  0.0f, -0.25f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
+         0.15f, -0.5f, -0.15f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+         0.15f, -0.5f, -0.15f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
+         0.15f, -0.5f,  0.15f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
+         0.25f,  0.0f,  0.25f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
+         // bottom face
+        -0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
+         0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
+         0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
+         0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
+        -0.15f, -0.5f,  0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
+        -0.15f, -0.5f, -0.15f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
+        //top face
+        -0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
+         0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
+         0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+         0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+        -0.25f,  0.0f,  0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
+        -0.25f,  0.0f, -0.25f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
+    };
+}
+
+void UCreatePlantarMesh(GLMesh& mesh) {
+    vector<GLfloat> verts;
+    UBuildPlantarVertices(verts);
+
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+
+    mesh.nPlantarVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+
+    UCreateVertexStream(verts, mesh.plantarvao, mesh.plantarvbo);
+
+    // Position-only copy for the depth pre-pass
+    mesh.plantarCenter = UCreateDepthOnlyStream(verts, mesh.plantardepthvao, mesh.plantardepthvbo);
+
+}
+
+// Fills verts with the interleaved dirt vertices (position, normal, uv), no GL calls
+void UBuildDirtVertices(vector<GLfloat>& verts) {
+    verts = {
+        //Dirt
+          
+        //top face
+        -0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
+         0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
+         0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+         0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
+        -0.2f,  0.01f,  0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
+        -0.2f,  0.01f, -0.2f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
+    };
+}
+
+void UCreateDirtMesh(GLMesh& mesh) {
+    vector<GLfloat> verts;
+    UBuildDirtVertices(verts);
+
+    const GLuint floatsPerVertex = 3;
+    const GLuint floatsPerNormal = 3;
+    const GLuint floatsPerUV = 2;
+
+    mesh.nDirtVerticies = verts.size() / (floatsPerVertex + floatsPerNormal + floatsPerUV);
+
+
+    UCreateVertexStream(verts, mesh.dirtvao, mesh.dirtvbo);
+
+    // Position-only copy for the depth pre-pass
+    mesh.dirtCenter = UCreateDepthOnlyStream(verts, mesh.dirtdepthvao, mesh.dirtdepthvbo);
+
+}
+
+// returns the normal of a triangle given the three vectors of the triangle
+glm::vec3 CalculateSurfaceNormal(glm::vec3 vOne, glm::vec3 vTwo, glm::vec3 vThree) {
+    glm::vec3 normal(0.0f, 0.0f, 0.0f);
+
+    normal.x = normal.x + (vOne.y - vTwo.y) * (vOne.z + vTwo.z);
+    normal.y = normal.y + (vOne.z - vTwo.z) * (vOne.x + vTwo.x);
+    normal.z = normal.z + (vOne.x - vTwo.x) * (vOne.y + vTwo.y);
+
+    normal.x = normal.x + (vTwo.y - vThree.y) * (vTwo.z + vThree.z);
+    normal.y = normal.y + (vTwo.z - vThree.z) * (vTwo.x + vThree.x);
+    normal.z = normal.z + (vTwo.x - vThree.x) * (vTwo.y + vThree.y);
+
+    normal.x = normal.x + (vThree.y - vOne.y) * (vThree.z + vOne.z);
+    normal.y = normal.y + (vThree.z - vOne.z) * (vThree.x + vOne.x);
+    normal.z = normal.z + (vThree.x - vOne.x) * (vThree.y + vOne.y);
+
+    return normal;
+
+}
+
+
+void UDestroyMesh(GLMesh& mesh)
+{
+    glDeleteVertexArrays(1, &mesh.tablevao);
+    glDeleteBuffers(1, &mesh.tablevbo);
+    glDeleteVertexArrays(1, &mesh.bowlvao);
+    glDeleteBuffers(1, &mesh.bowlvbo);
+    glDeleteVertexArrays(1, &mesh.plantarvao);
+    glDeleteBuffers(1, &mesh.plantarvbo);
+    glDeleteVertexArrays(1, &mesh.dirtvao);
+    glDeleteBuffers(1, &mesh.dirtvbo);
+    glDeleteVertexArrays(1, &mesh.grindervao);
+    glDeleteBuffers(1, &mesh.grindervbo);
+    glDeleteVertexArrays(1, &mesh.tabledepthvao);
+    glDeleteBuffers(1, &mesh.tabledepthvbo);
+    glDeleteVertexArrays(1, &mesh.bowldepthvao);
+    glDeleteBuffers(1, &mesh.bowldepthvbo);
+    glDeleteVertexArrays(1, &mesh.plantardepthvao);
+    glDeleteBuffers(1, &mesh.plantardepthvbo);
+    glDeleteVertexArrays(1, &mesh.dirtdepthvao);
+    glDeleteBuffers(1, &mesh.dirtdepthvbo);
+    glDeleteVertexArrays(1, &mesh.grinderdepthvao);
+    glDeleteBuffers(1, &mesh.grinderdepthvbo);
+}
+
+
+/*Generate and load the texture*/
+bool UCreateTexture(const char* filename, GLuint& textureId)
+{
+    int width, height, channels;
+    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
+    if (image)
+    {
+        flipImageVertically(image, width, height, channels);
+
+        if (channels != 3 && channels != 4)
+        {
+            cout << "Not implemented to handle image with " << channels << " channels" << endl;
+            stbi_image_free(image);
+            return false;
+        }
+
+        // immutable storage for the full mip chain, then the base level is uploaded and the rest generated
+        GLsizei levels = 1;
+        while ((std::max)(width, height) >> levels)
+            ++levels;
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &textureId);
+        glTextureStorage2D(textureId, levels, channels == 3 ? GL_RGB8 : GL_RGBA8, width, height);
+
+        // set the texture wrapping parameters
+        glTextureParameteri(textureId, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(textureId, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        // set texture filtering parameters
+        glTextureParameteri(textureId, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(textureId, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTextureSubImage2D(textureId, 0, 0, 0, width, height, channels == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, image);
+        glGenerateTextureMipmap(textureId);
+
+        stbi_image_free(image);
+
+        return true;
+    }
+
+    // Error loading the image
+    return false;
+}
+
+
+void UDestroyTexture(GLuint textureId)
+{
+    glGenTextures(1, &textureId);
+}
+
+
+// Implements the UCreateShaders function
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+{
+    // Same path as the background builds, just waiting for the result
+    GLProgramBuild build;
+    UBeginShaderProgram(vtxShaderSource, fragShaderSource, build);
+    ProgramBuildStatus status = UPollShaderProgram(build, true);
+    if (status == BUILD_REJECTED)
+    {
+        // the refused binary was dropped from the cache, so this compiles
+        glDeleteProgram(build.programId);
+        UBeginShaderProgram(vtxShaderSource, fragShaderSource, build);
+        status = UPollShaderProgram(build, true);
+    }
+    programId = build.programId;
+
+    if (status != BUILD_READY)
+        return false;
+
+    glUseProgram(programId);    // Uses the shader program
+
+    return true;
+}
+
+
+// Submits the compile and link of a program without reading back any status, so the driver can work in the background
+void UBeginShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLProgramBuild& build)
+{
+    // Create a Shader program object.
+    build.programId = glCreateProgram();
+    build.vertexShaderId = 0;
+    build.fragmentShaderId = 0;
+    build.submitTime = glfwGetTime();
+
+    // Restore the linked program from the binary cache when these exact sources were built before, the driver
+    // loads it in the background like a link
+    build.cacheKey = ProgramCache::Key({ vtxShaderSource, fragShaderSource });
+    build.cached = ProgramCache::Submit(build.programId, build.cacheKey);
+    if (build.cached)
+        return;
+
+    // Create the vertex and fragment shader objects
+    build.vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+    build.fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+
+    // Retrive the shader source
+    glShaderSource(build.vertexShaderId, 1, &vtxShaderSource, NULL);
+    glShaderSource(build.fragmentShaderId, 1, &fragShaderSource, NULL);
+
+    // Compile and link back to back, errors are picked up by UPollShaderProgram
+    glCompileShader(build.vertexShaderId);
+    glCompileShader(build.fragmentShaderId);
+
+    // Attached compiled shaders to the shader program
+    glAttachShader(build.programId, build.vertexShaderId);
+    glAttachShader(build.programId, build.fragmentShaderId);
+
+    ProgramCache::PrepareForBinary(build.programId);
+    glLinkProgram(build.programId);   // links the shader program
+}
+
+
+// Checks a submitted build. Without GL_KHR_parallel_shader_compile, or when asked to wait, this blocks until the driver is done
+ProgramBuildStatus UPollShaderProgram(GLProgramBuild& build, bool wait)
+{
+    // Compilation and linkage error reporting
+    int success = 0;
+    int linked = 0;
+    char infoLog[512];
+
+    if (!wait && gParallelShaderCompile)
+    {
+        glGetProgramiv(build.programId, GL_COMPLETION_STATUS_KHR, &success);
+        if (!success)
+            return BUILD_PENDING;
+    }
+
+    // A cached binary has no shaders behind it: either the driver took it or it is compiled from source instead
+    if (build.cached)
+    {
+        build.cached = false;
+        return ProgramCache::Accept(build.programId, build.cacheKey) ? BUILD_READY : BUILD_REJECTED;
+    }
+
+    // check for linking errors, and for the compile error behind them
+    glGetProgramiv(build.programId, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        const GLuint shaderIds[] = { build.vertexShaderId, build.fragmentShaderId };
+        const char* shaderTypes[] = { "VERTEX", "FRAGMENT" };
+        for (int i = 0; i < 2; ++i)
+        {
+            if (shaderIds[i] == 0)
+                continue;
+            glGetShaderiv(shaderIds[i], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shaderIds[i], sizeof(infoLog), NULL, infoLog);
+                std::cout << "ERROR::SHADER::" << shaderTypes[i] << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+            }
+        }
+
+        glGetProgramInfoLog(build.programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+    else
+    {
+        ProgramCache::Save(build.programId, build.cacheKey);
+    }
+
+    // the shaders are not needed once the program is linked (or failed to)
+    glDeleteShader(build.vertexShaderId);
+    glDeleteShader(build.fragmentShaderId);
+    build.vertexShaderId = 0;
+    build.fragmentShaderId = 0;
+
+    return linked ? BUILD_READY : BUILD_FAILED;
+}
+
+
+// Implements the UCreateComputeProgram function
+bool UCreateComputeProgram(const char* compShaderSource, GLuint& programId)
+{
+    // Compilation and linkage error reporting
+    int success = 0;
+    char infoLog[512];
+
+    // Create a Shader program object.
+    programId = glCreateProgram();
+
+    // Restore the linked program from the binary cache when this exact source was built before
+    const string cacheKey = ProgramCache::Key({ compShaderSource });
+    if (ProgramCache::Load(programId, cacheKey))
+        return true;
+
+    // Create the compute shader object and retrive its source
+    GLuint computeShaderId = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(computeShaderId, 1, &compShaderSource, NULL);
+
+    glCompileShader(computeShaderId); // compile the compute shader
+    // check for shader compile errors
+    glGetShaderiv(computeShaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(computeShaderId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    glAttachShader(programId, computeShaderId);
+
+    ProgramCache::PrepareForBinary(programId);
+    glLinkProgram(programId);   // links the shader program
+    // check for linking errors
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+
+        return false;
+    }
+
+    ProgramCache::Save(programId, cacheKey);
+
+    return true;
+}
+
+// Returns the shader source with injectedSource placed right after its #version line
+string UInjectAfterVersion(const char* shaderSource, const char* injectedSource)
+{
+    string source = shaderSource;
+    size_t lineEnd = source.find('\n');
+    source.insert(lineEnd == string::npos ? source.size() : lineEnd + 1, injectedSource);
+    return source;
+}
+
+
+// cameraBlockSource with its arrays sized like GLCameraBlock's
+string UCameraBlockSource()
+{
+    ostringstream source;
+    source << "#define MAX_VIEWS " << MAX_VIEWS << "\n" << cameraBlockSource;
+    return source.str();
+}
+
+
+// multiViewVertexShaderSource for this driver: SELECT_VIEWPORT writes gl_ViewportIndex when an extension lets
+// the vertex shader do it, otherwise it is empty and URender draws the views as separate passes
+string UMultiViewVertexSource()
+{
+    const string prelude = (gViewportIndexExtension
+        ? string("#extension ") + gViewportIndexExtension + " : require\n#define SELECT_VIEWPORT(index) gl_ViewportIndex = int(index)\n"
+        : string("#define SELECT_VIEWPORT(index)\n")) + UCameraBlockSource();
+    return UInjectAfterVersion(multiViewVertexShaderSource, prelude.c_str());
+}
+
+void UDestroyShaderProgram(GLuint programId)
+{
+    glDeleteProgram(programId);
+}
+
+
+// Lighting features this frame needs, from the current light list and toggles
+GLuint UFrameShaderFeatures()
+{
+    GLuint features = 0;
+
+    for (GLuint i = 0; i < gLightCount; ++i)
+    {
+        if (gLights[i].colorType.w > 0.5f)
+        {
+            features |= SHADER_HAS_SPOTLIGHT;
+            break;
+        }
+    }
+
+    if (gShadowsEnabled)
+        features |= SHADER_HAS_SHADOWS | (GLuint(gPcfRadius) << SHADER_PCF_SHIFT);
+
+    // A handful of lights is cheaper to loop over directly than to cull into clusters. The cluster grid is built
+    // for one view, so a multi-view frame loops over every light.
+    if (gLightCount > MAX_UNCLUSTERED_LIGHTS && gMultiView == MULTIVIEW_OFF)
+        features |= SHADER_CLUSTERED;
+    else
+        features |= gLightCount << SHADER_NUM_LIGHTS_SHIFT;
+
+    return features;
+}
+
+
+// Returns the program for a variant key. A variant is built in the background the first time it is asked for,
+// and the pass's fallback program is returned until it is ready
+GLuint UGetShaderVariant(GLuint variantKey)
+{
+    map<GLuint, GLuint>::const_iterator cached = gShaderVariants.find(variantKey);
+    if (cached != gShaderVariants.end())
+        return cached->second;
+
+    const GLuint pass = (variantKey >> SHADER_PASS_SHIFT) & 3u;
+    const GLuint fallbackProgramId = (variantKey & SHADER_MULTIVIEW) ? gFallbackMultiViewProgramId : gFallbackProgramIds[pass];
+
+    if (gPendingShaderVariants.find(variantKey) == gPendingShaderVariants.end())
+        USubmitShaderVariant(variantKey);
+
+    const double start = glfwGetTime();
+    GLProgramBuild& build = gPendingShaderVariants[variantKey];
+    const ProgramBuildStatus status = UPollShaderProgram(build, false);
+    gShaderVariantBlockingMs += (glfwGetTime() - start) * 1000.0;
+
+    if (status == BUILD_PENDING)
+        return fallbackProgramId;
+
+    // The driver refused the cached binary, which is now gone from the cache: compile the variant from source
+    if (status == BUILD_REJECTED)
+    {
+        glDeleteProgram(build.programId);
+        gPendingShaderVariants.erase(variantKey);
+        USubmitShaderVariant(variantKey);
+        return fallbackProgramId;
+    }
+
+    // Sampler units come from the binding qualifiers: material texture / G-buffer on 0 to 2, shadow maps on 3 and 4
+    GLuint programId = build.programId;
+    if (status == BUILD_FAILED)
+    {
+        // Keep the fallback for a broken variant rather than rebuilding it every frame
+        glDeleteProgram(programId);
+        programId = fallbackProgramId;
+    }
+
+    cout << "Shader variant 0x" << hex << variantKey << dec << (status == BUILD_READY ? " ready " : " failed ")
+        << (glfwGetTime() - build.submitTime) * 1000.0 << " ms after submission (" << gShaderVariants.size() + 1 << " variants, "
+        << gShaderVariantBlockingMs << " ms blocked on builds)" << endl;
+
+    gShaderVariants[variantKey] = programId;
+    gPendingShaderVariants.erase(variantKey);
+
+    return programId;
+}
+
+
+// Builds the sources of a variant with the matching #defines and submits its compile and link
+void USubmitShaderVariant(GLuint variantKey)
+{
+    const double start = glfwGetTime();
+    const GLuint pass = (variantKey >> SHADER_PASS_SHIFT) & 3u;
+
+    // SPIR-V: no GLSL front end, the features are specialization constants of the precompiled modules. The
+    // multi-view vertex shader depends on the driver's viewport index extension and is always built from GLSL.
+    if (gSpirvShaders && !(variantKey & SHADER_MULTIVIEW))
+    {
+        GLProgramBuild& build = gPendingShaderVariants[variantKey];
+        if (pass == PASS_GBUFFER)
+            UBeginSpirvProgram(SPIRV_SCENE_VERT, SPIRV_GBUFFER_FRAG, variantKey, build);
+        else if (pass == PASS_DEFERRED_LIGHTING)
+            UBeginSpirvProgram(SPIRV_FULLSCREEN_VERT, SPIRV_DEFERRED_LIGHTING_FRAG, variantKey, build);
+        else
+            UBeginSpirvProgram(SPIRV_SCENE_VERT, SPIRV_FORWARD_FRAG, variantKey, build);
+        gShaderVariantBlockingMs += (glfwGetTime() - start) * 1000.0;
+        return;
+    }
+
+    // Every feature macro is defined to 0 or 1 so the shaders can test it with a plain if
+    ostringstream defines;
+    defines << "#define HAS_TEXTURE " << ((variantKey & SHADER_HAS_TEXTURE) ? 1 : 0) << "\n"
+        << "#define HAS_SPOTLIGHT " << ((variantKey & SHADER_HAS_SPOTLIGHT) ? 1 : 0) << "\n"
+        << "#define HAS_SHADOWS " << ((variantKey & SHADER_HAS_SHADOWS) ? 1 : 0) << "\n"
+        << "#define CLUSTERED " << ((variantKey & SHADER_CLUSTERED) ? 1 : 0) << "\n"
+        << "#define PCF_RADIUS " << ((variantKey >> SHADER_PCF_SHIFT) & 3u) << "\n"
+        << "#define NUM_LIGHTS " << (variantKey >> SHADER_NUM_LIGHTS_SHIFT) << "\n"
+        << "#define LIGHTMAP " << ((variantKey & SHADER_LIGHTMAP) ? 1 : 0) << "\n";
+    const string sceneDefines = defines.str() + UCameraBlockSource();
+    const string lightingDefines = sceneDefines + clusteredLightingSource;
+
+    string vertexSource;
+    string fragmentSource;
+    switch (pass)
+    {
+    case PASS_GBUFFER:
+        vertexSource = UInjectAfterVersion(vertexShaderSource, sceneDefines.c_str());
+        fragmentSource = UInjectAfterVersion(gBufferFragmentShaderSource, defines.str().c_str());
+        break;
+    case PASS_DEFERRED_LIGHTING:
+        vertexSource = fullscreenVertexShaderSource;
+        fragmentSource = UInjectAfterVersion(deferredLightingFragmentShaderSource, lightingDefines.c_str());
+        break;
+    default:
+        vertexSource = (variantKey & SHADER_MULTIVIEW) ? UMultiViewVertexSource() : UInjectAfterVersion(vertexShaderSource, sceneDefines.c_str());
+        fragmentSource = UInjectAfterVersion(fragmentShaderSource, lightingDefines.c_str());
+        break;
+    }
+
+    UBeginShaderProgram(vertexSource.c_str(), fragmentSource.c_str(), gPendingShaderVariants[variantKey]);
+    gShaderVariantBlockingMs += (glfwGetTime() - start) * 1000.0;
+}
+
+
+// Submits the variants reachable from the starting scene: the current lights with and without shadows,
+// and the clustered variants the L key switches to
+void UPrewarmShaderVariants()
+{
+    UUpdateLights(0.0f);
+    const GLuint frameFeatures = UFrameShaderFeatures();
+    const GLuint lightingMask = SHADER_HAS_SPOTLIGHT | SHADER_HAS_SHADOWS | (3u << SHADER_PCF_SHIFT);
+    const GLuint clusteredFeatures = (frameFeatures & lightingMask) | SHADER_CLUSTERED;
+    const GLuint lightingVariants[] = { frameFeatures, frameFeatures & ~(SHADER_HAS_SHADOWS | (3u << SHADER_PCF_SHIFT)),
+        clusteredFeatures, clusteredFeatures | SHADER_HAS_SPOTLIGHT };
+
+    const GLuint multiView = gMultiView != MULTIVIEW_OFF ? SHADER_MULTIVIEW : 0u;
+
+    vector<GLuint> keys;
+    for (GLuint lighting : lightingVariants)
+    {
+        if (gDeferredShading)
+            keys.push_back((PASS_DEFERRED_LIGHTING << SHADER_PASS_SHIFT) | lighting);
+        else
+            for (const GLDrawItem& item : gDrawItems)
+                keys.push_back((PASS_FORWARD << SHADER_PASS_SHIFT) | lighting | item.features | multiView);
+    }
+    if (gDeferredShading)
+        for (const GLDrawItem& item : gDrawItems)
+            keys.push_back((PASS_GBUFFER << SHADER_PASS_SHIFT) | (item.features & SHADER_HAS_TEXTURE));
+
+    for (GLuint key : keys)
+    {
+        if (gShaderVariants.find(key) == gShaderVariants.end() && gPendingShaderVariants.find(key) == gPendingShaderVariants.end())
+            USubmitShaderVariant(key);
+    }
+
+    cout << "INFO: Submitted " << gPendingShaderVariants.size() << " shader variant builds in " << gShaderVariantBlockingMs << " ms" << endl;
+}
+
+
+// Creates the cheap programs drawn while variants are still building, one per ShaderPass
+bool UCreateFallbackPrograms()
+{
+    // the vertex shader and G-buffer shader only read the feature macros, all of them off here
+    const char* noFeatures = "#define HAS_TEXTURE 0\n#define HAS_SPOTLIGHT 0\n#define HAS_SHADOWS 0\n#define CLUSTERED 0\n#define PCF_RADIUS 0\n#define NUM_LIGHTS 0\n#define LIGHTMAP 0\n";
+    const string cameraBlock = UCameraBlockSource();
+    const string vertexSource = UInjectAfterVersion(vertexShaderSource, (noFeatures + cameraBlock).c_str());
+    const string gBufferSource = UInjectAfterVersion(gBufferFragmentShaderSource, noFeatures);
+    const string fallbackSource = UInjectAfterVersion(fallbackFragmentShaderSource, cameraBlock.c_str());
+
+    if (!UCreateShaderProgram(vertexSource.c_str(), fallbackSource.c_str(), gFallbackProgramIds[PASS_FORWARD]))
+        return false;
+
+    if (!UCreateShaderProgram(vertexSource.c_str(), gBufferSource.c_str(), gFallbackProgramIds[PASS_GBUFFER]))
+        return false;
+
+    if (!UCreateShaderProgram(fullscreenVertexShaderSource, fallbackDeferredFragmentShaderSource, gFallbackProgramIds[PASS_DEFERRED_LIGHTING]))
+        return false;
+
+    if (!UCreateShaderProgram(UMultiViewVertexSource().c_str(), fallbackSource.c_str(), gFallbackMultiViewProgramId))
+        return false;
+
+    return true;
+}
+
+
+void UDestroyShaderVariants()
+{
+    // failed variants point at a fallback, which is released below
+    for (map<GLuint, GLuint>::const_iterator it = gShaderVariants.begin(); it != gShaderVariants.end(); ++it)
+        if (it->second != gFallbackProgramIds[(it->first >> SHADER_PASS_SHIFT) & 3u] && it->second != gFallbackMultiViewProgramId)
+            UDestroyShaderProgram(it->second);
+    gShaderVariants.clear();
+
+    // builds that never finished
+    for (map<GLuint, GLProgramBuild>::iterator it = gPendingShaderVariants.begin(); it != gPendingShaderVariants.end(); ++it)
+    {
+        glDeleteShader(it->second.vertexShaderId);
+        glDeleteShader(it->second.fragmentShaderId);
+        UDestroyShaderProgram(it->second.programId);
+    }
+    gPendingShaderVariants.clear();
+
+    for (GLuint programId : gFallbackProgramIds)
+        UDestroyShaderProgram(programId);
+    UDestroyShaderProgram(gFallbackMultiViewProgramId);
+}
+
+
+// Location of an explicitly placed lighting uniform in a program, -1 when the program does not use it
+// (uniforms the compiler optimized away have no location to write to)
+GLint ULightingUniform(GLuint programId, GLint location)
+{
+    map<GLuint, GLuint>::iterator mask = gActiveUniformMasks.find(programId);
+    if (mask == gActiveUniformMasks.end())
+    {
+        // Introspect by index, SPIR-V programs do not need to keep uniform names
+        GLuint activeLocations = 0;
+        GLint uniformCount = 0;
+        glGetProgramInterfaceiv(programId, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+        for (GLint i = 0; i < uniformCount; ++i)
+        {
+            const GLenum property = GL_LOCATION;
+            GLint uniformLocation = -1;
+            glGetProgramResourceiv(programId, GL_UNIFORM, i, 1, &property, 1, NULL, &uniformLocation);
+            if (uniformLocation >= 0 && uniformLocation < 32)
+                activeLocations |= 1u << uniformLocation;
+        }
+        mask = gActiveUniformMasks.insert(make_pair(programId, activeLocations)).first;
+    }
+
+    return (mask->second >> location) & 1u ? location : -1;
+}
+
+
+// File name, GLSL source and the specialization constants (bit per SPEC_CONSTANT_NAMES entry) of a SPIR-V module
+const char* USpirvModuleInfo(SpirvModule module, const char*& source, GLuint& constants, bool& lighting)
+{
+    const GLuint allConstants = (1u << SPEC_CONSTANT_COUNT) - 1u;
+    lighting = false;
+    switch (module)
+    {
+    case SPIRV_SCENE_VERT:
+        source = vertexShaderSource;
+        constants = 1u << 3; // CLUSTERED
+        return "scene.vert";
+    case SPIRV_FORWARD_FRAG:
+        source = fragmentShaderSource;
+        constants = allConstants;
+        lighting = true;
+        return "forward.frag";
+    case SPIRV_GBUFFER_FRAG:
+        source = gBufferFragmentShaderSource;
+        constants = 1u << 0; // HAS_TEXTURE
+        return "gbuffer.frag";
+    case SPIRV_FULLSCREEN_VERT:
+        source = fullscreenVertexShaderSource;
+        constants = 0;
+        return "fullscreen.vert";
+    default:
+        source = deferredLightingFragmentShaderSource;
+        constants = allConstants & ~1u; // everything but HAS_TEXTURE
+        lighting = true;
+        return "deferred_lighting.frag";
+    }
+}
+
+
+// Writes the GLSL of every SPIR-V module. The feature macros become specialization constants and the
+// version is raised to 450, the lowest GLSL the SPIR-V compiler accepts for OpenGL
+bool UExportShaders(const string& directory)
+{
+    for (int module = 0; module < SPIRV_MODULE_COUNT; ++module)
+    {
+        const char* source = NULL;
+        GLuint constants = 0;
+        bool lighting = false;
+        const string path = directory + "/" + USpirvModuleInfo(SpirvModule(module), source, constants, lighting);
+
+        ostringstream prelude;
+        for (GLuint id = 0; id < SPEC_CONSTANT_COUNT; ++id)
+            if (constants & (1u << id))
+                prelude << "layout(constant_id = " << id << ") const int " << SPEC_CONSTANT_NAMES[id] << " = 0;\n";
+        if (module == SPIRV_SCENE_VERT || lighting)
+            prelude << UCameraBlockSource();
+        if (lighting)
+            prelude << clusteredLightingSource;
+
+        string glsl = UInjectAfterVersion(source, prelude.str().c_str());
+        glsl.replace(0, glsl.find('\n'), "#version 450");
+
+        ofstream file(path.c_str());
+        if (!file)
+        {
+            cout << "ERROR: cannot write " << path << endl;
+            return false;
+        }
+        file << glsl;
+        cout << "Exported " << path << endl;
+    }
+
+    return true;
+}
+
+
+// Reads the precompiled modules, all of them or none: a partial set would mix SPIR-V and GLSL builds of one pass
+void ULoadSpirvModules()
+{
+    if (!gSpirvAllowed)
+    {
+        cout << "INFO: Shaders: GLSL (--glsl)" << endl;
+        return;
+    }
+    if (!GLEW_VERSION_4_6 && !GLEW_ARB_gl_spirv)
+    {
+        cout << "INFO: Shaders: GLSL (no ARB_gl_spirv)" << endl;
+        return;
+    }
+
+    for (int module = 0; module < SPIRV_MODULE_COUNT; ++module)
+    {
+        const char* source = NULL;
+        GLuint constants = 0;
+        bool lighting = false;
+        const string path = string(SPIRV_DIRECTORY) + "/" + USpirvModuleInfo(SpirvModule(module), source, constants, lighting) + ".spv";
+
+        ifstream file(path.c_str(), ios::binary);
+        gSpirvModules[module].assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        if (gSpirvModules[module].empty())
+        {
+            cout << "INFO: Shaders: GLSL (" << path << " missing, run compile_spirv.cmd)" << endl;
+            for (int i = 0; i < SPIRV_MODULE_COUNT; ++i)
+                gSpirvModules[i].clear();
+            return;
+        }
+    }
+
+    gSpirvShaders = true;
+    cout << "INFO: Shaders: SPIR-V from " << SPIRV_DIRECTORY << endl;
+}
+
+
+// Loads one module into a new shader object and specializes it with the variant's feature values
+GLuint USpecializeSpirvShader(SpirvModule module, GLenum stage, const GLuint* constantValues)
+{
+    const char* source = NULL;
+    GLuint constants = 0;
+    bool lighting = false;
+    USpirvModuleInfo(module, source, constants, lighting);
+
+    GLuint shaderId = glCreateShader(stage);
+    glShaderBinary(1, &shaderId, GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, &gSpirvModules[module][0], (GLsizei)gSpirvModules[module].size());
+
+    // only the constants the module declares may be specialized
+    GLuint indices[SPEC_CONSTANT_COUNT];
+    GLuint values[SPEC_CONSTANT_COUNT];
+    GLuint count = 0;
+    for (GLuint id = 0; id < SPEC_CONSTANT_COUNT; ++id)
+    {
+        if (constants & (1u << id))
+        {
+            indices[count] = id;
+            values[count] = constantValues[id];
+            ++count;
+        }
+    }
+
+    if (GLEW_VERSION_4_6)
+        glSpecializeShader(shaderId, "main", count, indices, values);
+    else
+        glSpecializeShaderARB(shaderId, "main", count, indices, values);
+
+    return shaderId;
+}
+
+
+// SPIR-V counterpart of UBeginShaderProgram, the variant key becomes specialization constants
+void UBeginSpirvProgram(SpirvModule vertexModule, SpirvModule fragmentModule, GLuint variantKey, GLProgramBuild& build)
+{
+    const GLuint constantValues[SPEC_CONSTANT_COUNT] = {
+        (variantKey & SHADER_HAS_TEXTURE) ? 1u : 0u,
+        (variantKey & SHADER_HAS_SPOTLIGHT) ? 1u : 0u,
+        (variantKey & SHADER_HAS_SHADOWS) ? 1u : 0u,
+        (variantKey & SHADER_CLUSTERED) ? 1u : 0u,
+        (variantKey >> SHADER_PCF_SHIFT) & 3u,
+        variantKey >> SHADER_NUM_LIGHTS_SHIFT,
+        (variantKey & SHADER_LIGHTMAP) ? 1u : 0u };
+
+    // Create a Shader program object.
+    build.programId = glCreateProgram();
+    build.vertexShaderId = 0;
+    build.fragmentShaderId = 0;
+    build.submitTime = glfwGetTime();
+
+    // The binary cache key covers both modules and the constant values
+    const string vertexBinary(gSpirvModules[vertexModule].begin(), gSpirvModules[vertexModule].end());
+    const string fragmentBinary(gSpirvModules[fragmentModule].begin(), gSpirvModules[fragmentModule].end());
+    const string constants(reinterpret_cast<const char*>(constantValues), sizeof(constantValues));
+    build.cacheKey = ProgramCache::Key({ vertexBinary, fragmentBinary, constants });
+    build.cached = ProgramCache::Submit(build.programId, build.cacheKey);
+    if (build.cached)
+        return;
+
+    build.vertexShaderId = USpecializeSpirvShader(vertexModule, GL_VERTEX_SHADER, constantValues);
+    build.fragmentShaderId = USpecializeSpirvShader(fragmentModule, GL_FRAGMENT_SHADER, constantValues);
+
+    glAttachShader(build.programId, build.vertexShaderId);
+    glAttachShader(build.programId, build.fragmentShaderId);
+
+    ProgramCache::PrepareForBinary(build.programId);
+    glLinkProgram(build.programId);
+}
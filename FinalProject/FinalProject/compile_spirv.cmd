@@ -0,0 +1,33 @@
+@echo off
+rem Post-build step: compiles the lighting shaders to SPIR-V for the ARB_gl_spirv path in Source.cpp.
+rem usage: compile_spirv.cmd <FinalProject.exe> <output directory>
+rem
+rem The shaders are GLSL() strings inside Source.cpp, so the freshly built executable exports them
+rem (--export-shaders) and glslangValidator from the Vulkan SDK compiles them. When glslangValidator
+rem is not available the build still succeeds and the program compiles GLSL at runtime instead.
+setlocal
+
+set EXE=%~1
+set OUT=%~2
+set GLSLANG=glslangValidator
+if defined VULKAN_SDK set GLSLANG="%VULKAN_SDK%\Bin\glslangValidator.exe"
+
+if not exist "%OUT%" mkdir "%OUT%"
+rem stale modules would not match the exported sources
+del /q "%OUT%\*.spv" 2>nul
+
+"%EXE%" --export-shaders "%OUT%" >nul || (
+    echo warning: could not export the shaders, the GLSL fallback will be used
+    exit /b 0
+)
+
+for %%s in (scene.vert forward.frag gbuffer.frag fullscreen.vert deferred_lighting.frag) do (
+    %GLSLANG% -G -o "%OUT%\%%s.spv" "%OUT%\%%s" >nul 2>&1 || (
+        echo warning: glslangValidator could not compile %%s, the GLSL fallback will be used
+        del /q "%OUT%\*.spv" 2>nul
+        exit /b 0
+    )
+)
+
+echo SPIR-V shaders written to %OUT%
+exit /b 0
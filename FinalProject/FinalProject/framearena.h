@@ -0,0 +1,112 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Linear allocator for data that only lives until the end of the frame. Allocation bumps an offset in one
+// block reserved up front, Reset() at the start of the next frame releases everything at once; nothing is
+// destructed, so only trivially destructible types belong here. A frame that outgrows the block still gets
+// its memory from the heap (freed by the next Reset) and is counted, the allocation check reports it.
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity) : base(static_cast<char*>(std::malloc(capacity))), capacity(capacity) {}
+	~FrameArena()
+	{
+		Reset();
+		std::free(base);
+	}
+
+	void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+	{
+		const size_t start = (offset + alignment - 1) & ~(alignment - 1);
+		if (start + bytes <= capacity)
+		{
+			offset = start + bytes;
+			highWater = offset > highWater ? offset : highWater;
+			return base + start;
+		}
+
+		// overflow block: header links it for Reset, the payload follows at max_align_t alignment
+		++overflows;
+		const size_t header = (sizeof(Overflow) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		Overflow* block = static_cast<Overflow*>(::operator new(header + bytes));
+		block->next = overflow;
+		overflow = block;
+		return reinterpret_cast<char*>(block) + header;
+	}
+
+	template <typename T>
+	T* Allocate(size_t count)
+	{
+		return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	void Reset()
+	{
+		while (overflow)
+		{
+			Overflow* next = overflow->next;
+			::operator delete(overflow);
+			overflow = next;
+		}
+		offset = 0;
+	}
+
+	size_t Used() const { return offset; }
+	size_t HighWater() const { return highWater; }
+	size_t Capacity() const { return capacity; }
+	unsigned int Overflows() const { return overflows; }
+
+private:
+	struct Overflow
+	{
+		Overflow* next;
+	};
+
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	char* base;
+	size_t capacity;
+	size_t offset = 0;
+	size_t highWater = 0;
+	unsigned int overflows = 0;
+	Overflow* overflow = nullptr;
+};
+
+// Heap allocation counter fed by the replaced global operator new in Source.cpp (TRACK_ALLOCATIONS builds).
+// The frame loop samples it around each frame to prove the steady state does not allocate.
+class AllocationCounter
+{
+public:
+	static void Count()
+	{
+		Allocations().fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static unsigned long long Total()
+	{
+		return Allocations().load(std::memory_order_relaxed);
+	}
+
+	static bool Enabled()
+	{
+#ifdef TRACK_ALLOCATIONS
+		return true;
+#else
+		return false;
+#endif
+	}
+
+private:
+	static std::atomic<unsigned long long>& Allocations()
+	{
+		static std::atomic<unsigned long long> allocations(0);
+		return allocations;
+	}
+};
+#endif
@@ -0,0 +1,226 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <timeapi.h>        // timeBeginPeriod, the 15.6 ms default timer makes every short sleep oversleep
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Paces the frame loop: the swap interval of each mode, a frame rate cap for the capped mode, and a limit on
+// how many frames the CPU may queue ahead of the GPU, enforced with a fence per frame. Call BeginFrame before
+// the frame samples its input and EndFrame right after the swap. The present-to-present times of the last
+// HISTORY frames are kept for the frame time variance report.
+class FramePacer
+{
+public:
+	enum Mode
+	{
+		VSYNC,              // swap interval 1
+		ADAPTIVE_VSYNC,     // swap interval -1: waits for vblank, tears instead of waiting when a frame is late
+		UNCAPPED,           // swap interval 0
+		CAPPED,             // swap interval 0, BeginFrame holds the frame rate at the cap
+		MODE_COUNT
+	};
+
+	static const int MAX_FRAMES_IN_FLIGHT = 3;
+	static const int HISTORY = 240;
+
+	// frame times over the history, milliseconds
+	struct Report
+	{
+		int frames = 0;
+		double meanMs = 0.0;
+		double deviationMs = 0.0;   // standard deviation, the frame-to-frame jitter
+		double p99Ms = 0.0;
+		double worstMs = 0.0;
+		double waitMs = 0.0;        // mean time BeginFrame held the frame back
+	};
+
+	FramePacer()
+	{
+#ifdef _WIN32
+		timeBeginPeriod(1);
+#endif
+	}
+
+	~FramePacer()
+	{
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	static const char* ModeName(Mode mode)
+	{
+		const char* names[MODE_COUNT] = { "vsync", "adaptive vsync", "uncapped", "capped" };
+		return mode < MODE_COUNT ? names[mode] : "unknown";
+	}
+
+	// the glfwSwapInterval argument of a mode; adaptive vsync needs EXT_swap_control_tear and falls back to vsync
+	static int SwapInterval(Mode mode, bool tearSupported)
+	{
+		if (mode == ADAPTIVE_VSYNC)
+			return tearSupported ? -1 : 1;
+		return mode == VSYNC ? 1 : 0;
+	}
+
+	void SetMode(Mode newMode) { mode = newMode; }
+	Mode GetMode() const { return mode; }
+
+	void SetCap(double framesPerSecond) { capSeconds = framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0; }
+	double Cap() const { return capSeconds > 0.0 ? 1.0 / capSeconds : 0.0; }
+
+	void SetFramesInFlight(int frames) { framesInFlight = frames < 1 ? 1 : frames > MAX_FRAMES_IN_FLIGHT ? MAX_FRAMES_IN_FLIGHT : frames; }
+	int FramesInFlight() const { return framesInFlight; }
+
+	// Waits until the GPU finished the frame framesInFlight frames back, then, when capped, until one cap
+	// interval after the previous frame began. The cap sleeps while more than the worst oversleep seen is
+	// left and spins the rest, so it is both cheap and on time.
+	void BeginFrame()
+	{
+		const Clock::time_point start = Clock::now();
+
+		if (frame >= framesInFlight)
+		{
+			GLsync& fence = fences[(frame - framesInFlight) % MAX_FRAMES_IN_FLIGHT];
+			if (fence)
+			{
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+				glDeleteSync(fence);
+				fence = 0;
+			}
+		}
+
+		if (mode == CAPPED && capSeconds > 0.0 && began)
+		{
+			const Clock::duration interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(capSeconds));
+			const Clock::time_point target = lastBegin + interval;
+			WaitUntil(target);
+
+			// stepping from the target keeps the average on the cap; more than an interval behind, start over
+			const Clock::time_point now = Clock::now();
+			lastBegin = now - target > interval ? now : target;
+		}
+		else
+			lastBegin = Clock::now();
+		began = true;
+
+		waitSeconds[frame % HISTORY] = Seconds(Clock::now() - start);
+	}
+
+	// fences the frame's commands and records the present-to-present time
+	void EndFrame()
+	{
+		GLsync& fence = fences[frame % MAX_FRAMES_IN_FLIGHT];
+		if (fence)
+			glDeleteSync(fence);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		const Clock::time_point now = Clock::now();
+		if (presented && !idle)
+		{
+			frameSeconds[recorded % HISTORY] = Seconds(now - lastPresent);
+			++recorded;
+		}
+		lastPresent = now;
+		presented = true;
+		idle = false;
+		++frame;
+	}
+
+	// the loop slept waiting for input, the next frame time is not a frame time
+	void Idle() { idle = true; began = false; }
+
+	Report GetReport() const
+	{
+		Report report;
+		const long long count = recorded < HISTORY ? recorded : HISTORY;
+		if (count == 0)
+			return report;
+
+		double sum = 0.0, sumSquares = 0.0, waited = 0.0;
+		double sorted[HISTORY];
+		for (long long i = 0; i < count; ++i)
+		{
+			sorted[i] = frameSeconds[i];
+			sum += frameSeconds[i];
+			sumSquares += frameSeconds[i] * frameSeconds[i];
+		}
+		const long long waits = frame < HISTORY ? frame : HISTORY;
+		for (long long i = 0; i < waits; ++i)
+			waited += waitSeconds[i];
+		std::sort(sorted, sorted + count);
+
+		const double mean = sum / count;
+		report.frames = int(count);
+		report.meanMs = mean * 1000.0;
+		report.deviationMs = std::sqrt((std::max)(sumSquares / count - mean * mean, 0.0)) * 1000.0;
+		report.p99Ms = sorted[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1] * 1000.0;
+		report.worstMs = sorted[count - 1] * 1000.0;
+		report.waitMs = waits > 0 ? waited / waits * 1000.0 : 0.0;
+		return report;
+	}
+
+	// deletes the fences, needs the context
+	void Destroy()
+	{
+		for (GLsync& fence : fences)
+		{
+			if (fence)
+				glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	static double Seconds(Clock::duration duration) { return std::chrono::duration<double>(duration).count(); }
+
+	void WaitUntil(Clock::time_point target)
+	{
+		for (;;)
+		{
+			const Clock::time_point before = Clock::now();
+			if (before >= target || Seconds(target - before) <= sleepMargin)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			// the margin follows the worst recent oversleep, decaying so one hiccup does not spin forever
+			const double overslept = Seconds(Clock::now() - before) - 0.001;
+			sleepMargin = (std::max)(sleepMargin * 0.99, (std::min)(overslept + 0.0002, 0.02));
+		}
+		while (Clock::now() < target)
+			std::this_thread::yield();
+	}
+
+	Mode mode = VSYNC;
+	double capSeconds = 0.0;
+	int framesInFlight = 2;
+	GLsync fences[MAX_FRAMES_IN_FLIGHT] = {};
+	long long frame = 0;
+	long long recorded = 0;
+	double frameSeconds[HISTORY] = {};
+	double waitSeconds[HISTORY] = {};
+	double sleepMargin = 0.002;
+	Clock::time_point lastBegin;
+	Clock::time_point lastPresent;
+	bool began = false;
+	bool presented = false;
+	bool idle = false;
+};
+#endif
@@ -0,0 +1,284 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+#include <map>
+
+// Shadow copy of the GL binding and capability state. Program, VAO, texture, buffer, framebuffer and
+// capability changes made through it are only issued when they change something; the rest are dropped
+// and counted. Anything that changes the same state behind its back must call Invalidate().
+class GLStateCache
+{
+public:
+	// calls issued to GL and calls dropped as redundant
+	struct Stats
+	{
+		unsigned int issued = 0;
+		unsigned int filtered = 0;
+		// issued program, VAO and texture binds, also part of issued
+		unsigned int programs = 0;
+		unsigned int vertexArrays = 0;
+		unsigned int textures = 0;
+	};
+
+	static GLStateCache& Current()
+	{
+		static GLStateCache cache;
+		return cache;
+	}
+
+	// forget everything, the next call of each kind is always issued
+	void Invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		activeTexture = UNKNOWN;
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+			textures2D[unit] = UNKNOWN;
+		drawFramebuffer = UNKNOWN;
+		readFramebuffer = UNKNOWN;
+		buffers.clear();
+		bufferBases.clear();
+		capabilities.clear();
+		depthMask = UNKNOWN;
+		depthFunc = UNKNOWN;
+		colorMask = UNKNOWN;
+		clearColorKnown = false;
+		viewportKnown = false;
+	}
+
+	void UseProgram(GLuint id)
+	{
+		if (Changed(program, id))
+		{
+			++frame.programs;
+			glUseProgram(id);
+		}
+	}
+
+	void BindVertexArray(GLuint id)
+	{
+		if (Changed(vertexArray, id))
+		{
+			++frame.vertexArrays;
+			glBindVertexArray(id);
+		}
+	}
+
+	void ActiveTexture(GLenum unit)
+	{
+		if (Changed(activeTexture, unit))
+			glActiveTexture(unit);
+	}
+
+	// binds on the active texture unit
+	void BindTexture(GLenum target, GLuint id)
+	{
+		const GLuint unit = activeTexture - GL_TEXTURE0;
+		if (target != GL_TEXTURE_2D || activeTexture == UNKNOWN || unit >= MAX_TEXTURE_UNITS)
+		{
+			++frame.issued;
+			++frame.textures;
+			glBindTexture(target, id);
+			return;
+		}
+		if (Changed(textures2D[unit], id))
+		{
+			++frame.textures;
+			glBindTexture(target, id);
+		}
+	}
+
+	// binds texture to unit, only switching the active unit when the binding actually changes
+	void BindTextureUnit(GLuint unit, GLenum target, GLuint id)
+	{
+		if (target == GL_TEXTURE_2D && unit < MAX_TEXTURE_UNITS && textures2D[unit] == id)
+		{
+			++frame.filtered;
+			return;
+		}
+		ActiveTexture(GL_TEXTURE0 + unit);
+		BindTexture(target, id);
+	}
+
+	// GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO and is passed straight through
+	void BindBuffer(GLenum target, GLuint id)
+	{
+		if (target == GL_ELEMENT_ARRAY_BUFFER)
+		{
+			++frame.issued;
+			glBindBuffer(target, id);
+			return;
+		}
+		if (Changed(Lookup(buffers, target), id))
+			glBindBuffer(target, id);
+	}
+
+	// also sets the generic binding of target, like GL does
+	void BindBufferBase(GLenum target, GLuint index, GLuint id)
+	{
+		if (Changed(Lookup(bufferBases, (unsigned long long)target << 32 | index), id))
+		{
+			glBindBufferBase(target, index, id);
+			Lookup(buffers, target) = id;
+		}
+	}
+
+	// always issued, a ring of blocks moves the range every frame; the index is left unknown so a later
+	// BindBufferBase of it is not dropped when the same buffer was bound whole before
+	void BindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+	{
+		++frame.issued;
+		glBindBufferRange(target, index, id, offset, size);
+		Lookup(bufferBases, (unsigned long long)target << 32 | index) = UNKNOWN;
+		Lookup(buffers, target) = id;
+	}
+
+	// GL_FRAMEBUFFER sets the draw and read bindings together
+	void BindFramebuffer(GLenum target, GLuint id)
+	{
+		const bool draw = target != GL_READ_FRAMEBUFFER;
+		const bool read = target != GL_DRAW_FRAMEBUFFER;
+		if ((!draw || drawFramebuffer == id) && (!read || readFramebuffer == id))
+		{
+			++frame.filtered;
+			return;
+		}
+		++frame.issued;
+		glBindFramebuffer(target, id);
+		if (draw)
+			drawFramebuffer = id;
+		if (read)
+			readFramebuffer = id;
+	}
+
+	void Enable(GLenum capability)
+	{
+		if (Changed(Lookup(capabilities, capability), GL_TRUE))
+			glEnable(capability);
+	}
+
+	void Disable(GLenum capability)
+	{
+		if (Changed(Lookup(capabilities, capability), GL_FALSE))
+			glDisable(capability);
+	}
+
+	void DepthMask(GLboolean flag)
+	{
+		if (Changed(depthMask, flag))
+			glDepthMask(flag);
+	}
+
+	void DepthFunc(GLenum func)
+	{
+		if (Changed(depthFunc, func))
+			glDepthFunc(func);
+	}
+
+	void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+	{
+		if (Changed(colorMask, (red ? 1u : 0u) | (green ? 2u : 0u) | (blue ? 4u : 0u) | (alpha ? 8u : 0u)))
+			glColorMask(red, green, blue, alpha);
+	}
+
+	void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+	{
+		if (clearColorKnown && clearColor[0] == red && clearColor[1] == green && clearColor[2] == blue && clearColor[3] == alpha)
+		{
+			++frame.filtered;
+			return;
+		}
+		++frame.issued;
+		glClearColor(red, green, blue, alpha);
+		clearColor[0] = red;
+		clearColor[1] = green;
+		clearColor[2] = blue;
+		clearColor[3] = alpha;
+		clearColorKnown = true;
+	}
+
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (viewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+		{
+			++frame.filtered;
+			return;
+		}
+		++frame.issued;
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		viewportKnown = true;
+	}
+
+	// viewports 0 to count - 1 at once (x, y, width, height each), for drawing to several with gl_ViewportIndex.
+	// The next Viewport call is always issued, glViewport sets every viewport of the array.
+	void ViewportArray(GLuint count, const GLfloat* viewports)
+	{
+		++frame.issued;
+		glViewportArrayv(0, count, viewports);
+		viewportKnown = false;
+	}
+
+	// closes the frame's counters, LastFrame() then reports them
+	void EndFrame()
+	{
+		lastFrame = frame;
+		frame = Stats();
+	}
+	const Stats& LastFrame() const { return lastFrame; }
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const int MAX_TEXTURE_UNITS = 16;
+
+	GLStateCache() { Invalidate(); }
+
+	// records value and returns true when it differs from the shadowed one
+	bool Changed(GLuint& shadowed, GLuint value)
+	{
+		if (shadowed == value)
+		{
+			++frame.filtered;
+			return false;
+		}
+		++frame.issued;
+		shadowed = value;
+		return true;
+	}
+
+	// finds before inserting, so the steady state (every key seen) never allocates a node
+	template <typename Key>
+	static GLuint& Lookup(std::map<Key, GLuint>& state, Key key)
+	{
+		typename std::map<Key, GLuint>::iterator found = state.find(key);
+		if (found != state.end())
+			return found->second;
+		return state.insert(std::make_pair(key, GLuint(UNKNOWN))).first->second;
+	}
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeTexture;
+	GLuint textures2D[MAX_TEXTURE_UNITS];
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	std::map<GLenum, GLuint> buffers;
+	std::map<unsigned long long, GLuint> bufferBases;
+	std::map<GLenum, GLuint> capabilities;
+	GLuint depthMask;
+	GLuint depthFunc;
+	GLuint colorMask;
+	GLfloat clearColor[4];
+	bool clearColorKnown;
+	GLint viewport[4];
+	bool viewportKnown;
+
+	Stats frame;
+	Stats lastFrame;
+};
+#endif
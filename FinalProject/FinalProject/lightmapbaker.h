@@ -0,0 +1,451 @@
+#ifndef LIGHTMAPBAKER_H
+#define LIGHTMAPBAKER_H
+
+// Offline lightmaps of the static objects (--bake-lightmaps in Source.cpp). Unwrap gives every triangle of a
+// draw its own chart, laid flat at one texel density for the whole object and shelf packed into a square
+// atlas; a chart is padded by a texel on each side so bilinear filtering never reads a neighbour. Bake then
+// lights each texel with one light, traced through a RayTracer built over the whole scene:
+//   rgb  the light's ambient and diffuse terms of clusteredPhong, shadowed by a shadow ray, plus one bounce:
+//        cosine distributed rays gather the light's direct diffuse times the albedo of what they hit
+//   a    visibility of the light, which still shadows its live specular highlight
+// All of it is irradiance, the runtime multiplies it by the surface albedo. Texels are independent and run
+// on the WorkerPool a row at a time, the random sequence of a texel depends on its position only, so the
+// result is the same for any thread count.
+//
+// Save and Load keep a lightmap in a small binary file: "LMAP", version, size, vertex count, the vertex
+// coordinates and the texels, native endian. Only the draw the lightmap was unwrapped from may use it,
+// the runtime checks the vertex count.
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "raytracer.h"
+#include "softrasterizer.h"
+#include "workerpool.h"
+
+class LightmapBaker
+{
+public:
+	static const int PADDING = 1;                   // texels around every chart
+	static const int FIT_ITERATIONS = 24;           // bisection steps of the texel density
+	static const uint32_t FILE_VERSION = 1;
+
+	typedef SoftwareRasterizer::Draw Draw;
+	typedef SoftwareRasterizer::Light Light;
+
+	// a square RGBA float lightmap and the coordinates of every vertex of its draw in it
+	struct Lightmap
+	{
+		int size = 0;
+		std::vector<glm::vec2> uvs;                 // per vertex, [0, 1]
+		std::vector<glm::vec4> texels;              // rows bottom to top like the GL textures
+		std::vector<int> texelTriangles;            // triangle of the chart each texel belongs to, -1 = unused
+	};
+
+	struct Settings
+	{
+		unsigned int bounceSamples;                 // gather rays per texel, 0 = direct light only
+		float bounceDistance;                       // how far a gather ray looks for a surface
+		glm::vec2 uvScale;                          // texture coordinate scale of the material textures
+	};
+
+	// the tracer is built over the same draws, draws[drawIndex] being the object to bake
+	LightmapBaker(WorkerPool& pool, const RayTracer& tracer, const Draw* draws)
+		: pool(pool), tracer(tracer), draws(draws)
+	{
+	}
+
+	// Charts of the draw's triangles in a size x size atlas, at the largest texel density they still fit
+	// at. Returns false when even one texel per chart does not fit.
+	static bool Unwrap(const Draw& draw, int size, Lightmap& lightmap)
+	{
+		const unsigned int triangleCount = draw.vertexCount / 3;
+		std::vector<Chart> charts(triangleCount);
+		float totalArea = 0.0f;
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			FlattenTriangle(draw, t, charts[t]);
+			totalArea += charts[t].extent.x * charts[t].extent.y;
+		}
+
+		// the bounding rectangles have at least the total area, so the density can only be lower
+		float low = 0.0f;
+		float high = totalArea > 0.0f ? float(size) / std::sqrt(totalArea) : float(size);
+		if (!Pack(charts, low, size))
+			return false;
+		for (int i = 0; i < FIT_ITERATIONS; ++i)
+		{
+			const float density = (low + high) * 0.5f;
+			if (Pack(charts, density, size))
+				low = density;
+			else
+				high = density;
+		}
+		Pack(charts, low, size);
+
+		lightmap.size = size;
+		lightmap.uvs.assign(size_t(triangleCount) * 3, glm::vec2(0.0f));
+		lightmap.texels.assign(size_t(size) * size, glm::vec4(0.0f));
+		lightmap.texelTriangles.assign(size_t(size) * size, -1);
+		for (unsigned int t = 0; t < triangleCount; ++t)
+		{
+			const Chart& chart = charts[t];
+			for (int i = 0; i < 3; ++i)
+			{
+				const glm::vec2 texel = glm::vec2(chart.x + PADDING, chart.y + PADDING) + chart.corners[i] * low;
+				lightmap.uvs[size_t(t) * 3 + i] = texel / float(size);
+			}
+			for (int y = chart.y; y < chart.y + chart.height; ++y)
+				for (int x = chart.x; x < chart.x + chart.width; ++x)
+					lightmap.texelTriangles[size_t(y) * size + x] = int(t);
+		}
+		return true;
+	}
+
+	// lights the charts of an unwrapped lightmap of draws[drawIndex]
+	void Bake(unsigned int drawIndex, const Light& light, const Settings& settings, Lightmap& lightmap)
+	{
+		bakeDraw = &draws[drawIndex];
+		bakeLight = &light;
+		bakeSettings = &settings;
+		bakeLightmap = &lightmap;
+		modelNormal = glm::transpose(glm::inverse(glm::mat3(bakeDraw->model)));
+
+		auto row = [this](unsigned int y, unsigned int)
+		{
+			RayBatch batch(bakeSettings->bounceSamples);
+			for (int x = 0; x < bakeLightmap->size; ++x)
+			{
+				const size_t texel = size_t(y) * bakeLightmap->size + x;
+				if (bakeLightmap->texelTriangles[texel] >= 0)
+					bakeLightmap->texels[texel] = BakeTexel(x, int(y), bakeLightmap->texelTriangles[texel], batch);
+			}
+		};
+		pool.ParallelFor((unsigned int)lightmap.size, row);
+	}
+
+	// writes the coordinates and texels, creating the directory the file goes in when needed
+	static bool Save(const std::string& directory, const std::string& name, const Lightmap& lightmap)
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+		std::ofstream file(directory + "/" + name, std::ios::binary);
+		if (!file)
+			return false;
+		const uint32_t header[4] = { FileMagic(), FILE_VERSION, uint32_t(lightmap.size), uint32_t(lightmap.uvs.size()) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(lightmap.uvs.data()), lightmap.uvs.size() * sizeof(glm::vec2));
+		file.write(reinterpret_cast<const char*>(lightmap.texels.data()), lightmap.texels.size() * sizeof(glm::vec4));
+		return bool(file);
+	}
+
+	// reads a file written by Save; texelTriangles stays empty. The counts in the header must match the
+	// length of the file, so a damaged one allocates nothing.
+	static bool Load(const std::string& path, Lightmap& lightmap)
+	{
+		std::ifstream file(path, std::ios::binary);
+		uint32_t header[4];
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != FileMagic() || header[1] != FILE_VERSION
+			|| header[2] == 0 || header[2] > 16384 || header[3] > (1u << 24))
+			return false;
+		const std::streamoff start = file.tellg();
+		file.seekg(0, std::ios::end);
+		const std::streamoff length = file.tellg();
+		file.seekg(start);
+		const unsigned long long expected = sizeof(header) + (unsigned long long)header[3] * sizeof(glm::vec2)
+			+ (unsigned long long)header[2] * header[2] * sizeof(glm::vec4);
+		if (!file || length < 0 || (unsigned long long)length != expected)
+			return false;
+		lightmap.size = int(header[2]);
+		lightmap.uvs.resize(header[3]);
+		lightmap.texels.resize(size_t(header[2]) * header[2]);
+		lightmap.texelTriangles.clear();
+		file.read(reinterpret_cast<char*>(lightmap.uvs.data()), lightmap.uvs.size() * sizeof(glm::vec2));
+		file.read(reinterpret_cast<char*>(lightmap.texels.data()), lightmap.texels.size() * sizeof(glm::vec4));
+		return bool(file);
+	}
+
+private:
+	static uint32_t FileMagic()
+	{
+		uint32_t magic;
+		std::memcpy(&magic, "LMAP", sizeof(magic));
+		return magic;
+	}
+
+	// a triangle laid flat with its longest edge along x, and its rectangle in the atlas
+	struct Chart
+	{
+		glm::vec2 corners[3];       // world units, bounds starting at 0
+		glm::vec2 extent;
+		int x, y, width, height;    // texels, padding included
+	};
+
+	// gather rays of a texel and the shadow rays of their hits, reused along a row
+	struct RayBatch
+	{
+		std::vector<RayTracer::Ray> rays;
+		std::vector<RayTracer::Hit> hits;
+		std::vector<RayTracer::Ray> shadowRays;
+		std::vector<unsigned int> shadowHits;     // gather ray of each shadow ray
+		std::unique_ptr<bool[]> occluded;
+
+		explicit RayBatch(unsigned int samples) : rays(samples), hits(samples), occluded(new bool[samples + 1])
+		{
+			shadowRays.reserve(samples);
+			shadowHits.reserve(samples);
+		}
+	};
+
+	static glm::vec3 Position(const Draw& draw, unsigned int vertex)
+	{
+		const float* v = draw.vertices + size_t(vertex) * 8;
+		return glm::vec3(draw.model * glm::vec4(v[0], v[1], v[2], 1.0f));
+	}
+
+	static void FlattenTriangle(const Draw& draw, unsigned int triangle, Chart& chart)
+	{
+		const glm::vec3 p[3] = { Position(draw, triangle * 3), Position(draw, triangle * 3 + 1), Position(draw, triangle * 3 + 2) };
+
+		int first = 0;
+		float longest = -1.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float length = glm::length(p[(i + 1) % 3] - p[i]);
+			if (length > longest)
+			{
+				longest = length;
+				first = i;
+			}
+		}
+
+		const glm::vec3 origin = p[first];
+		const glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+		const float area = glm::length(normal);
+		const glm::vec3 axisX = longest > 0.0f ? (p[(first + 1) % 3] - origin) / longest : glm::vec3(1.0f, 0.0f, 0.0f);
+		const glm::vec3 axisY = area > 0.0f ? glm::cross(normal / area, axisX) : glm::vec3(0.0f);
+
+		glm::vec2 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec3 offset = p[i] - origin;
+			chart.corners[i] = glm::vec2(glm::dot(offset, axisX), glm::dot(offset, axisY));
+			boundsMin = glm::min(boundsMin, chart.corners[i]);
+			boundsMax = glm::max(boundsMax, chart.corners[i]);
+		}
+		for (int i = 0; i < 3; ++i)
+			chart.corners[i] -= boundsMin;
+		chart.extent = boundsMax - boundsMin;
+	}
+
+	// shelf packing, tallest charts first; false when the charts at this density overflow the atlas
+	static bool Pack(std::vector<Chart>& charts, float density, int size)
+	{
+		std::vector<uint32_t> order(charts.size());
+		for (size_t i = 0; i < charts.size(); ++i)
+		{
+			order[i] = uint32_t(i);
+			charts[i].width = int(std::ceil(charts[i].extent.x * density)) + 2 * PADDING;
+			charts[i].height = int(std::ceil(charts[i].extent.y * density)) + 2 * PADDING;
+		}
+		std::sort(order.begin(), order.end(), [&charts](uint32_t a, uint32_t b) { return charts[a].height > charts[b].height; });
+
+		int x = 0, y = 0, shelfHeight = 0;
+		for (uint32_t index : order)
+		{
+			Chart& chart = charts[index];
+			if (chart.width > size)
+				return false;
+			if (x + chart.width > size)
+			{
+				x = 0;
+				y += shelfHeight;
+				shelfHeight = 0;
+			}
+			if (y + chart.height > size)
+				return false;
+			chart.x = x;
+			chart.y = y;
+			x += chart.width;
+			shelfHeight = std::max(shelfHeight, chart.height);
+		}
+		return true;
+	}
+
+	// xorshift on a per texel seed, [0, 1)
+	static float Random(uint32_t& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return float(state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// the light's direct diffuse and ambient at a point, what clusteredPhong adds for it without specular;
+	// visible is the shadow ray's answer
+	glm::vec3 DirectLight(const glm::vec3& position, const glm::vec3& normal, bool visible, glm::vec3& ambient) const
+	{
+		const Light& light = *bakeLight;
+		const glm::vec3 toLight = light.position - position;
+		const float distance = glm::length(toLight);
+		const glm::vec3 lightDirection = toLight / distance;
+
+		float intensity = 1.0f;
+		float impact = std::max(glm::dot(normal, lightDirection), 0.0f);
+		if (light.spot)
+		{
+			const float theta = glm::dot(lightDirection, -glm::normalize(light.direction));
+			intensity = glm::clamp((theta - light.outerCutOff) / (light.innerCutOff - light.outerCutOff), 0.0f, 1.0f);
+			impact = 1.0f;
+		}
+		if (light.range > 0.0f)
+		{
+			const float ratio = distance / light.range;
+			const float window = glm::clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+			intensity *= window * window / (distance * distance + 1.0f);
+		}
+
+		const glm::vec3 lightColor = light.color * intensity;
+		ambient = 0.1f * lightColor;
+		return visible ? impact * lightColor : glm::vec3(0.0f);
+	}
+
+	// a shadow ray toward the light, leaving the surface on the side of its normal
+	RayTracer::Ray ShadowRay(const glm::vec3& position, const glm::vec3& faceNormal) const
+	{
+		const glm::vec3 origin = position + faceNormal * 1e-3f;
+		RayTracer::Ray ray = { origin, bakeLight->position - origin, 1.0f };
+		return ray;
+	}
+
+	glm::vec4 BakeTexel(int x, int y, int triangle, RayBatch& batch) const
+	{
+		const Lightmap& lightmap = *bakeLightmap;
+		const Draw& draw = *bakeDraw;
+
+		// barycentrics of the texel center in the chart, clamped onto the triangle for the padding texels
+		const glm::vec2 texel = glm::vec2(x + 0.5f, y + 0.5f) / float(lightmap.size);
+		const glm::vec2 a = lightmap.uvs[size_t(triangle) * 3];
+		const glm::vec2 e1 = lightmap.uvs[size_t(triangle) * 3 + 1] - a;
+		const glm::vec2 e2 = lightmap.uvs[size_t(triangle) * 3 + 2] - a;
+		const glm::vec2 d = texel - a;
+		const float determinant = e1.x * e2.y - e1.y * e2.x;
+		float u = determinant != 0.0f ? (d.x * e2.y - d.y * e2.x) / determinant : 1.0f / 3.0f;
+		float v = determinant != 0.0f ? (e1.x * d.y - e1.y * d.x) / determinant : 1.0f / 3.0f;
+		u = std::max(u, 0.0f);
+		v = std::max(v, 0.0f);
+		if (u + v > 1.0f)
+		{
+			const float sum = u + v;
+			u /= sum;
+			v /= sum;
+		}
+		const float w = 1.0f - u - v;
+
+		const unsigned int vertex = unsigned(triangle) * 3;
+		const glm::vec3 p0 = Position(draw, vertex), p1 = Position(draw, vertex + 1), p2 = Position(draw, vertex + 2);
+		const glm::vec3 position = p0 * w + p1 * u + p2 * v;
+		const float* n0 = draw.vertices + size_t(vertex) * 8 + 3;
+		const float* n1 = n0 + 8;
+		const float* n2 = n1 + 8;
+		const glm::vec3 normal = glm::normalize(modelNormal * (glm::vec3(n0[0], n0[1], n0[2]) * w + glm::vec3(n1[0], n1[1], n1[2]) * u
+			+ glm::vec3(n2[0], n2[1], n2[2]) * v));
+		glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+		const float faceLength = glm::length(faceNormal);
+		faceNormal = faceLength > 0.0f ? faceNormal / faceLength : normal;
+		if (glm::dot(faceNormal, normal) < 0.0f)
+			faceNormal = -faceNormal;
+
+		// direct light and ambient
+		const RayTracer::Ray shadowRay = ShadowRay(position, faceNormal);
+		bool occluded = false;
+		tracer.Occluded(&shadowRay, 1, &occluded);
+		glm::vec3 ambient;
+		const glm::vec3 direct = DirectLight(position, normal, !occluded, ambient);
+
+		// one bounce: cosine distributed gather rays, each bringing back the direct diffuse light of the surface
+		// it hits times that surface's albedo
+		glm::vec3 indirect(0.0f);
+		const unsigned int samples = bakeSettings->bounceSamples;
+		if (samples > 0)
+		{
+			const glm::vec3 tangent = glm::normalize(std::fabs(normal.x) > 0.5f ? glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f))
+				: glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)));
+			const glm::vec3 bitangent = glm::cross(normal, tangent);
+			uint32_t state = (uint32_t(y) * 73856093u) ^ (uint32_t(x) * 19349663u) ^ 0x9E3779B9u;
+			if (state == 0)
+				state = 0x9E3779B9u;    // xorshift stays at 0 forever
+			for (unsigned int s = 0; s < samples; ++s)
+			{
+				// stratified on a samples x 1 grid in the angle, so few samples still cover the hemisphere
+				const float radius = std::sqrt(Random(state));
+				const float angle = 6.2831853f * (float(s) + Random(state)) / float(samples);
+				const glm::vec3 direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle))
+					+ normal * std::sqrt(std::max(0.0f, 1.0f - radius * radius));
+				batch.rays[s].origin = position + faceNormal * 1e-3f;
+				batch.rays[s].direction = direction * bakeSettings->bounceDistance;
+				batch.rays[s].tMax = 1.0f;
+			}
+			tracer.Intersect(batch.rays.data(), samples, batch.hits.data());
+
+			// the hit points' shadow rays, as one batch
+			batch.shadowRays.clear();
+			batch.shadowHits.clear();
+			for (unsigned int s = 0; s < samples; ++s)
+			{
+				if (batch.hits[s].draw < 0)
+					continue;
+				batch.shadowRays.push_back(ShadowRay(batch.hits[s].position, batch.hits[s].faceNormal));
+				batch.shadowHits.push_back(s);
+			}
+			tracer.Occluded(batch.shadowRays.data(), (unsigned int)batch.shadowRays.size(), batch.occluded.get());
+
+			for (size_t i = 0; i < batch.shadowHits.size(); ++i)
+			{
+				const RayTracer::Hit& hit = batch.hits[batch.shadowHits[i]];
+				const Draw& hitDraw = draws[hit.draw];
+				const glm::vec3 albedo = hitDraw.texture
+					? SoftwareRasterizer::Sample(*hitDraw.texture, hit.uv.x * bakeSettings->uvScale.x, hit.uv.y * bakeSettings->uvScale.y) : hitDraw.color;
+				const glm::vec3 hitNormal = glm::dot(hit.normal, hit.faceNormal) < 0.0f ? -hit.normal : hit.normal;
+				glm::vec3 hitAmbient;
+				indirect += albedo * DirectLight(hit.position, hitNormal, !batch.occluded[i], hitAmbient);
+			}
+			indirect /= float(samples);
+		}
+
+		return glm::vec4(ambient + direct + indirect, occluded ? 0.0f : 1.0f);
+	}
+
+	LightmapBaker(const LightmapBaker&) = delete;
+	LightmapBaker& operator=(const LightmapBaker&) = delete;
+
+	WorkerPool& pool;
+	const RayTracer& tracer;
+	const Draw* draws;
+
+	// what the current Bake works on, read by its rows
+	const Draw* bakeDraw = nullptr;
+	const Light* bakeLight = nullptr;
+	const Settings* bakeSettings = nullptr;
+	Lightmap* bakeLightmap = nullptr;
+	glm::mat3 modelNormal;
+};
+#endif
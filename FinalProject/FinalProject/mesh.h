@@ -1,134 +1,201 @@
-#ifndef MESH_H
-#define MESH_H
-
-#include <glad/glad.h> // holds all OpenGL type declarations
-
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
-#include "shader.h"
-
-#include <string>
-#include <vector>
-using namespace std;
-
-struct Vertex {
-	// position
-	glm::vec3 Position;
-	// normal
-	glm::vec3 Normal;
-	// texCoords
-	glm::vec2 TexCoords;
-	// tangent
-	glm::vec3 Tangent;
-	// bitangent
-	glm::vec3 Bitangent;
-};
-
-struct Texture {
-	unsigned int id;
-	string type;
-	string path;
-};
-
-class Mesh {
-public:
-	// mesh Data
-	vector<Vertex>       vertices;
-	vector<unsigned int> indices;
-	vector<Texture>      textures;
-	unsigned int VAO;
-
-	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
-	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
-
-		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
-	}
-
-	// render the mesh
-	void Draw(Shader &shader)
-	{
-		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++)
-		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-			// retrieve texture number (the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-			else if (name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-			else if (name == "texture_height")
-				number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
-		}
-
-		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
-	}
-
-private:
-	// render data 
-	unsigned int VBO, EBO;
-
-	// initializes all the buffer objects/arrays
-	void setupMesh()
-	{
-		// create buffers/arrays
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-
-		glBindVertexArray(VAO);
-		// load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// A great thing about structs is that their memory layout is sequential for all its items.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-		// set the vertex attribute pointers
-		// vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-		glBindVertexArray(0);
-	}
-};
+#ifndef MESH_H
+#define MESH_H
+
+// Include after GLEW. Every translation unit uses the same loader: the inline members here and in the
+// headers below are emitted in each of them and the linker keeps one copy, which must call the loaded entry points.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "glstate.h"
+#include "renderstats.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Vertex {
+	// position
+	glm::vec3 Position;
+	// normal
+	glm::vec3 Normal;
+	// texCoords
+	glm::vec2 TexCoords;
+	// tangent
+	glm::vec3 Tangent;
+	// bitangent
+	glm::vec3 Bitangent;
+};
+
+struct Texture {
+	unsigned int id;
+	string type;
+	string path;
+};
+
+// what happens to the CPU copy of the vertices and indices once they are uploaded
+enum MeshCpuData {
+	MESH_KEEP_CPU_DATA,     // keep them as they are
+	MESH_SHRINK_CPU_DATA,   // keep them, but give back the spare vector capacity
+	MESH_RELEASE_CPU_DATA   // free them, only the counts and the bounds remain
+};
+
+class Mesh {
+public:
+	// mesh Data
+	vector<Vertex>       vertices;
+	vector<unsigned int> indices;
+	vector<Texture>      textures;
+	unsigned int VAO;
+
+	// counts and object space bounds, valid even when the CPU copy was released
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// constructor, the arrays are moved in: pass temporaries or std::move them to avoid copies
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshCpuData cpuData = MESH_KEEP_CPU_DATA)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
+	{
+		vertexCount = (unsigned int)this->vertices.size();
+		indexCount = (unsigned int)this->indices.size();
+		setupBounds();
+
+		// now that we have all the required data, set the vertex buffers and its attribute pointers.
+		setupMesh();
+		setupSamplerNames();
+
+		if (cpuData == MESH_SHRINK_CPU_DATA)
+		{
+			this->vertices.shrink_to_fit();
+			this->indices.shrink_to_fit();
+		}
+		else if (cpuData == MESH_RELEASE_CPU_DATA)
+		{
+			// swapping with empty vectors frees the storage, clear() would keep it
+			vector<Vertex>().swap(this->vertices);
+			vector<unsigned int>().swap(this->indices);
+		}
+	}
+
+	// render the mesh
+	void Draw(Shader &shader)
+	{
+		// bind the textures on the units the shader's samplers read, the binds are skipped when a unit already holds them
+		const vector<SamplerBinding>& bindings = samplerBindings(shader);
+		for (size_t i = 0; i < bindings.size(); i++)
+			GLStateCache::Current().BindTextureUnit(bindings[i].unit, GL_TEXTURE_2D, bindings[i].texture);
+
+		// draw mesh, the state cache tracks the bindings so nothing is reset afterwards
+		GLStateCache::Current().BindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+		RenderStats::Current().Draw(GL_TRIANGLES, (GLsizei)indexCount);
+	}
+
+private:
+	// render data 
+	unsigned int VBO, EBO;
+	// sampler uniform of each texture (diffuse_textureN etc.), built once so Draw does not allocate
+	vector<string> samplerNames;
+
+	// texture to bind on each unit when drawing with one shader, only for samplers the shader actually uses
+	struct SamplerBinding
+	{
+		GLuint unit;
+		GLuint texture;
+	};
+	struct ShaderSamplerBindings
+	{
+		unsigned long long shader;  // Shader::Serial, a recreated program that reuses the GL name does not match
+		vector<SamplerBinding> bindings;
+	};
+	// resolved bindings per shader, searched linearly since a mesh is drawn with a handful of shaders at most
+	vector<ShaderSamplerBindings> shaderBindings;
+
+	// the bindings of shader, resolved on the first draw with it
+	const vector<SamplerBinding>& samplerBindings(Shader &shader)
+	{
+		for (size_t i = 0; i < shaderBindings.size(); i++)
+			if (shaderBindings[i].shader == shader.Serial)
+				return shaderBindings[i].bindings;
+
+		ShaderSamplerBindings resolved;
+		resolved.shader = shader.Serial;
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			GLint location = glGetUniformLocation(shader.ID, samplerNames[i].c_str());
+			if (location < 0)
+				continue; // not read by this shader, nothing to bind
+			SamplerBinding binding = { shader.samplerUnit(location), textures[i].id };
+			resolved.bindings.push_back(binding);
+		}
+		shaderBindings.push_back(resolved);
+		return shaderBindings.back().bindings;
+	}
+
+	// axis aligned box around the vertices, for culling
+	void setupBounds()
+	{
+		boundsMin = boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+		for (unsigned int i = 1; i < vertices.size(); i++)
+		{
+			boundsMin = glm::min(boundsMin, vertices[i].Position);
+			boundsMax = glm::max(boundsMax, vertices[i].Position);
+		}
+	}
+
+	// names the sampler of each texture after its type and its number among textures of that type
+	void setupSamplerNames()
+	{
+		unsigned int diffuseNr = 1;
+		unsigned int specularNr = 1;
+		unsigned int normalNr = 1;
+		unsigned int heightNr = 1;
+		samplerNames.clear();
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			// retrieve texture number (the N in diffuse_textureN)
+			string number;
+			string name = textures[i].type;
+			if (name == "texture_diffuse")
+				number = std::to_string(diffuseNr++);
+			else if (name == "texture_specular")
+				number = std::to_string(specularNr++); // transfer unsigned int to stream
+			else if (name == "texture_normal")
+				number = std::to_string(normalNr++); // transfer unsigned int to stream
+			else if (name == "texture_height")
+				number = std::to_string(heightNr++); // transfer unsigned int to stream
+			samplerNames.push_back(name + number);
+		}
+	}
+
+	// initializes all the buffer objects/arrays
+	void setupMesh()
+	{
+		// immutable storage and direct state access (GL 4.5, the context version): nothing is bound, so meshes
+		// can be created anywhere. Storage of size 0 is an error, an empty mesh gets one unused byte.
+		glCreateBuffers(1, &VBO);
+		glNamedBufferStorage(VBO, (std::max)(vertices.size() * sizeof(Vertex), size_t(1)), vertices.empty() ? nullptr : vertices.data(), 0);
+		glCreateBuffers(1, &EBO);
+		glNamedBufferStorage(EBO, (std::max)(indices.size() * sizeof(unsigned int), size_t(1)), indices.empty() ? nullptr : indices.data(), 0);
+
+		glCreateVertexArrays(1, &VAO);
+		glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(Vertex));
+		glVertexArrayElementBuffer(VAO, EBO);
+
+		// position, normal, texture coords, tangent, bitangent, all read from binding 0
+		const GLint sizes[] = { 3, 3, 2, 3, 3 };
+		const GLuint offsets[] = { offsetof(Vertex, Position), offsetof(Vertex, Normal), offsetof(Vertex, TexCoords),
+			offsetof(Vertex, Tangent), offsetof(Vertex, Bitangent) };
+		for (GLuint i = 0; i < 5; i++)
+		{
+			glEnableVertexArrayAttrib(VAO, i);
+			glVertexArrayAttribFormat(VAO, i, sizes[i], GL_FLOAT, GL_FALSE, offsets[i]);
+			glVertexArrayAttribBinding(VAO, i, 0);
+		}
+	}
+};
 #endif
\ No newline at end of file
@@ -0,0 +1,122 @@
+// Mesh::Draw micro-benchmark (--bench-mesh-draw). Built against GLEW like Source.cpp, which loaded it before
+// calling in, so the inline GL wrappers of mesh.h, shader.h and glstate.h are the same in both translation units.
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include "mesh.h"
+
+namespace
+{
+    const int WARMUP_DRAWS = 1000;
+    const int TIMED_DRAWS = 100000;
+
+    // What Mesh::Draw did on every draw before the bindings were cached: build each sampler name, look it up
+    // and set it, then bind the texture on the unit of its index
+    void UDrawWithNameLookups(Mesh& mesh, Shader& shader)
+    {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr = 1;
+        unsigned int heightNr = 1;
+        for (unsigned int i = 0; i < mesh.textures.size(); i++)
+        {
+            string number;
+            string name = mesh.textures[i].type;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++);
+            else if (name == "texture_normal")
+                number = std::to_string(normalNr++);
+            else if (name == "texture_height")
+                number = std::to_string(heightNr++);
+
+            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            GLStateCache::Current().BindTextureUnit(i, GL_TEXTURE_2D, mesh.textures[i].id);
+        }
+
+        GLStateCache::Current().BindVertexArray(mesh.VAO);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    // submits draws until count, returns the CPU submission time in ms and the time until the GPU finished
+    template <typename DrawFunction>
+    double UTimeDraws(DrawFunction draw, int count, double& finishedMs)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; ++i)
+            draw();
+        const std::chrono::steady_clock::time_point submitted = std::chrono::steady_clock::now();
+        glFinish();
+        const std::chrono::steady_clock::time_point finished = std::chrono::steady_clock::now();
+
+        finishedMs = std::chrono::duration<double, std::milli>(finished - start).count();
+        return std::chrono::duration<double, std::milli>(submitted - start).count();
+    }
+}
+
+
+// Draws one small quad with five textures (two diffuse, specular, normal, height) through the old per-draw name
+// lookups and through Mesh::Draw with cached bindings, and reports the submission rate of both.
+// Needs a current context; returns a process exit code.
+int UBenchmarkMeshDraw()
+{
+    Shader shader("../resources/shaders/mesh_benchmark.vs", "../resources/shaders/mesh_benchmark.fs");
+    GLint linked = 0;
+    glGetProgramiv(shader.ID, GL_LINK_STATUS, &linked);
+    if (!linked)
+        return EXIT_FAILURE;
+
+    // a 1x1 texture per type, the quad covers a few pixels so the GPU side stays cheap
+    const char* types[] = { "texture_diffuse", "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+    vector<Texture> textures;
+    for (const char* type : types)
+    {
+        Texture texture;
+        const unsigned char texel[4] = { 32, 64, 128, 255 };
+        glGenTextures(1, &texture.id);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        texture.type = type;
+        textures.push_back(texture);
+    }
+
+    vector<Vertex> vertices(4);
+    const float corners[4][2] = { { -0.01f, -0.01f }, { 0.01f, -0.01f }, { 0.01f, 0.01f }, { -0.01f, 0.01f } };
+    for (int i = 0; i < 4; ++i)
+    {
+        vertices[i].Position = glm::vec3(corners[i][0], corners[i][1], 0.0f);
+        vertices[i].TexCoords = glm::vec2(corners[i][0] > 0.0f ? 1.0f : 0.0f, corners[i][1] > 0.0f ? 1.0f : 0.0f);
+    }
+    const unsigned int quad[] = { 0, 1, 2, 0, 2, 3 };
+    vector<unsigned int> indices(quad, quad + 6);
+
+    Mesh mesh(std::move(vertices), std::move(indices), textures, MESH_RELEASE_CPU_DATA);
+
+    GLStateCache::Current().Invalidate();
+    shader.use();
+
+    double lookupFinishedMs = 0.0;
+    double cachedFinishedMs = 0.0;
+    UTimeDraws([&]() { UDrawWithNameLookups(mesh, shader); }, WARMUP_DRAWS, lookupFinishedMs);
+    const double lookupMs = UTimeDraws([&]() { UDrawWithNameLookups(mesh, shader); }, TIMED_DRAWS, lookupFinishedMs);
+    UTimeDraws([&]() { mesh.Draw(shader); }, WARMUP_DRAWS, cachedFinishedMs);
+    const double cachedMs = UTimeDraws([&]() { mesh.Draw(shader); }, TIMED_DRAWS, cachedFinishedMs);
+
+    std::cout << "Mesh::Draw benchmark, " << TIMED_DRAWS << " draws of a mesh with " << textures.size() << " textures:" << std::endl;
+    std::cout << "  name lookups per draw:  " << lookupMs * 1000000.0 / TIMED_DRAWS << " ns/draw submitted ("
+        << lookupFinishedMs << " ms until the GPU finished)" << std::endl;
+    std::cout << "  cached sampler binding: " << cachedMs * 1000000.0 / TIMED_DRAWS << " ns/draw submitted ("
+        << cachedFinishedMs << " ms until the GPU finished)" << std::endl;
+    std::cout << "  submission speedup: " << lookupMs / cachedMs << "x" << std::endl;
+
+    for (const Texture& texture : textures)
+        glDeleteTextures(1, &texture.id);
+    glDeleteProgram(shader.ID);
+    return EXIT_SUCCESS;
+}
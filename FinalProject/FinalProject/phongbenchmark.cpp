@@ -0,0 +1,187 @@
+// Phong kernel check and benchmark (--bench-phong): every kernel the CPU supports is compared with
+// PhongShadeReference, then timed on one thread and on all of them. Needs no GL context.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "phongkernel.h"
+#include "workerpool.h"
+
+namespace
+{
+    const unsigned int CHECK_FRAGMENTS = 65533;     // not a multiple of any width, so the scalar tails run too
+    const unsigned int BLOCK_FRAGMENTS = 1024;      // shaded per call while timing, fits in L2 with its outputs
+    const double TIMED_SECONDS = 0.5;
+    const float MAX_RELATIVE_ERROR = 1e-4f;         // of max(1, |reference|), pow() against four squarings
+
+    // the fragments of one call, laid out like the rasterizer's batches
+    struct FragmentBlock
+    {
+        std::vector<float> components[14];  // position xyz, normal xyz, albedo rgb, two shadow maps, red green blue
+        PhongFragments fragments;
+
+        explicit FragmentBlock(unsigned int count)
+        {
+            for (std::vector<float>& component : components)
+                component.resize(count);
+            fragments = { components[0].data(), components[1].data(), components[2].data(), components[3].data(),
+                components[4].data(), components[5].data(), components[6].data(), components[7].data(), components[8].data(),
+                { components[9].data(), components[10].data() }, components[11].data(), components[12].data(), components[13].data(), count };
+        }
+    };
+
+    // deterministic, so runs are comparable
+    float URandom(unsigned int& state, float low, float high)
+    {
+        state = state * 1664525u + 1013904223u;
+        return low + (high - low) * float(state >> 8) / float(1u << 24);
+    }
+
+    // surface points on and around the table, seen from the starting camera
+    void UFillFragments(FragmentBlock& block, unsigned int seed)
+    {
+        unsigned int state = seed;
+        for (unsigned int i = 0; i < block.fragments.count; ++i)
+        {
+            block.components[0][i] = URandom(state, -2.0f, 2.0f);
+            block.components[1][i] = URandom(state, -0.5f, 1.5f);
+            block.components[2][i] = URandom(state, -2.0f, 2.0f);
+
+            float nx = URandom(state, -1.0f, 1.0f), ny = URandom(state, -1.0f, 1.0f), nz = URandom(state, -1.0f, 1.0f);
+            const float length = std::sqrt(nx * nx + ny * ny + nz * nz) + 1e-6f;
+            block.components[3][i] = nx / length;
+            block.components[4][i] = ny / length;
+            block.components[5][i] = nz / length;
+
+            for (int c = 6; c < 9; ++c)
+                block.components[c][i] = URandom(state, 0.0f, 1.0f);
+            block.components[9][i] = URandom(state, 0.0f, 1.0f) < 0.3f ? 0.0f : 1.0f;  // mostly lit, some in shadow
+            block.components[10][i] = URandom(state, 0.0f, 1.0f);                     // PCF edge values
+        }
+    }
+
+    // the lights of the scene with the spotlight on and four dynamic lights: unbounded key light,
+    // spotlight, two bounded point lights and two bounded spotlights
+    std::vector<PhongLight> UBenchmarkLights()
+    {
+        const float spotAxis[3] = { 0.0f, 0.0f, 1.0f };     // camera looking down -z
+        const float downAxis[3] = { 0.0f, 1.0f, 0.0f };     // dynamic spotlights point down
+        std::vector<PhongLight> lights(6);
+        lights[0] = { { -1.5f, 3.5f, 0.0f }, 0.0f, { 1.0f, 1.0f, 1.0f }, 0, { 0.0f, 0.0f, 0.0f }, 0.0f, 0.0f, 0 };
+        lights[1] = { { 0.0f, 1.0f, 4.0f }, 0.0f, { 0.0f, 0.0f, 1.0f }, 1, { spotAxis[0], spotAxis[1], spotAxis[2] },
+            std::cos(8.5f * 3.14159265f / 180.0f), std::cos(12.5f * 3.14159265f / 180.0f), 1 };
+        for (int i = 2; i < 6; ++i)
+        {
+            const float angle = float(i) * 1.3f;
+            const bool spot = i >= 4;
+            lights[i] = { { 2.0f * std::cos(angle), 1.5f, 2.0f * std::sin(angle) }, 3.0f, { 1.0f, 0.6f, 0.3f }, spot ? 1 : 0,
+                { downAxis[0], downAxis[1], downAxis[2] }, spot ? std::cos(20.0f * 3.14159265f / 180.0f) : 0.0f,
+                spot ? std::cos(30.0f * 3.14159265f / 180.0f) : 0.0f, -1 };
+        }
+        return lights;
+    }
+
+    // largest error of a kernel against the reference, relative to max(1, |reference|)
+    float UCheckKernel(PhongKernel kernel, const PhongScene& scene, FragmentBlock& block, const std::vector<float> reference[3])
+    {
+        PhongKernelFunction(kernel)(scene, block.fragments, 0);
+        float maxError = 0.0f;
+        for (int c = 0; c < 3; ++c)
+        {
+            for (unsigned int i = 0; i < block.fragments.count; ++i)
+            {
+                const float expected = reference[c][i];
+                const float error = std::fabs(block.components[11 + c][i] - expected) / (std::max)(1.0f, std::fabs(expected));
+                maxError = (std::max)(maxError, error == error ? error : 1.0f);  // NaN counts as wrong
+            }
+        }
+        return maxError;
+    }
+
+    // fragments shaded per second by each thread, every thread shading its own block over and over
+    double UTimeKernel(PhongKernel kernel, const PhongScene& scene, WorkerPool& pool)
+    {
+        const PhongShadeFunction shade = PhongKernelFunction(kernel);
+        std::vector<FragmentBlock> blocks;
+        blocks.reserve(pool.Threads());     // the fragment pointers point into the blocks
+        for (unsigned int t = 0; t < pool.Threads(); ++t)
+        {
+            blocks.emplace_back(BLOCK_FRAGMENTS);
+            UFillFragments(blocks.back(), 7u + t);
+        }
+
+        std::vector<double> rates(pool.Threads());
+        auto run = [&](unsigned int index, unsigned int)
+        {
+            FragmentBlock& block = blocks[index];
+            shade(scene, block.fragments, 0);   // warm-up
+
+            unsigned long long fragments = 0;
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            double seconds = 0.0;
+            do
+            {
+                for (int repeat = 0; repeat < 64; ++repeat)
+                    shade(scene, block.fragments, 0);
+                fragments += 64ull * BLOCK_FRAGMENTS;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (seconds < TIMED_SECONDS);
+            rates[index] = fragments / seconds;
+        };
+        pool.ParallelFor(pool.Threads(), run);
+
+        double total = 0.0;
+        for (double rate : rates)
+            total += rate;
+        return total / pool.Threads();
+    }
+}
+
+
+// Returns a process exit code: failure when a kernel is further from the reference than MAX_RELATIVE_ERROR.
+int UBenchmarkPhongKernels()
+{
+    const std::vector<PhongLight> lights = UBenchmarkLights();
+    const PhongScene scene = { { 0.0f, 1.0f, 4.0f }, lights.data(), (unsigned int)lights.size() };
+
+    FragmentBlock block(CHECK_FRAGMENTS);
+    UFillFragments(block, 1u);
+    PhongShadeReference(scene, block.fragments, 0);
+    const std::vector<float> reference[3] = { block.components[11], block.components[12], block.components[13] };
+
+    WorkerPool pool;
+    std::cout << "Phong kernels, " << lights.size() << " lights, " << pool.Threads() << " threads, best kernel "
+        << PhongKernelName(PhongBestKernel()) << ":" << std::endl;
+
+    bool passed = true;
+    double scalarRate = 0.0;
+    WorkerPool single(1);
+    for (int k = 0; k < PHONG_KERNEL_COUNT; ++k)
+    {
+        const PhongKernel kernel = PhongKernel(k);
+        if (!PhongKernelSupported(kernel))
+        {
+            std::cout << "  " << PhongKernelName(kernel) << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+
+        const float error = UCheckKernel(kernel, scene, block, reference);
+        const bool kernelPassed = error <= MAX_RELATIVE_ERROR;
+        passed = passed && kernelPassed;
+
+        const double singleRate = UTimeKernel(kernel, scene, single);
+        const double perCoreRate = UTimeKernel(kernel, scene, pool);
+        if (kernel == PHONG_KERNEL_SCALAR)
+            scalarRate = singleRate;
+
+        std::cout << "  " << PhongKernelName(kernel) << " (" << PhongKernelWidth(kernel) << " wide): max error " << error
+            << (kernelPassed ? "" : " TOO LARGE") << ", " << singleRate / 1e6 << " M fragments/s on one thread ("
+            << singleRate / scalarRate << "x scalar), " << perCoreRate / 1e6 << " M fragments/s/core with all threads" << std::endl;
+    }
+
+    std::cout << "PHONG KERNELS " << (passed ? "PASSED" : "FAILED") << std::endl;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
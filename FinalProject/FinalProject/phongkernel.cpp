@@ -0,0 +1,191 @@
+// Reference, scalar and SSE2 Phong kernels and the runtime dispatch. The AVX2 and AVX-512 kernels are in
+// phongkernel_avx2.cpp and phongkernel_avx512.cpp, built with /arch:AVX2 and /arch:AVX512.
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>         // __cpuid, __cpuidex, _xgetbv
+#endif
+
+#include "phongkernel.h"
+#include "phonglanes.h"
+
+namespace
+{
+    struct ScalarLanes
+    {
+        typedef float Value;
+        static const unsigned int WIDTH = 1;
+        static Value Set(float value) { return value; }
+        static Value Load(const float* source) { return *source; }
+        static void Store(float* destination, Value value) { *destination = value; }
+        static Value Add(Value a, Value b) { return a + b; }
+        static Value Sub(Value a, Value b) { return a - b; }
+        static Value Mul(Value a, Value b) { return a * b; }
+        static Value Div(Value a, Value b) { return a / b; }
+        static Value Min(Value a, Value b) { return a < b ? a : b; }
+        static Value Max(Value a, Value b) { return a > b ? a : b; }
+        static Value Sqrt(Value a) { return std::sqrt(a); }
+    };
+
+    struct Sse2Lanes
+    {
+        typedef __m128 Value;
+        static const unsigned int WIDTH = 4;
+        static Value Set(float value) { return _mm_set1_ps(value); }
+        static Value Load(const float* source) { return _mm_loadu_ps(source); }
+        static void Store(float* destination, Value value) { _mm_storeu_ps(destination, value); }
+        static Value Add(Value a, Value b) { return _mm_add_ps(a, b); }
+        static Value Sub(Value a, Value b) { return _mm_sub_ps(a, b); }
+        static Value Mul(Value a, Value b) { return _mm_mul_ps(a, b); }
+        static Value Div(Value a, Value b) { return _mm_div_ps(a, b); }
+        static Value Min(Value a, Value b) { return _mm_min_ps(a, b); }
+        static Value Max(Value a, Value b) { return _mm_max_ps(a, b); }
+        static Value Sqrt(Value a) { return _mm_sqrt_ps(a); }
+    };
+
+    // CPUID leaf 7 feature bits, and XGETBV for the register state the OS saves on a context switch:
+    // without it the AVX registers would be corrupted by the first thread switch
+    bool UCpuSupports(PhongKernel kernel)
+    {
+        if (kernel == PHONG_KERNEL_SCALAR || kernel == PHONG_KERNEL_SSE2)
+            return true;
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osSavesState = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osSavesState || !avx)
+            return false;
+        const unsigned long long enabledState = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        if (kernel == PHONG_KERNEL_AVX2)
+            return (enabledState & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+        return (enabledState & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+#else
+        // the builtins check the OS support too
+        __builtin_cpu_init();
+        if (kernel == PHONG_KERNEL_AVX2)
+            return __builtin_cpu_supports("avx2") != 0;
+        return __builtin_cpu_supports("avx512f") != 0;
+#endif
+    }
+}
+
+
+// clusteredPhong as written in GLSL, one fragment at a time with pow(); slow, only for validating the kernels
+void PhongShadeReference(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+    const float ambientStrength = 0.1f;
+    const float specularIntensity = 1.0f;
+    const float highlightSize = 16.0f;
+    const glm::vec3 viewPosition(scene.viewPosition[0], scene.viewPosition[1], scene.viewPosition[2]);
+
+    for (unsigned int f = first; f < fragments.count; ++f)
+    {
+        const glm::vec3 fragmentPos(fragments.positionX[f], fragments.positionY[f], fragments.positionZ[f]);
+        const glm::vec3 norm(fragments.normalX[f], fragments.normalY[f], fragments.normalZ[f]);
+        const glm::vec3 viewDir = glm::normalize(viewPosition - fragmentPos);
+
+        glm::vec3 ambient(0.0f), diffuse(0.0f), specular(0.0f);
+        for (unsigned int l = 0; l < scene.lightCount; ++l)
+        {
+            const PhongLight& light = scene.lights[l];
+            const glm::vec3 lightPosition(light.position[0], light.position[1], light.position[2]);
+
+            const glm::vec3 lightDirection = glm::normalize(lightPosition - fragmentPos);
+            float impact = (std::max)(glm::dot(norm, lightDirection), 0.0f);
+            float intensity = 1.0f;
+
+            if (light.spot)
+            {
+                const float theta = glm::dot(lightDirection, glm::vec3(light.axis[0], light.axis[1], light.axis[2]));
+                const float epsilon = light.innerCutOff - light.outerCutOff;
+                intensity = glm::clamp((theta - light.outerCutOff) / epsilon, 0.0f, 1.0f);
+                impact = 1.0f;
+            }
+
+            if (light.range > 0.0f)
+            {
+                const float distance = glm::length(lightPosition - fragmentPos);
+                const float window = glm::clamp(1.0f - std::pow(distance / light.range, 4.0f), 0.0f, 1.0f);
+                intensity *= window * window / (distance * distance + 1.0f);
+            }
+
+            const glm::vec3 reflectDir = glm::reflect(-lightDirection, norm);
+            const float specularComponent = std::pow((std::max)(glm::dot(viewDir, reflectDir), 0.0f), highlightSize);
+
+            const glm::vec3 lightColor = glm::vec3(light.color[0], light.color[1], light.color[2]) * intensity;
+            const float shadow = light.shadowMap >= 0 && fragments.shadow[light.shadowMap] ? fragments.shadow[light.shadowMap][f] : 1.0f;
+            ambient += ambientStrength * lightColor;
+            diffuse += impact * lightColor * shadow;
+            specular += specularIntensity * specularComponent * lightColor * shadow;
+        }
+
+        const glm::vec3 phong = (ambient + diffuse + specular) * glm::vec3(fragments.albedoR[f], fragments.albedoG[f], fragments.albedoB[f]);
+        fragments.red[f] = phong.r;
+        fragments.green[f] = phong.g;
+        fragments.blue[f] = phong.b;
+    }
+}
+
+
+void PhongShadeScalar(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+    PhongShadeLanes<ScalarLanes>(scene, fragments, first);
+}
+
+
+void PhongShadeSse2(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+    const unsigned int done = PhongShadeLanes<Sse2Lanes>(scene, fragments, first);
+    if (done < fragments.count)
+        PhongShadeScalar(scene, fragments, done);
+}
+
+
+bool PhongKernelSupported(PhongKernel kernel)
+{
+    // CPUID is slow enough to matter per batch, ask once
+    static const bool supported[PHONG_KERNEL_COUNT] = { UCpuSupports(PHONG_KERNEL_SCALAR), UCpuSupports(PHONG_KERNEL_SSE2),
+        UCpuSupports(PHONG_KERNEL_AVX2), UCpuSupports(PHONG_KERNEL_AVX512) };
+    return kernel < PHONG_KERNEL_COUNT && supported[kernel];
+}
+
+
+PhongKernel PhongBestKernel()
+{
+    if (PhongKernelSupported(PHONG_KERNEL_AVX512))
+        return PHONG_KERNEL_AVX512;
+    if (PhongKernelSupported(PHONG_KERNEL_AVX2))
+        return PHONG_KERNEL_AVX2;
+    return PHONG_KERNEL_SSE2;
+}
+
+
+PhongShadeFunction PhongKernelFunction(PhongKernel kernel)
+{
+    const PhongShadeFunction functions[PHONG_KERNEL_COUNT] = { PhongShadeScalar, PhongShadeSse2, PhongShadeAvx2, PhongShadeAvx512 };
+    return kernel < PHONG_KERNEL_COUNT ? functions[kernel] : nullptr;
+}
+
+
+const char* PhongKernelName(PhongKernel kernel)
+{
+    const char* names[PHONG_KERNEL_COUNT] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    return kernel < PHONG_KERNEL_COUNT ? names[kernel] : "unknown";
+}
+
+
+unsigned int PhongKernelWidth(PhongKernel kernel)
+{
+    const unsigned int widths[PHONG_KERNEL_COUNT] = { 1, 4, 8, 16 };
+    return kernel < PHONG_KERNEL_COUNT ? widths[kernel] : 0;
+}
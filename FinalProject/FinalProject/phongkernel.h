@@ -0,0 +1,79 @@
+#ifndef PHONGKERNEL_H
+#define PHONGKERNEL_H
+
+// clusteredPhong of Source.cpp on the CPU, for the software renderer and offline tools. Fragments are passed
+// as structure-of-arrays blocks and shaded 1, 4, 8 or 16 at a time (scalar, SSE2, AVX2, AVX-512); the wide
+// kernels are compiled in their own files with the matching /arch flag and only called when the CPU has it.
+// pow(x, 16) is computed by squaring four times. PhongShadeReference follows the GLSL line by line and is
+// what the kernels are validated against (--bench-phong).
+//
+// This header has no inline code on purpose: the AVX files include it, and an inline function compiled
+// there could be the copy the linker keeps for every caller.
+
+// one light in the layout the kernels read, see PhongLightFrom in softrasterizer.h
+struct PhongLight
+{
+	float position[3];
+	float range;            // 0 = unbounded
+	float color[3];
+	int spot;               // nonzero for a spotlight
+	float axis[3];          // normalize(-direction), what the cone angle is measured against
+	float innerCutOff;      // cosines of the cone angles
+	float outerCutOff;
+	int shadowMap;          // index into PhongFragments::shadow, -1 = not shadowed
+};
+
+// what is shaded: the eye and the light list
+struct PhongScene
+{
+	float viewPosition[3];
+	const PhongLight* lights;
+	unsigned int lightCount;
+};
+
+// count fragments, one array per component. Normals are unit length. shadow[m] holds the shadow factor of
+// map m per fragment and may be null when no light reads it. The kernels write the lit color times the
+// albedo, unclamped, to red, green and blue.
+struct PhongFragments
+{
+	const float* positionX;
+	const float* positionY;
+	const float* positionZ;
+	const float* normalX;
+	const float* normalY;
+	const float* normalZ;
+	const float* albedoR;
+	const float* albedoG;
+	const float* albedoB;
+	const float* shadow[2];
+	float* red;
+	float* green;
+	float* blue;
+	unsigned int count;
+};
+
+enum PhongKernel
+{
+	PHONG_KERNEL_SCALAR,
+	PHONG_KERNEL_SSE2,
+	PHONG_KERNEL_AVX2,
+	PHONG_KERNEL_AVX512,
+	PHONG_KERNEL_COUNT
+};
+
+typedef void (*PhongShadeFunction)(const PhongScene& scene, const PhongFragments& fragments, unsigned int first);
+
+// the kernels shade fragments [first, count); the wide ones finish the last partial vector with the scalar one
+void PhongShadeReference(const PhongScene& scene, const PhongFragments& fragments, unsigned int first = 0);
+void PhongShadeScalar(const PhongScene& scene, const PhongFragments& fragments, unsigned int first = 0);
+void PhongShadeSse2(const PhongScene& scene, const PhongFragments& fragments, unsigned int first = 0);
+void PhongShadeAvx2(const PhongScene& scene, const PhongFragments& fragments, unsigned int first = 0);
+void PhongShadeAvx512(const PhongScene& scene, const PhongFragments& fragments, unsigned int first = 0);
+
+// runtime dispatch: whether this CPU and OS can run a kernel, and the widest one they can
+bool PhongKernelSupported(PhongKernel kernel);
+PhongKernel PhongBestKernel();
+PhongShadeFunction PhongKernelFunction(PhongKernel kernel);
+const char* PhongKernelName(PhongKernel kernel);
+unsigned int PhongKernelWidth(PhongKernel kernel);
+#endif
@@ -0,0 +1,36 @@
+// AVX2 Phong kernel, eight fragments per iteration. Built with /arch:AVX2 and only called after
+// PhongKernelSupported(PHONG_KERNEL_AVX2); keep glm and other shared inline code out of this file.
+#include <immintrin.h>
+
+#include "phongkernel.h"
+#include "phonglanes.h"
+
+namespace
+{
+    struct Avx2Lanes
+    {
+        typedef __m256 Value;
+        static const unsigned int WIDTH = 8;
+        static Value Set(float value) { return _mm256_set1_ps(value); }
+        static Value Load(const float* source) { return _mm256_loadu_ps(source); }
+        static void Store(float* destination, Value value) { _mm256_storeu_ps(destination, value); }
+        static Value Add(Value a, Value b) { return _mm256_add_ps(a, b); }
+        static Value Sub(Value a, Value b) { return _mm256_sub_ps(a, b); }
+        static Value Mul(Value a, Value b) { return _mm256_mul_ps(a, b); }
+        static Value Div(Value a, Value b) { return _mm256_div_ps(a, b); }
+        static Value Min(Value a, Value b) { return _mm256_min_ps(a, b); }
+        static Value Max(Value a, Value b) { return _mm256_max_ps(a, b); }
+        static Value Sqrt(Value a) { return _mm256_sqrt_ps(a); }
+    };
+}
+
+
+void PhongShadeAvx2(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+    const unsigned int done = PhongShadeLanes<Avx2Lanes>(scene, fragments, first);
+
+    // leave the upper register halves clean before the SSE code that runs next
+    _mm256_zeroupper();
+    if (done < fragments.count)
+        PhongShadeScalar(scene, fragments, done);
+}
@@ -0,0 +1,36 @@
+// AVX-512 Phong kernel, sixteen fragments per iteration. Built with /arch:AVX512 and only called after
+// PhongKernelSupported(PHONG_KERNEL_AVX512); keep glm and other shared inline code out of this file.
+#include <immintrin.h>
+
+#include "phongkernel.h"
+#include "phonglanes.h"
+
+namespace
+{
+    struct Avx512Lanes
+    {
+        typedef __m512 Value;
+        static const unsigned int WIDTH = 16;
+        static Value Set(float value) { return _mm512_set1_ps(value); }
+        static Value Load(const float* source) { return _mm512_loadu_ps(source); }
+        static void Store(float* destination, Value value) { _mm512_storeu_ps(destination, value); }
+        static Value Add(Value a, Value b) { return _mm512_add_ps(a, b); }
+        static Value Sub(Value a, Value b) { return _mm512_sub_ps(a, b); }
+        static Value Mul(Value a, Value b) { return _mm512_mul_ps(a, b); }
+        static Value Div(Value a, Value b) { return _mm512_div_ps(a, b); }
+        static Value Min(Value a, Value b) { return _mm512_min_ps(a, b); }
+        static Value Max(Value a, Value b) { return _mm512_max_ps(a, b); }
+        static Value Sqrt(Value a) { return _mm512_sqrt_ps(a); }
+    };
+}
+
+
+void PhongShadeAvx512(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+    const unsigned int done = PhongShadeLanes<Avx512Lanes>(scene, fragments, first);
+
+    // leave the upper register halves clean before the SSE code that runs next
+    _mm256_zeroupper();
+    if (done < fragments.count)
+        PhongShadeScalar(scene, fragments, done);
+}
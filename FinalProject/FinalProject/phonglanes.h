@@ -0,0 +1,105 @@
+#ifndef PHONGLANES_H
+#define PHONGLANES_H
+
+// Body of the Phong kernels, written once against a lane type and instantiated by each phongkernel*.cpp
+// with its own instruction set. Lanes provides Value (Lanes::WIDTH floats), Set, Load, Store, Add, Sub,
+// Mul, Div, Min, Max and Sqrt; loads and stores are unaligned. Define the lane types in an unnamed
+// namespace so every instantiation stays inside the file that compiled it.
+
+#include "phongkernel.h"
+
+// shades whole vectors of fragments from first on, returns where it stopped
+template <typename Lanes>
+unsigned int PhongShadeLanes(const PhongScene& scene, const PhongFragments& fragments, unsigned int first)
+{
+	typedef typename Lanes::Value Value;
+
+	const Value zero = Lanes::Set(0.0f);
+	const Value one = Lanes::Set(1.0f);
+	const Value two = Lanes::Set(2.0f);
+	const Value ambientStrength = Lanes::Set(0.1f);
+	const Value viewX = Lanes::Set(scene.viewPosition[0]);
+	const Value viewY = Lanes::Set(scene.viewPosition[1]);
+	const Value viewZ = Lanes::Set(scene.viewPosition[2]);
+
+	unsigned int f = first;
+	for (; f + Lanes::WIDTH <= fragments.count; f += Lanes::WIDTH)
+	{
+		const Value px = Lanes::Load(fragments.positionX + f);
+		const Value py = Lanes::Load(fragments.positionY + f);
+		const Value pz = Lanes::Load(fragments.positionZ + f);
+		const Value nx = Lanes::Load(fragments.normalX + f);
+		const Value ny = Lanes::Load(fragments.normalY + f);
+		const Value nz = Lanes::Load(fragments.normalZ + f);
+
+		// view direction
+		Value vx = Lanes::Sub(viewX, px);
+		Value vy = Lanes::Sub(viewY, py);
+		Value vz = Lanes::Sub(viewZ, pz);
+		const Value viewLength = Lanes::Sqrt(Lanes::Add(Lanes::Add(Lanes::Mul(vx, vx), Lanes::Mul(vy, vy)), Lanes::Mul(vz, vz)));
+		vx = Lanes::Div(vx, viewLength);
+		vy = Lanes::Div(vy, viewLength);
+		vz = Lanes::Div(vz, viewLength);
+
+		Value red = zero, green = zero, blue = zero;
+		for (unsigned int l = 0; l < scene.lightCount; ++l)
+		{
+			const PhongLight& light = scene.lights[l];
+
+			Value lx = Lanes::Sub(Lanes::Set(light.position[0]), px);
+			Value ly = Lanes::Sub(Lanes::Set(light.position[1]), py);
+			Value lz = Lanes::Sub(Lanes::Set(light.position[2]), pz);
+			const Value distance = Lanes::Sqrt(Lanes::Add(Lanes::Add(Lanes::Mul(lx, lx), Lanes::Mul(ly, ly)), Lanes::Mul(lz, lz)));
+			lx = Lanes::Div(lx, distance);
+			ly = Lanes::Div(ly, distance);
+			lz = Lanes::Div(lz, distance);
+
+			const Value normalDotLight = Lanes::Add(Lanes::Add(Lanes::Mul(nx, lx), Lanes::Mul(ny, ly)), Lanes::Mul(nz, lz));
+			Value impact = Lanes::Max(normalDotLight, zero);
+			Value intensity = one;
+			if (light.spot)
+			{
+				// spotlight cone, the diffuse term is not scaled by the surface angle
+				const Value theta = Lanes::Add(Lanes::Add(Lanes::Mul(lx, Lanes::Set(light.axis[0])), Lanes::Mul(ly, Lanes::Set(light.axis[1]))),
+					Lanes::Mul(lz, Lanes::Set(light.axis[2])));
+				const Value epsilon = Lanes::Set(light.innerCutOff - light.outerCutOff);
+				intensity = Lanes::Min(Lanes::Max(Lanes::Div(Lanes::Sub(theta, Lanes::Set(light.outerCutOff)), epsilon), zero), one);
+				impact = one;
+			}
+			if (light.range > 0.0f)
+			{
+				// smooth window so bounded lights reach exactly zero at their range
+				Value ratio = Lanes::Div(distance, Lanes::Set(light.range));
+				ratio = Lanes::Mul(ratio, ratio);
+				const Value window = Lanes::Min(Lanes::Max(Lanes::Sub(one, Lanes::Mul(ratio, ratio)), zero), one);
+				intensity = Lanes::Mul(intensity, Lanes::Div(Lanes::Mul(window, window), Lanes::Add(Lanes::Mul(distance, distance), one)));
+			}
+
+			// reflect(-lightDirection, norm), then pow(max(dot(view, reflection), 0), 16) by squaring
+			const Value twoNdotL = Lanes::Mul(two, normalDotLight);
+			const Value rx = Lanes::Sub(Lanes::Mul(twoNdotL, nx), lx);
+			const Value ry = Lanes::Sub(Lanes::Mul(twoNdotL, ny), ly);
+			const Value rz = Lanes::Sub(Lanes::Mul(twoNdotL, nz), lz);
+			Value specular = Lanes::Max(Lanes::Add(Lanes::Add(Lanes::Mul(vx, rx), Lanes::Mul(vy, ry)), Lanes::Mul(vz, rz)), zero);
+			specular = Lanes::Mul(specular, specular);
+			specular = Lanes::Mul(specular, specular);
+			specular = Lanes::Mul(specular, specular);
+			specular = Lanes::Mul(specular, specular);
+
+			// ambient is not shadowed
+			Value lit = Lanes::Add(impact, specular);
+			if (light.shadowMap >= 0 && fragments.shadow[light.shadowMap])
+				lit = Lanes::Mul(lit, Lanes::Load(fragments.shadow[light.shadowMap] + f));
+			const Value scale = Lanes::Mul(intensity, Lanes::Add(ambientStrength, lit));
+			red = Lanes::Add(red, Lanes::Mul(Lanes::Set(light.color[0]), scale));
+			green = Lanes::Add(green, Lanes::Mul(Lanes::Set(light.color[1]), scale));
+			blue = Lanes::Add(blue, Lanes::Mul(Lanes::Set(light.color[2]), scale));
+		}
+
+		Lanes::Store(fragments.red + f, Lanes::Mul(red, Lanes::Load(fragments.albedoR + f)));
+		Lanes::Store(fragments.green + f, Lanes::Mul(green, Lanes::Load(fragments.albedoG + f)));
+		Lanes::Store(fragments.blue + f, Lanes::Mul(blue, Lanes::Load(fragments.albedoB + f)));
+	}
+	return f;
+}
+#endif
@@ -0,0 +1,235 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary).
+// Entries are keyed by a hash of the shader sources (defines included, they are part of the source)
+// and the driver vendor/renderer/version strings, so a driver update simply misses the cache.
+class ProgramCache
+{
+public:
+	// hit/miss counters for the startup report
+	struct Stats
+	{
+		unsigned int hits = 0;      // programs restored from a binary
+		unsigned int misses = 0;    // programs compiled from source
+		unsigned int rejected = 0;  // binaries the driver refused, also counted as misses
+		unsigned int stored = 0;    // binaries written
+	};
+
+	// cache options, set before the first program is created
+	static bool& Enabled()
+	{
+		static bool enabled = true;
+		return enabled;
+	}
+	static std::string& Directory()
+	{
+		static std::string directory = "shader_cache";
+		return directory;
+	}
+	static Stats& GetStats()
+	{
+		static Stats stats;
+		return stats;
+	}
+
+	// returns the cache key of a program built from the given stages (sources, or SPIR-V modules and constants)
+	static std::string Key(std::initializer_list<std::string> stages)
+	{
+		// 64 bit FNV-1a over the stages and the driver identification, each stage prefixed with its length so
+		// text moved from one stage to the next changes the key
+		unsigned long long hash = 14695981039346656037ull;
+		HashValue(hash, stages.size());
+		for (const std::string& stage : stages)
+		{
+			HashValue(hash, stage.size());
+			HashString(hash, stage);
+		}
+		HashString(hash, GetString(GL_VENDOR));
+		HashString(hash, GetString(GL_RENDERER));
+		HashString(hash, GetString(GL_VERSION));
+
+		std::ostringstream key;
+		key << std::hex << hash;
+		return key.str();
+	}
+
+	// must be called before glLinkProgram so the driver keeps a retrievable binary
+	static void PrepareForBinary(GLuint program)
+	{
+		if (Usable())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Hands the cached binary to program without waiting for the driver, returns false (program untouched) when
+	// there is no usable file. The driver may still refuse the binary (e.g. a driver update with the same version
+	// string), so the program is only known to be good once Accept saw its link status.
+	static bool Submit(GLuint program, const std::string& key)
+	{
+		if (!Usable())
+			return false;
+
+		std::ifstream file(Path(key).c_str(), std::ios::binary);
+		if (!file)
+		{
+			++GetStats().misses;
+			return false;
+		}
+
+		GLuint header[3] = { 0, 0, 0 }; // magic, binary format, binary length
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+		// the stored length must fit in what is left of the file, a truncated or corrupt entry is not allocated for
+		std::streamoff remaining = 0;
+		if (file)
+		{
+			const std::streamoff start = file.tellg();
+			file.seekg(0, std::ios::end);
+			remaining = file.tellg() - start;
+			file.seekg(start);
+		}
+		std::vector<char> binary(file && header[0] == MAGIC && header[2] <= remaining ? header[2] : 0);
+		if (!binary.empty())
+			file.read(&binary[0], binary.size());
+		if (!file || binary.empty())
+		{
+			++GetStats().rejected;
+			++GetStats().misses;
+			return false;
+		}
+
+		glProgramBinary(program, (GLenum)header[1], &binary[0], (GLsizei)binary.size());
+		return true;
+	}
+
+	// Reads the link status of a program Submit loaded, waiting for the driver if it is not done, and counts the
+	// hit. A refused binary is removed from the cache, the caller compiles the program from source instead.
+	static bool Accept(GLuint program, const std::string& key)
+	{
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			std::remove(Path(key).c_str());
+			++GetStats().rejected;
+			++GetStats().misses;
+			return false;
+		}
+
+		++GetStats().hits;
+		return true;
+	}
+
+	// restores program from the cache and waits for the result, returns false (program unlinked) when there is
+	// no usable binary
+	static bool Load(GLuint program, const std::string& key)
+	{
+		return Submit(program, key) && Accept(program, key);
+	}
+
+	// writes the binary of a successfully linked program to the cache, failed links are skipped
+	static void Save(GLuint program, const std::string& key)
+	{
+		if (!Usable())
+			return;
+
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+			return;
+
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+		MakeDirectory(Directory());
+		std::ofstream file(Path(key).c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			std::cout << "WARNING::PROGRAM_CACHE::CANNOT_WRITE " << Path(key) << std::endl;
+			return;
+		}
+
+		const GLuint header[3] = { MAGIC, (GLuint)format, (GLuint)length };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(&binary[0], binary.size());
+		++GetStats().stored;
+	}
+
+private:
+	static const GLuint MAGIC = 0x4e494250; // "PBIN"
+
+	// the cache is only used when enabled and the driver offers at least one binary format
+	static bool Usable()
+	{
+		if (!Enabled())
+			return false;
+		static GLint formats = -1;
+		if (formats < 0)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	static std::string Path(const std::string& key)
+	{
+		return Directory() + "/" + key + ".bin";
+	}
+
+	static std::string GetString(GLenum name)
+	{
+		const GLubyte* value = glGetString(name);
+		return value ? reinterpret_cast<const char*>(value) : "";
+	}
+
+	static void HashValue(unsigned long long& hash, unsigned long long value)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			hash ^= (value >> (i * 8)) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	}
+
+	static void HashString(unsigned long long& hash, const std::string& value)
+	{
+		for (size_t i = 0; i < value.size(); ++i)
+		{
+			hash ^= (unsigned char)value[i];
+			hash *= 1099511628211ull;
+		}
+		// separator, so moving text between two strings changes the key
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+	}
+
+	static void MakeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+};
+#endif
@@ -0,0 +1,909 @@
+#ifndef RAYTRACER_H
+#define RAYTRACER_H
+
+// CPU ray tracer for ground truth images of the scene (--raytrace in Source.cpp). It takes the same draws and
+// lights as the software rasterizer and shades hits with the same Phong kernels, but the shadows of the key
+// light and the spotlight come from shadow rays instead of shadow maps. That leaves the shadow map
+// resolution, bias and PCF as the visible differences from the rasterized frames.
+//
+// The triangles are put in a bounding volume hierarchy built with a binned surface area heuristic: the top
+// levels are split on the calling thread until there is a subtree per worker or so, then the subtrees are
+// built in parallel and stitched below them. Rays are traced as 2x2 SSE packets, tile by tile, and a tile
+// is shaded as soon as its primary and shadow rays are done.
+
+#include <glm/glm.hpp>
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "phongkernel.h"
+#include "softrasterizer.h"     // Draw, Light and texture sampling are shared with the rasterizer
+#include "workerpool.h"
+
+class RayTracer
+{
+public:
+	static const int TILE_SIZE = 16;
+	static const int SAH_BINS = 16;
+	static const unsigned int MAX_LEAF_TRIANGLES = 4;
+	static const unsigned int PARALLEL_SUBTREE_TRIANGLES = 2048;  // larger ranges are split before the parallel build
+	static const unsigned int TRAVERSAL_STACK_SIZE = 64;          // deeper hierarchies trace with a heap stack
+
+	typedef SoftwareRasterizer::Draw Draw;
+	typedef SoftwareRasterizer::Light Light;
+
+	// what to render once the BVH is built over the draws passed to Build
+	struct Frame
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 viewPosition;
+		const Light* lights;
+		unsigned int lightCount;
+		bool shadows;           // trace shadow rays for the lights with a shadow map in the GL path
+		glm::vec2 uvScale;
+	};
+
+	// a ray of the batch queries, from origin to origin + direction * tMax
+	struct Ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float tMax;
+	};
+
+	// closest hit of a batch query, draw -1 = missed. faceNormal is the geometric normal turned toward the
+	// ray origin, normal the interpolated vertex normal
+	struct Hit
+	{
+		int draw;
+		float t;
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec3 faceNormal;
+		glm::vec2 uv;
+	};
+
+	explicit RayTracer(WorkerPool& pool) : pool(pool)
+	{
+		shade = PhongKernelFunction(PhongBestKernel());
+	}
+
+	void Resize(int width, int height)
+	{
+		colorWidth = width;
+		colorHeight = height;
+		color.assign(size_t(width) * height * 3, 0);
+	}
+
+	int Width() const { return colorWidth; }
+	int Height() const { return colorHeight; }
+
+	// RGB8, rows bottom to top like glReadPixels
+	const unsigned char* Pixels() const { return color.data(); }
+
+	unsigned int TriangleCount() const { return (unsigned int)triangles.size(); }
+	unsigned int NodeCount() const { return (unsigned int)nodes.size(); }
+	unsigned int Depth() const { return depth; }
+
+	// primary and shadow rays traced by the last Render
+	unsigned long long Rays() const
+	{
+		unsigned long long total = 0;
+		for (unsigned long long count : rayCounts)
+			total += count;
+		return total;
+	}
+
+	// world space triangles of the draws and the hierarchy over them; the draws must outlive the renders
+	void Build(const Draw* draws, unsigned int drawCount)
+	{
+		this->draws = draws;
+		BuildTriangles(draws, drawCount);
+
+		const unsigned int count = (unsigned int)triangles.size();
+		order.resize(count);
+		centroids.resize(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			order[i] = i;
+			centroids[i] = (triangles[i].v0 * 3.0f + triangles[i].edge1 + triangles[i].edge2) * (1.0f / 3.0f);
+		}
+
+		nodes.clear();
+		nodes.push_back(Node());
+		std::vector<Subtree> subtrees;
+		if (count > 0)
+			SplitTopLevels(subtrees);
+
+		auto buildSubtree = [this, &subtrees](unsigned int index, unsigned int)
+		{
+			Subtree& subtree = subtrees[index];
+			subtree.nodes.push_back(Node());
+			SetBounds(subtree.nodes[0], subtree.first, subtree.count);
+			BuildNode(subtree.nodes, 0, subtree.first, subtree.count);
+		};
+		pool.ParallelFor((unsigned int)subtrees.size(), buildSubtree);
+
+		// each subtree root replaces its placeholder, its other nodes go to the end with their child indices moved
+		for (Subtree& subtree : subtrees)
+		{
+			const uint32_t offset = (uint32_t)nodes.size() - 1;
+			for (size_t i = 1; i < subtree.nodes.size(); ++i)
+			{
+				Node node = subtree.nodes[i];
+				if (node.count == 0)
+					node.leftFirst += offset;
+				nodes.push_back(node);
+			}
+			Node root = subtree.nodes[0];
+			if (root.count == 0)
+				root.leftFirst += offset;
+			nodes[subtree.node] = root;
+		}
+		depth = MeasureDepth();
+
+		// leaves index the triangles directly, in hierarchy order
+		std::vector<TriangleData> ordered(count);
+		for (unsigned int i = 0; i < count; ++i)
+			ordered[i] = triangles[order[i]];
+		triangles.swap(ordered);
+	}
+
+	void Render(const Frame& frame)
+	{
+		this->frame = &frame;
+		inverseViewProjection = glm::inverse(frame.projection * frame.view);
+
+		phongLights.resize(frame.lightCount);
+		for (unsigned int l = 0; l < frame.lightCount; ++l)
+			phongLights[l] = SoftwareRasterizer::PhongLightFrom(frame.lights[l], frame.shadows);
+		phongScene.viewPosition[0] = frame.viewPosition.x;
+		phongScene.viewPosition[1] = frame.viewPosition.y;
+		phongScene.viewPosition[2] = frame.viewPosition.z;
+		phongScene.lights = phongLights.data();
+		phongScene.lightCount = frame.lightCount;
+
+		rayCounts.assign(pool.Threads(), 0);
+		const unsigned int tilesX = (unsigned int)((colorWidth + TILE_SIZE - 1) / TILE_SIZE);
+		const unsigned int tilesY = (unsigned int)((colorHeight + TILE_SIZE - 1) / TILE_SIZE);
+		auto tile = [this, tilesX](unsigned int index, unsigned int threadIndex)
+		{
+			RenderTile(int(index % tilesX) * TILE_SIZE, int(index / tilesX) * TILE_SIZE, rayCounts[threadIndex]);
+		};
+		pool.ParallelFor(tilesX * tilesY, tile);
+	}
+
+	// Closest hits of any number of rays, traced four at a time on the calling thread. Safe to call from
+	// several threads once Build is done, the offline tools (lightmapbaker.h) run their own loops.
+	void Intersect(const Ray* rays, unsigned int count, Hit* hits) const
+	{
+		for (unsigned int first = 0; first < count; first += 4)
+		{
+			const unsigned int lanes = std::min(count - first, 4u);
+			RayPacket packet;
+			__m128 active;
+			LoadPacket(rays + first, lanes, packet, active);
+			PacketHits packetHits;
+			Trace(packet, active, false, packetHits);
+
+			alignas(16) float t[4], u[4], v[4];
+			alignas(16) int triangleIndex[4];
+			_mm_store_ps(t, packetHits.t);
+			_mm_store_ps(u, packetHits.u);
+			_mm_store_ps(v, packetHits.v);
+			_mm_store_si128(reinterpret_cast<__m128i*>(triangleIndex), packetHits.triangle);
+			for (unsigned int lane = 0; lane < lanes; ++lane)
+			{
+				Hit& hit = hits[first + lane];
+				hit.draw = -1;
+				if (triangleIndex[lane] < 0)
+					continue;
+				const TriangleData& triangle = triangles[triangleIndex[lane]];
+				const float w = 1.0f - u[lane] - v[lane];
+				const Ray& ray = rays[first + lane];
+				hit.draw = int(triangle.draw);
+				hit.t = t[lane];
+				hit.position = triangle.v0 + triangle.edge1 * u[lane] + triangle.edge2 * v[lane];
+				hit.normal = glm::normalize(triangle.normal[0] * w + triangle.normal[1] * u[lane] + triangle.normal[2] * v[lane]);
+				hit.faceNormal = glm::dot(triangle.faceNormal, ray.direction) > 0.0f ? -triangle.faceNormal : triangle.faceNormal;
+				hit.uv = triangle.uv[0] * w + triangle.uv[1] * u[lane] + triangle.uv[2] * v[lane];
+			}
+		}
+	}
+
+	// whether anything lies on each ray before tMax, four at a time and stopping at the first blocker
+	void Occluded(const Ray* rays, unsigned int count, bool* occluded) const
+	{
+		for (unsigned int first = 0; first < count; first += 4)
+		{
+			const unsigned int lanes = std::min(count - first, 4u);
+			RayPacket packet;
+			__m128 active;
+			LoadPacket(rays + first, lanes, packet, active);
+			PacketHits packetHits;
+			Trace(packet, active, true, packetHits);
+
+			alignas(16) int blocked[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(blocked), packetHits.triangle);
+			for (unsigned int lane = 0; lane < lanes; ++lane)
+				occluded[first + lane] = blocked[lane] >= 0;
+		}
+	}
+
+private:
+	// 32 bytes, two per cache line. Inner nodes have count 0 and their children at leftFirst and leftFirst + 1;
+	// leaves have their triangles at [leftFirst, leftFirst + count)
+	struct Node
+	{
+		float boundsMin[3];
+		uint32_t leftFirst;
+		float boundsMax[3];
+		uint16_t count;
+		uint16_t axis;      // split axis of inner nodes, picks the child to visit first
+	};
+
+	// a range of triangles left for a worker, and the node it hangs from
+	struct Subtree
+	{
+		uint32_t node;
+		unsigned int first;
+		unsigned int count;
+		std::vector<Node> nodes;
+	};
+
+	struct TriangleData
+	{
+		glm::vec3 v0, edge1, edge2;     // what the intersection test reads
+		glm::vec3 faceNormal;           // pushes shadow ray origins off the surface
+		glm::vec3 normal[3];
+		glm::vec2 uv[3];
+		unsigned int draw;
+	};
+
+	struct Bin
+	{
+		glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+		glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+		unsigned int count = 0;
+	};
+
+	// four rays, one per lane; t runs from the origin (0) to the far end of the ray (1)
+	struct RayPacket
+	{
+		__m128 originX, originY, originZ;
+		__m128 directionX, directionY, directionZ;
+		__m128 inverseX, inverseY, inverseZ;
+		__m128 tMax;
+	};
+
+	struct PacketHits
+	{
+		__m128 t, u, v;
+		__m128i triangle;   // -1 = missed
+	};
+
+	// fragments of one tile, structure of arrays for the Phong kernel
+	struct TileFragments
+	{
+		static const int SIZE = TILE_SIZE * TILE_SIZE;
+		alignas(64) float positionX[SIZE];
+		alignas(64) float positionY[SIZE];
+		alignas(64) float positionZ[SIZE];
+		alignas(64) float normalX[SIZE];
+		alignas(64) float normalY[SIZE];
+		alignas(64) float normalZ[SIZE];
+		alignas(64) float albedoR[SIZE];
+		alignas(64) float albedoG[SIZE];
+		alignas(64) float albedoB[SIZE];
+		alignas(64) float shadow[2][SIZE];
+		alignas(64) float red[SIZE];
+		alignas(64) float green[SIZE];
+		alignas(64) float blue[SIZE];
+		glm::vec3 faceNormal[SIZE];
+		unsigned char* pixel[SIZE];
+		int count;
+	};
+
+	void BuildTriangles(const Draw* draws, unsigned int drawCount)
+	{
+		triangles.clear();
+		for (unsigned int d = 0; d < drawCount; ++d)
+		{
+			const Draw& draw = draws[d];
+			const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(draw.model)));
+			for (unsigned int v = 0; v + 2 < draw.vertexCount; v += 3)
+			{
+				TriangleData triangle;
+				glm::vec3 positions[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					const float* vertex = draw.vertices + size_t(v + i) * 8;
+					positions[i] = glm::vec3(draw.model * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+					triangle.normal[i] = normalMatrix * glm::vec3(vertex[3], vertex[4], vertex[5]);
+					triangle.uv[i] = glm::vec2(vertex[6], vertex[7]);
+				}
+				triangle.v0 = positions[0];
+				triangle.edge1 = positions[1] - positions[0];
+				triangle.edge2 = positions[2] - positions[0];
+				const glm::vec3 cross = glm::cross(triangle.edge1, triangle.edge2);
+				const float area = glm::length(cross);
+				if (area <= 0.0f)
+					continue;   // degenerate, the rasterizer draws nothing for it either
+				triangle.faceNormal = cross / area;
+				triangle.draw = d;
+				triangles.push_back(triangle);
+			}
+		}
+	}
+
+	void SetBounds(Node& node, unsigned int first, unsigned int count) const
+	{
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (unsigned int i = first; i < first + count; ++i)
+		{
+			const TriangleData& triangle = triangles[order[i]];
+			const glm::vec3 v1 = triangle.v0 + triangle.edge1;
+			const glm::vec3 v2 = triangle.v0 + triangle.edge2;
+			boundsMin = glm::min(boundsMin, glm::min(triangle.v0, glm::min(v1, v2)));
+			boundsMax = glm::max(boundsMax, glm::max(triangle.v0, glm::max(v1, v2)));
+		}
+		for (int a = 0; a < 3; ++a)
+		{
+			node.boundsMin[a] = boundsMin[a];
+			node.boundsMax[a] = boundsMax[a];
+		}
+	}
+
+	static float HalfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		const glm::vec3 extent = boundsMax - boundsMin;
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	// binned SAH over the centroids; returns false when a leaf is cheaper. The range is partitioned in place,
+	// splitCount triangles go left.
+	bool Split(const Node& node, unsigned int first, unsigned int count, int& splitAxis, unsigned int& splitCount)
+	{
+		glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+		for (unsigned int i = first; i < first + count; ++i)
+		{
+			centroidMin = glm::min(centroidMin, centroids[order[i]]);
+			centroidMax = glm::max(centroidMax, centroids[order[i]]);
+		}
+
+		float bestCost = FLT_MAX;
+		int bestAxis = -1;
+		int bestBin = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float extent = centroidMax[axis] - centroidMin[axis];
+			if (extent <= 0.0f)
+				continue;
+			const float scale = SAH_BINS / extent;
+
+			Bin bins[SAH_BINS];
+			for (unsigned int i = first; i < first + count; ++i)
+			{
+				const TriangleData& triangle = triangles[order[i]];
+				const int bin = std::min(SAH_BINS - 1, int((centroids[order[i]][axis] - centroidMin[axis]) * scale));
+				const glm::vec3 v1 = triangle.v0 + triangle.edge1;
+				const glm::vec3 v2 = triangle.v0 + triangle.edge2;
+				bins[bin].boundsMin = glm::min(bins[bin].boundsMin, glm::min(triangle.v0, glm::min(v1, v2)));
+				bins[bin].boundsMax = glm::max(bins[bin].boundsMax, glm::max(triangle.v0, glm::max(v1, v2)));
+				++bins[bin].count;
+			}
+
+			// sweep from the right to collect the right side costs, then from the left
+			float rightCost[SAH_BINS];
+			Bin right;
+			for (int b = SAH_BINS - 1; b > 0; --b)
+			{
+				right.boundsMin = glm::min(right.boundsMin, bins[b].boundsMin);
+				right.boundsMax = glm::max(right.boundsMax, bins[b].boundsMax);
+				right.count += bins[b].count;
+				rightCost[b] = right.count ? HalfArea(right.boundsMin, right.boundsMax) * right.count : 0.0f;
+			}
+			Bin left;
+			for (int b = 0; b < SAH_BINS - 1; ++b)
+			{
+				left.boundsMin = glm::min(left.boundsMin, bins[b].boundsMin);
+				left.boundsMax = glm::max(left.boundsMax, bins[b].boundsMax);
+				left.count += bins[b].count;
+				const float cost = (left.count ? HalfArea(left.boundsMin, left.boundsMax) * left.count : 0.0f) + rightCost[b + 1];
+				if (left.count > 0 && left.count < count && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		// a triangle test and a node visit cost the same; small ranges stay leaves unless splitting pays
+		const float area = HalfArea(glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]),
+			glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+		const float splitCost = area > 0.0f ? 1.0f + bestCost / area : float(count);
+		if (bestAxis < 0 || (count <= MAX_LEAF_TRIANGLES && splitCost >= float(count)))
+			return false;
+
+		const float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		const uint32_t* middle = std::partition(order.data() + first, order.data() + first + count, [&](uint32_t index)
+		{
+			return std::min(SAH_BINS - 1, int((centroids[index][bestAxis] - centroidMin[bestAxis]) * scale)) <= bestBin;
+		});
+		splitAxis = bestAxis;
+		splitCount = (unsigned int)(middle - (order.data() + first));
+		return true;
+	}
+
+	// the node's bounds are set; splits it into children appended to nodes, recursively
+	void BuildNode(std::vector<Node>& nodes, uint32_t index, unsigned int first, unsigned int count)
+	{
+		int axis = 0;
+		unsigned int leftCount = 0;
+		if (count <= 1 || !Split(nodes[index], first, count, axis, leftCount))
+		{
+			// all centroids equal and too many for one leaf: halve the range, any split is as good
+			if (count > MAX_LEAF_TRIANGLES)
+			{
+				leftCount = count / 2;
+			}
+			else
+			{
+				nodes[index].leftFirst = first;
+				nodes[index].count = (uint16_t)count;
+				return;
+			}
+		}
+
+		const uint32_t left = (uint32_t)nodes.size();
+		nodes.push_back(Node());
+		nodes.push_back(Node());
+		nodes[index].leftFirst = left;
+		nodes[index].count = 0;
+		nodes[index].axis = (uint16_t)axis;
+		SetBounds(nodes[left], first, leftCount);
+		SetBounds(nodes[left + 1], first + leftCount, count - leftCount);
+		BuildNode(nodes, left, first, leftCount);
+		BuildNode(nodes, left + 1, first + leftCount, count - leftCount);
+	}
+
+	// splits from the root on this thread until every open range is small enough or there are enough
+	// ranges to keep the workers busy; each open range becomes a subtree placeholder
+	void SplitTopLevels(std::vector<Subtree>& subtrees)
+	{
+		SetBounds(nodes[0], 0, (unsigned int)triangles.size());
+		std::vector<Subtree> open(1);
+		open[0].node = 0;
+		open[0].first = 0;
+		open[0].count = (unsigned int)triangles.size();
+
+		const size_t wanted = size_t(pool.Threads()) * 4;
+		while (!open.empty())
+		{
+			// the largest range first, so the work is split evenly
+			std::vector<Subtree>::iterator largest = std::max_element(open.begin(), open.end(),
+				[](const Subtree& a, const Subtree& b) { return a.count < b.count; });
+			Subtree range = *largest;
+			open.erase(largest);
+
+			int axis = 0;
+			unsigned int leftCount = 0;
+			if (range.count <= PARALLEL_SUBTREE_TRIANGLES || open.size() + subtrees.size() + 1 >= wanted
+				|| !Split(nodes[range.node], range.first, range.count, axis, leftCount))
+			{
+				subtrees.push_back(range);
+				continue;
+			}
+
+			const uint32_t left = (uint32_t)nodes.size();
+			nodes.push_back(Node());
+			nodes.push_back(Node());
+			nodes[range.node].leftFirst = left;
+			nodes[range.node].count = 0;
+			nodes[range.node].axis = (uint16_t)axis;
+			SetBounds(nodes[left], range.first, leftCount);
+			SetBounds(nodes[left + 1], range.first + leftCount, range.count - leftCount);
+
+			Subtree leftRange = { left, range.first, leftCount, std::vector<Node>() };
+			Subtree rightRange = { left + 1, range.first + leftCount, range.count - leftCount, std::vector<Node>() };
+			open.push_back(leftRange);
+			open.push_back(rightRange);
+		}
+	}
+
+	// levels below the root of the deepest leaf; a traversal holds at most one more node than that
+	unsigned int MeasureDepth() const
+	{
+		unsigned int deepest = 0;
+		std::vector<std::pair<uint32_t, unsigned int> > open(1, std::make_pair(0u, 0u));
+		while (!open.empty())
+		{
+			const std::pair<uint32_t, unsigned int> entry = open.back();
+			open.pop_back();
+			const Node& node = nodes[entry.first];
+			deepest = std::max(deepest, entry.second);
+			if (node.count > 0)
+				continue;
+			open.push_back(std::make_pair(node.leftFirst, entry.second + 1));
+			open.push_back(std::make_pair(node.leftFirst + 1, entry.second + 1));
+		}
+		return deepest;
+	}
+
+	static __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// lanes whose ray enters the node's box before tMax
+	static __m128 HitBox(const Node& node, const RayPacket& rays)
+	{
+		const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[0]), rays.originX), rays.inverseX);
+		const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[0]), rays.originX), rays.inverseX);
+		const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[1]), rays.originY), rays.inverseY);
+		const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[1]), rays.originY), rays.inverseY);
+		const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[2]), rays.originZ), rays.inverseZ);
+		const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[2]), rays.originZ), rays.inverseZ);
+		const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+		const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), rays.tMax));
+		return _mm_cmple_ps(tNear, tFar);
+	}
+
+	// Moller-Trumbore for four rays against one triangle, no culling since the GL path draws both sides;
+	// returns the lanes hit closer than tMax
+	static __m128 HitTriangle(const TriangleData& triangle, const RayPacket& rays, __m128& t, __m128& u, __m128& v)
+	{
+		const __m128 e1x = _mm_set1_ps(triangle.edge1.x), e1y = _mm_set1_ps(triangle.edge1.y), e1z = _mm_set1_ps(triangle.edge1.z);
+		const __m128 e2x = _mm_set1_ps(triangle.edge2.x), e2y = _mm_set1_ps(triangle.edge2.y), e2z = _mm_set1_ps(triangle.edge2.z);
+
+		// p = direction x edge2
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(rays.directionY, e2z), _mm_mul_ps(rays.directionZ, e2y));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(rays.directionZ, e2x), _mm_mul_ps(rays.directionX, e2z));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(rays.directionX, e2y), _mm_mul_ps(rays.directionY, e2x));
+		const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		const __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+		const __m128 sx = _mm_sub_ps(rays.originX, _mm_set1_ps(triangle.v0.x));
+		const __m128 sy = _mm_sub_ps(rays.originY, _mm_set1_ps(triangle.v0.y));
+		const __m128 sz = _mm_sub_ps(rays.originZ, _mm_set1_ps(triangle.v0.z));
+		u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverseDeterminant);
+
+		// q = s x edge1
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+		v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.directionX, qx), _mm_mul_ps(rays.directionY, qy)), _mm_mul_ps(rays.directionZ, qz)), inverseDeterminant);
+		t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+		const __m128 zero = _mm_setzero_ps();
+		__m128 hit = _mm_cmpneq_ps(determinant, zero);
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+		hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+		hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+		return _mm_and_ps(hit, _mm_cmplt_ps(t, rays.tMax));
+	}
+
+	// closest hit of each lane; with anyHit the packet stops as soon as every active lane is blocked and
+	// only the hit mask (triangle >= 0) is meaningful. Lanes outside active are not traced.
+	void Trace(RayPacket& rays, __m128 active, bool anyHit, PacketHits& hits) const
+	{
+		hits.t = rays.tMax;
+		hits.u = hits.v = _mm_setzero_ps();
+		hits.triangle = _mm_set1_epi32(-1);
+		if (nodes.empty() || triangles.empty() || _mm_movemask_ps(active) == 0)
+			return;
+
+		// packet direction signs pick the near child, the packet is coherent enough for one order
+		alignas(16) float firstDirection[4][4];
+		_mm_store_ps(firstDirection[0], rays.directionX);
+		_mm_store_ps(firstDirection[1], rays.directionY);
+		_mm_store_ps(firstDirection[2], rays.directionZ);
+
+		// inactive lanes get tMax -1 so no box or triangle accepts them
+		rays.tMax = Select(active, rays.tMax, _mm_set1_ps(-1.0f));
+		const int activeBits = _mm_movemask_ps(active);
+
+		// every level of the path holds at most one pending sibling, so depth + 1 entries always fit
+		uint32_t localStack[TRAVERSAL_STACK_SIZE];
+		std::vector<uint32_t> deepStack;
+		uint32_t* stack = localStack;
+		if (depth + 1 > TRAVERSAL_STACK_SIZE)
+		{
+			deepStack.resize(depth + 1);
+			stack = deepStack.data();
+		}
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		int blocked = 0;
+		while (stackSize > 0)
+		{
+			const Node& node = nodes[stack[--stackSize]];
+			if (_mm_movemask_ps(HitBox(node, rays)) == 0)
+				continue;
+
+			if (node.count > 0)
+			{
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					__m128 t, u, v;
+					const __m128 hit = HitTriangle(triangles[i], rays, t, u, v);
+					if (_mm_movemask_ps(hit) == 0)
+						continue;
+					rays.tMax = Select(hit, t, rays.tMax);
+					hits.u = Select(hit, u, hits.u);
+					hits.v = Select(hit, v, hits.v);
+					const __m128i hitBits = _mm_castps_si128(hit);
+					hits.triangle = _mm_or_si128(_mm_and_si128(hitBits, _mm_set1_epi32(int(i))), _mm_andnot_si128(hitBits, hits.triangle));
+					if (anyHit)
+					{
+						// a blocked lane needs no more tests
+						blocked |= _mm_movemask_ps(hit);
+						rays.tMax = Select(hit, _mm_set1_ps(-1.0f), rays.tMax);
+						if ((blocked & activeBits) == activeBits)
+						{
+							hits.t = rays.tMax;
+							return;
+						}
+					}
+				}
+				continue;
+			}
+
+			// push the far child first so the near one is visited next
+			int nearFirst = 0;
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				if (activeBits & (1 << lane))
+				{
+					nearFirst = firstDirection[node.axis][lane] < 0.0f ? 1 : 0;
+					break;
+				}
+			}
+			stack[stackSize++] = node.leftFirst + (1 - nearFirst);
+			stack[stackSize++] = node.leftFirst + nearFirst;
+		}
+		hits.t = rays.tMax;
+	}
+
+	static void SetInverse(RayPacket& rays)
+	{
+		// 1/0 is infinity, which the slab test handles; the tiny bias keeps 0 * infinity out of it
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 tiny = _mm_set1_ps(1e-20f);
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		rays.inverseX = _mm_div_ps(one, _mm_or_ps(_mm_max_ps(_mm_andnot_ps(signMask, rays.directionX), tiny), _mm_and_ps(signMask, rays.directionX)));
+		rays.inverseY = _mm_div_ps(one, _mm_or_ps(_mm_max_ps(_mm_andnot_ps(signMask, rays.directionY), tiny), _mm_and_ps(signMask, rays.directionY)));
+		rays.inverseZ = _mm_div_ps(one, _mm_or_ps(_mm_max_ps(_mm_andnot_ps(signMask, rays.directionZ), tiny), _mm_and_ps(signMask, rays.directionZ)));
+	}
+
+	// up to four rays of a batch query, the missing lanes are inactive
+	static void LoadPacket(const Ray* rays, unsigned int lanes, RayPacket& packet, __m128& active)
+	{
+		alignas(16) float origin[3][4], direction[3][4], tMax[4];
+		alignas(16) int mask[4];
+		for (unsigned int lane = 0; lane < 4; ++lane)
+		{
+			const Ray& ray = rays[std::min(lane, lanes - 1)];
+			for (int a = 0; a < 3; ++a)
+			{
+				origin[a][lane] = ray.origin[a];
+				direction[a][lane] = ray.direction[a];
+			}
+			tMax[lane] = ray.tMax;
+			mask[lane] = lane < lanes ? -1 : 0;
+		}
+		packet.originX = _mm_load_ps(origin[0]);
+		packet.originY = _mm_load_ps(origin[1]);
+		packet.originZ = _mm_load_ps(origin[2]);
+		packet.directionX = _mm_load_ps(direction[0]);
+		packet.directionY = _mm_load_ps(direction[1]);
+		packet.directionZ = _mm_load_ps(direction[2]);
+		packet.tMax = _mm_load_ps(tMax);
+		SetInverse(packet);
+		active = _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(mask)));
+	}
+
+	// near and far plane points of pixel centers, so the visible depth range matches the rasterizer's
+	void PrimaryRays(int x, int y, RayPacket& rays) const
+	{
+		alignas(16) float origin[3][4], direction[3][4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			const float ndcX = (float(x + (lane & 1)) + 0.5f) / colorWidth * 2.0f - 1.0f;
+			const float ndcY = (float(y + (lane >> 1)) + 0.5f) / colorHeight * 2.0f - 1.0f;
+			const glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+			const glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+			const glm::vec3 from = glm::vec3(nearPoint) / nearPoint.w;
+			const glm::vec3 to = glm::vec3(farPoint) / farPoint.w;
+			for (int a = 0; a < 3; ++a)
+			{
+				origin[a][lane] = from[a];
+				direction[a][lane] = to[a] - from[a];
+			}
+		}
+		rays.originX = _mm_load_ps(origin[0]);
+		rays.originY = _mm_load_ps(origin[1]);
+		rays.originZ = _mm_load_ps(origin[2]);
+		rays.directionX = _mm_load_ps(direction[0]);
+		rays.directionY = _mm_load_ps(direction[1]);
+		rays.directionZ = _mm_load_ps(direction[2]);
+		rays.tMax = _mm_set1_ps(1.0f);
+		SetInverse(rays);
+	}
+
+	void RenderTile(int tileX, int tileY, unsigned long long& rayCount)
+	{
+		TileFragments fragments;
+		fragments.count = 0;
+
+		const int x1 = std::min(tileX + TILE_SIZE, colorWidth);
+		const int y1 = std::min(tileY + TILE_SIZE, colorHeight);
+		for (int y = tileY; y < y1; y += 2)
+		{
+			for (int x = tileX; x < x1; x += 2)
+			{
+				// lanes outside the image on odd sizes are not traced
+				const __m128 active = _mm_castsi128_ps(_mm_set_epi32(x + 1 < x1 && y + 1 < y1 ? -1 : 0, y + 1 < y1 ? -1 : 0, x + 1 < x1 ? -1 : 0, -1));
+				RayPacket rays;
+				PrimaryRays(x, y, rays);
+				PacketHits hits;
+				Trace(rays, active, false, hits);
+				alignas(16) float u[4], v[4];
+				alignas(16) int triangleIndex[4];
+				_mm_store_ps(u, hits.u);
+				_mm_store_ps(v, hits.v);
+				_mm_store_si128(reinterpret_cast<__m128i*>(triangleIndex), hits.triangle);
+				const int activeBits = _mm_movemask_ps(active);
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if (!(activeBits & (1 << lane)))
+						continue;
+					++rayCount;
+					unsigned char* pixel = &color[(size_t(y + (lane >> 1)) * colorWidth + x + (lane & 1)) * 3];
+					if (triangleIndex[lane] < 0)
+					{
+						// the clear color
+						pixel[0] = pixel[1] = pixel[2] = 0;
+						continue;
+					}
+					AddFragment(fragments, triangles[triangleIndex[lane]], u[lane], v[lane], pixel);
+				}
+			}
+		}
+
+		for (int m = 0; m < 2; ++m)
+			ShadowRays(fragments, m, rayCount);
+
+		const PhongFragments kernelFragments = { fragments.positionX, fragments.positionY, fragments.positionZ, fragments.normalX, fragments.normalY,
+			fragments.normalZ, fragments.albedoR, fragments.albedoG, fragments.albedoB, { fragments.shadow[0], fragments.shadow[1] },
+			fragments.red, fragments.green, fragments.blue, (unsigned int)fragments.count };
+		shade(phongScene, kernelFragments, 0);
+		for (int i = 0; i < fragments.count; ++i)
+		{
+			unsigned char* pixel = fragments.pixel[i];
+			pixel[0] = ToByte(fragments.red[i]);
+			pixel[1] = ToByte(fragments.green[i]);
+			pixel[2] = ToByte(fragments.blue[i]);
+		}
+	}
+
+	void AddFragment(TileFragments& fragments, const TriangleData& triangle, float u, float v, unsigned char* pixel) const
+	{
+		const float w = 1.0f - u - v;
+		const glm::vec3 position = triangle.v0 + triangle.edge1 * u + triangle.edge2 * v;
+		const glm::vec3 normal = glm::normalize(triangle.normal[0] * w + triangle.normal[1] * u + triangle.normal[2] * v);
+		const glm::vec2 uv = triangle.uv[0] * w + triangle.uv[1] * u + triangle.uv[2] * v;
+
+		const Draw& draw = draws[triangle.draw];
+		const glm::vec3 albedo = draw.texture ? SoftwareRasterizer::Sample(*draw.texture, uv.x * frame->uvScale.x, uv.y * frame->uvScale.y) : draw.color;
+
+		const int i = fragments.count++;
+		fragments.positionX[i] = position.x;
+		fragments.positionY[i] = position.y;
+		fragments.positionZ[i] = position.z;
+		fragments.normalX[i] = normal.x;
+		fragments.normalY[i] = normal.y;
+		fragments.normalZ[i] = normal.z;
+		fragments.albedoR[i] = albedo.r;
+		fragments.albedoG[i] = albedo.g;
+		fragments.albedoB[i] = albedo.b;
+		fragments.faceNormal[i] = triangle.faceNormal;
+		fragments.shadow[0][i] = fragments.shadow[1][i] = 1.0f;
+		fragments.pixel[i] = pixel;
+	}
+
+	// visibility of the light that uses shadow map slot m, four fragments per packet; the origins move off the
+	// surface along the face normal, to the side the light is on
+	void ShadowRays(TileFragments& fragments, int m, unsigned long long& rayCount) const
+	{
+		const PhongLight* light = nullptr;
+		for (const PhongLight& candidate : phongLights)
+		{
+			if (candidate.shadowMap == m)
+				light = &candidate;
+		}
+		if (!light)
+			return;
+
+		const glm::vec3 lightPosition(light->position[0], light->position[1], light->position[2]);
+		const float offset = 1e-3f;
+		for (int first = 0; first < fragments.count; first += 4)
+		{
+			alignas(16) float origin[3][4], direction[3][4];
+			int activeBits = 0;
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				const int i = std::min(first + lane, fragments.count - 1);
+				const glm::vec3 position(fragments.positionX[i], fragments.positionY[i], fragments.positionZ[i]);
+				const glm::vec3 toLight = lightPosition - position;
+				const float side = glm::dot(fragments.faceNormal[i], toLight) >= 0.0f ? offset : -offset;
+				const glm::vec3 from = position + fragments.faceNormal[i] * side;
+				for (int a = 0; a < 3; ++a)
+				{
+					origin[a][lane] = from[a];
+					direction[a][lane] = lightPosition[a] - from[a];
+				}
+				if (first + lane < fragments.count)
+					activeBits |= 1 << lane;
+			}
+
+			RayPacket rays;
+			rays.originX = _mm_load_ps(origin[0]);
+			rays.originY = _mm_load_ps(origin[1]);
+			rays.originZ = _mm_load_ps(origin[2]);
+			rays.directionX = _mm_load_ps(direction[0]);
+			rays.directionY = _mm_load_ps(direction[1]);
+			rays.directionZ = _mm_load_ps(direction[2]);
+			rays.tMax = _mm_set1_ps(1.0f);
+			SetInverse(rays);
+
+			const __m128 active = _mm_castsi128_ps(_mm_set_epi32(activeBits & 8 ? -1 : 0, activeBits & 4 ? -1 : 0, activeBits & 2 ? -1 : 0, activeBits & 1 ? -1 : 0));
+			PacketHits hits;
+			Trace(rays, active, true, hits);
+
+			alignas(16) int blocked[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(blocked), hits.triangle);
+			for (int lane = 0; lane < 4 && first + lane < fragments.count; ++lane)
+			{
+				fragments.shadow[m][first + lane] = blocked[lane] >= 0 ? 0.0f : 1.0f;
+				++rayCount;
+			}
+		}
+	}
+
+	static unsigned char ToByte(float value)
+	{
+		return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	RayTracer(const RayTracer&) = delete;
+	RayTracer& operator=(const RayTracer&) = delete;
+
+	WorkerPool& pool;
+	PhongShadeFunction shade = nullptr;
+	const Draw* draws = nullptr;
+	const Frame* frame = nullptr;
+	glm::mat4 inverseViewProjection;
+	std::vector<PhongLight> phongLights;
+	PhongScene phongScene = {};
+
+	int colorWidth = 0;
+	int colorHeight = 0;
+	std::vector<unsigned char> color;
+	std::vector<unsigned long long> rayCounts;     // per worker thread, summed by Rays
+
+	std::vector<TriangleData> triangles;
+	std::vector<uint32_t> order;                    // triangle indices, partitioned by the build
+	std::vector<glm::vec3> centroids;
+	std::vector<Node> nodes;
+	unsigned int depth = 0;                         // of the hierarchy, recorded by Build
+};
+#endif
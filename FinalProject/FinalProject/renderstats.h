@@ -0,0 +1,178 @@
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+#include <fstream>
+#include <string>
+
+#include "glstate.h"
+
+// Per-frame work counters: draw calls, triangles and uniform uploads are counted by the draw code,
+// program/VAO/texture switches are taken from the GLStateCache when the frame is closed.
+// Closed frames are kept in a short history for the rolling average and can be streamed to a CSV file.
+class RenderStats
+{
+public:
+	struct Frame
+	{
+		unsigned int draws = 0;
+		unsigned long long triangles = 0;
+		unsigned int programSwitches = 0;
+		unsigned int vertexArraySwitches = 0;
+		unsigned int textureSwitches = 0;
+		unsigned int uniformUploads = 0;
+		// ARB_pipeline_statistics_query counters, read back without stalling so they describe the frame
+		// pipelineFrame and not this one; pipelineFrame is -1 while no result has arrived
+		long long pipelineFrame = -1;
+		unsigned long long vertexInvocations = 0;
+		unsigned long long clippingPrimitives = 0;
+		unsigned long long fragmentInvocations = 0;
+		float cpuMs = 0.0f;
+		// heap allocations (TRACK_ALLOCATIONS builds) and frame arena bytes used
+		unsigned int heapAllocations = 0;
+		unsigned long long arenaBytes = 0;
+	};
+
+	static const int HISTORY = 120;
+
+	static RenderStats& Current()
+	{
+		static RenderStats stats;
+		return stats;
+	}
+
+	// counts one draw call of count vertices (or indices)
+	void Draw(GLenum mode, GLsizei count, GLsizei instances = 1)
+	{
+		++frame.draws;
+		unsigned long long triangles = 0;
+		if (mode == GL_TRIANGLES)
+			triangles = count / 3;
+		else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+			triangles = count - 2;
+		frame.triangles += triangles * instances;
+	}
+
+	// counts an upload to location and returns it, wrap the location argument of glUniform*:
+	// glUniform1f(stats.Uniform(location), value); inactive locations (-1) are not counted
+	GLint Uniform(GLint location)
+	{
+		if (location >= 0)
+			++frame.uniformUploads;
+		return location;
+	}
+
+	// pipeline statistics of an earlier frame, stored with the frame being recorded
+	void PipelineStatistics(long long frameIndex, unsigned long long vertexInvocations, unsigned long long clippingPrimitives, unsigned long long fragmentInvocations)
+	{
+		frame.pipelineFrame = frameIndex;
+		frame.vertexInvocations = vertexInvocations;
+		frame.clippingPrimitives = clippingPrimitives;
+		frame.fragmentInvocations = fragmentInvocations;
+	}
+
+	// memory use of the frame being recorded
+	void Memory(unsigned int heapAllocations, unsigned long long arenaBytes)
+	{
+		frame.heapAllocations = heapAllocations;
+		frame.arenaBytes = arenaBytes;
+	}
+
+	// index of the frame being recorded
+	long long FrameIndex() const { return frameIndex; }
+
+	// starts writing one CSV row per closed frame, returns false when the file cannot be created
+	bool OpenLog(const std::string& path)
+	{
+		log.open(path.c_str(), std::ios::trunc);
+		if (!log)
+			return false;
+		log << "frame,cpu_ms,draws,triangles,program_switches,vao_switches,texture_switches,uniform_uploads,"
+			"pipeline_frame,vs_invocations,clipping_primitives,fs_invocations,heap_allocations,arena_bytes\n";
+		return true;
+	}
+
+	// closes the frame: takes the switch counts from the state cache's just closed frame
+	void EndFrame(const GLStateCache::Stats& state, float cpuMs)
+	{
+		frame.programSwitches = state.programs;
+		frame.vertexArraySwitches = state.vertexArrays;
+		frame.textureSwitches = state.textures;
+		frame.cpuMs = cpuMs;
+
+		if (log)
+		{
+			log << frameIndex << ',' << frame.cpuMs << ',' << frame.draws << ',' << frame.triangles << ','
+				<< frame.programSwitches << ',' << frame.vertexArraySwitches << ',' << frame.textureSwitches << ','
+				<< frame.uniformUploads << ',' << frame.pipelineFrame << ',' << frame.vertexInvocations << ','
+				<< frame.clippingPrimitives << ',' << frame.fragmentInvocations << ',' << frame.heapAllocations << ','
+				<< frame.arenaBytes << '\n';
+		}
+
+		history[frameIndex % HISTORY] = frame;
+		lastFrame = frame;
+		frame = Frame();
+		++frameIndex;
+	}
+	const Frame& LastFrame() const { return lastFrame; }
+
+	// mean of the last HISTORY closed frames (fewer right after startup), pipeline counters over the
+	// frames that carried a result
+	Frame Average() const
+	{
+		Frame sum;
+		const long long frames = frameIndex < HISTORY ? frameIndex : HISTORY;
+		long long pipelineFrames = 0;
+		for (long long i = 0; i < frames; ++i)
+		{
+			const Frame& f = history[i];
+			sum.draws += f.draws;
+			sum.triangles += f.triangles;
+			sum.programSwitches += f.programSwitches;
+			sum.vertexArraySwitches += f.vertexArraySwitches;
+			sum.textureSwitches += f.textureSwitches;
+			sum.uniformUploads += f.uniformUploads;
+			sum.cpuMs += f.cpuMs;
+			sum.heapAllocations += f.heapAllocations;
+			sum.arenaBytes += f.arenaBytes;
+			if (f.pipelineFrame >= 0)
+			{
+				sum.vertexInvocations += f.vertexInvocations;
+				sum.clippingPrimitives += f.clippingPrimitives;
+				sum.fragmentInvocations += f.fragmentInvocations;
+				++pipelineFrames;
+			}
+		}
+		if (frames == 0)
+			return sum;
+
+		sum.draws = (unsigned int)(sum.draws / frames);
+		sum.triangles /= frames;
+		sum.programSwitches = (unsigned int)(sum.programSwitches / frames);
+		sum.vertexArraySwitches = (unsigned int)(sum.vertexArraySwitches / frames);
+		sum.textureSwitches = (unsigned int)(sum.textureSwitches / frames);
+		sum.uniformUploads = (unsigned int)(sum.uniformUploads / frames);
+		sum.cpuMs /= frames;
+		sum.heapAllocations = (unsigned int)(sum.heapAllocations / frames);
+		sum.arenaBytes /= frames;
+		if (pipelineFrames > 0)
+		{
+			sum.pipelineFrame = frameIndex - 1;
+			sum.vertexInvocations /= pipelineFrames;
+			sum.clippingPrimitives /= pipelineFrames;
+			sum.fragmentInvocations /= pipelineFrames;
+		}
+		return sum;
+	}
+
+private:
+	RenderStats() {}
+
+	Frame frame;
+	Frame lastFrame;
+	Frame history[HISTORY];
+	long long frameIndex = 0;
+	std::ofstream log;
+};
+#endif
@@ -0,0 +1,104 @@
+#ifndef RESOLUTIONSCALER_H
+#define RESOLUTIONSCALER_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+#include <algorithm>
+#include <cmath>
+
+// Dynamic resolution: picks the fraction of the framebuffer the scene is drawn at so the GPU time of a frame
+// stays near a budget. The GPU time comes from a timestamp pair around the frame's work, read back a few
+// frames late without stalling. The shading cost goes with the pixel count, the square of the scale, so the
+// scale aims at the square root of budget / time. Times measured at an older scale are ignored, and the scale
+// moves in SCALE_STEP steps so the draw size does not change every frame.
+class ResolutionScaler
+{
+public:
+	static const int QUERY_FRAMES = 4;
+	static constexpr float MIN_SCALE = 0.5f;
+	static constexpr float SCALE_STEP = 1.0f / 32.0f;
+	static constexpr double HEADROOM = 0.85;    // only grows while the frame takes less than this part of the budget
+
+	void Create()
+	{
+		for (int frame = 0; frame < QUERY_FRAMES; ++frame)
+			glGenQueries(2, queries[frame]);
+	}
+
+	void Destroy()
+	{
+		for (int frame = 0; frame < QUERY_FRAMES; ++frame)
+			glDeleteQueries(2, queries[frame]);
+	}
+
+	void SetBudget(double milliseconds) { budgetMs = milliseconds; }
+	double Budget() const { return budgetMs; }
+
+	// the scale of the frames from now on
+	float Scale() const { return scale; }
+	void Reset() { scale = 1.0f; }
+
+	// newest GPU time measured, milliseconds
+	double GpuMs() const { return gpuMs; }
+
+	// the size to draw at: the framebuffer size times the scale, at least one pixel
+	int Scaled(int size) const
+	{
+		const int scaled = int(std::lround(size * double(scale)));
+		return scaled > 1 ? scaled : 1;
+	}
+
+	// Collects the oldest frame in the ring if the GPU finished it and steers the scale with its time, then
+	// starts timing this frame in its place. steer false only measures.
+	void BeginFrame(bool steer)
+	{
+		const int slot = int(frame % QUERY_FRAMES);
+		GLint available = 0;
+		if (frame >= QUERY_FRAMES)
+			glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &end);
+			gpuMs = (end - begin) / 1e6;
+			if (steer && scales[slot] == scale)
+				Steer();
+		}
+
+		glQueryCounter(queries[slot][0], GL_TIMESTAMP);
+		scales[slot] = scale;
+	}
+
+	// after the frame's last scene command, before the upscale
+	void EndFrame()
+	{
+		glQueryCounter(queries[frame % QUERY_FRAMES][1], GL_TIMESTAMP);
+		++frame;
+	}
+
+private:
+	void Steer()
+	{
+		if (budgetMs <= 0.0 || gpuMs <= 0.0)
+			return;
+
+		// whole steps: shrinking rounds down to get under budget at once, growing takes a quarter of the way
+		// but at least a step, which HEADROOM keeps from overshooting (one step at MIN_SCALE is 13% more pixels)
+		const double ideal = scale * std::sqrt(budgetMs / gpuMs);
+		double next = scale;
+		if (gpuMs > budgetMs)
+			next = scale + SCALE_STEP * std::floor((ideal - scale) / SCALE_STEP);
+		else if (gpuMs < budgetMs * HEADROOM)
+			next = scale + SCALE_STEP * (std::max)(1.0, std::floor((ideal - scale) * 0.25 / SCALE_STEP));
+		scale = float(next < MIN_SCALE ? MIN_SCALE : next > 1.0 ? 1.0 : next);
+	}
+
+	GLuint queries[QUERY_FRAMES][2];
+	float scales[QUERY_FRAMES] = {};
+	long long frame = 0;
+	float scale = 1.0f;
+	double budgetMs = 0.0;
+	double gpuMs = 0.0;
+};
+#endif
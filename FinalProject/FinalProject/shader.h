@@ -1,313 +1,396 @@
-#ifndef SHADER_H
-#define SHADER_H
-
-#include <glad/glad.h>
-
-#include <glm/glm.hpp>
-
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <iostream>
-
-class Shader
-{
-public:
-	unsigned int ID;
-	// constructor generates the shader on the fly
-	// ------------------------------------------------------------------------
-	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
-	{
-		// 1. retrieve the vertex/fragment source code from filePath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::string geometryCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		std::ifstream gShaderFile;
-		// ensure ifstream objects can throw exceptions:
-		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-		try
-		{
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
-			// if geometry shader path is present, also load a geometry shader
-			if (geometryPath != nullptr)
-			{
-				gShaderFile.open(geometryPath);
-				std::stringstream gShaderStream;
-				gShaderStream << gShaderFile.rdbuf();
-				gShaderFile.close();
-				geometryCode = gShaderStream.str();
-			}
-		}
-		catch (std::ifstream::failure& e)
-		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-		}
-		const char* vShaderCode = vertexCode.c_str();
-		const char * fShaderCode = fragmentCode.c_str();
-		// 2. compile shaders
-		unsigned int vertex, fragment;
-		// vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-		checkCompileErrors(vertex, "VERTEX");
-		// fragment Shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
-		checkCompileErrors(fragment, "FRAGMENT");
-		// if geometry shader is given, compile geometry shader
-		unsigned int geometry;
-		if (geometryPath != nullptr)
-		{
-			const char * gShaderCode = geometryCode.c_str();
-			geometry = glCreateShader(GL_GEOMETRY_SHADER);
-			glShaderSource(geometry, 1, &gShaderCode, NULL);
-			glCompileShader(geometry);
-			checkCompileErrors(geometry, "GEOMETRY");
-		}
-		// shader Program
-		ID = glCreateProgram();
-		glAttachShader(ID, vertex);
-		glAttachShader(ID, fragment);
-		if (geometryPath != nullptr)
-			glAttachShader(ID, geometry);
-		glLinkProgram(ID);
-		checkCompileErrors(ID, "PROGRAM");
-		// delete the shaders as they're linked into our program now and no longer necessery
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-		if (geometryPath != nullptr)
-			glDeleteShader(geometry);
-
-	}
-	// activate the shader
-	// ------------------------------------------------------------------------
-	void use()
-	{
-		glUseProgram(ID);
-	}
-	// utility uniform functions
-	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
-	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-	}
-	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
-	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-	}
-	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
-	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-	}
-	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
-	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-	}
-	void setVec2(const std::string &name, float x, float y) const
-	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
-	}
-	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
-	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-	}
-	void setVec3(const std::string &name, float x, float y, float z) const
-	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
-	}
-	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
-	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
-	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
-	}
-	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
-	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-	}
-	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
-	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-	}
-	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
-	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-	}
-
-private:
-	// utility function for checking shader compilation/linking errors.
-	// ------------------------------------------------------------------------
-	void checkCompileErrors(GLuint shader, std::string type)
-	{
-		GLint success;
-		GLchar infoLog[1024];
-		if (type != "PROGRAM")
-		{
-			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-			if (!success)
-			{
-				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-			}
-		}
-		else
-		{
-			glGetProgramiv(shader, GL_LINK_STATUS, &success);
-			if (!success)
-			{
-				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-			}
-		}
-	}
-};
-#endif
-//#ifndef SHADER_H
-//#define SHADER_H
-//
-//#include <glad/glad.h>
-//
-//#include <string>
-//#include <fstream>
-//#include <sstream>
-//#include <iostream>
-//
-//class Shader
-//{
-//public:
-//	unsigned int ID;
-//	// constructor generates the shader on the fly
-//	// ------------------------------------------------------------------------
-//	Shader(const char* vertexPath, const char* fragmentPath)
-//	{
-//		// 1. retrieve the vertex/fragment source code from filePath
-//		std::string vertexCode;
-//		std::string fragmentCode;
-//		std::ifstream vShaderFile;
-//		std::ifstream fShaderFile;
-//		// ensure ifstream objects can throw exceptions:
-//		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-//		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-//		try
-//		{
-//			// open files
-//			vShaderFile.open(vertexPath);
-//			fShaderFile.open(fragmentPath);
-//			std::stringstream vShaderStream, fShaderStream;
-//			// read file's buffer contents into streams
-//			vShaderStream << vShaderFile.rdbuf();
-//			fShaderStream << fShaderFile.rdbuf();
-//			// close file handlers
-//			vShaderFile.close();
-//			fShaderFile.close();
-//			// convert stream into string
-//			vertexCode = vShaderStream.str();
-//			fragmentCode = fShaderStream.str();
-//		}
-//		catch (std::ifstream::failure& e)
-//		{
-//			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-//		}
-//		const char* vShaderCode = vertexCode.c_str();
-//		const char * fShaderCode = fragmentCode.c_str();
-//		// 2. compile shaders
-//		unsigned int vertex, fragment;
-//		// vertex shader
-//		vertex = glCreateShader(GL_VERTEX_SHADER);
-//		glShaderSource(vertex, 1, &vShaderCode, NULL);
-//		glCompileShader(vertex);
-//		checkCompileErrors(vertex, "VERTEX");
-//		// fragment Shader
-//		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-//		glShaderSource(fragment, 1, &fShaderCode, NULL);
-//		glCompileShader(fragment);
-//		checkCompileErrors(fragment, "FRAGMENT");
-//		// shader Program
-//		ID = glCreateProgram();
-//		glAttachShader(ID, vertex);
-//		glAttachShader(ID, fragment);
-//		glLinkProgram(ID);
-//		checkCompileErrors(ID, "PROGRAM");
-//		// delete the shaders as they're linked into our program now and no longer necessary
-//		glDeleteShader(vertex);
-//		glDeleteShader(fragment);
-//	}
-//	// activate the shader
-//	// ------------------------------------------------------------------------
-//	void use()
-//	{
-//		glUseProgram(ID);
-//	}
-//	// utility uniform functions
-//	// ------------------------------------------------------------------------
-//	void setBool(const std::string &name, bool value) const
-//	{
-//		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-//	}
-//	// ------------------------------------------------------------------------
-//	void setInt(const std::string &name, int value) const
-//	{
-//		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-//	}
-//	// ------------------------------------------------------------------------
-//	void setFloat(const std::string &name, float value) const
-//	{
-//		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-//	}
-//
-//private:
-//	// utility function for checking shader compilation/linking errors.
-//	// ------------------------------------------------------------------------
-//	void checkCompileErrors(unsigned int shader, std::string type)
-//	{
-//		int success;
-//		char infoLog[1024];
-//		if (type != "PROGRAM")
-//		{
-//			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-//			if (!success)
-//			{
-//				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-//				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-//			}
-//		}
-//		else
-//		{
-//			glGetProgramiv(shader, GL_LINK_STATUS, &success);
-//			if (!success)
-//			{
-//				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-//				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-//			}
-//		}
-//	}
-//};
+#ifndef SHADER_H
+#define SHADER_H
+
+// Include after GLEW. Every translation unit uses the same loader: the inline members here and in the
+// headers below are emitted in each of them and the linker keeps one copy, which must call the loaded entry points.
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "programcache.h"
+#include "glstate.h"
+#include "renderstats.h"
+
+class Shader
+{
+public:
+	unsigned int ID;
+	// identifies this program to caches kept outside it (Mesh's sampler bindings); unlike ID it is never reused
+	// by a later program, so an entry cannot outlive the program it was resolved for
+	unsigned long long Serial;
+	// constructor generates the shader on the fly
+	// ------------------------------------------------------------------------
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	{
+		static unsigned long long nextSerial = 0;
+		Serial = ++nextSerial;
+		// 1. retrieve the vertex/fragment source code from filePath
+		std::string vertexCode;
+		std::string fragmentCode;
+		std::string geometryCode;
+		std::ifstream vShaderFile;
+		std::ifstream fShaderFile;
+		std::ifstream gShaderFile;
+		// ensure ifstream objects can throw exceptions:
+		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		try
+		{
+			// open files
+			vShaderFile.open(vertexPath);
+			fShaderFile.open(fragmentPath);
+			std::stringstream vShaderStream, fShaderStream;
+			// read file's buffer contents into streams
+			vShaderStream << vShaderFile.rdbuf();
+			fShaderStream << fShaderFile.rdbuf();
+			// close file handlers
+			vShaderFile.close();
+			fShaderFile.close();
+			// convert stream into string
+			vertexCode = vShaderStream.str();
+			fragmentCode = fShaderStream.str();
+			// if geometry shader path is present, also load a geometry shader
+			if (geometryPath != nullptr)
+			{
+				gShaderFile.open(geometryPath);
+				std::stringstream gShaderStream;
+				gShaderStream << gShaderFile.rdbuf();
+				gShaderFile.close();
+				geometryCode = gShaderStream.str();
+			}
+		}
+		catch (std::ifstream::failure& e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		const char* vShaderCode = vertexCode.c_str();
+		const char * fShaderCode = fragmentCode.c_str();
+		// 2. restore the program from the binary cache if these sources were linked before
+		ID = glCreateProgram();
+		const std::string cacheKey = ProgramCache::Key({ vertexCode, fragmentCode, geometryCode });
+		if (ProgramCache::Load(ID, cacheKey))
+			return;
+		// 3. compile shaders
+		unsigned int vertex, fragment;
+		// vertex shader
+		vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		checkCompileErrors(vertex, "VERTEX");
+		// fragment Shader
+		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(fragment, 1, &fShaderCode, NULL);
+		glCompileShader(fragment);
+		checkCompileErrors(fragment, "FRAGMENT");
+		// if geometry shader is given, compile geometry shader
+		unsigned int geometry;
+		if (geometryPath != nullptr)
+		{
+			const char * gShaderCode = geometryCode.c_str();
+			geometry = glCreateShader(GL_GEOMETRY_SHADER);
+			glShaderSource(geometry, 1, &gShaderCode, NULL);
+			glCompileShader(geometry);
+			checkCompileErrors(geometry, "GEOMETRY");
+		}
+		// shader Program
+		glAttachShader(ID, vertex);
+		glAttachShader(ID, fragment);
+		if (geometryPath != nullptr)
+			glAttachShader(ID, geometry);
+		ProgramCache::PrepareForBinary(ID);
+		glLinkProgram(ID);
+		checkCompileErrors(ID, "PROGRAM");
+		ProgramCache::Save(ID, cacheKey);
+		// delete the shaders as they're linked into our program now and no longer necessery
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		if (geometryPath != nullptr)
+			glDeleteShader(geometry);
+
+	}
+	// activate the shader
+	// ------------------------------------------------------------------------
+	void use()
+	{
+		GLStateCache::Current().UseProgram(ID);
+	}
+	// utility uniform functions, the const char* overloads let literal names through without building a std::string
+	// ------------------------------------------------------------------------
+	void setBool(const char *name, bool value) const
+	{
+		glUniform1i(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), (int)value);
+	}
+	void setBool(const std::string &name, bool value) const
+	{
+		setBool(name.c_str(), value);
+	}
+	// ------------------------------------------------------------------------
+	void setInt(const char *name, int value) const
+	{
+		glUniform1i(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), value);
+	}
+	void setInt(const std::string &name, int value) const
+	{
+		setInt(name.c_str(), value);
+	}
+	// ------------------------------------------------------------------------
+	void setFloat(const char *name, float value) const
+	{
+		glUniform1f(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), value);
+	}
+	void setFloat(const std::string &name, float value) const
+	{
+		setFloat(name.c_str(), value);
+	}
+	// ------------------------------------------------------------------------
+	void setVec2(const char *name, const glm::vec2 &value) const
+	{
+		glUniform2fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, &value[0]);
+	}
+	void setVec2(const std::string &name, const glm::vec2 &value) const
+	{
+		setVec2(name.c_str(), value);
+	}
+	void setVec2(const char *name, float x, float y) const
+	{
+		glUniform2f(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), x, y);
+	}
+	void setVec2(const std::string &name, float x, float y) const
+	{
+		setVec2(name.c_str(), x, y);
+	}
+	// ------------------------------------------------------------------------
+	void setVec3(const char *name, const glm::vec3 &value) const
+	{
+		glUniform3fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, &value[0]);
+	}
+	void setVec3(const std::string &name, const glm::vec3 &value) const
+	{
+		setVec3(name.c_str(), value);
+	}
+	void setVec3(const char *name, float x, float y, float z) const
+	{
+		glUniform3f(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), x, y, z);
+	}
+	void setVec3(const std::string &name, float x, float y, float z) const
+	{
+		setVec3(name.c_str(), x, y, z);
+	}
+	// ------------------------------------------------------------------------
+	void setVec4(const char *name, const glm::vec4 &value) const
+	{
+		glUniform4fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, &value[0]);
+	}
+	void setVec4(const std::string &name, const glm::vec4 &value) const
+	{
+		setVec4(name.c_str(), value);
+	}
+	void setVec4(const char *name, float x, float y, float z, float w)
+	{
+		glUniform4f(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), x, y, z, w);
+	}
+	void setVec4(const std::string &name, float x, float y, float z, float w)
+	{
+		setVec4(name.c_str(), x, y, z, w);
+	}
+	// ------------------------------------------------------------------------
+	void setMat2(const char *name, const glm::mat2 &mat) const
+	{
+		glUniformMatrix2fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	{
+		setMat2(name.c_str(), mat);
+	}
+	// ------------------------------------------------------------------------
+	void setMat3(const char *name, const glm::mat3 &mat) const
+	{
+		glUniformMatrix3fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	{
+		setMat3(name.c_str(), mat);
+	}
+	// ------------------------------------------------------------------------
+	void setMat4(const char *name, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(RenderStats::Current().Uniform(glGetUniformLocation(ID, name)), 1, GL_FALSE, &mat[0][0]);
+	}
+	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	{
+		setMat4(name.c_str(), mat);
+	}
+	// Texture unit of a sampler uniform. Units are handed out on first use and set a single time, and every mesh
+	// drawn with this shader shares them, so no mesh can leave a sampler pointing at its own unit.
+	// ------------------------------------------------------------------------
+	GLuint samplerUnit(GLint location)
+	{
+		for (size_t i = 0; i < samplerUnits.size(); i++)
+			if (samplerUnits[i].first == location)
+				return samplerUnits[i].second;
+
+		const GLuint unit = (GLuint)samplerUnits.size();
+		glProgramUniform1i(ID, RenderStats::Current().Uniform(location), (GLint)unit);
+		samplerUnits.push_back(std::make_pair(location, unit));
+		return unit;
+	}
+
+private:
+	// sampler location -> texture unit, lives and dies with the program
+	std::vector<std::pair<GLint, GLuint>> samplerUnits;
+
+	// utility function for checking shader compilation/linking errors.
+	// ------------------------------------------------------------------------
+	void checkCompileErrors(GLuint shader, std::string type)
+	{
+		GLint success;
+		GLchar infoLog[1024];
+		if (type != "PROGRAM")
+		{
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+		else
+		{
+			glGetProgramiv(shader, GL_LINK_STATUS, &success);
+			if (!success)
+			{
+				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+	}
+};
+#endif
+//#ifndef SHADER_H
+//#define SHADER_H
+//
+//#include <glad/glad.h>
+//
+//#include <string>
+//#include <fstream>
+//#include <sstream>
+//#include <iostream>
+//
+//class Shader
+//{
+//public:
+//	unsigned int ID;
+//	// constructor generates the shader on the fly
+//	// ------------------------------------------------------------------------
+//	Shader(const char* vertexPath, const char* fragmentPath)
+//	{
+//		// 1. retrieve the vertex/fragment source code from filePath
+//		std::string vertexCode;
+//		std::string fragmentCode;
+//		std::ifstream vShaderFile;
+//		std::ifstream fShaderFile;
+//		// ensure ifstream objects can throw exceptions:
+//		vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+//		fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+//		try
+//		{
+//			// open files
+//			vShaderFile.open(vertexPath);
+//			fShaderFile.open(fragmentPath);
+//			std::stringstream vShaderStream, fShaderStream;
+//			// read file's buffer contents into streams
+//			vShaderStream << vShaderFile.rdbuf();
+//			fShaderStream << fShaderFile.rdbuf();
+//			// close file handlers
+//			vShaderFile.close();
+//			fShaderFile.close();
+//			// convert stream into string
+//			vertexCode = vShaderStream.str();
+//			fragmentCode = fShaderStream.str();
+//		}
+//		catch (std::ifstream::failure& e)
+//		{
+//			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+//		}
+//		const char* vShaderCode = vertexCode.c_str();
+//		const char * fShaderCode = fragmentCode.c_str();
+//		// 2. compile shaders
+//		unsigned int vertex, fragment;
+//		// vertex shader
+//		vertex = glCreateShader(GL_VERTEX_SHADER);
+//		glShaderSource(vertex, 1, &vShaderCode, NULL);
+//		glCompileShader(vertex);
+//		checkCompileErrors(vertex, "VERTEX");
+//		// fragment Shader
+//		fragment = glCreateShader(GL_FRAGMENT_SHADER);
+//		glShaderSource(fragment, 1, &fShaderCode, NULL);
+//		glCompileShader(fragment);
+//		checkCompileErrors(fragment, "FRAGMENT");
+//		// shader Program
+//		ID = glCreateProgram();
+//		glAttachShader(ID, vertex);
+//		glAttachShader(ID, fragment);
+//		glLinkProgram(ID);
+//		checkCompileErrors(ID, "PROGRAM");
+//		// delete the shaders as they're linked into our program now and no longer necessary
+//		glDeleteShader(vertex);
+//		glDeleteShader(fragment);
+//	}
+//	// activate the shader
+//	// ------------------------------------------------------------------------
+//	void use()
+//	{
+//		glUseProgram(ID);
+//	}
+//	// utility uniform functions
+//	// ------------------------------------------------------------------------
+//	void setBool(const std::string &name, bool value) const
+//	{
+//		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+//	}
+//	// ------------------------------------------------------------------------
+//	void setInt(const std::string &name, int value) const
+//	{
+//		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+//	}
+//	// ------------------------------------------------------------------------
+//	void setFloat(const std::string &name, float value) const
+//	{
+//		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+//	}
+//
+//private:
+//	// utility function for checking shader compilation/linking errors.
+//	// ------------------------------------------------------------------------
+//	void checkCompileErrors(unsigned int shader, std::string type)
+//	{
+//		int success;
+//		char infoLog[1024];
+//		if (type != "PROGRAM")
+//		{
+//			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+//			if (!success)
+//			{
+//				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+//				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+//			}
+//		}
+//		else
+//		{
+//			glGetProgramiv(shader, GL_LINK_STATUS, &success);
+//			if (!success)
+//			{
+//				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+//				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+//			}
+//		}
+//	}
+//};
 //#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef SNAPSHOTBUFFER_H
+#define SNAPSHOTBUFFER_H
+
+#include <atomic>
+
+// Triple buffer handing the newest snapshot of some state from one writer thread to one reader thread. The
+// writer fills Write() and publishes it, the reader's Acquire() switches to the newest published snapshot.
+// Neither side ever waits for the other: snapshots the reader was too slow to see are overwritten.
+template <typename T>
+class SnapshotBuffer
+{
+public:
+	SnapshotBuffer() : back(0), middle(1), front(2) {}
+
+	// writer: the slot to fill, owned by the writer until Publish
+	T& Write() { return slots[back]; }
+
+	// writer: makes the filled slot the newest snapshot and takes the slot the reader left to fill next
+	void Publish()
+	{
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// reader: switches to the newest snapshot, false when nothing was published since the last call
+	bool Acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// reader: the snapshot taken by the last Acquire, owned by the reader until the next one
+	const T& Read() const { return slots[front]; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 };
+
+	T slots[3];
+	unsigned int back;                  // writer only
+	std::atomic<unsigned int> middle;   // slot index plus FRESH while the reader has not taken it
+	unsigned int front;                 // reader only
+};
+#endif
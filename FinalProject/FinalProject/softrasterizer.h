@@ -0,0 +1,832 @@
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+// Tile-binned software rasterizer, the CPU backend for machines without a GPU (--software in Source.cpp).
+// It draws the interleaved meshes of the GL path (position 3, normal 3, uv 2 floats per vertex, non-indexed
+// triangles) and lights them with the Phong, spotlight and PCF shadow model of clusteredLightingSource.
+//
+// A frame runs in parallel phases on a WorkerPool:
+//   geometry:   chunks of triangles are transformed, clipped against the near plane, set up and binned
+//               into the screen tiles they touch
+//   visibility: every tile rasterizes its bins in submission order, four pixels at a time with SSE edge
+//               functions, against a depth buffer whose per 8x8 block maximum rejects hidden blocks early
+//   shading:    the visible triangle of each pixel is interpolated, then lit in batches by the widest
+//               Phong kernel of phongkernel.h the CPU supports
+// so a pixel is shaded once however deep the overdraw. Tiles own disjoint pixels, nothing is locked.
+
+#include <glm/glm.hpp>
+#include <emmintrin.h>      // SSE2, available on every x86 target the project builds for
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "phongkernel.h"
+#include "workerpool.h"
+
+// RGB8 or RGBA8 image, rows bottom to top like the GL textures; sampled bilinearly with repeat wrapping
+struct SoftwareTexture
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::vector<unsigned char> texels;
+};
+
+class SoftwareRasterizer
+{
+public:
+	static const int TILE_SIZE = 64;
+	static const int BLOCK_SIZE = 8;            // granularity of the hierarchical depth test
+	static const unsigned int CHUNK_TRIANGLES = 256;
+
+	// one non-indexed triangle list, untextured draws use color
+	struct Draw
+	{
+		const float* vertices;
+		unsigned int vertexCount;
+		glm::mat4 model;
+		const SoftwareTexture* texture;
+		glm::vec3 color;
+	};
+
+	// the fields of the GL light SSBO
+	struct Light
+	{
+		glm::vec3 position;
+		float range;          // 0 = unbounded
+		glm::vec3 color;
+		bool spot;
+		glm::vec3 direction;
+		float innerCutOff;    // cosines of the cone angles
+		float outerCutOff;
+		int shadowMap;        // index into Frame::shadowMaps, -1 = none
+	};
+
+	// depth seen from a light, sampled with bilinear depth comparison like a sampler2DShadow
+	struct ShadowMap
+	{
+		glm::mat4 viewProjection;
+		int size = 0;
+		std::vector<float> depth;
+	};
+
+	struct Frame
+	{
+		const Draw* draws;
+		unsigned int drawCount;
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 viewPosition;
+		const Light* lights;
+		unsigned int lightCount;
+		const ShadowMap* shadowMaps;  // two maps, null when shadows are off
+		int pcfRadius;
+		glm::vec2 uvScale;
+	};
+
+	explicit SoftwareRasterizer(WorkerPool& pool) : pool(pool)
+	{
+		SetKernel(PhongBestKernel());
+	}
+
+	// lighting kernel, the widest supported one by default; unsupported kernels are ignored
+	void SetKernel(PhongKernel phongKernel)
+	{
+		if (!PhongKernelSupported(phongKernel))
+			return;
+		kernel = phongKernel;
+		shade = PhongKernelFunction(phongKernel);
+	}
+
+	PhongKernel Kernel() const { return kernel; }
+
+	void Resize(int width, int height)
+	{
+		colorWidth = width;
+		colorHeight = height;
+		color.assign(size_t(width) * height * 3, 0);
+	}
+
+	int Width() const { return colorWidth; }
+	int Height() const { return colorHeight; }
+
+	// RGB8, rows bottom to top like glReadPixels
+	const unsigned char* Pixels() const { return color.data(); }
+
+	// triangles that reached the tiles in the last pass, after clipping
+	unsigned int Triangles() const { return setupTriangles; }
+
+	void Render(const Frame& frame)
+	{
+		Target target;
+		Bind(target, colorWidth, colorHeight, colorDepth, colorBlockDepth, &colorTriangles, 0.0f, 0.0f);
+		this->frame = &frame;
+		shadowMapUsed[0] = shadowMapUsed[1] = false;
+		for (unsigned int l = 0; frame.shadowMaps && l < frame.lightCount; ++l)
+		{
+			if (frame.lights[l].shadowMap >= 0)
+				shadowMapUsed[frame.lights[l].shadowMap] = true;
+		}
+
+		phongLights.resize(frame.lightCount);
+		for (unsigned int l = 0; l < frame.lightCount; ++l)
+			phongLights[l] = PhongLightFrom(frame.lights[l], frame.shadowMaps != nullptr);
+		phongScene.viewPosition[0] = frame.viewPosition.x;
+		phongScene.viewPosition[1] = frame.viewPosition.y;
+		phongScene.viewPosition[2] = frame.viewPosition.z;
+		phongScene.lights = phongLights.data();
+		phongScene.lightCount = frame.lightCount;
+
+		BuildChunks(frame.draws, frame.drawCount, frame.projection * frame.view, target, true);
+
+		auto tile = [this, &target](unsigned int index, unsigned int)
+		{
+			const int x0 = int(index % target.tilesX) * TILE_SIZE;
+			const int y0 = int(index / target.tilesX) * TILE_SIZE;
+			RasterizeTile(target, index, x0, y0);
+			ShadeTile(target, x0, y0);
+		};
+		pool.ParallelFor(target.tilesX * target.tilesY, tile);
+	}
+
+	// depth-only pass from a light, with the slope scaled and constant offsets of glPolygonOffset
+	void RenderShadowMap(const Draw* draws, unsigned int drawCount, ShadowMap& shadow, float offsetFactor, float offsetUnits)
+	{
+		Target target;
+		Bind(target, shadow.size, shadow.size, shadow.depth, shadowBlockDepth, nullptr, offsetFactor, offsetUnits);
+
+		BuildChunks(draws, drawCount, shadow.viewProjection, target, false);
+
+		auto tile = [this, &target](unsigned int index, unsigned int)
+		{
+			RasterizeTile(target, index, int(index % target.tilesX) * TILE_SIZE, int(index / target.tilesX) * TILE_SIZE);
+		};
+		pool.ParallelFor(target.tilesX * target.tilesY, tile);
+
+		// the padded rows were only needed while rasterizing, samplers read size x size
+		if (target.stride != shadow.size)
+		{
+			for (int y = 1; y < shadow.size; ++y)
+				std::copy(shadow.depth.begin() + size_t(y) * target.stride, shadow.depth.begin() + size_t(y) * target.stride + shadow.size,
+					shadow.depth.begin() + size_t(y) * shadow.size);
+		}
+		shadow.depth.resize(size_t(shadow.size) * shadow.size);
+	}
+
+	// the kernel's copy of a light, with the cone axis normalized once instead of per batch
+	static PhongLight PhongLightFrom(const Light& light, bool shadowed)
+	{
+		const glm::vec3 axis = light.spot ? -glm::normalize(light.direction) : glm::vec3(0.0f);
+		PhongLight phongLight = { { light.position.x, light.position.y, light.position.z }, light.range,
+			{ light.color.r, light.color.g, light.color.b }, light.spot ? 1 : 0, { axis.x, axis.y, axis.z },
+			light.innerCutOff, light.outerCutOff, shadowed ? light.shadowMap : -1 };
+		return phongLight;
+	}
+
+	// bilinear sample with repeat wrapping, GL_LINEAR without mipmaps
+	static glm::vec3 Sample(const SoftwareTexture& texture, float u, float v)
+	{
+		const float fx = u * texture.width - 0.5f;
+		const float fy = v * texture.height - 0.5f;
+		const float floorX = std::floor(fx);
+		const float floorY = std::floor(fy);
+		const float ax = fx - floorX;
+		const float ay = fy - floorY;
+		const int x0 = Wrap(int(floorX), texture.width);
+		const int y0 = Wrap(int(floorY), texture.height);
+		const int x1 = Wrap(x0 + 1, texture.width);
+		const int y1 = Wrap(y0 + 1, texture.height);
+
+		glm::vec3 result(0.0f);
+		const int xs[2] = { x0, x1 };
+		const int ys[2] = { y0, y1 };
+		const float wx[2] = { 1.0f - ax, ax };
+		const float wy[2] = { 1.0f - ay, ay };
+		for (int j = 0; j < 2; ++j)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				const unsigned char* texel = &texture.texels[(size_t(ys[j]) * texture.width + xs[i]) * texture.channels];
+				const float weight = wx[i] * wy[j];
+				result += glm::vec3(texel[0], texel[1], texel[2]) * weight;
+			}
+		}
+		return result * (1.0f / 255.0f);
+	}
+
+	// shadowFactor of clusteredLightingSource: (2r+1)^2 taps one texel apart, each a bilinear filtered depth
+	// comparison. The taps overlap, so every texel of the (2r+2)^2 footprint is compared once and weighted by
+	// the sum of the bilinear weights the taps give it: 1 inside, the fractional weight on the outer rows.
+	static float ShadowFactor(const ShadowMap& shadow, int pcfRadius, const glm::vec3& position, const glm::vec3& normal)
+	{
+		const glm::vec4 lightClip = shadow.viewProjection * glm::vec4(position + normal * 0.01f, 1.0f);
+		if (lightClip.w <= 0.0f)
+			return 1.0f;
+		const float coordX = lightClip.x / lightClip.w * 0.5f + 0.5f;
+		const float coordY = lightClip.y / lightClip.w * 0.5f + 0.5f;
+		const float coordZ = lightClip.z / lightClip.w * 0.5f + 0.5f;
+		if (coordZ > 1.0f)
+			return 1.0f;
+
+		const float fx = coordX * shadow.size - 0.5f;
+		const float fy = coordY * shadow.size - 0.5f;
+		const float floorX = std::floor(fx);
+		const float floorY = std::floor(fy);
+		const float ax = fx - floorX;
+		const float ay = fy - floorY;
+		const int x0 = int(floorX) - pcfRadius;
+		const int y0 = int(floorY) - pcfRadius;
+		const int footprint = 2 * pcfRadius + 2;
+		const float reference = coordZ - 0.0005f;
+
+		float lit = 0.0f;
+		for (int j = 0; j < footprint; ++j)
+		{
+			const float weightY = j == 0 ? 1.0f - ay : j == footprint - 1 ? ay : 1.0f;
+			const int y = y0 + j;
+			float row = 0.0f;
+			for (int i = 0; i < footprint; ++i)
+			{
+				// GL_CLAMP_TO_BORDER with a border depth of 1, GL_LEQUAL comparison
+				const int x = x0 + i;
+				const bool inside = x >= 0 && y >= 0 && x < shadow.size && y < shadow.size;
+				if (inside && reference > shadow.depth[size_t(y) * shadow.size + x])
+					continue;
+				row += i == 0 ? 1.0f - ax : i == footprint - 1 ? ax : 1.0f;
+			}
+			lit += row * weightY;
+		}
+		const float taps = float((footprint - 1) * (footprint - 1));
+		return lit / taps;
+	}
+
+private:
+	static const uint32_t NO_TRIANGLE = 0xFFFFFFFFu;
+
+	// screen-space triangle ready for rasterization; edge i is opposite vertex i, E(x, y) = A x + B y + C
+	// is positive inside and, divided by the area term, the barycentric weight of vertex i
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		uint32_t topLeft[3];  // all bits set when pixels exactly on the edge belong to this triangle
+		float inverseArea;
+		float depthA, depthB, depthC;  // window depth plane
+		float minDepth;
+		int minX, minY, maxX, maxY;    // pixel bounds, inclusive
+		float inverseW[3];
+		glm::vec3 world[3];
+		glm::vec3 normal[3];
+		glm::vec2 uv[3];
+		unsigned int draw;
+	};
+
+	// clip-space vertex with its attributes, as it goes through near plane clipping
+	struct ClipVertex
+	{
+		glm::vec4 clip;
+		glm::vec3 world;
+		glm::vec3 normal;
+		glm::vec2 uv;
+	};
+
+	struct Chunk
+	{
+		unsigned int draw;
+		unsigned int first;     // first triangle of the draw
+		unsigned int count;
+		unsigned int slot;      // first entry in triangles, two per input triangle since clipping can split one
+		unsigned int setup;     // triangles written
+	};
+
+	// per-draw transforms, computed once per pass
+	struct DrawTransform
+	{
+		glm::mat4 clip;
+		glm::mat4 model;
+		glm::mat3 normal;
+	};
+
+	// what a pass rasterizes into: a depth buffer padded to whole tiles, and for the color pass the visible
+	// triangle of every pixel
+	struct Target
+	{
+		int width, height;
+		int stride;             // padded width
+		unsigned int tilesX, tilesY;
+		float* depth;
+		float* blockDepth;      // farthest depth of each 8x8 block
+		uint32_t* triangles;    // null for depth-only passes
+		float offsetFactor, offsetUnits;
+	};
+
+	static int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	void Bind(Target& target, int width, int height, std::vector<float>& depth, std::vector<float>& blockDepth,
+		std::vector<uint32_t>* triangles, float offsetFactor, float offsetUnits)
+	{
+		target.width = width;
+		target.height = height;
+		target.tilesX = (unsigned int)((width + TILE_SIZE - 1) / TILE_SIZE);
+		target.tilesY = (unsigned int)((height + TILE_SIZE - 1) / TILE_SIZE);
+		target.stride = int(target.tilesX) * TILE_SIZE;
+
+		const size_t pixels = size_t(target.stride) * target.tilesY * TILE_SIZE;
+		depth.resize(pixels);
+		blockDepth.resize(pixels / (BLOCK_SIZE * BLOCK_SIZE));
+		target.depth = depth.data();
+		target.blockDepth = blockDepth.data();
+		target.triangles = nullptr;
+		if (triangles)
+		{
+			triangles->resize(pixels);
+			target.triangles = triangles->data();
+		}
+		target.offsetFactor = offsetFactor;
+		target.offsetUnits = offsetUnits;
+	}
+
+	// splits the draws into chunks and runs the geometry phase over them
+	void BuildChunks(const Draw* draws, unsigned int drawCount, const glm::mat4& viewProjection, const Target& target, bool attributes)
+	{
+		chunks.clear();
+		transforms.resize(drawCount);
+		unsigned int slot = 0;
+		for (unsigned int d = 0; d < drawCount; ++d)
+		{
+			transforms[d].model = draws[d].model;
+			transforms[d].clip = viewProjection * draws[d].model;
+			transforms[d].normal = glm::transpose(glm::inverse(glm::mat3(draws[d].model)));
+
+			const unsigned int triangleCount = draws[d].vertexCount / 3;
+			for (unsigned int first = 0; first < triangleCount; first += CHUNK_TRIANGLES)
+			{
+				Chunk chunk = { d, first, std::min(CHUNK_TRIANGLES, triangleCount - first), slot, 0 };
+				chunks.push_back(chunk);
+				slot += 2 * chunk.count;
+			}
+		}
+		if (triangles.size() < slot)
+			triangles.resize(slot);
+
+		const size_t tileCount = size_t(target.tilesX) * target.tilesY;
+		if (bins.size() < chunks.size() * tileCount)
+			bins.resize(chunks.size() * tileCount);
+		binStride = tileCount;
+
+		auto geometry = [this, draws, &target, attributes](unsigned int index, unsigned int)
+		{
+			SetupChunk(draws, chunks[index], index, target, attributes);
+		};
+		pool.ParallelFor((unsigned int)chunks.size(), geometry);
+
+		setupTriangles = 0;
+		for (const Chunk& chunk : chunks)
+			setupTriangles += chunk.setup;
+	}
+
+	void SetupChunk(const Draw* draws, Chunk& chunk, unsigned int chunkIndex, const Target& target, bool attributes)
+	{
+		std::vector<uint32_t>* chunkBins = &bins[chunkIndex * binStride];
+		for (size_t tile = 0; tile < binStride; ++tile)
+			chunkBins[tile].clear();
+		chunk.setup = 0;
+
+		const Draw& draw = draws[chunk.draw];
+		const DrawTransform& transform = transforms[chunk.draw];
+		for (unsigned int t = chunk.first; t < chunk.first + chunk.count; ++t)
+		{
+			ClipVertex vertices[4];
+			for (int i = 0; i < 3; ++i)
+			{
+				const float* v = draw.vertices + (size_t(t) * 3 + i) * 8;
+				const glm::vec4 position(v[0], v[1], v[2], 1.0f);
+				vertices[i].clip = transform.clip * position;
+				if (attributes)
+				{
+					vertices[i].world = glm::vec3(transform.model * position);
+					vertices[i].normal = transform.normal * glm::vec3(v[3], v[4], v[5]);
+					vertices[i].uv = glm::vec2(v[6], v[7]);
+				}
+				else
+				{
+					vertices[i].world = vertices[i].normal = glm::vec3(0.0f);
+					vertices[i].uv = glm::vec2(0.0f);
+				}
+			}
+
+			// clip against the near plane (z >= -w), the only plane crossing can break the projection
+			const float d0 = vertices[0].clip.z + vertices[0].clip.w;
+			const float d1 = vertices[1].clip.z + vertices[1].clip.w;
+			const float d2 = vertices[2].clip.z + vertices[2].clip.w;
+			if (d0 >= 0.0f && d1 >= 0.0f && d2 >= 0.0f)
+			{
+				SetupTriangle(vertices[0], vertices[1], vertices[2], chunk, chunkBins, target);
+				continue;
+			}
+			if (d0 < 0.0f && d1 < 0.0f && d2 < 0.0f)
+				continue;
+
+			ClipVertex clipped[4];
+			int count = 0;
+			const float distances[3] = { d0, d1, d2 };
+			for (int i = 0; i < 3; ++i)
+			{
+				const int j = (i + 1) % 3;
+				if (distances[i] >= 0.0f)
+					clipped[count++] = vertices[i];
+				if ((distances[i] >= 0.0f) != (distances[j] >= 0.0f))
+					clipped[count++] = Lerp(vertices[i], vertices[j], distances[i] / (distances[i] - distances[j]));
+			}
+			for (int i = 1; i + 1 < count; ++i)
+				SetupTriangle(clipped[0], clipped[i], clipped[i + 1], chunk, chunkBins, target);
+		}
+	}
+
+	static ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t)
+	{
+		ClipVertex result;
+		result.clip = a.clip + (b.clip - a.clip) * t;
+		result.world = a.world + (b.world - a.world) * t;
+		result.normal = a.normal + (b.normal - a.normal) * t;
+		result.uv = a.uv + (b.uv - a.uv) * t;
+		return result;
+	}
+
+	void SetupTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, Chunk& chunk, std::vector<uint32_t>* chunkBins, const Target& target)
+	{
+		const ClipVertex* vertices[3] = { &a, &b, &c };
+		float x[3], y[3], z[3], inverseW[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec4& clip = vertices[i]->clip;
+			inverseW[i] = 1.0f / clip.w;
+			// snapped to 1/256 pixel like the hardware's sub-pixel grid, shared edges then evaluate identically
+			x[i] = std::floor((clip.x * inverseW[i] * 0.5f + 0.5f) * target.width * 256.0f + 0.5f) * (1.0f / 256.0f);
+			y[i] = std::floor((clip.y * inverseW[i] * 0.5f + 0.5f) * target.height * 256.0f + 0.5f) * (1.0f / 256.0f);
+			z[i] = clip.z * inverseW[i] * 0.5f + 0.5f;
+		}
+
+		const float minX = std::min(x[0], std::min(x[1], x[2]));
+		const float maxX = std::max(x[0], std::max(x[1], x[2]));
+		const float minY = std::min(y[0], std::min(y[1], y[2]));
+		const float maxY = std::max(y[0], std::max(y[1], y[2]));
+		const int pixelMinX = std::max(0, int(std::floor(minX)));
+		const int pixelMaxX = std::min(target.width - 1, int(std::ceil(maxX)));
+		const int pixelMinY = std::max(0, int(std::floor(minY)));
+		const int pixelMaxY = std::min(target.height - 1, int(std::ceil(maxY)));
+		if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+			return;
+
+		Triangle& triangle = triangles[chunk.slot + chunk.setup];
+		for (int i = 0; i < 3; ++i)
+		{
+			const int j = (i + 1) % 3;
+			const int k = (i + 2) % 3;
+			triangle.edgeA[i] = y[j] - y[k];
+			triangle.edgeB[i] = x[k] - x[j];
+			triangle.edgeC[i] = x[j] * y[k] - x[k] * y[j];
+		}
+		float area = triangle.edgeA[0] * x[0] + (triangle.edgeB[0] * y[0] + triangle.edgeC[0]);
+		if (area == 0.0f)
+			return;
+		if (area < 0.0f)
+		{
+			// no culling, clockwise triangles are flipped so inside is positive
+			for (int i = 0; i < 3; ++i)
+			{
+				triangle.edgeA[i] = -triangle.edgeA[i];
+				triangle.edgeB[i] = -triangle.edgeB[i];
+				triangle.edgeC[i] = -triangle.edgeC[i];
+			}
+			area = -area;
+		}
+		for (int i = 0; i < 3; ++i)
+		{
+			// neighbours see a shared edge with exactly negated coefficients, so exactly one of them owns it
+			const bool owned = triangle.edgeA[i] > 0.0f || (triangle.edgeA[i] == 0.0f && triangle.edgeB[i] > 0.0f);
+			triangle.topLeft[i] = owned ? 0xFFFFFFFFu : 0u;
+		}
+		triangle.inverseArea = 1.0f / area;
+
+		// depth is linear in screen space: the barycentric weights applied to the vertex depths
+		triangle.depthA = (triangle.edgeA[0] * z[0] + triangle.edgeA[1] * z[1] + triangle.edgeA[2] * z[2]) * triangle.inverseArea;
+		triangle.depthB = (triangle.edgeB[0] * z[0] + triangle.edgeB[1] * z[1] + triangle.edgeB[2] * z[2]) * triangle.inverseArea;
+		triangle.depthC = (triangle.edgeC[0] * z[0] + triangle.edgeC[1] * z[1] + triangle.edgeC[2] * z[2]) * triangle.inverseArea;
+		float offset = 0.0f;
+		if (target.offsetFactor != 0.0f || target.offsetUnits != 0.0f)
+		{
+			// glPolygonOffset for a float depth buffer: the steepest slope and the resolution at the largest depth
+			const float slope = std::max(std::fabs(triangle.depthA), std::fabs(triangle.depthB));
+			const float maxDepth = std::max(z[0], std::max(z[1], z[2]));
+			const float resolution = maxDepth > 0.0f ? std::ldexp(1.0f, std::ilogb(maxDepth) - 23) : std::ldexp(1.0f, -126);
+			offset = target.offsetFactor * slope + target.offsetUnits * resolution;
+			triangle.depthC += offset;
+		}
+		triangle.minDepth = std::min(z[0], std::min(z[1], z[2])) + offset;
+
+		triangle.minX = pixelMinX;
+		triangle.maxX = pixelMaxX;
+		triangle.minY = pixelMinY;
+		triangle.maxY = pixelMaxY;
+		for (int i = 0; i < 3; ++i)
+		{
+			triangle.inverseW[i] = inverseW[i];
+			triangle.world[i] = vertices[i]->world;
+			triangle.normal[i] = vertices[i]->normal;
+			triangle.uv[i] = vertices[i]->uv;
+		}
+		triangle.draw = chunk.draw;
+
+		// bin into every tile of the bounds that no edge excludes entirely
+		const uint32_t index = chunk.slot + chunk.setup;
+		for (int ty = pixelMinY / TILE_SIZE; ty <= pixelMaxY / TILE_SIZE; ++ty)
+		{
+			for (int tx = pixelMinX / TILE_SIZE; tx <= pixelMaxX / TILE_SIZE; ++tx)
+			{
+				if (!Overlaps(triangle, tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE))
+					continue;
+				chunkBins[size_t(ty) * target.tilesX + tx].push_back(index);
+			}
+		}
+		++chunk.setup;
+	}
+
+	// false when one edge puts every pixel center of the square outside the triangle
+	static bool Overlaps(const Triangle& triangle, int x0, int y0, int size)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			const float x = triangle.edgeA[i] > 0.0f ? x0 + size - 0.5f : x0 + 0.5f;
+			const float y = triangle.edgeB[i] > 0.0f ? y0 + size - 0.5f : y0 + 0.5f;
+			if (triangle.edgeA[i] * x + (triangle.edgeB[i] * y + triangle.edgeC[i]) < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	void RasterizeTile(const Target& target, unsigned int tileIndex, int tileX, int tileY)
+	{
+		const int blocksPerRow = target.stride / BLOCK_SIZE;
+		for (int y = tileY; y < tileY + TILE_SIZE; ++y)
+		{
+			std::fill(target.depth + size_t(y) * target.stride + tileX, target.depth + size_t(y) * target.stride + tileX + TILE_SIZE, 1.0f);
+			if (target.triangles)
+				std::fill(target.triangles + size_t(y) * target.stride + tileX, target.triangles + size_t(y) * target.stride + tileX + TILE_SIZE, NO_TRIANGLE);
+		}
+		for (int by = tileY / BLOCK_SIZE; by < (tileY + TILE_SIZE) / BLOCK_SIZE; ++by)
+			std::fill(target.blockDepth + size_t(by) * blocksPerRow + tileX / BLOCK_SIZE, target.blockDepth + size_t(by) * blocksPerRow + (tileX + TILE_SIZE) / BLOCK_SIZE, 1.0f);
+
+		// chunks are in submission order, so equal depths resolve like GL_LESS on the GPU
+		for (size_t c = 0; c < chunks.size(); ++c)
+		{
+			const std::vector<uint32_t>& bin = bins[c * binStride + tileIndex];
+			for (uint32_t index : bin)
+				RasterizeTriangle(target, triangles[index], index, tileX, tileY);
+		}
+	}
+
+	void RasterizeTriangle(const Target& target, const Triangle& triangle, uint32_t index, int tileX, int tileY)
+	{
+		const int minX = std::max(triangle.minX, tileX);
+		const int maxX = std::min(triangle.maxX, tileX + TILE_SIZE - 1);
+		const int minY = std::max(triangle.minY, tileY);
+		const int maxY = std::min(triangle.maxY, tileY + TILE_SIZE - 1);
+		const int blocksPerRow = target.stride / BLOCK_SIZE;
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		__m128 edgeA[3], edgeB[3], edgeC[3], topLeft[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			edgeA[i] = _mm_set1_ps(triangle.edgeA[i]);
+			edgeB[i] = _mm_set1_ps(triangle.edgeB[i]);
+			edgeC[i] = _mm_set1_ps(triangle.edgeC[i]);
+			topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32(int(triangle.topLeft[i])));
+		}
+		const __m128 depthA = _mm_set1_ps(triangle.depthA);
+		const __m128 depthB = _mm_set1_ps(triangle.depthB);
+		const __m128 depthC = _mm_set1_ps(triangle.depthC);
+		const __m128i triangleIndex = _mm_set1_epi32(int(index));
+
+		for (int blockY = minY / BLOCK_SIZE; blockY <= maxY / BLOCK_SIZE; ++blockY)
+		{
+			for (int blockX = minX / BLOCK_SIZE; blockX <= maxX / BLOCK_SIZE; ++blockX)
+			{
+				// hierarchical depth: nothing in the block can pass when the nearest point of the triangle is behind its farthest pixel
+				float& blockDepth = target.blockDepth[size_t(blockY) * blocksPerRow + blockX];
+				if (triangle.minDepth >= blockDepth || !Overlaps(triangle, blockX * BLOCK_SIZE, blockY * BLOCK_SIZE, BLOCK_SIZE))
+					continue;
+
+				bool written = false;
+				const int y0 = std::max(minY, blockY * BLOCK_SIZE);
+				const int y1 = std::min(maxY, blockY * BLOCK_SIZE + BLOCK_SIZE - 1);
+				for (int y = y0; y <= y1; ++y)
+				{
+					const __m128 py = _mm_set1_ps(y + 0.5f);
+					__m128 rowEdge[3];
+					for (int i = 0; i < 3; ++i)
+						rowEdge[i] = _mm_add_ps(_mm_mul_ps(edgeB[i], py), edgeC[i]);
+					const __m128 rowDepth = _mm_add_ps(_mm_mul_ps(depthB, py), depthC);
+
+					for (int x = blockX * BLOCK_SIZE; x < blockX * BLOCK_SIZE + BLOCK_SIZE; x += 4)
+					{
+						if (x + 3 < minX || x > maxX)
+							continue;
+						const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffsets);
+
+						// inside: E > 0, or E == 0 on an edge the triangle owns
+						__m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+						for (int i = 0; i < 3; ++i)
+						{
+							const __m128 e = _mm_add_ps(_mm_mul_ps(edgeA[i], px), rowEdge[i]);
+							mask = _mm_and_ps(mask, _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(_mm_cmpeq_ps(e, zero), topLeft[i])));
+						}
+						if (_mm_movemask_ps(mask) == 0)
+							continue;
+
+						float* depth = target.depth + size_t(y) * target.stride + x;
+						const __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+						const __m128 stored = _mm_loadu_ps(depth);
+						mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, stored), _mm_cmpge_ps(z, zero)));
+						if (_mm_movemask_ps(mask) == 0)
+							continue;
+
+						_mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, stored)));
+						if (target.triangles)
+						{
+							__m128i* ids = reinterpret_cast<__m128i*>(target.triangles + size_t(y) * target.stride + x);
+							const __m128i maskBits = _mm_castps_si128(mask);
+							_mm_storeu_si128(ids, _mm_or_si128(_mm_and_si128(maskBits, triangleIndex), _mm_andnot_si128(maskBits, _mm_loadu_si128(ids))));
+						}
+						written = true;
+					}
+				}
+
+				if (written)
+				{
+					__m128 farthest = zero;
+					for (int y = blockY * BLOCK_SIZE; y < blockY * BLOCK_SIZE + BLOCK_SIZE; ++y)
+					{
+						const float* row = target.depth + size_t(y) * target.stride + blockX * BLOCK_SIZE;
+						farthest = _mm_max_ps(farthest, _mm_max_ps(_mm_loadu_ps(row), _mm_loadu_ps(row + 4)));
+					}
+					farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+					farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+					_mm_store_ss(&blockDepth, farthest);
+				}
+			}
+		}
+	}
+
+	// fragments gathered for lighting, structure of arrays so whole vectors load at once
+	struct FragmentBatch
+	{
+		static const int SIZE = 64;
+		alignas(64) float positionX[SIZE];
+		alignas(64) float positionY[SIZE];
+		alignas(64) float positionZ[SIZE];
+		alignas(64) float normalX[SIZE];
+		alignas(64) float normalY[SIZE];
+		alignas(64) float normalZ[SIZE];
+		alignas(64) float albedoR[SIZE];
+		alignas(64) float albedoG[SIZE];
+		alignas(64) float albedoB[SIZE];
+		alignas(64) float shadow[2][SIZE];
+		alignas(64) float red[SIZE];
+		alignas(64) float green[SIZE];
+		alignas(64) float blue[SIZE];
+		unsigned char* pixel[SIZE];
+		int count;
+	};
+
+	void ShadeTile(const Target& target, int tileX, int tileY)
+	{
+		FragmentBatch batch;
+		batch.count = 0;
+
+		const int x1 = std::min(tileX + TILE_SIZE, target.width);
+		const int y1 = std::min(tileY + TILE_SIZE, target.height);
+		for (int y = tileY; y < y1; ++y)
+		{
+			for (int x = tileX; x < x1; ++x)
+			{
+				unsigned char* pixel = &color[(size_t(y) * colorWidth + x) * 3];
+				const uint32_t index = target.triangles[size_t(y) * target.stride + x];
+				if (index == NO_TRIANGLE)
+				{
+					// the clear color
+					pixel[0] = pixel[1] = pixel[2] = 0;
+					continue;
+				}
+				Gather(batch, triangles[index], x + 0.5f, y + 0.5f, pixel);
+				if (batch.count == FragmentBatch::SIZE)
+					ShadeBatch(batch);
+			}
+		}
+		if (batch.count > 0)
+			ShadeBatch(batch);
+	}
+
+	// interpolates the vertex outputs at a pixel center, perspective-correct like the GL varyings
+	void Gather(FragmentBatch& batch, const Triangle& triangle, float x, float y, unsigned char* pixel)
+	{
+		float weights[3];
+		float sum = 0.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			const float screenWeight = (triangle.edgeA[i] * x + (triangle.edgeB[i] * y + triangle.edgeC[i])) * triangle.inverseArea;
+			weights[i] = screenWeight * triangle.inverseW[i];
+			sum += weights[i];
+		}
+		const float perspective = 1.0f / sum;
+		glm::vec3 world(0.0f), normal(0.0f);
+		glm::vec2 uv(0.0f);
+		for (int i = 0; i < 3; ++i)
+		{
+			const float weight = weights[i] * perspective;
+			world += triangle.world[i] * weight;
+			normal += triangle.normal[i] * weight;
+			uv = uv + triangle.uv[i] * weight;
+		}
+		normal = glm::normalize(normal);
+
+		const Draw& draw = frame->draws[triangle.draw];
+		const glm::vec3 albedo = draw.texture ? Sample(*draw.texture, uv.x * frame->uvScale.x, uv.y * frame->uvScale.y) : draw.color;
+
+		const int i = batch.count++;
+		batch.positionX[i] = world.x;
+		batch.positionY[i] = world.y;
+		batch.positionZ[i] = world.z;
+		batch.normalX[i] = normal.x;
+		batch.normalY[i] = normal.y;
+		batch.normalZ[i] = normal.z;
+		batch.albedoR[i] = albedo.r;
+		batch.albedoG[i] = albedo.g;
+		batch.albedoB[i] = albedo.b;
+		batch.pixel[i] = pixel;
+		for (int m = 0; m < 2; ++m)
+		{
+			if (shadowMapUsed[m])
+				batch.shadow[m][i] = ShadowFactor(frame->shadowMaps[m], frame->pcfRadius, world, normal);
+		}
+	}
+
+	// clusteredPhong times the albedo for a batch, then clamped and rounded to 8 bits like the default framebuffer
+	void ShadeBatch(FragmentBatch& batch)
+	{
+		const PhongFragments fragments = { batch.positionX, batch.positionY, batch.positionZ, batch.normalX, batch.normalY, batch.normalZ,
+			batch.albedoR, batch.albedoG, batch.albedoB, { shadowMapUsed[0] ? batch.shadow[0] : nullptr, shadowMapUsed[1] ? batch.shadow[1] : nullptr },
+			batch.red, batch.green, batch.blue, (unsigned int)batch.count };
+		shade(phongScene, fragments, 0);
+
+		for (int i = 0; i < batch.count; ++i)
+		{
+			unsigned char* pixel = batch.pixel[i];
+			pixel[0] = ToByte(batch.red[i]);
+			pixel[1] = ToByte(batch.green[i]);
+			pixel[2] = ToByte(batch.blue[i]);
+		}
+		batch.count = 0;
+	}
+
+	static unsigned char ToByte(float value)
+	{
+		return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+	}
+
+	SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+	SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+	WorkerPool& pool;
+	const Frame* frame = nullptr;
+	bool shadowMapUsed[2] = { false, false };  // shadow maps read by the lights of the frame
+	PhongKernel kernel = PHONG_KERNEL_SSE2;
+	PhongShadeFunction shade = nullptr;
+	std::vector<PhongLight> phongLights;
+	PhongScene phongScene = {};
+
+	int colorWidth = 0;
+	int colorHeight = 0;
+	std::vector<unsigned char> color;
+	std::vector<float> colorDepth;
+	std::vector<float> colorBlockDepth;
+	std::vector<uint32_t> colorTriangles;
+	std::vector<float> shadowBlockDepth;
+
+	// geometry of the current pass, the storage is kept between passes
+	std::vector<Chunk> chunks;
+	std::vector<DrawTransform> transforms;
+	std::vector<Triangle> triangles;
+	std::vector<std::vector<uint32_t>> bins;  // chunk * binStride + tile
+	size_t binStride = 0;
+	unsigned int setupTriangles = 0;
+};
+#endif
@@ -0,0 +1,315 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Include after GLEW, like every GL header here (see mesh.h)
+
+// Scoped CPU/GPU tracing written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Compiled in only when ENABLE_TRACING is defined (the Debug configurations of FinalProject.vcxproj); without it the
+// TRACE_* macros expand to nothing and this header declares nothing else.
+//
+//   TRACE_SCOPE("URender");          CPU slice from here to the end of the enclosing block
+//   TRACE_GPU_BEGIN("shadow maps");  GPU slice measured with timestamp queries, closed by TRACE_GPU_END()
+//   TRACE_GPU_FRAME();               once per frame, collects finished GPU slices without stalling
+//
+// Names must be string literals (only the pointer is stored).
+
+#ifdef ENABLE_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Tracer
+{
+public:
+	struct Event
+	{
+		const char* name;
+		long long begin; // ns since the trace started
+		long long end;
+	};
+
+	// Ring of the most recent events of one thread (or of the GPU track). Only its owning thread writes,
+	// the count is published with release semantics so Write() reads complete events without a lock.
+	class Buffer
+	{
+	public:
+		static const unsigned int CAPACITY = 1 << 16;
+
+		Buffer(int id, const char* name, int process) : id(id), name(name), process(process), events(new Event[CAPACITY]), written(0) {}
+		~Buffer() { delete[] events; }
+
+		void Record(const char* eventName, long long begin, long long end)
+		{
+			const unsigned long long index = written.load(std::memory_order_relaxed);
+			Event& event = events[index % CAPACITY];
+			event.name = eventName;
+			event.begin = begin;
+			event.end = end;
+			written.store(index + 1, std::memory_order_release);
+		}
+
+		const int id;
+		const char* name;
+		const int process;
+		Event* const events;
+		std::atomic<unsigned long long> written;
+	};
+
+	// process ids of the two tracks groups in the capture
+	enum { CPU_PROCESS = 1, GPU_PROCESS = 2 };
+
+	// ns since the first call, the time base of every event
+	static long long Now()
+	{
+		static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// the calling thread's buffer, registered on first use (the only time a lock is taken)
+	static Buffer& ThisThread()
+	{
+		static thread_local Buffer* buffer = nullptr;
+		if (!buffer)
+			buffer = CreateBuffer(nullptr, CPU_PROCESS);
+		return *buffer;
+	}
+
+	// names the calling thread's track
+	static void SetThreadName(const char* name)
+	{
+		ThisThread().name = name;
+	}
+
+	// registers an extra track, e.g. the GPU timeline
+	static Buffer* CreateBuffer(const char* name, int process)
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		registry.buffers.push_back(new Buffer((int)registry.buffers.size(), name, process));
+		return registry.buffers.back();
+	}
+
+	// writes every buffered event as Chrome trace JSON, call while the traced threads are idle
+	static bool Write(const std::string& path)
+	{
+		std::ofstream file(path.c_str(), std::ios::trunc);
+		if (!file)
+			return false;
+
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << CPU_PROCESS << ",\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+		file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << GPU_PROCESS << ",\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+		for (Buffer* buffer : registry.buffers)
+		{
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << buffer->process << ",\"tid\":" << buffer->id
+				<< ",\"args\":{\"name\":\"";
+			if (buffer->name)
+				file << buffer->name;
+			else
+				file << "thread " << buffer->id;
+			file << "\"}}";
+
+			const unsigned long long written = buffer->written.load(std::memory_order_acquire);
+			const unsigned long long first = written > Buffer::CAPACITY ? written - Buffer::CAPACITY : 0;
+			for (unsigned long long i = first; i < written; ++i)
+			{
+				const Event& event = buffer->events[i % Buffer::CAPACITY];
+				// microseconds with ns precision
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << buffer->process << ",\"tid\":" << buffer->id
+					<< ",\"ts\":" << event.begin / 1000 << '.' << Fraction(event.begin)
+					<< ",\"dur\":" << (event.end - event.begin) / 1000 << '.' << Fraction(event.end - event.begin) << '}';
+			}
+		}
+		file << "\n]}\n";
+		return bool(file);
+	}
+
+private:
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<Buffer*> buffers; // never freed, threads may still hold them at exit
+	};
+
+	static Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	// the three sub-microsecond digits of a ns value
+	static std::string Fraction(long long ns)
+	{
+		const long long digits = ns % 1000;
+		return std::string(digits < 10 ? "00" : digits < 100 ? "0" : "") + std::to_string(digits);
+	}
+};
+
+// records a CPU slice on the calling thread's track for the lifetime of the object
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name) : name(name), begin(Tracer::Now()) {}
+	~TraceScope() { Tracer::ThisThread().Record(name, begin, Tracer::Now()); }
+
+private:
+	const char* name;
+	long long begin;
+};
+
+// GPU slices from glQueryCounter timestamps. Queries are kept for a few frames and read once the GPU has
+// passed them, then moved onto the GPU track through a GL_TIMESTAMP / CPU clock calibration.
+// Must be used from the thread that owns the GL context.
+class GpuTracer
+{
+public:
+	static GpuTracer& Current()
+	{
+		static GpuTracer tracer;
+		return tracer;
+	}
+
+	void BeginZone(const char* name)
+	{
+		Create();
+		FrameZones& frame = frames[current];
+		if (depth >= MAX_DEPTH)
+		{
+			++depth;
+			++dropped;
+			return;
+		}
+		if (frame.count == MAX_ZONES)
+		{
+			stack[depth++] = -1;
+			++dropped;
+			return;
+		}
+		Zone& zone = frame.zones[frame.count];
+		zone.name = name;
+		glQueryCounter(zone.queries[0], GL_TIMESTAMP);
+		stack[depth++] = frame.count++;
+	}
+
+	void EndZone()
+	{
+		if (depth == 0 || --depth >= MAX_DEPTH)
+			return;
+		const int index = stack[depth];
+		if (index >= 0)
+			glQueryCounter(frames[current].zones[index].queries[1], GL_TIMESTAMP);
+	}
+
+	// closes the frame's zones and recycles the oldest frame: its results are emitted when the GPU finished
+	// them and dropped otherwise, so tracing never waits for the GPU
+	void EndFrame()
+	{
+		if (!created)
+			return;
+		current = (current + 1) % FRAMES;
+		depth = 0;
+
+		FrameZones& oldest = frames[current];
+		if (oldest.count > 0)
+		{
+			// nested zones end out of submission order, every end has to be checked
+			GLint available = 1;
+			for (int i = 0; i < oldest.count && available; ++i)
+				glGetQueryObjectiv(oldest.zones[i].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				for (int i = 0; i < oldest.count; ++i)
+				{
+					GLuint64 begin = 0, end = 0;
+					glGetQueryObjectui64v(oldest.zones[i].queries[0], GL_QUERY_RESULT, &begin);
+					glGetQueryObjectui64v(oldest.zones[i].queries[1], GL_QUERY_RESULT, &end);
+					track->Record(oldest.zones[i].name, ToCpuTime(begin), ToCpuTime(end));
+				}
+			}
+			else
+				dropped += oldest.count;
+		}
+		oldest.count = 0;
+	}
+
+	// zones that were not recorded (GPU too far behind, or too many zones in a frame)
+	unsigned int Dropped() const { return dropped; }
+
+private:
+	static const int FRAMES = 4;
+	static const int MAX_ZONES = 16;
+	static const int MAX_DEPTH = 8;
+
+	struct Zone
+	{
+		const char* name;
+		GLuint queries[2];
+	};
+
+	struct FrameZones
+	{
+		Zone zones[MAX_ZONES];
+		int count = 0;
+	};
+
+	GpuTracer() {}
+
+	// queries and the clock calibration need the GL context, so they are set up on first use
+	void Create()
+	{
+		if (created)
+			return;
+		for (FrameZones& frame : frames)
+			for (Zone& zone : frame.zones)
+				glGenQueries(2, zone.queries);
+		track = Tracer::CreateBuffer("GPU", Tracer::GPU_PROCESS);
+
+		// GPU and CPU clocks have unrelated origins, pair one reading of each
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuBase = gpuNow;
+		cpuBase = Tracer::Now();
+		created = true;
+	}
+
+	long long ToCpuTime(GLuint64 gpuTime) const
+	{
+		return cpuBase + (long long)(gpuTime - gpuBase);
+	}
+
+	FrameZones frames[FRAMES];
+	int current = 0;
+	int stack[MAX_DEPTH];
+	int depth = 0;
+	bool created = false;
+	unsigned int dropped = 0;
+	Tracer::Buffer* track = nullptr;
+	GLuint64 gpuBase = 0;
+	long long cpuBase = 0;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Tracer::SetThreadName(name)
+#define TRACE_GPU_BEGIN(name) GpuTracer::Current().BeginZone(name)
+#define TRACE_GPU_END() GpuTracer::Current().EndZone()
+#define TRACE_GPU_FRAME() GpuTracer::Current().EndFrame()
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_GPU_BEGIN(name) ((void)0)
+#define TRACE_GPU_END() ((void)0)
+#define TRACE_GPU_FRAME() ((void)0)
+
+#endif
+#endif
@@ -0,0 +1,120 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running one parallel loop at a time, for the CPU renderers. ParallelFor hands
+// the indices out one by one from an atomic counter, so uneven items (a screen tile with many triangles)
+// balance themselves; the calling thread works on the loop too and returns once every index is done.
+class WorkerPool
+{
+public:
+	// threads counts the caller, 0 uses every hardware thread
+	explicit WorkerPool(unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 1;
+		for (unsigned int i = 1; i < threads; ++i)
+			workers.emplace_back(&WorkerPool::WorkerLoop, this, i);
+	}
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	// threads working on a loop, the caller included; thread indices passed to the loop body are below this
+	unsigned int Threads() const { return (unsigned int)workers.size() + 1; }
+
+	// calls function(index, threadIndex) for every index in [0, count), the caller is thread 0
+	template <typename Function>
+	void ParallelFor(unsigned int count, Function& function)
+	{
+		if (count == 0)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			invoke = &Invoke<Function>;
+			context = &function;
+			itemCount = count;
+			next.store(0, std::memory_order_relaxed);
+			running = (unsigned int)workers.size();
+			++generation;
+		}
+		wake.notify_all();
+
+		Run(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return running == 0; });
+	}
+
+private:
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	template <typename Function>
+	static void Invoke(void* function, unsigned int index, unsigned int threadIndex)
+	{
+		(*static_cast<Function*>(function))(index, threadIndex);
+	}
+
+	void Run(unsigned int threadIndex)
+	{
+		for (;;)
+		{
+			const unsigned int index = next.fetch_add(1, std::memory_order_relaxed);
+			if (index >= itemCount)
+				return;
+			invoke(context, index, threadIndex);
+		}
+	}
+
+	void WorkerLoop(unsigned int threadIndex)
+	{
+		unsigned long long seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stop || generation != seen; });
+				if (stop)
+					return;
+				seen = generation;
+			}
+
+			Run(threadIndex);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0)
+				done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	// the loop being run, published under the mutex
+	void (*invoke)(void*, unsigned int, unsigned int) = nullptr;
+	void* context = nullptr;
+	unsigned int itemCount = 0;
+	std::atomic<unsigned int> next{ 0 };
+	unsigned int running = 0;
+	unsigned long long generation = 0;
+	bool stop = false;
+};
+#endif
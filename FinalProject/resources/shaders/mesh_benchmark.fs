@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// the sampler names Mesh::Draw resolves: one per texture type and number
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_diffuse2;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_normal1;
+uniform sampler2D texture_height1;
+
+void main()
+{
+    FragColor = texture(texture_diffuse1, TexCoords) + texture(texture_diffuse2, TexCoords) + texture(texture_specular1, TexCoords)
+        + texture(texture_normal1, TexCoords) + texture(texture_height1, TexCoords);
+}